@@ -0,0 +1,314 @@
+#include "at_engine.h"
+#include "modem_serial.h"
+#include "config.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+// Handlers for the URCs the firmware cares about
+#define AT_URC_HANDLER_COUNT 12
+
+// Room reserved for a response up front, so short ones never reallocate
+#define AT_RESPONSE_RESERVE 128
+
+// The engine wakes at least this often even with nothing to do
+#define AT_ENGINE_IDLE_WAIT_MS 1000
+
+// A command on its way through the engine
+struct AtRequest {
+  AtCommand command;
+  char prefix[16];           // "+CREG" for AT+CREG?, its answers are not URCs
+  AtCallback callback;
+  void* context;
+  SemaphoreHandle_t done;    // Given when finished, for a waiting caller
+  AtStatus status;
+  String response;
+  unsigned long startedAt;
+  
+  AtRequest(const AtCommand& command) : command(command), callback(NULL), context(NULL),
+                                        done(NULL), status(AT_TIMEOUT), startedAt(0) {
+    prefix[0] = '\0';
+  }
+};
+
+struct UrcEntry {
+  const char* prefix;
+  AtUrcHandler handler;
+  void* context;
+};
+
+TaskHandle_t atEngineHandle = NULL;
+QueueHandle_t atQueue = NULL;
+AtRequest* currentRequest = NULL;
+AtLineReader atReader;
+UrcEntry urcHandlers[AT_URC_HANDLER_COUNT];
+int urcHandlerCount = 0;
+AtEngineStats atEngineStats;
+
+// Binary data still to come after a rawLine, and where it goes
+size_t rawRemaining = 0;
+uint8_t* rawTarget = NULL;
+size_t rawSpace = 0;
+
+// "AT+CREG?" -> "+CREG"
+static void setResponsePrefix(AtRequest* request) {
+  const char* command = request->command.command.c_str();
+  request->prefix[0] = '\0';
+  if (strncmp(command, "AT+", 3) != 0) {
+    return;
+  }
+  
+  size_t n = 1;
+  while (n < sizeof(request->prefix) - 1 && isalnum((unsigned char)command[n + 2])) {
+    n++;
+  }
+  memcpy(request->prefix, command + 2, n);
+  request->prefix[n] = '\0';
+}
+
+static const UrcEntry* findUrcHandler(const AtSlice& line) {
+  for (int i = 0; i < urcHandlerCount; i++) {
+    if (line.startsWith(urcHandlers[i].prefix)) {
+      return &urcHandlers[i];
+    }
+  }
+  return NULL;
+}
+
+static void finishRequest(AtStatus status) {
+  AtRequest* request = currentRequest;
+  currentRequest = NULL;
+  request->status = status;
+  
+  // Data arriving after a timeout is skipped, the buffer may be gone
+  rawTarget = NULL;
+  rawSpace = 0;
+  
+  if (status == AT_TIMEOUT) {
+    atEngineStats.timeouts++;
+    Serial.printf("AT timeout after %lu ms\n", request->command.timeout);
+  }
+  Serial.println("AT< " + request->response);
+  
+  // A waiting caller owns the request, otherwise it ends here
+  if (request->done) {
+    xSemaphoreGive(request->done);
+    return;
+  }
+  if (request->callback) {
+    request->callback(status, request->response, request->context);
+  }
+  delete request;
+}
+
+static void startRequest(AtRequest* request) {
+  Stream& modem = getModemSerial();
+  const AtCommand& command = request->command;
+  
+  currentRequest = request;
+  request->startedAt = millis();
+  request->response.reserve(AT_RESPONSE_RESERVE);
+  atEngineStats.commands++;
+  
+  if (command.data) {
+    Serial.printf("AT> (%u bytes)\n", (unsigned)command.length);
+    modem.write(command.data, command.length);
+  } else {
+    Serial.print("AT> " + command.command + "\n");
+    modem.print(command.command + "\r\n");
+  }
+}
+
+static void handleLine(const AtSlice& line) {
+  AtRequest* request = currentRequest;
+  const UrcEntry* urc = findUrcHandler(line);
+  
+  // Lines carrying the command's own prefix answer it even if they look like a URC
+  if (request && (!urc || (request->prefix[0] && line.startsWith(request->prefix)))) {
+    request->response.concat(line.data, line.length);
+    request->response.concat("\r\n", 2);
+    
+    const AtCommand& command = request->command;
+    AtFields fields;
+    if (command.rawLine && fields.parse(line, command.rawLine) && fields.getInt(1, 0) > 0) {
+      rawRemaining = fields.getInt(1);
+      rawTarget = command.rawBuffer;
+      rawSpace = command.rawCapacity;
+    } else if (command.failLine && line.startsWith(command.failLine)) {
+      finishRequest(AT_ERROR);
+    } else if (line.equals("ERROR") || line.startsWith("+CME ERROR") || line.startsWith("+CMS ERROR")) {
+      finishRequest(AT_ERROR);
+    } else if (command.finalLine ? line.startsWith(command.finalLine) : line.equals("OK")) {
+      finishRequest(AT_OK);
+    }
+    return;
+  }
+  
+  if (urc) {
+    atEngineStats.urcs++;
+    Serial.printf("URC: %.*s\n", (int)line.length, line.data);
+    urc->handler(line, urc->context);
+    return;
+  }
+  
+  atEngineStats.unmatched++;
+  Serial.printf("AT? %.*s\n", (int)line.length, line.data);
+}
+
+static void handleByte(char c) {
+  // Binary data after its announcing line bypasses the line reader
+  if (rawRemaining > 0) {
+    rawRemaining--;
+    if (rawSpace > 0) {
+      *rawTarget++ = (uint8_t)c;
+      rawSpace--;
+    }
+    return;
+  }
+  
+  // The data prompt comes without a line end
+  bool promptExpected = currentRequest && currentRequest->command.expectPrompt;
+  
+  switch (atReader.feed(c, promptExpected)) {
+    case AtLineReader::AT_LINE_READY:
+      handleLine(atReader.line());
+      break;
+      
+    case AtLineReader::AT_LINE_PROMPT:
+      currentRequest->response.concat(">\r\n", 3);
+      finishRequest(AT_PROMPT);
+      break;
+      
+    default:
+      break;
+  }
+}
+
+static void atEngineTask(void* param) {
+  Stream& modem = getModemSerial();
+  
+  while (true) {
+    if (!currentRequest) {
+      AtRequest* next;
+      if (xQueueReceive(atQueue, &next, 0) == pdTRUE) {
+        setResponsePrefix(next);
+        startRequest(next);
+      }
+    }
+    
+    // Sleep until bytes arrive, a command is queued or the one in flight times out
+    unsigned long wait = AT_ENGINE_IDLE_WAIT_MS;
+    if (currentRequest) {
+      unsigned long elapsed = millis() - currentRequest->startedAt;
+      if (elapsed >= currentRequest->command.timeout) {
+        finishRequest(AT_TIMEOUT);
+        continue;
+      }
+      wait = currentRequest->command.timeout - elapsed;
+    }
+    
+    if (waitModemData(wait)) {
+      while (modem.available()) {
+        handleByte((char)modem.read());
+      }
+    }
+  }
+}
+
+bool startAtEngine() {
+  if (atEngineHandle) {
+    return true;
+  }
+  
+  atQueue = xQueueCreate(AT_QUEUE_LENGTH, sizeof(AtRequest*));
+  memset(&atEngineStats, 0, sizeof(atEngineStats));
+  
+  // Core 0 with the UART driver's event task
+  BaseType_t result = xTaskCreatePinnedToCore(atEngineTask, "at_engine", AT_ENGINE_STACK_SIZE, NULL,
+                                              AT_ENGINE_PRIORITY, &atEngineHandle, 0);
+  if (result != pdPASS) {
+    Serial.println("Failed to start AT engine");
+    atEngineHandle = NULL;
+    return false;
+  }
+  
+  return true;
+}
+
+bool onAtUrc(const char* prefix, AtUrcHandler handler, void* context) {
+  if (urcHandlerCount >= AT_URC_HANDLER_COUNT) {
+    Serial.printf("No room for URC handler %s\n", prefix);
+    return false;
+  }
+  
+  urcHandlers[urcHandlerCount].prefix = prefix;
+  urcHandlers[urcHandlerCount].handler = handler;
+  urcHandlers[urcHandlerCount].context = context;
+  urcHandlerCount++;
+  return true;
+}
+
+static bool queueRequest(AtRequest* request, TickType_t wait) {
+  if (!atQueue || xQueueSend(atQueue, &request, wait) != pdTRUE) {
+    return false;
+  }
+  
+  uint32_t queued = uxQueueMessagesWaiting(atQueue);
+  if (queued > atEngineStats.maxQueued) {
+    atEngineStats.maxQueued = queued;
+  }
+  wakeModemReader();
+  return true;
+}
+
+bool submitAtCommand(const AtCommand& command, AtCallback callback, void* context) {
+  AtRequest* request = new AtRequest(command);
+  request->callback = callback;
+  request->context = context;
+  
+  if (!queueRequest(request, 0)) {
+    Serial.println("AT queue full, command dropped: " + command.command);
+    delete request;
+    return false;
+  }
+  return true;
+}
+
+AtStatus executeAtCommand(const AtCommand& command, String& response) {
+  response = "";
+  
+  // Waiting on the engine from its own task would never return
+  if (xTaskGetCurrentTaskHandle() == atEngineHandle) {
+    Serial.println("AT command from the engine task refused: " + command.command);
+    return AT_ERROR;
+  }
+  
+  StaticSemaphore_t doneBuffer;
+  AtRequest request(command);
+  request.done = xSemaphoreCreateBinaryStatic(&doneBuffer);
+  
+  if (!queueRequest(&request, portMAX_DELAY)) {
+    vSemaphoreDelete(request.done);
+    return AT_ERROR;
+  }
+  
+  // The engine always finishes a request, at the latest at its timeout
+  xSemaphoreTake(request.done, portMAX_DELAY);
+  vSemaphoreDelete(request.done);
+  
+  response = request.response;
+  return request.status;
+}
+
+const AtEngineStats& getAtEngineStats() {
+  return atEngineStats;
+}
+
+void printAtEngineStats() {
+  Serial.printf("AT engine: %lu commands, %lu timeouts, %lu URCs, %lu unmatched lines, %lu split lines, "
+                "queue peak %lu\n",
+                (unsigned long)atEngineStats.commands, (unsigned long)atEngineStats.timeouts,
+                (unsigned long)atEngineStats.urcs, (unsigned long)atEngineStats.unmatched,
+                (unsigned long)atReader.getSplitLines(), (unsigned long)atEngineStats.maxQueued);
+}
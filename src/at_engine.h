@@ -0,0 +1,65 @@
+#ifndef AT_ENGINE_H
+#define AT_ENGINE_H
+
+#include <Arduino.h>
+#include "at_parser.h"
+
+// AT commands are queued to a task that owns the modem's receive side. It
+// matches each line either to the command in flight or to an unsolicited
+// result code (URC), so URCs are no longer lost between commands.
+
+enum AtStatus {
+  AT_OK,        // OK, or the command's final line
+  AT_ERROR,     // ERROR, +CME/+CMS ERROR, or the command's failure line
+  AT_PROMPT,    // The "> " data prompt
+  AT_TIMEOUT
+};
+
+// One command. By default it completes on OK or ERROR.
+struct AtCommand {
+  String command;
+  unsigned long timeout;
+  const char* finalLine;  // Completes on this line instead of OK ("CONNECT OK", "+CDNSGIP:")
+  const char* failLine;   // Completes with AT_ERROR on this line ("SEND FAIL")
+  bool expectPrompt;      // Completes on the "> " prompt
+  const uint8_t* data;    // Raw bytes sent instead of the command, kept alive by the caller
+  size_t length;
+  const char* rawLine;    // Announces binary data, its second field is the length ("+CIPRXGET:")
+  uint8_t* rawBuffer;     // Where that data goes, up to rawCapacity bytes
+  size_t rawCapacity;
+  
+  AtCommand(const String& command, unsigned long timeout = 3000)
+      : command(command), timeout(timeout), finalLine(NULL), failLine(NULL),
+        expectPrompt(false), data(NULL), length(0), rawLine(NULL), rawBuffer(NULL), rawCapacity(0) {}
+};
+
+// Runs on the engine task, must not wait on the modem itself
+typedef void (*AtCallback)(AtStatus status, const String& response, void* context);
+typedef void (*AtUrcHandler)(const AtSlice& line, void* context);  // line is only valid during the call
+
+struct AtEngineStats {
+  uint32_t commands;
+  uint32_t timeouts;
+  uint32_t urcs;          // Dispatched to a handler
+  uint32_t unmatched;     // Lines nobody was waiting for
+  uint32_t maxQueued;     // Deepest the command queue got
+};
+
+// Start the engine task (once, after the modem UART)
+bool startAtEngine();
+
+// Lines starting with prefix go to handler when they aren't the answer to
+// the command in flight; register before the engine starts
+bool onAtUrc(const char* prefix, AtUrcHandler handler, void* context = NULL);
+
+// Queue a command without waiting; the callback gets the result. False if
+// the queue is full.
+bool submitAtCommand(const AtCommand& command, AtCallback callback = NULL, void* context = NULL);
+
+// Queue a command and wait for its result (response holds every line of it)
+AtStatus executeAtCommand(const AtCommand& command, String& response);
+
+const AtEngineStats& getAtEngineStats();
+void printAtEngineStats();
+
+#endif // AT_ENGINE_H
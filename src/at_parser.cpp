@@ -0,0 +1,230 @@
+#include "at_parser.h"
+
+bool AtSlice::equals(const char* text) const {
+  return strlen(text) == length && memcmp(data, text, length) == 0;
+}
+
+bool AtSlice::startsWith(const char* prefix) const {
+  size_t n = strlen(prefix);
+  return n <= length && memcmp(data, prefix, n) == 0;
+}
+
+bool AtSlice::contains(const char* text) const {
+  size_t n = strlen(text);
+  for (size_t i = 0; i + n <= length; i++) {
+    if (memcmp(data + i, text, n) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int AtSlice::indexOf(char c, size_t from) const {
+  for (size_t i = from; i < length; i++) {
+    if (data[i] == c) {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+AtSlice AtSlice::substr(size_t start, size_t count) const {
+  if (start >= length) {
+    return AtSlice(data + length, 0);
+  }
+  size_t n = length - start;
+  return AtSlice(data + start, count < n ? count : n);
+}
+
+AtSlice AtSlice::trim() const {
+  size_t start = 0;
+  size_t end = length;
+  while (start < end && (data[start] == ' ' || data[start] == '\r' || data[start] == '\t')) {
+    start++;
+  }
+  while (end > start && (data[end - 1] == ' ' || data[end - 1] == '\r' || data[end - 1] == '\t')) {
+    end--;
+  }
+  return AtSlice(data + start, end - start);
+}
+
+long AtSlice::toInt(long fallback) const {
+  size_t i = 0;
+  while (i < length && data[i] == ' ') {
+    i++;
+  }
+  
+  bool negative = false;
+  if (i < length && (data[i] == '-' || data[i] == '+')) {
+    negative = data[i] == '-';
+    i++;
+  }
+  
+  if (i >= length || data[i] < '0' || data[i] > '9') {
+    return fallback;
+  }
+  
+  long value = 0;
+  while (i < length && data[i] >= '0' && data[i] <= '9') {
+    value = value * 10 + (data[i] - '0');
+    i++;
+  }
+  return negative ? -value : value;
+}
+
+AtLineReader::Result AtLineReader::feed(char c, bool promptExpected) {
+  // The previous line stayed readable until now
+  if (complete) {
+    used = 0;
+    complete = false;
+  }
+  
+  if (c == '\n') {
+    complete = true;
+    return line().empty() ? AT_LINE_NONE : AT_LINE_READY;
+  }
+  
+  if (c == '\r') {
+    return AT_LINE_NONE;
+  }
+  
+  buffer[used++] = c;
+  
+  if (promptExpected && used == 1 && c == '>') {
+    complete = true;
+    return AT_LINE_PROMPT;
+  }
+  
+  if (used == sizeof(buffer)) {
+    pieces++;
+    complete = true;
+    return AT_LINE_READY;
+  }
+  
+  return AT_LINE_NONE;
+}
+
+bool AtFields::parse(const AtSlice& line, const char* prefix) {
+  count = 0;
+  if (!line.startsWith(prefix)) {
+    return false;
+  }
+  
+  AtSlice rest = line.substr(strlen(prefix)).trim();
+  size_t start = 0;
+  bool quoted = false;
+  for (size_t i = 0; i <= rest.length && count < AT_MAX_FIELDS; i++) {
+    if (i < rest.length && rest.data[i] == '"') {
+      quoted = !quoted;
+      continue;
+    }
+    if (i == rest.length || (rest.data[i] == ',' && !quoted)) {
+      AtSlice field = rest.substr(start, i - start).trim();
+      
+      // Drop the quotes around a value
+      if (field.length >= 2 && field.data[0] == '"' && field.data[field.length - 1] == '"') {
+        field = field.substr(1, field.length - 2);
+      }
+      fields[count++] = field;
+      start = i + 1;
+    }
+  }
+  return true;
+}
+
+bool parseSignalQuality(const AtSlice& line, AtSignalQuality& result) {
+  AtFields fields;
+  if (!fields.parse(line, "+CSQ:") || fields.size() < 2) {
+    return false;
+  }
+  
+  result.rssi = fields.getInt(0, 99);
+  result.ber = fields.getInt(1, 99);
+  return true;
+}
+
+bool parseRegistration(const AtSlice& line, AtRegistration& result) {
+  static const char* const prefixes[AT_REG_DOMAINS] = {"+CREG:", "+CGREG:", "+CEREG:"};
+  
+  AtFields fields;
+  int domain = 0;
+  while (domain < AT_REG_DOMAINS && !fields.parse(line, prefixes[domain])) {
+    domain++;
+  }
+  if (domain == AT_REG_DOMAINS || fields.size() == 0) {
+    return false;
+  }
+  
+  result.domain = (AtRegDomain)domain;
+  
+  // The answer to AT+CREG? starts with the URC mode, the URC itself doesn't
+  result.stat = fields.getInt(fields.size() == 1 ? 0 : 1);
+  return result.stat >= 0;
+}
+
+bool parseHttpAction(const AtSlice& line, AtHttpAction& result) {
+  AtFields fields;
+  if (!fields.parse(line, "+HTTPACTION:") || fields.size() < 2) {
+    return false;
+  }
+  
+  result.method = fields.getInt(0);
+  result.status = fields.getInt(1);
+  result.length = fields.getInt(2, 0);
+  return result.status >= 0;
+}
+
+bool parseTcpAck(const AtSlice& line, AtTcpAck& result) {
+  AtFields fields;
+  if (!fields.parse(line, "+CIPACK:") || fields.size() != 3 || fields.getInt(0) < 0 || fields.getInt(1) < 0) {
+    return false;
+  }
+  
+  result.sent = fields.getInt(0);
+  result.acked = fields.getInt(1);
+  result.unacked = fields.getInt(2, 0);
+  return true;
+}
+
+bool parseClock(const AtSlice& line, AtClock& result) {
+  AtFields fields;
+  if (!fields.parse(line, "+CCLK:") || fields.size() != 1) {
+    return false;
+  }
+  
+  // yy/MM/dd,hh:mm:ss±zz
+  AtSlice value = fields.get(0);
+  if (value.length < 17) {
+    return false;
+  }
+  
+  result.year = 2000 + value.substr(0, 2).toInt();
+  result.month = value.substr(3, 2).toInt();
+  result.day = value.substr(6, 2).toInt();
+  result.hour = value.substr(9, 2).toInt();
+  result.minute = value.substr(12, 2).toInt();
+  result.second = value.substr(15, 2).toInt();
+  result.zoneQuarters = value.length > 17 ? value.substr(17).toInt(0) : 0;
+  
+  return result.month >= 1 && result.month <= 12 && result.day >= 1 && result.day <= 31 &&
+         result.hour >= 0 && result.hour < 24 && result.minute >= 0 && result.minute < 60 &&
+         result.second >= 0 && result.second < 61;
+}
+
+bool findAtLine(const char* response, size_t length, const char* prefix, AtSlice& line) {
+  size_t start = 0;
+  while (start < length) {
+    size_t end = start;
+    while (end < length && response[end] != '\n') {
+      end++;
+    }
+    
+    AtSlice candidate = AtSlice(response + start, end - start).trim();
+    if (candidate.startsWith(prefix)) {
+      line = candidate;
+      return true;
+    }
+    start = end + 1;
+  }
+  return false;
+}
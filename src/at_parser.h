@@ -0,0 +1,143 @@
+#ifndef AT_PARSER_H
+#define AT_PARSER_H
+
+// Modem output parsed in place: lines are collected in a fixed buffer and
+// handed out as slices, and typed results (+CSQ, +CREG/+CGREG/+CEREG,
+// +HTTPACTION, +CIPACK, +CCLK) are read straight from those slices, so
+// nothing is allocated per byte or per line. Free of Arduino includes so it
+// can be built on a host machine.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Longest line kept whole; longer ones are handed out in pieces
+#define AT_LINE_BUFFER_SIZE 512
+
+// Most comma separated values read from one line
+#define AT_MAX_FIELDS 8
+
+// A view into characters owned by someone else (string_view style)
+struct AtSlice {
+  const char* data;
+  size_t length;
+  
+  AtSlice() : data(""), length(0) {}
+  AtSlice(const char* data, size_t length) : data(data), length(length) {}
+  
+  bool empty() const { return length == 0; }
+  bool equals(const char* text) const;
+  bool startsWith(const char* prefix) const;
+  bool contains(const char* text) const;
+  int indexOf(char c, size_t from = 0) const;
+  AtSlice substr(size_t start, size_t count = (size_t)-1) const;
+  AtSlice trim() const;
+  
+  // Leading (optionally signed) decimal number, fallback if there is none
+  long toInt(long fallback = -1) const;
+};
+
+// Splits modem output into lines. CR and surrounding spaces are dropped,
+// empty lines are skipped. The "> " data prompt has no line end, so it is
+// only reported when the caller is waiting for one.
+class AtLineReader {
+public:
+  enum Result {
+    AT_LINE_NONE,
+    AT_LINE_READY,   // line() holds a line until the next feed()
+    AT_LINE_PROMPT
+  };
+  
+  AtLineReader() : used(0), complete(false), pieces(0) {}
+  
+  Result feed(char c, bool promptExpected = false);
+  AtSlice line() const { return AtSlice(buffer, used).trim(); }
+  
+  // Lines that didn't fit the buffer and were split
+  uint32_t getSplitLines() const { return pieces; }
+
+private:
+  char buffer[AT_LINE_BUFFER_SIZE];
+  size_t used;
+  bool complete;
+  uint32_t pieces;
+};
+
+// Comma separated values after a "+NAME: " prefix; quotes are removed and
+// commas inside them don't split
+class AtFields {
+public:
+  AtFields() : count(0) {}
+  
+  // False if the line doesn't start with prefix (e.g. "+CSQ:")
+  bool parse(const AtSlice& line, const char* prefix);
+  
+  size_t size() const { return count; }
+  AtSlice get(size_t index) const { return index < count ? fields[index] : AtSlice(); }
+  long getInt(size_t index, long fallback = -1) const { return get(index).toInt(fallback); }
+
+private:
+  AtSlice fields[AT_MAX_FIELDS];
+  size_t count;
+};
+
+// +CSQ: <rssi>,<ber>; 99 means unknown
+struct AtSignalQuality {
+  int rssi;
+  int ber;
+  
+  bool isKnown() const { return rssi != 99; }
+  int dbm() const { return -113 + 2 * rssi; }
+};
+
+// Which registration a line reports; LTE-M and NB-IoT only show up in +CEREG
+enum AtRegDomain {
+  AT_REG_CS,    // +CREG, circuit switched (GSM voice and SMS)
+  AT_REG_GPRS,  // +CGREG, GSM packet data
+  AT_REG_EPS,   // +CEREG, LTE-M and NB-IoT
+  AT_REG_DOMAINS
+};
+
+// +CREG: <n>,<stat> as an answer, +CREG: <stat> as a URC (likewise +CGREG, +CEREG)
+struct AtRegistration {
+  AtRegDomain domain;
+  int stat;
+  
+  bool isRegistered() const { return stat == 1 || stat == 5; }  // Home or roaming
+};
+
+// +HTTPACTION: <method>,<status>,<length>
+struct AtHttpAction {
+  int method;
+  int status;
+  long length;
+};
+
+// +CIPACK: <sent>,<acked>,<unacked> for the open TCP connection (quick send)
+struct AtTcpAck {
+  uint32_t sent;
+  uint32_t acked;
+  uint32_t unacked;
+};
+
+// +CCLK: "yy/MM/dd,hh:mm:ss±zz", the zone in quarter hours
+struct AtClock {
+  int year;
+  int month;
+  int day;
+  int hour;
+  int minute;
+  int second;
+  int zoneQuarters;
+};
+
+bool parseSignalQuality(const AtSlice& line, AtSignalQuality& result);
+bool parseRegistration(const AtSlice& line, AtRegistration& result);
+bool parseHttpAction(const AtSlice& line, AtHttpAction& result);
+bool parseTcpAck(const AtSlice& line, AtTcpAck& result);
+bool parseClock(const AtSlice& line, AtClock& result);
+
+// The first line of a collected response that starts with prefix
+bool findAtLine(const char* response, size_t length, const char* prefix, AtSlice& line);
+
+#endif // AT_PARSER_H
@@ -0,0 +1,57 @@
+#include "backoff.h"
+
+Backoff* backoffList = NULL;
+
+Backoff::Backoff(const char* name, unsigned long baseMs, unsigned long maxMs)
+  : name(name), baseMs(baseMs), maxMs(maxMs), failures(0), skipped(0), failedAt(0), waitMs(0),
+    next(backoffList) {
+  backoffList = this;
+}
+
+bool Backoff::ready() {
+  if (remainingMs() == 0) {
+    return true;
+  }
+  skipped++;
+  return false;
+}
+
+unsigned long Backoff::remainingMs() const {
+  if (failures == 0) {
+    return 0;
+  }
+  unsigned long elapsed = millis() - failedAt;
+  return elapsed >= waitMs ? 0 : waitMs - elapsed;
+}
+
+void Backoff::success() {
+  if (failures > 0) {
+    Serial.printf("%s recovered after %lu failures\n", name, (unsigned long)failures);
+  }
+  failures = 0;
+  waitMs = 0;
+}
+
+void Backoff::failure() {
+  failures++;
+  
+  // Half the wait is fixed, half random ("equal jitter")
+  unsigned long wait = baseMs << min(failures - 1, (uint32_t)16);
+  if (wait > maxMs || wait < baseMs) {
+    wait = maxMs;
+  }
+  waitMs = wait / 2 + random(wait / 2 + 1);
+  failedAt = millis();
+  
+  Serial.printf("%s failed %lu times, next try in %lu s\n", name, (unsigned long)failures, waitMs / 1000);
+}
+
+void printBackoffStats() {
+  for (Backoff* backoff = backoffList; backoff; backoff = backoff->getNext()) {
+    if (backoff->getSkipped() > 0 || backoff->getFailures() > 0) {
+      Serial.printf("%s: %lu attempts skipped while backing off, %lu failures pending\n",
+                    backoff->getName(), (unsigned long)backoff->getSkipped(),
+                    (unsigned long)backoff->getFailures());
+    }
+  }
+}
@@ -0,0 +1,41 @@
+#ifndef BACKOFF_H
+#define BACKOFF_H
+
+#include <Arduino.h>
+
+// Retry policy shared by the cellular, upload, NTP and SMS paths. After each
+// failure the wait doubles up to a cap, with random jitter so retries from
+// different paths don't line up; a success resets it.
+class Backoff {
+public:
+  Backoff(const char* name, unsigned long baseMs, unsigned long maxMs);
+  
+  // True when there is no failure to wait out; a refused attempt is counted
+  bool ready();
+  
+  void success();
+  void failure();
+  
+  // Milliseconds until the next attempt is allowed, 0 if ready
+  unsigned long remainingMs() const;
+  
+  uint32_t getFailures() const { return failures; }
+  uint32_t getSkipped() const { return skipped; }
+  const char* getName() const { return name; }
+  Backoff* getNext() const { return next; }
+
+private:
+  const char* name;
+  unsigned long baseMs;
+  unsigned long maxMs;
+  uint32_t failures;      // Consecutive
+  uint32_t skipped;       // Attempts refused while waiting (modem wake-ups saved)
+  unsigned long failedAt;
+  unsigned long waitMs;
+  Backoff* next;          // All policies, for the stats
+};
+
+// Attempts saved by each policy since boot
+void printBackoffStats();
+
+#endif // BACKOFF_H
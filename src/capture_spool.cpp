@@ -0,0 +1,170 @@
+#include "capture_spool.h"
+#include "storage.h"
+#include "config.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+// Fixed-size slots in one PSRAM allocation; frames are queued by slot
+// number, so any of them can be dropped without moving frame data
+struct SpoolSlot {
+  char filename[64];
+  size_t len;
+};
+
+uint8_t* spoolArena = NULL;
+SpoolSlot spoolSlots[SPOOL_FRAME_COUNT];
+int spoolQueue[SPOOL_FRAME_COUNT];  // Slots holding frames, oldest first
+int spoolFree[SPOOL_FRAME_COUNT];   // Slots not in use
+int spoolCount = 0;
+int spoolFreeCount = 0;
+uint32_t spoolOverwrites = 0;
+bool spoolHeadPinned = false;  // Oldest frame handed out by peek, not yet dropped
+SemaphoreHandle_t spoolMutex = NULL;
+
+// Take the frame at a queue position out and give its slot back
+static void removeQueued(int position) {
+  spoolFree[spoolFreeCount++] = spoolQueue[position];
+  for (int i = position + 1; i < spoolCount; i++) {
+    spoolQueue[i - 1] = spoolQueue[i];
+  }
+  spoolCount--;
+}
+
+bool initCaptureSpool() {
+  if (spoolArena) {
+    return true;
+  }
+  
+  if (!psramFound()) {
+    Serial.println("No PSRAM, capture spool disabled");
+    return false;
+  }
+  
+  spoolArena = (uint8_t*)ps_malloc((size_t)SPOOL_FRAME_COUNT * SPOOL_SLOT_SIZE);
+  if (!spoolArena) {
+    Serial.println("Failed to allocate capture spool");
+    return false;
+  }
+  
+  spoolMutex = xSemaphoreCreateMutex();
+  spoolCount = 0;
+  for (int i = 0; i < SPOOL_FRAME_COUNT; i++) {
+    spoolFree[i] = SPOOL_FRAME_COUNT - 1 - i;
+  }
+  spoolFreeCount = SPOOL_FRAME_COUNT;
+  Serial.printf("Capture spool: %d frames of up to %u bytes\n", SPOOL_FRAME_COUNT, (unsigned)SPOOL_SLOT_SIZE);
+  return true;
+}
+
+bool isCaptureSpoolAvailable() {
+  return spoolArena != NULL;
+}
+
+bool spoolCapture(const char* filename, const uint8_t* data, size_t len) {
+  if (!spoolArena) {
+    return false;
+  }
+  
+  if (len > SPOOL_SLOT_SIZE) {
+    Serial.printf("Frame too large to spool (%u bytes)\n", (unsigned)len);
+    return false;
+  }
+  
+  xSemaphoreTake(spoolMutex, portMAX_DELAY);
+  
+  // Keep the most recent frames, drop the oldest when full. The oldest may
+  // be out for upload and can't be touched, then the next oldest goes.
+  if (spoolCount == SPOOL_FRAME_COUNT) {
+    int victim = spoolHeadPinned ? 1 : 0;
+    Serial.printf("Spool full, dropping %s\n", spoolSlots[spoolQueue[victim]].filename);
+    removeQueued(victim);
+    spoolOverwrites++;
+  }
+  
+  int index = spoolFree[--spoolFreeCount];
+  spoolQueue[spoolCount] = index;
+  SpoolSlot& slot = spoolSlots[index];
+  strncpy(slot.filename, filename, sizeof(slot.filename) - 1);
+  slot.filename[sizeof(slot.filename) - 1] = '\0';
+  slot.len = len;
+  memcpy(spoolArena + (size_t)index * SPOOL_SLOT_SIZE, data, len);
+  spoolCount++;
+  
+  xSemaphoreGive(spoolMutex);
+  
+  Serial.printf("Spooled %s in PSRAM (%d/%d)\n", filename, spoolCount, SPOOL_FRAME_COUNT);
+  return true;
+}
+
+int getSpoolCount() {
+  return spoolCount;
+}
+
+bool peekSpooledCapture(String& filename, const uint8_t** data, size_t* len) {
+  if (!spoolArena) {
+    return false;
+  }
+  
+  xSemaphoreTake(spoolMutex, portMAX_DELAY);
+  
+  // Only one user of the oldest frame at a time (upload task or SD flush)
+  if (spoolCount == 0 || spoolHeadPinned) {
+    xSemaphoreGive(spoolMutex);
+    return false;
+  }
+  
+  int index = spoolQueue[0];
+  const SpoolSlot& slot = spoolSlots[index];
+  filename = slot.filename;
+  *data = spoolArena + (size_t)index * SPOOL_SLOT_SIZE;
+  *len = slot.len;
+  spoolHeadPinned = true;
+  
+  xSemaphoreGive(spoolMutex);
+  return true;
+}
+
+void dropSpooledCapture() {
+  if (!spoolArena) {
+    return;
+  }
+  
+  xSemaphoreTake(spoolMutex, portMAX_DELAY);
+  if (spoolCount > 0) {
+    removeQueued(0);
+  }
+  spoolHeadPinned = false;
+  xSemaphoreGive(spoolMutex);
+}
+
+void releaseSpooledCapture() {
+  if (!spoolArena) {
+    return;
+  }
+  
+  xSemaphoreTake(spoolMutex, portMAX_DELAY);
+  spoolHeadPinned = false;
+  xSemaphoreGive(spoolMutex);
+}
+
+int flushSpoolToStorage() {
+  int written = 0;
+  
+  String filename;
+  const uint8_t* data;
+  size_t len;
+  
+  while (peekSpooledCapture(filename, &data, &len)) {
+    if (!savePhotoToSD(filename.c_str(), data, len)) {
+      releaseSpooledCapture();
+      break;
+    }
+    dropSpooledCapture();
+    written++;
+  }
+  
+  if (written > 0) {
+    Serial.printf("Flushed %d spooled frames to SD (%d left)\n", written, spoolCount);
+  }
+  return written;
+}
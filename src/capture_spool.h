@@ -0,0 +1,34 @@
+#ifndef CAPTURE_SPOOL_H
+#define CAPTURE_SPOOL_H
+
+#include <Arduino.h>
+
+// PSRAM ring of the most recent frames, used while the SD card is unavailable
+
+// Allocate the spool in PSRAM
+bool initCaptureSpool();
+
+// Check if the spool was allocated
+bool isCaptureSpoolAvailable();
+
+// Add a frame, overwriting the oldest one when the spool is full (the next
+// oldest while the oldest is held by peekSpooledCapture())
+bool spoolCapture(const char* filename, const uint8_t* data, size_t len);
+
+// Number of frames held
+int getSpoolCount();
+
+// Get the oldest frame without removing it; it stays reserved for the
+// caller until dropped or released
+bool peekSpooledCapture(String& filename, const uint8_t** data, size_t* len);
+
+// Remove the oldest frame
+void dropSpooledCapture();
+
+// Give back the oldest frame without removing it
+void releaseSpooledCapture();
+
+// Write spooled frames to storage, returns the number written
+int flushSpoolToStorage();
+
+#endif // CAPTURE_SPOOL_H
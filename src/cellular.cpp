@@ -1,15 +1,222 @@
 #include "cellular.h"
 #include "hw_config.h"
 #include "config.h"
-#include <SoftwareSerial.h>
+#include "backoff.h"
+#include "modem_serial.h"
+#include "at_engine.h"
+#include "at_parser.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+// Quick send answers DATA ACCEPT once a packet is in the modem's buffer
+#define TCP_ACCEPT_LINE "DATA ACCEPT:"
 
-SoftwareSerial simSerial(SIM7000_RX_PIN, SIM7000_TX_PIN);
 bool cellularInitialized = false;
 bool cellularConnected = false;
+SemaphoreHandle_t modemMutex = NULL;
+Backoff cellularBackoff("Cellular connect", CELLULAR_BACKOFF_BASE_MS, CELLULAR_BACKOFF_MAX_MS);
+
+// Network state as the modem reports it in URCs, so callers get an answer
+// without a round trip; written by the AT engine task
+volatile int8_t registrationStat[AT_REG_DOMAINS] = {-1, -1, -1};  // -1 unknown
+volatile bool simReady = false;
+volatile unsigned long attachStartMs = 0;  // Power-on or the last registration loss
+SemaphoreHandle_t registrationSignal = NULL;  // Given on every registration change
+
+// Open TCP connection: packet size the modem takes, and with quick send the
+// bytes it holds that the server hasn't acknowledged (as of the last
+// AT+CIPACK, plus what was sent since). Received data stays in the modem
+// until it is fetched with AT+CIPRXGET.
+volatile bool tcpOpen = false;
+volatile bool tcpDataPending = false;
+SemaphoreHandle_t tcpDataSignal = NULL;  // Given when data arrives or the connection closes
+bool tcpQuickSend = false;
+size_t tcpPacketSize = TCP_MAX_PACKET_SIZE;
+uint32_t tcpUnacked = 0;
+uint8_t tcpPacket[TCP_MAX_PACKET_SIZE];  // Used with the modem locked
+TcpSendStats tcpSendStats;
+
+bool lockModem(unsigned long timeout) {
+  // Created on first use, which is in setup() before any other task runs
+  if (!modemMutex) {
+    modemMutex = xSemaphoreCreateRecursiveMutex();
+  }
+  
+  if (xSemaphoreTakeRecursive(modemMutex, pdMS_TO_TICKS(timeout)) != pdTRUE) {
+    Serial.println("Modem busy");
+    return false;
+  }
+  return true;
+}
+
+void unlockModem() {
+  xSemaphoreGiveRecursive(modemMutex);
+}
+
+// The modem keeps a rate set with AT+IPR across power cycles, so after a
+// reboot it may already be at MODEM_BAUD; try that first
+static bool detectModemBaud() {
+  const uint32_t rates[] = {MODEM_BAUD, MODEM_DEFAULT_BAUD};
+  for (uint32_t rate : rates) {
+    setModemBaud(rate);
+    for (int attempt = 0; attempt < 3; attempt++) {
+      if (sendATCommand("AT", 500).indexOf("OK") != -1) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Move the link to MODEM_BAUD; the modem answers at the old rate, then
+// switches. If nothing comes back at the new rate, go back to the default.
+static void negotiateModemBaud() {
+  uint32_t oldBaud = getModemBaud();
+  if (oldBaud == MODEM_BAUD) {
+    return;
+  }
+  
+  if (sendATCommand("AT+IPR=" + String(MODEM_BAUD)).indexOf("OK") == -1) {
+    Serial.printf("Modem refused %lu baud\n", (unsigned long)MODEM_BAUD);
+    return;
+  }
+  
+  setModemBaud(MODEM_BAUD);
+  delay(100);
+  if (sendATCommand("AT", 1000).indexOf("OK") != -1) {
+    Serial.printf("Modem link at %lu baud\n", (unsigned long)MODEM_BAUD);
+    return;
+  }
+  
+  Serial.printf("No answer at %lu baud, staying at %lu\n", (unsigned long)MODEM_BAUD, (unsigned long)oldBaud);
+  setModemBaud(oldBaud);
+  sendATCommand("AT+IPR=" + String(oldBaud));
+}
+
+// The line of a response starting with prefix, read in place
+static bool findResponseLine(const String& response, const char* prefix, AtSlice& line) {
+  return findAtLine(response.c_str(), response.length(), prefix, line);
+}
+
+// Status code of a finished HTTP action, 0 if there is none
+static int getHttpActionStatus(const String& response) {
+  AtSlice line;
+  AtHttpAction action;
+  if (!findResponseLine(response, "+HTTPACTION:", line) || !parseHttpAction(line, action)) {
+    return 0;
+  }
+  return action.status;
+}
+
+static const char* domainName(int domain) {
+  switch (domain) {
+    case AT_REG_CS: return "GSM";
+    case AT_REG_GPRS: return "GPRS";
+    default: return "LTE";
+  }
+}
+
+bool isCellularRegistered() {
+  for (int domain = 0; domain < AT_REG_DOMAINS; domain++) {
+    if (registrationStat[domain] == 1 || registrationStat[domain] == 5) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// A registration answer or URC; registered in any domain is enough, an
+// LTE-M or NB-IoT modem never registers for GSM
+static void updateRegistration(const AtRegistration& registration) {
+  bool wasRegistered = isCellularRegistered();
+  registrationStat[registration.domain] = registration.stat;
+  bool registered = isCellularRegistered();
+  
+  if (registered && !wasRegistered) {
+    Serial.printf("Registered on %s (%s) after %lu ms\n", domainName(registration.domain),
+                  registration.stat == 5 ? "roaming" : "home", millis() - attachStartMs);
+  } else if (!registered && wasRegistered) {
+    attachStartMs = millis();
+    Serial.println("Network registration lost");
+    
+    // The bearer goes with the registration
+    cellularConnected = false;
+  }
+  
+  if (registrationSignal) {
+    xSemaphoreGive(registrationSignal);
+  }
+}
+
+// +CREG: <stat>, +CGREG: <stat>, +CEREG: <stat>
+static void onRegistrationUrc(const AtSlice& line, void* context) {
+  AtRegistration registration;
+  if (parseRegistration(line, registration)) {
+    updateRegistration(registration);
+  }
+}
+
+// "+CPIN: READY" once the SIM is up after power-on
+static void onSimUrc(const AtSlice& line, void* context) {
+  simReady = line.contains("READY") && !line.contains("NOT READY");
+}
+
+// The network dropped the data context ("+APP PDP: 0,DEACTIVE", "+SAPBR 1: DEACT")
+static void onPdpUrc(const AtSlice& line, void* context) {
+  if (line.contains("DEACT") && cellularConnected) {
+    cellularConnected = false;
+    Serial.println("Cellular data context lost");
+  }
+}
+
+// The modem holds received data for the connection ("+CIPRXGET: 1")
+static void onTcpDataUrc(const AtSlice& line, void* context) {
+  if (line.startsWith("+CIPRXGET: 1")) {
+    tcpDataPending = true;
+    xSemaphoreGive(tcpDataSignal);
+  }
+}
+
+// The server closed the connection
+static void onTcpClosedUrc(const AtSlice& line, void* context) {
+  tcpOpen = false;
+  xSemaphoreGive(tcpDataSignal);
+}
+
+// The engine reads everything the modem sends from here on
+static bool startModemIO() {
+  if (registrationSignal) {
+    return true;
+  }
+  
+  registrationSignal = xSemaphoreCreateBinary();
+  tcpDataSignal = xSemaphoreCreateBinary();
+  onAtUrc("+APP PDP:", onPdpUrc);
+  onAtUrc("+SAPBR 1:", onPdpUrc);
+  onAtUrc("+CIPRXGET:", onTcpDataUrc);
+  onAtUrc("+CREG:", onRegistrationUrc);
+  onAtUrc("+CGREG:", onRegistrationUrc);
+  onAtUrc("+CEREG:", onRegistrationUrc);
+  onAtUrc("+CPIN:", onSimUrc);
+  onAtUrc("CLOSED", onTcpClosedUrc);
+  
+  return beginModemSerial() && startAtEngine();
+}
 
 bool initCellular() {
-  // Initialize UART for SIM7000G
-  simSerial.begin(115200);
+  // Hardware UART for SIM7000G, read by the AT engine
+  if (!startModemIO()) {
+    Serial.println("Modem UART not started");
+    return false;
+  }
+  
+  // Whatever the modem reported before the reset no longer holds
+  for (int domain = 0; domain < AT_REG_DOMAINS; domain++) {
+    registrationStat[domain] = -1;
+  }
+  simReady = false;
+  cellularConnected = false;
+  attachStartMs = millis();
   
   // Power on sequence for SIM7000G
   pinMode(SIM7000_PWR_PIN, OUTPUT);
@@ -28,15 +235,33 @@ bool initCellular() {
   delay(5000);  // Wait for module to initialize
   
   // Check if module is responsive
-  String response = sendATCommand("AT");
-  if (response.indexOf("OK") == -1) {
+  if (!detectModemBaud()) {
     Serial.println("No response from SIM7000G module");
     return false;
   }
   
+  // Hardware flow control on the modem's side too, then the faster rate
+  if (hasModemFlowControl()) {
+    sendATCommand("AT+IFC=2,2");
+  }
+  negotiateModemBaud();
+  
   // Configure module
   sendATCommand("AT+CMEE=2");  // Enable verbose error messages
   
+  // Radio access: GSM, LTE or both, and which LTE flavours
+  sendATCommand("AT+CNMP=" + String(CELLULAR_NETWORK_MODE));
+  sendATCommand("AT+CMNB=" + String(CELLULAR_LTE_MODE));
+  
+  // Registration changes come in as URCs from here on
+  sendATCommand("AT+CREG=1");
+  sendATCommand("AT+CGREG=1");
+  sendATCommand("AT+CEREG=1");
+  
+  // Received SMS are kept on the SIM and announced with +CMTI
+  sendATCommand("AT+CMGF=1");
+  sendATCommand("AT+CNMI=2,1,0,0,0");
+  
   // Set module to function mode
   sendATCommand("AT+CFUN=1");
   
@@ -49,45 +274,86 @@ bool initCellular() {
   return true;
 }
 
-bool connectCellular() {
+// Ask for every domain's registration, for when the URCs were missed
+static void queryRegistration() {
+  static const char* const queries[AT_REG_DOMAINS] = {"AT+CREG?", "AT+CGREG?", "AT+CEREG?"};
+  static const char* const answers[AT_REG_DOMAINS] = {"+CREG:", "+CGREG:", "+CEREG:"};
+  for (int domain = 0; domain < AT_REG_DOMAINS; domain++) {
+    String response = sendATCommand(queries[domain]);
+    AtSlice line;
+    AtRegistration registration;
+    if (findResponseLine(response, answers[domain], line) && parseRegistration(line, registration)) {
+      updateRegistration(registration);
+    }
+  }
+}
+
+// SIM and network registration, called with the modem locked; returns at
+// once when the URCs already say the modem is registered
+static bool openRegistration() {
   if (!cellularInitialized) {
     if (!initCellular()) {
       return false;
     }
   }
   
-  // Check if SIM card is ready
-  String response = sendATCommand("AT+CPIN?");
-  if (response.indexOf("READY") == -1) {
-    Serial.println("SIM card not ready");
-    return false;
+  // The SIM stays ready until the modem is reset
+  if (!simReady) {
+    String response = sendATCommand("AT+CPIN?");
+    if (response.indexOf("READY") == -1) {
+      Serial.println("SIM card not ready");
+      return false;
+    }
+    simReady = true;
   }
   
-  // Wait for network registration
-  int retry = 0;
-  bool registered = false;
-  while (retry < CELLULAR_RETRY_COUNT && !registered) {
-    response = sendATCommand("AT+CREG?");
-    if (response.indexOf("+CREG: 0,1") != -1 || response.indexOf("+CREG: 0,5") != -1) {
-      registered = true;
-    } else {
-      Serial.println("Waiting for network registration...");
-      delay(2000);
-      retry++;
-    }
+  if (isCellularRegistered()) {
+    return true;
   }
   
-  if (!registered) {
-    Serial.println("Failed to register to network");
+  // Wait for the registration URC rather than polling
+  queryRegistration();
+  unsigned long start = millis();
+  while (!isCellularRegistered()) {
+    unsigned long elapsed = millis() - start;
+    if (elapsed >= CELLULAR_ATTACH_TIMEOUT_MS) {
+      Serial.println("Failed to register to network");
+      return false;
+    }
+    Serial.println("Waiting for network registration...");
+    xSemaphoreTake(registrationSignal, pdMS_TO_TICKS(CELLULAR_ATTACH_TIMEOUT_MS - elapsed));
+  }
+  return true;
+}
+
+// Registration and GPRS context, called with the modem locked
+static bool openCellularConnection() {
+  if (!openRegistration()) {
     return false;
   }
   
+  unsigned long bearerStart = millis();
+  
+  // A bearer left open (by a failed close, or before a reboot of ours) is reused
+  String response = sendATCommand("AT+SAPBR=2,1");
+  if (response.indexOf("+SAPBR: 1,1") != -1) {
+    cellularConnected = true;
+    Serial.println("Cellular connection already open");
+    return true;
+  }
+  
   // Check signal quality
   response = sendATCommand("AT+CSQ");
-  Serial.println("Signal quality: " + response);
+  AtSlice line;
+  AtSignalQuality quality;
+  if (findResponseLine(response, "+CSQ:", line) && parseSignalQuality(line, quality) && quality.isKnown()) {
+    Serial.printf("Signal quality: %d dBm\n", quality.dbm());
+  } else {
+    Serial.println("Signal quality unknown");
+  }
   
   // Open GPRS context
-  retry = 0;
+  int retry = 0;
   bool contextOpened = false;
   while (retry < CELLULAR_RETRY_COUNT && !contextOpened) {
     response = sendATCommand("AT+SAPBR=1,1", 10000);
@@ -113,10 +379,55 @@ bool connectCellular() {
   }
   
   cellularConnected = true;
-  Serial.println("Cellular connection established");
+  Serial.printf("Cellular connection established in %lu ms\n", millis() - bearerStart);
+  return true;
+}
+
+bool connectCellular() {
+  ModemLock lock;
+  if (!lock.isLocked()) {
+    return false;
+  }
+  
+  // During an outage every caller would otherwise wake the modem and wait
+  // out the registration retries
+  if (!cellularBackoff.ready()) {
+    Serial.printf("Cellular connect backing off, %lu s left\n", cellularBackoff.remainingMs() / 1000);
+    return false;
+  }
+  
+  if (!openCellularConnection()) {
+    cellularBackoff.failure();
+    return false;
+  }
+  cellularBackoff.success();
   return true;
 }
 
+bool registerCellular() {
+  ModemLock lock;
+  if (!lock.isLocked()) {
+    return false;
+  }
+  return openRegistration();
+}
+
+bool resolveHost(const String& host) {
+  ModemLock lock;
+  if (!lock.isLocked()) {
+    return false;
+  }
+  
+  // The answer follows the OK as +CDNSGIP: 1,"host","ip" (0,<error> on failure)
+  String response = sendATCommandUntil("AT+CDNSGIP=\"" + host + "\"", "+CDNSGIP:", CELLULAR_DNS_TIMEOUT_MS);
+  int result = response.indexOf("+CDNSGIP: ");
+  if (result == -1) {
+    Serial.printf("No DNS answer for %s\n", host.c_str());
+    return false;
+  }
+  return response.charAt(result + 10) == '1';
+}
+
 void disconnectCellular() {
   if (!cellularConnected) {
     return;
@@ -133,128 +444,313 @@ bool isCellularConnected() {
   return cellularConnected;
 }
 
-String sendATCommand(const String& command, unsigned long timeout) {
-  // Clear any pending data
-  while (simSerial.available()) {
-    simSerial.read();
-  }
-  
-  // Send command
-  simSerial.println(command);
-  Serial.print("AT> " + command + "\n");
-  
-  // Collect response
-  String response = "";
-  unsigned long startTime = millis();
-  
-  while (millis() - startTime < timeout) {
-    if (simSerial.available()) {
-      char c = simSerial.read();
-      response += c;
-      
-      // Check if response is complete (ends with OK or ERROR)
-      if (response.endsWith("\r\nOK\r\n") || response.endsWith("\r\nERROR\r\n")) {
-        break;
-      }
-    }
-    yield();  // Allow other tasks to run
+// The engine routes anything unsolicited to the URC handlers, so there is
+// no pending input to throw away before a command
+static String executeLocked(const AtCommand& command, AtStatus* status = NULL) {
+  ModemLock lock;
+  if (!lock.isLocked()) {
+    return "";
   }
   
-  Serial.println("AT< " + response);
+  String response;
+  AtStatus result = executeAtCommand(command, response);
+  if (status) {
+    *status = result;
+  }
   return response;
 }
 
+String sendATCommand(const String& command, unsigned long timeout) {
+  return executeLocked(AtCommand(command, timeout));
+}
+
+String sendATCommandUntil(const String& command, const char* finalLine, unsigned long timeout,
+                          const char* failLine) {
+  AtCommand at(command, timeout);
+  at.finalLine = finalLine;
+  at.failLine = failLine;
+  return executeLocked(at);
+}
+
+bool sendATPrompt(const String& command, unsigned long timeout) {
+  AtCommand at(command, timeout);
+  at.expectPrompt = true;
+  AtStatus status = AT_ERROR;
+  executeLocked(at, &status);
+  return status == AT_PROMPT;
+}
+
+String sendATData(const uint8_t* data, size_t length, unsigned long timeout, const char* finalLine,
+                  const char* failLine) {
+  AtCommand at("", timeout);
+  at.data = data;
+  at.length = length;
+  at.finalLine = finalLine;
+  at.failLine = failLine;
+  return executeLocked(at);
+}
+
 bool connectTCP(const String& host, int port) {
+  ModemLock lock;
+  if (!lock.isLocked()) {
+    return false;
+  }
   if (!cellularConnected && !connectCellular()) {
     return false;
   }
   
   // Close any existing connection
-  sendATCommand("AT+CIPSHUT", 5000);
+  sendATCommandUntil("AT+CIPSHUT", "SHUT OK", 5000);
   
   // Configure TCP/IP parameters
   sendATCommand("AT+CIPMUX=0");  // Single connection mode
   
+  // Quick send lets packets follow each other without waiting for the
+  // server's ACK; it can only be changed with no connection open
+  tcpQuickSend = sendATCommand("AT+CIPQSEND=1").indexOf("OK") != -1;
+  
+  // Received data waits in the modem to be fetched, so binary data doesn't
+  // get mixed into the AT lines
+  sendATCommand("AT+CIPRXGET=1");
+  tcpDataPending = false;
+  
   // Start TCP connection
   String cmd = "AT+CIPSTART=\"TCP\",\"" + host + "\"," + String(port);
-  String response = sendATCommand(cmd, 20000);
+  String response = sendATCommandUntil(cmd, "CONNECT OK", 20000, "CONNECT FAIL");
+  if (response.indexOf("CONNECT OK") == -1 && response.indexOf("ALREADY CONNECT") == -1) {
+    return false;
+  }
   
-  return (response.indexOf("CONNECT OK") != -1 || response.indexOf("ALREADY CONNECT") != -1);
+  tcpOpen = true;
+  
+  // The largest packet the modem takes on this connection
+  tcpPacketSize = TCP_MAX_PACKET_SIZE;
+  tcpUnacked = 0;
+  response = sendATCommand("AT+CIPSEND?");
+  AtSlice line;
+  AtFields fields;
+  if (findResponseLine(response, "+CIPSEND:", line) && fields.parse(line, "+CIPSEND:") && fields.size() > 0) {
+    long size = fields.getInt(fields.size() - 1);
+    if (size > 0 && size < TCP_MAX_PACKET_SIZE) {
+      tcpPacketSize = size;
+    }
+  }
+  return true;
 }
 
 bool disconnectTCP() {
+  ModemLock lock;
+  if (!lock.isLocked()) {
+    return false;
+  }
+  
   // Close TCP connection
-  String response = sendATCommand("AT+CIPCLOSE", 5000);
-  sendATCommand("AT+CIPSHUT", 5000);
+  String response = sendATCommandUntil("AT+CIPCLOSE", "CLOSE OK", 5000);
+  sendATCommandUntil("AT+CIPSHUT", "SHUT OK", 5000);
+  tcpOpen = false;
+  tcpDataPending = false;
   
   return (response.indexOf("CLOSE OK") != -1);
 }
 
-bool sendTCPData(const String& data) {
-  // Send data command
-  String cmd = "AT+CIPSEND=" + String(data.length());
-  String response = sendATCommand(cmd, 5000);
+// Wait until at most maxUnacked bytes are waiting for the server's ACK,
+// asking the modem only when the running count says the window is full
+static bool waitTcpWindow(uint32_t maxUnacked) {
+  unsigned long lastProgress = millis();
+  uint32_t lastUnacked = tcpUnacked;
+  bool stalled = false;
+  
+  while (tcpUnacked > maxUnacked) {
+    String response = sendATCommand("AT+CIPACK");
+    AtSlice line;
+    AtTcpAck ack;
+    if (!findResponseLine(response, "+CIPACK:", line) || !parseTcpAck(line, ack)) {
+      Serial.println("No TCP ACK state");
+      return false;
+    }
+    tcpSendStats.ackPolls++;
+    tcpUnacked = ack.sent - ack.acked;
+    
+    if (tcpUnacked < lastUnacked) {
+      lastProgress = millis();
+      lastUnacked = tcpUnacked;
+    } else if (millis() - lastProgress > TCP_SEND_TIMEOUT_MS) {
+      Serial.printf("TCP send stalled, %lu bytes unacknowledged\n", (unsigned long)tcpUnacked);
+      return false;
+    }
+    
+    if (tcpUnacked > maxUnacked) {
+      stalled = true;
+      delay(TCP_ACK_POLL_MS);
+    }
+  }
   
-  if (response.indexOf(">") == -1) {
+  if (stalled) {
+    tcpSendStats.windowStalls++;
+  }
+  return true;
+}
+
+// One packet after the prompt; with quick send the modem takes it into its
+// buffer and answers at once
+static bool sendTCPPacket(const uint8_t* data, size_t length) {
+  if (!sendATPrompt("AT+CIPSEND=" + String((unsigned long)length), 5000)) {
     return false;
   }
   
-  // Send the actual data
-  simSerial.print(data);
-  delay(500);
+  const char* finalLine = tcpQuickSend ? TCP_ACCEPT_LINE : "SEND OK";
+  String response = sendATData(data, length, TCP_SEND_TIMEOUT_MS, finalLine, "SEND FAIL");
+  if (response.indexOf(finalLine) == -1) {
+    return false;
+  }
   
-  // Wait for SEND OK
-  response = "";
-  unsigned long startTime = millis();
+  tcpUnacked += length;
+  tcpSendStats.packets++;
+  return true;
+}
+
+// Packets from the source's current position; with drain, wait until the
+// server has acknowledged everything
+static bool streamTCPData(UploadSource& source, size_t total, bool drain) {
+  ModemLock lock;
+  if (!lock.isLocked()) {
+    return false;
+  }
   
-  while (millis() - startTime < 10000) {
-    if (simSerial.available()) {
-      char c = simSerial.read();
-      response += c;
-      
-      if (response.indexOf("SEND OK") != -1) {
-        Serial.println("TCP data sent successfully");
-        return true;
-      }
-      
-      if (response.indexOf("SEND FAIL") != -1 || response.indexOf("ERROR") != -1) {
-        Serial.println("Failed to send TCP data");
-        return false;
-      }
+  unsigned long start = micros();
+  size_t sent = 0;
+  while (sent < total) {
+    size_t n = source.read(tcpPacket, min(tcpPacketSize, total - sent));
+    if (n == 0) {
+      Serial.println("TCP source read failed");
+      return false;
+    }
+    
+    // Keep sending while the modem still has room for the packet
+    if (tcpQuickSend && tcpUnacked + n > TCP_SEND_WINDOW && !waitTcpWindow(TCP_SEND_WINDOW - n)) {
+      return false;
     }
-    yield();
+    
+    if (!sendTCPPacket(tcpPacket, n)) {
+      Serial.printf("Failed to send TCP data after %u of %u bytes\n", (unsigned)sent, (unsigned)total);
+      return false;
+    }
+    sent += n;
   }
   
-  Serial.println("TCP send timeout");
-  return false;
+  // Done once the server has everything, not when the modem has buffered it
+  if (drain && tcpQuickSend && !waitTcpWindow(0)) {
+    return false;
+  }
+  
+  unsigned long elapsed = micros() - start;
+  tcpSendStats.bytes += total;
+  tcpSendStats.micros += elapsed;
+  if (drain) {
+    Serial.printf("TCP sent %u bytes in %lu ms (%lu B/s)\n", (unsigned)total, elapsed / 1000,
+                  elapsed ? (unsigned long)((uint64_t)total * 1000000 / elapsed) : 0UL);
+  }
+  return true;
 }
 
-String receiveTCPData(int timeout) {
-  String data = "";
-  unsigned long startTime = millis();
-  
-  while (millis() - startTime < timeout) {
-    if (simSerial.available()) {
-      char c = simSerial.read();
-      data += c;
-      
-      // Check for the pattern: +CIPRCV: len,data
-      if (data.indexOf("+CIPRCV:") != -1 && data.endsWith("\r\n")) {
-        int dataStart = data.indexOf(",");
-        if (dataStart != -1) {
-          data = data.substring(dataStart + 1);
-          data.trim();
-          return data;
-        }
-      }
+bool sendTCPData(UploadSource& source) {
+  return source.seek(0) && streamTCPData(source, source.size(), true);
+}
+
+bool sendTCPData(const uint8_t* data, size_t length) {
+  BufferUploadSource source(data, length);
+  return sendTCPData(source);
+}
+
+bool writeTCPData(const uint8_t* data, size_t length) {
+  BufferUploadSource source(data, length);
+  return streamTCPData(source, length, false);
+}
+
+size_t getTCPPacketSize() {
+  return tcpPacketSize;
+}
+
+bool sendTCPData(const String& data) {
+  return sendTCPData((const uint8_t*)data.c_str(), data.length());
+}
+
+void printTcpSendStats() {
+  const TcpSendStats& stats = tcpSendStats;
+  Serial.printf("TCP send: %lu packets, %llu bytes, %lu B/s, %lu ACK polls, %lu window stalls\n",
+                (unsigned long)stats.packets, (unsigned long long)stats.bytes,
+                stats.micros ? (unsigned long)(stats.bytes * 1000000 / stats.micros) : 0UL,
+                (unsigned long)stats.ackPolls, (unsigned long)stats.windowStalls);
+}
+
+bool isTCPConnected() {
+  return tcpOpen;
+}
+
+bool hasTCPData() {
+  return tcpDataPending;
+}
+
+bool waitTCPData(unsigned long timeout) {
+  unsigned long start = millis();
+  while (!tcpDataPending && tcpOpen) {
+    unsigned long elapsed = millis() - start;
+    if (elapsed >= timeout) {
+      return false;
     }
-    yield();
+    xSemaphoreTake(tcpDataSignal, pdMS_TO_TICKS(timeout - elapsed));
+  }
+  return tcpDataPending;
+}
+
+int readTCPData(uint8_t* buffer, size_t length) {
+  length = min(length, (size_t)TCP_MAX_PACKET_SIZE);
+  
+  // Cleared first: a URC for data arriving during the read sets it again
+  tcpDataPending = false;
+  
+  // "+CIPRXGET: 2,<read>,<left>" and then the data
+  AtCommand at("AT+CIPRXGET=2," + String((unsigned long)length));
+  at.rawLine = "+CIPRXGET:";
+  at.rawBuffer = buffer;
+  at.rawCapacity = length;
+  AtStatus status = AT_ERROR;
+  String response = executeLocked(at, &status);
+  if (status != AT_OK) {
+    return -1;
   }
   
+  AtSlice line;
+  AtFields fields;
+  if (!findResponseLine(response, "+CIPRXGET: 2", line) || !fields.parse(line, "+CIPRXGET:")) {
+    return 0;
+  }
+  if (fields.getInt(2, 0) > 0) {
+    tcpDataPending = true;
+  }
+  return min((size_t)fields.getInt(1, 0), length);
+}
+
+String receiveTCPData(int timeout) {
+  ModemLock lock;
+  if (!lock.isLocked() || !waitTCPData(timeout)) {
+    return "";
+  }
+  
+  int n = readTCPData(tcpPacket, sizeof(tcpPacket));
+  String data;
+  if (n > 0) {
+    data.concat((const char*)tcpPacket, n);
+  }
+  data.trim();
   return data;
 }
 
 bool httpGet(const String& url, String& response) {
+  ModemLock lock;
+  if (!lock.isLocked()) {
+    return false;
+  }
   if (!cellularConnected && !connectCellular()) {
     return false;
   }
@@ -267,10 +763,10 @@ bool httpGet(const String& url, String& response) {
   sendATCommand("AT+HTTPPARA=\"URL\",\"" + url + "\"");
   
   // Execute GET request
-  String result = sendATCommand("AT+HTTPACTION=0", 30000);
+  String result = sendATCommandUntil("AT+HTTPACTION=0", "+HTTPACTION:", 30000);
   
   // Check for success (200 OK)
-  if (result.indexOf("+HTTPACTION: 0,200") == -1) {
+  if (getHttpActionStatus(result) != 200) {
     sendATCommand("AT+HTTPTERM");
     return false;
   }
@@ -291,6 +787,10 @@ bool httpGet(const String& url, String& response) {
 }
 
 bool httpPost(const String& url, const String& contentType, const String& data, String& response) {
+  ModemLock lock;
+  if (!lock.isLocked()) {
+    return false;
+  }
   if (!cellularConnected && !connectCellular()) {
     return false;
   }
@@ -307,22 +807,21 @@ bool httpPost(const String& url, const String& contentType, const String& data,
   
   // Prepare to send data
   String cmd = "AT+HTTPDATA=" + String(data.length()) + ",10000";
-  String result = sendATCommand(cmd);
+  String result = sendATCommandUntil(cmd, "DOWNLOAD");
   
   if (result.indexOf("DOWNLOAD") == -1) {
     sendATCommand("AT+HTTPTERM");
     return false;
   }
   
-  // Send data
-  simSerial.print(data);
-  delay(500);
+  // Send data, the modem answers OK once it has all of it
+  sendATData((const uint8_t*)data.c_str(), data.length(), 10000);
   
   // Execute POST request
-  result = sendATCommand("AT+HTTPACTION=1", 30000);
+  result = sendATCommandUntil("AT+HTTPACTION=1", "+HTTPACTION:", 30000);
   
   // Check for success (200 OK)
-  if (result.indexOf("+HTTPACTION: 1,200") == -1) {
+  if (getHttpActionStatus(result) != 200) {
     sendATCommand("AT+HTTPTERM");
     return false;
   }
@@ -2,6 +2,8 @@
 #define CELLULAR_H
 
 #include <Arduino.h>
+#include "config.h"
+#include "upload_source.h"
 
 // Initialize the SIM7000G cellular module
 bool initCellular();
@@ -15,14 +17,82 @@ void disconnectCellular();
 // Check if cellular is connected
 bool isCellularConnected();
 
+// Registered on the network (GSM, LTE-M or NB-IoT), as last reported by the
+// modem; no AT round trip
+bool isCellularRegistered();
+
+// Wait for network registration without opening the data bearer (enough for SMS)
+bool registerCellular();
+
+// Resolve a host name through the modem, a cheap check that data gets through
+bool resolveHost(const String& host);
+
+// The modem is shared by the main loop and the upload task; hold the lock
+// across any exchange of more than one command
+bool lockModem(unsigned long timeout = CELLULAR_TIMEOUT_MS);
+void unlockModem();
+
+// Holds the modem lock for a scope
+class ModemLock {
+public:
+  explicit ModemLock(unsigned long timeout = CELLULAR_TIMEOUT_MS) : locked(lockModem(timeout)) {}
+  ~ModemLock() { if (locked) unlockModem(); }
+  bool isLocked() const { return locked; }
+
+private:
+  bool locked;
+};
+
 // Send an AT command and return the response
 String sendATCommand(const String& command, unsigned long timeout = 3000);
 
+// Same, for commands whose result is a later line (CONNECT OK, +HTTPACTION:)
+// rather than OK
+String sendATCommandUntil(const String& command, const char* finalLine, unsigned long timeout = 3000,
+                          const char* failLine = NULL);
+
+// Send a command that answers with the "> " data prompt
+bool sendATPrompt(const String& command, unsigned long timeout = 5000);
+
+// Send raw data after a prompt, waiting for OK or finalLine
+String sendATData(const uint8_t* data, size_t length, unsigned long timeout = 10000,
+                  const char* finalLine = NULL, const char* failLine = NULL);
+
+// Effective send rate counts from the first packet until the server has
+// acknowledged the last byte
+struct TcpSendStats {
+  uint32_t packets;
+  uint64_t bytes;
+  uint64_t micros;
+  uint32_t ackPolls;      // AT+CIPACK queries
+  uint32_t windowStalls;  // Sends that had to wait for the server's ACKs
+};
+
 // TCP/IP functions
 bool connectTCP(const String& host, int port);
 bool disconnectTCP();
+
+// Send binary data in packets of the modem's size, streamed from a source
+// (a file, a buffer) so it never has to be in memory at once
+bool sendTCPData(UploadSource& source);
+bool sendTCPData(const uint8_t* data, size_t length);
 bool sendTCPData(const String& data);
+
+// Queue data on the connection without waiting for the server's ACK, for
+// a stream of writes (the Client adapter); packets of getTCPPacketSize()
+// bytes go out most efficiently
+bool writeTCPData(const uint8_t* data, size_t length);
+size_t getTCPPacketSize();
+
+// Received data stays in the modem until it is read: hasTCPData() is set by
+// the modem's announcement, readTCPData() fetches up to length bytes
+// (0 if none, -1 on error)
+bool isTCPConnected();
+bool hasTCPData();
+bool waitTCPData(unsigned long timeout);
+int readTCPData(uint8_t* buffer, size_t length);
 String receiveTCPData(int timeout = 10000);
+void printTcpSendStats();
 
 // HTTP functions
 bool httpGet(const String& url, String& response);
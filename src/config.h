@@ -32,15 +32,25 @@
 
 // Storage settings
 #define BASE_FILENAME               "capture"
-#define MAX_FILES_PER_SESSION       100             // Maximum files to store before forced upload
-#define SD_CHECK_INTERVAL_MS        60000           // Time between SD card space checks
+#define MAX_FILES_PER_SESSION       100             // Maximum files uploaded in one session
+#define SD_CHECK_INTERVAL_MS        60000           // Time between SD card checks (remount after a fault)
 #define MIN_SD_FREE_SPACE_MB        100             // Minimum free space required on SD
+#define SD_WRITE_CHUNK_SIZE         16384           // Bytes written (and hashed) per SD write
+#define CAPTURE_FILE_EXT            ".jpg"          // Extension of capture files
+#define INTEGRITY_SIDECAR_EXT       ".sum"          // Digest sidecar appended to capture names
+#define INTEGRITY_READ_CHUNK_SIZE   2048            // Read buffer when verifying before upload
+#define QUARANTINE_DIR              "/quarantine"   // Corrupt captures are moved here
+#define UNSYNCED_TIMESTAMP          "unsynced"      // Filename time field before NTP sync
+#define MAX_BACKFILL_CAPTURES       256             // Pre-sync captures remembered for renaming
+#define SPOOL_FRAME_COUNT           7               // Frames kept in PSRAM when the SD card fails (~3 MB)
+#define SPOOL_SLOT_SIZE             (448 * 1024)    // UXGA JPEG buffer (1600x1200/5 = 375 KB) plus headroom
 
 // Time sync settings
 #define NTP_SERVER                  "pool.ntp.org"
 #define NTP_TIMEZONE_OFFSET_SEC     0               // Change according to your timezone
 #define NTP_UPDATE_INTERVAL_MS      86400000        // 24 hours
 #define TIME_FORMAT                 "%Y%m%d_%H%M%S" // Format for filename timestamp
+#define MIN_VALID_EPOCH             1577836800      // 2020-01-01, clock is unset before this
 
 // Weekly photo settings
 #define WEEKLY_PHOTO_DAY            1               // Day of week (0=Sunday, 1=Monday, etc.)
@@ -63,11 +73,93 @@
 #define APN_NAME                    "your-apn-name" // Set your cellular APN
 #define CELLULAR_TIMEOUT_MS         60000           // Timeout for cellular operations
 #define CELLULAR_RETRY_COUNT        3               // Number of retries for cellular operations
+#define CELLULAR_ATTACH_TIMEOUT_MS  30000           // Wait for registration, a cold LTE-M attach is slow
+#define CELLULAR_NETWORK_MODE       2               // AT+CNMP: 2 automatic, 13 GSM only, 38 LTE only
+#define CELLULAR_LTE_MODE           3               // AT+CMNB: 1 LTE-M, 2 NB-IoT, 3 both
+#define MODEM_BAUD                  921600          // Link rate set with AT+IPR, 115200 keeps the modem's default
+#define MODEM_RX_BUFFER_SIZE        8192            // UART driver receive buffer (bytes)
+#define MODEM_RTS_THRESHOLD         100             // RX FIFO fill (of 128) that raises RTS, with flow control wired
+#define AT_QUEUE_LENGTH             8               // AT commands waiting for the modem
+#define AT_ENGINE_STACK_SIZE        4096            // Task that talks to the modem and dispatches URCs
+#define AT_ENGINE_PRIORITY          2               // Above the upload task, so replies are read promptly
+#define MODEM_TASK_STACK_SIZE       16384           // SMS, time sync and probes off the main loop (probes need TLS)
+#define MODEM_TASK_PRIORITY         1
+#define MODEM_TASK_QUEUE_LENGTH     8               // Modem jobs waiting, e.g. SMS during an event
+
+// Modem simulator, used instead of the SIM7000G when built with -DMODEM_SIMULATOR
+#define MODEM_SIM_LATENCY_MS        150             // Before every answer
+#define MODEM_SIM_BYTES_PER_SECOND  12500           // Uplink, about 100 kbit/s LTE-M
+#define MODEM_SIM_FAILURE_PERCENT   0               // Connects, lookups, sends and SMS that fail
+#define MODEM_SIM_SILENT_PERCENT    0               // Commands that get no answer
+#define MODEM_SIM_RSSI              18              // +CSQ signal value (-77 dBm)
+#define MODEM_SIM_EPOCH             1767225600      // Network clock at boot (2026-01-01 UTC)
+#define MODEM_SIM_TRANSCRIPT        "/modem_sim.txt" // Recorded session replayed first, if present
+
+// Retry settings (the wait doubles per failure up to the cap, with jitter)
+#define CELLULAR_BACKOFF_BASE_MS    30000           // First wait after a failed cellular connect
+#define CELLULAR_BACKOFF_MAX_MS     1800000         // 30 minutes
+#define UPLOAD_BACKOFF_BASE_MS      60000           // First wait after a failed upload probe
+#define UPLOAD_BACKOFF_MAX_MS       3600000         // 1 hour
+#define NTP_BACKOFF_BASE_MS         60000           // First wait after a failed time sync
+#define NTP_BACKOFF_MAX_MS          3600000         // 1 hour
+#define SMS_BACKOFF_BASE_MS         30000           // First wait after a failed SMS
+#define SMS_BACKOFF_MAX_MS          900000          // 15 minutes
+#define UPLOAD_PROBE_TTL_MS         300000          // A successful reachability probe is reused this long
+#define CELLULAR_DNS_TIMEOUT_MS     15000           // Wait for the modem's DNS answer
+#define TCP_MAX_PACKET_SIZE         1460            // Largest AT+CIPSEND, the modem may report less
+#define TCP_SEND_WINDOW             5840            // Unacknowledged bytes the modem may hold (quick send)
+#define TCP_SEND_TIMEOUT_MS         20000           // A TCP send with no progress this long fails
+#define TCP_ACK_POLL_MS             50              // AT+CIPACK interval while the send window is full
 
 // SMS settings
 #define SMS_PHONE_MAX_LENGTH        13              // Max length of phone number
 #define SMS_MESSAGE_MIN_LENGTH      3               // Min length of SMS messages
 #define SMS_MESSAGE_MAX_LENGTH      80              // Max length of SMS messages
+#define SMS_PENDING_MAX             4               // Messages held while SMS backs off, oldest dropped
+#define SMS_UPLOAD_COMMAND          "FULL"          // "FULL <capture or preview name>" sends that original
+
+// Upload settings
+#define DRIVE_UPLOAD_CHUNK_SIZE     (256 * 1024)    // Resumable chunk, must be a multiple of 256 KB
+#define DRIVE_UPLOAD_MAX_STALLS     3               // Chunks without progress before giving up
+#define UPLOAD_SESSION_EXT          ".ses"          // Resumable session sidecar appended to capture names
+#define HTTP_TIMEOUT_MS             30000           // Timeout waiting for an HTTP response
+#define HTTP_WRITE_BUFFER_SIZE      1024            // Buffer used to stream request bodies (one TLS record each)
+#define TLS_CA_FILE                 "/ca.pem"       // PEM root certificates on LittleFS for HTTPS over cellular
+#define TLS_HANDSHAKE_TIMEOUT_S     60              // A handshake over LTE-M takes several round trips
+#define TLS_SESSION_CACHE_SIZE      4               // Hosts whose TLS session is kept for resumption
+#define MODEM_CLIENT_POLL_MS        500             // Ask the modem for TCP data this often if none was announced
+#define READ_AHEAD_BUFFER_COUNT     3               // PSRAM buffers read ahead of the network, 0 to disable
+#define READ_AHEAD_BUFFER_SIZE      (32 * 1024)     // Bytes per read-ahead buffer
+#define READ_AHEAD_TASK_STACK_SIZE  4096            // Stack of the storage reader task
+#define UPLOAD_VERIFY_REMOTE        false           // Ask the server for each file's size (and SHA-256) after upload
+#define UPLOAD_TASK_STACK_SIZE      16384           // Upload task stack (TLS needs a large one)
+#define UPLOAD_TASK_PRIORITY        1               // Runs on core 0 below the WiFi/BLE tasks
+#define UPLOAD_DAILY_BUDGET_BYTES   (20UL << 20)    // Cellular data per day (bytes), 0 for no limit
+#define UPLOAD_MONTHLY_BUDGET_BYTES (400UL << 20)   // Cellular data per month (SIM plan), 0 for no limit
+#define UPLOAD_WEIGHT_RECENCY       1.0f            // Priority for newer captures
+#define UPLOAD_WEIGHT_EVENT_EDGE    2.0f            // Priority for the first/last frame of an event
+#define UPLOAD_WEIGHT_CONFIDENCE    3.0f            // Priority for confident detections
+#define UPLOAD_WEIGHT_SIZE          0.5f            // Priority for small files
+#define UPLOAD_BUNDLE_MODE          false           // Send captures as one tar archive per upload
+#define UPLOAD_BUNDLE_MAX_FILES     50              // Captures per archive
+#define UPLOAD_BUNDLE_MAX_BYTES     (2UL << 20)     // Archive payload limit (bytes)
+#define MAX_CAPTURE_HINTS           512             // Captures whose hints are kept in RAM
+#define PREVIEW_UPLOAD              true            // Send a small preview of every capture first
+#define PREVIEW_FULL_UPLOAD         true            // Then the originals (false: only through uploadCapture())
+#define PREVIEW_SCALE               JPG_SCALE_8X    // Decode scale, 1/8 uses the DC coefficients only
+#define PREVIEW_JPEG_QUALITY        60              // 1-100, higher means higher quality
+#define PREVIEW_MARKER_EXT          ".pv"           // Sidecar left once a capture's preview is uploaded
+#define PREVIEW_FAILED_MARKER       "none"          // Marker contents when no preview could be made
+#define UPLOAD_FOLDER_PER_DAY       true            // Put captures in a remote folder per day (YYYYMMDD)
+#define DRIVE_FOLDER_CACHE_SIZE     8               // Day folder IDs remembered in NVS
+#define UPLOAD_LEDGER_FILE          "/uploaded.log" // Hashes of confirmed uploads, checked before each transfer
+#define UPLOAD_LEDGER_MAX_ENTRIES   50000           // Hashes kept, 8 B each on the card; the table is 1 MB (131072 slots) in PSRAM
+#define UPLOAD_DEDUP_REMOTE         false           // Also ask the server for a matching checksum first
+#define ALERT_FAST_PATH             false           // Send an event's first frame at once from the frame buffer
+#define TRIGGER_CONFIDENCE_PIR      70              // Detection confidence of a PIR trigger
+#define TRIGGER_CONFIDENCE_SOUND    40              // Detection confidence of a sound trigger
+#define OAUTH_TOKEN_MAX_LENGTH      512             // Longest access token kept in RTC memory
+#define OAUTH_REFRESH_MARGIN_SEC    300             // Refresh this long before the token expires
 
 // OTA settings
 #define OTA_TIMEOUT_MS              300000          // 5 minutes timeout for OTA
@@ -0,0 +1,124 @@
+#include "credentials.h"
+#include "storage.h"
+#include <LittleFS.h>
+#include <ArduinoJson.h>
+
+// Credentials storage
+#define CREDENTIALS_FILE "/google_creds.json"
+
+enum CredentialState {
+  CREDENTIALS_UNKNOWN,  // Not read yet
+  CREDENTIALS_MISSING,  // No file, or missing fields
+  CREDENTIALS_VALID
+};
+
+DriveCredentials driveCredentials;
+CredentialState credentialState = CREDENTIALS_UNKNOWN;
+
+static bool isComplete(const DriveCredentials& credentials) {
+  return credentials.clientId.length() > 0 &&
+         credentials.clientSecret.length() > 0 &&
+         credentials.refreshToken.length() > 0 &&
+         credentials.folderId.length() > 0;
+}
+
+static void loadDriveCredentials() {
+  credentialState = CREDENTIALS_MISSING;
+  driveCredentials = DriveCredentials();
+  
+  if (!mountConfigStorage()) {
+    return;
+  }
+  
+  if (!LittleFS.exists(CREDENTIALS_FILE)) {
+    Serial.println("Google Drive credentials not found");
+    return;
+  }
+  
+  File file = LittleFS.open(CREDENTIALS_FILE, "r");
+  if (!file) {
+    Serial.println("Failed to open credentials file");
+    return;
+  }
+  
+  // Check if file is empty or malformed
+  if (file.size() == 0) {
+    file.close();
+    Serial.println("Credentials file is empty");
+    return;
+  }
+  
+  // Parse JSON credentials
+  StaticJsonDocument<512> doc;
+  DeserializationError error = deserializeJson(doc, file);
+  file.close();
+  
+  if (error) {
+    Serial.println("Failed to parse credentials JSON");
+    return;
+  }
+  
+  driveCredentials.clientId = doc["client_id"] | "";
+  driveCredentials.clientSecret = doc["client_secret"] | "";
+  driveCredentials.refreshToken = doc["refresh_token"] | "";
+  driveCredentials.folderId = doc["folder_id"] | "";
+  
+  if (!isComplete(driveCredentials)) {
+    Serial.println("Missing required credential fields");
+    driveCredentials = DriveCredentials();
+    return;
+  }
+  
+  credentialState = CREDENTIALS_VALID;
+}
+
+bool hasDriveCredentials() {
+  if (credentialState == CREDENTIALS_UNKNOWN) {
+    loadDriveCredentials();
+  }
+  return credentialState == CREDENTIALS_VALID;
+}
+
+const DriveCredentials& getDriveCredentials() {
+  hasDriveCredentials();
+  return driveCredentials;
+}
+
+bool storeDriveCredentials(const DriveCredentials& credentials) {
+  if (!mountConfigStorage()) {
+    return false;
+  }
+  
+  // Create JSON document with credentials
+  StaticJsonDocument<512> doc;
+  doc["client_id"] = credentials.clientId;
+  doc["client_secret"] = credentials.clientSecret;
+  doc["refresh_token"] = credentials.refreshToken;
+  doc["folder_id"] = credentials.folderId;
+  
+  // Open file for writing
+  File file = LittleFS.open(CREDENTIALS_FILE, "w");
+  if (!file) {
+    Serial.println("Failed to open credentials file for writing");
+    return false;
+  }
+  
+  // Serialize JSON to file
+  if (serializeJson(doc, file) == 0) {
+    Serial.println("Failed to write credentials to file");
+    file.close();
+    invalidateDriveCredentials();
+    return false;
+  }
+  
+  file.close();
+  
+  driveCredentials = credentials;
+  credentialState = isComplete(credentials) ? CREDENTIALS_VALID : CREDENTIALS_MISSING;
+  return true;
+}
+
+void invalidateDriveCredentials() {
+  driveCredentials = DriveCredentials();
+  credentialState = CREDENTIALS_UNKNOWN;
+}
@@ -0,0 +1,27 @@
+#ifndef CREDENTIALS_H
+#define CREDENTIALS_H
+
+#include <Arduino.h>
+
+// Google Drive credentials, read from LittleFS once and kept in RAM
+
+struct DriveCredentials {
+  String clientId;
+  String clientSecret;
+  String refreshToken;
+  String folderId;
+};
+
+// Check if complete credentials are stored (loads them on first use)
+bool hasDriveCredentials();
+
+// Loaded credentials, empty when none are stored
+const DriveCredentials& getDriveCredentials();
+
+// Write new credentials to flash and replace the copy in RAM
+bool storeDriveCredentials(const DriveCredentials& credentials);
+
+// Drop the copy in RAM so the next use reads flash again
+void invalidateDriveCredentials();
+
+#endif // CREDENTIALS_H
@@ -0,0 +1,159 @@
+#include "drive_folders.h"
+#include "config.h"
+#include <ArduinoJson.h>
+#include <Preferences.h>
+
+#define DRIVE_API_HOST "www.googleapis.com"
+#define DRIVE_FILES_PATH "/drive/v3/files"
+#define DRIVE_FOLDER_MIME_TYPE "application/vnd.google-apps.folder"
+
+// The most recent days, kept as one NVS blob
+struct FolderCacheEntry {
+  char day[16];
+  char id[64];
+};
+
+struct FolderCache {
+  FolderCacheEntry entries[DRIVE_FOLDER_CACHE_SIZE];
+  uint8_t next;  // Slot replaced next
+};
+
+FolderCache folderCache;
+bool folderCacheLoaded = false;
+DriveFolderStats folderStats;
+
+static void loadFolderCache() {
+  if (folderCacheLoaded) {
+    return;
+  }
+  folderCacheLoaded = true;
+  memset(&folderCache, 0, sizeof(folderCache));
+  
+  Preferences preferences;
+  if (preferences.begin("gdrive", true)) {
+    if (preferences.getBytesLength("folders") == sizeof(folderCache)) {
+      preferences.getBytes("folders", &folderCache, sizeof(folderCache));
+    }
+    preferences.end();
+  }
+}
+
+static void saveFolderCache() {
+  Preferences preferences;
+  if (preferences.begin("gdrive", false)) {
+    preferences.putBytes("folders", &folderCache, sizeof(folderCache));
+    preferences.end();
+  }
+}
+
+static void rememberFolder(const String& day, const String& folderId) {
+  FolderCacheEntry& entry = folderCache.entries[folderCache.next];
+  strlcpy(entry.day, day.c_str(), sizeof(entry.day));
+  strlcpy(entry.id, folderId.c_str(), sizeof(entry.id));
+  folderCache.next = (folderCache.next + 1) % DRIVE_FOLDER_CACHE_SIZE;
+  saveFolderCache();
+}
+
+static String authHeader(const String& accessToken) {
+  return "Authorization: Bearer " + accessToken + "\r\n";
+}
+
+// Search the parent for a folder of this name, true on a completed request
+static bool findFolder(HttpConnection& http, const String& accessToken, const String& parentId,
+                       const String& day, String& folderId) {
+  String query = "name='" + day + "' and mimeType='" + DRIVE_FOLDER_MIME_TYPE + "' and '" +
+                 parentId + "' in parents and trashed=false";
+  String path = String(DRIVE_FILES_PATH) + "?fields=" + urlEncode("files(id)") + "&q=" + urlEncode(query);
+  
+  HttpResponse response;
+  if (!http.request("GET", DRIVE_API_HOST, 443, path.c_str(), authHeader(accessToken), "", response, 1024) ||
+      response.status != 200) {
+    return false;
+  }
+  
+  DynamicJsonDocument doc(1024);
+  if (deserializeJson(doc, response.body)) {
+    return false;
+  }
+  
+  folderId = doc["files"][0]["id"] | "";
+  return true;
+}
+
+static bool createFolder(HttpConnection& http, const String& accessToken, const String& parentId,
+                         const String& day, String& folderId) {
+  String metadata = "{\"name\":\"" + day + "\",\"mimeType\":\"" + DRIVE_FOLDER_MIME_TYPE +
+                    "\",\"parents\":[\"" + parentId + "\"]}";
+  String headers = authHeader(accessToken) + "Content-Type: application/json; charset=UTF-8\r\n";
+  String path = String(DRIVE_FILES_PATH) + "?fields=id";
+  
+  HttpResponse response;
+  if (!http.request("POST", DRIVE_API_HOST, 443, path.c_str(), headers, metadata, response, 1024) ||
+      response.status != 200) {
+    Serial.printf("Failed to create Drive folder %s (HTTP %d)\n", day.c_str(), response.status);
+    return false;
+  }
+  
+  DynamicJsonDocument doc(512);
+  if (deserializeJson(doc, response.body)) {
+    return false;
+  }
+  
+  folderId = doc["id"] | "";
+  return folderId.length() > 0;
+}
+
+bool getDriveDayFolder(HttpConnection& http, const String& accessToken, const String& parentId,
+                       const String& day, bool create, String& folderId) {
+  loadFolderCache();
+  for (int i = 0; i < DRIVE_FOLDER_CACHE_SIZE; i++) {
+    if (day == folderCache.entries[i].day) {
+      folderStats.hits++;
+      folderId = folderCache.entries[i].id;
+      return true;
+    }
+  }
+  
+  // Look first, the folder may exist from before the cache was cleared
+  if (!findFolder(http, accessToken, parentId, day, folderId)) {
+    folderStats.failures++;
+    return false;
+  }
+  
+  if (folderId.length() > 0) {
+    folderStats.found++;
+  } else if (!create) {
+    return false;
+  } else if (createFolder(http, accessToken, parentId, day, folderId)) {
+    folderStats.created++;
+    Serial.printf("Created Drive folder %s\n", day.c_str());
+  } else {
+    folderStats.failures++;
+    return false;
+  }
+  
+  rememberFolder(day, folderId);
+  return true;
+}
+
+void clearDriveFolderCache() {
+  memset(&folderCache, 0, sizeof(folderCache));
+  folderCacheLoaded = true;
+  saveFolderCache();
+}
+
+const DriveFolderStats& getDriveFolderStats() {
+  return folderStats;
+}
+
+void printDriveFolderStats() {
+  uint32_t lookups = folderStats.hits + folderStats.found + folderStats.created;
+  if (lookups == 0) {
+    return;
+  }
+  
+  Serial.printf("Drive folders: %lu%% cache hits (%lu hits, %lu found, %lu created, %lu failed)\n",
+                (unsigned long)(100 * folderStats.hits / lookups), (unsigned long)folderStats.hits,
+                (unsigned long)folderStats.found, (unsigned long)folderStats.created,
+                (unsigned long)folderStats.failures);
+}
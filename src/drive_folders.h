@@ -0,0 +1,30 @@
+#ifndef DRIVE_FOLDERS_H
+#define DRIVE_FOLDERS_H
+
+#include <Arduino.h>
+#include "http_client.h"
+
+// Per-day Google Drive subfolders, created on demand inside the configured
+// folder. Their IDs are cached in NVS, so only the first upload of a day
+// pays for a lookup or creation round trip.
+
+// Counters since boot
+struct DriveFolderStats {
+  uint32_t hits;      // Served from the cache
+  uint32_t found;     // Looked up on the server
+  uint32_t created;
+  uint32_t failures;
+};
+
+// Get the ID of the subfolder named day (e.g. "20261018") under parentId,
+// creating it if create is set and it doesn't exist yet
+bool getDriveDayFolder(HttpConnection& http, const String& accessToken, const String& parentId,
+                       const String& day, bool create, String& folderId);
+
+// Forget cached IDs (credentials or parent folder changed)
+void clearDriveFolderCache();
+
+const DriveFolderStats& getDriveFolderStats();
+void printDriveFolderStats();
+
+#endif // DRIVE_FOLDERS_H
@@ -0,0 +1,260 @@
+#include "drive_resumable.h"
+#include "storage.h"
+#include "upload_task.h"
+#include "config.h"
+
+#define DRIVE_UPLOAD_HOST "www.googleapis.com"
+#define DRIVE_UPLOAD_PATH "/upload/drive/v3/files?uploadType=resumable"
+
+String getUploadSessionPath(const char* capturePath) {
+  return String(capturePath) + UPLOAD_SESSION_EXT;
+}
+
+// Session file: "<committed offset> <session URI>\n"
+static bool loadSession(const char* sessionPath, String& uri, size_t& offset) {
+  StorageFilePtr file = getStorageBackend()->open(sessionPath, STORAGE_READ);
+  if (!file) {
+    return false;
+  }
+  
+  char line[512];
+  size_t len = file->read((uint8_t*)line, sizeof(line) - 1);
+  file->close();
+  line[len] = '\0';
+  
+  char* space = strchr(line, ' ');
+  if (!space) {
+    return false;
+  }
+  
+  *space = '\0';
+  offset = strtoul(line, NULL, 10);
+  uri = String(space + 1);
+  uri.trim();
+  return uri.startsWith("https://");
+}
+
+static void saveSession(const char* sessionPath, const String& uri, size_t offset) {
+  if (!sessionPath) {
+    return;
+  }
+  
+  StorageFilePtr file = getStorageBackend()->open(sessionPath, STORAGE_WRITE);
+  if (!file) {
+    return;
+  }
+  
+  String line = String((unsigned long)offset) + " " + uri + "\n";
+  file->write((const uint8_t*)line.c_str(), line.length());
+  file->close();
+}
+
+static void clearSession(const char* sessionPath) {
+  if (sessionPath) {
+    getStorageBackend()->remove(sessionPath);
+  }
+}
+
+// Committed bytes from a 308 response ("Range: bytes=0-1234" -> 1235)
+static size_t committedBytes(const HttpResponse& response) {
+  int dash = response.range.lastIndexOf('-');
+  if (dash == -1) {
+    return 0;
+  }
+  return strtoul(response.range.c_str() + dash + 1, NULL, 10) + 1;
+}
+
+static String authHeader(const String& accessToken) {
+  return "Authorization: Bearer " + accessToken + "\r\n";
+}
+
+// Start a session, returns the session URI
+static DriveUploadResult createSession(HttpConnection& http, const String& accessToken,
+                                       const String& name, const String& folderId,
+                                       const char* mimeType, size_t total, String& uri) {
+  String metadata = "{\"name\":\"" + name + "\",\"parents\":[\"" + folderId + "\"]}";
+  String headers = authHeader(accessToken);
+  headers += "Content-Type: application/json; charset=UTF-8\r\n";
+  headers += "X-Upload-Content-Type: " + String(mimeType) + "\r\n";
+  headers += "X-Upload-Content-Length: " + String((unsigned long)total) + "\r\n";
+  
+  HttpResponse response;
+  if (!http.request("POST", DRIVE_UPLOAD_HOST, 443, DRIVE_UPLOAD_PATH, headers, metadata, response)) {
+    return DRIVE_UPLOAD_INTERRUPTED;
+  }
+  
+  if (response.status == 401) {
+    return DRIVE_UPLOAD_UNAUTHORIZED;
+  }
+  
+  if (response.status != 200 || response.location.length() == 0) {
+    Serial.printf("Drive session not created (HTTP %d)\n", response.status);
+    return DRIVE_UPLOAD_FAILED;
+  }
+  
+  uri = response.location;
+  return DRIVE_UPLOAD_OK;
+}
+
+// Ask the server how much of an existing session it has
+static DriveUploadResult querySession(HttpConnection& http, const String& uri, size_t total,
+                                      size_t& offset, bool& complete) {
+  String host, path;
+  uint16_t port;
+  if (!splitUrl(uri, host, path, port)) {
+    return DRIVE_UPLOAD_FAILED;
+  }
+  
+  String headers = "Content-Range: bytes */" + String((unsigned long)total) + "\r\n";
+  
+  HttpResponse response;
+  if (!http.request("PUT", host.c_str(), port, path.c_str(), headers, "", response)) {
+    return DRIVE_UPLOAD_INTERRUPTED;
+  }
+  
+  complete = (response.status == 200 || response.status == 201);
+  if (complete) {
+    offset = total;
+    return DRIVE_UPLOAD_OK;
+  }
+  
+  if (response.status == 308) {
+    offset = committedBytes(response);
+    return DRIVE_UPLOAD_OK;
+  }
+  
+  // 404/410: the session expired (they last about a week)
+  return DRIVE_UPLOAD_FAILED;
+}
+
+// Send one chunk, returns the new committed offset
+static DriveUploadResult sendChunk(HttpConnection& http, const String& uri, UploadSource& source,
+                                   size_t offset, size_t total, size_t& committed, bool& complete) {
+  String host, path;
+  uint16_t port;
+  if (!splitUrl(uri, host, path, port)) {
+    return DRIVE_UPLOAD_FAILED;
+  }
+  
+  size_t chunkLen = min((size_t)DRIVE_UPLOAD_CHUNK_SIZE, total - offset);
+  String headers = "Content-Range: bytes " + String((unsigned long)offset) + "-" +
+                   String((unsigned long)(offset + chunkLen - 1)) + "/" +
+                   String((unsigned long)total) + "\r\n";
+  
+  if (!source.seek(offset)) {
+    return DRIVE_UPLOAD_FAILED;
+  }
+  
+  if (!http.connect(host.c_str(), port) ||
+      !http.beginRequest("PUT", host.c_str(), path.c_str(), headers, chunkLen)) {
+    return DRIVE_UPLOAD_INTERRUPTED;
+  }
+  
+  uint8_t buffer[HTTP_WRITE_BUFFER_SIZE];
+  size_t sent = 0;
+  while (sent < chunkLen) {
+    size_t n = source.read(buffer, min(sizeof(buffer), chunkLen - sent));
+    if (n == 0) {
+      http.stop();
+      return DRIVE_UPLOAD_FAILED;
+    }
+    if (!http.write(buffer, n)) {
+      return DRIVE_UPLOAD_INTERRUPTED;
+    }
+    sent += n;
+  }
+  
+  HttpResponse response;
+  if (!http.readResponse(response)) {
+    return DRIVE_UPLOAD_INTERRUPTED;
+  }
+  
+  complete = (response.status == 200 || response.status == 201);
+  if (complete) {
+    committed = total;
+    return DRIVE_UPLOAD_OK;
+  }
+  
+  if (response.status == 308) {
+    committed = committedBytes(response);
+    return DRIVE_UPLOAD_OK;
+  }
+  
+  if (response.status == 401) {
+    return DRIVE_UPLOAD_UNAUTHORIZED;
+  }
+  
+  // 5xx: keep the session and resume later
+  if (response.status >= 500) {
+    return DRIVE_UPLOAD_INTERRUPTED;
+  }
+  
+  Serial.printf("Drive chunk rejected (HTTP %d)\n", response.status);
+  return DRIVE_UPLOAD_FAILED;
+}
+
+DriveUploadResult driveResumableUpload(HttpConnection& http, const String& accessToken,
+                                       const String& name, const String& folderId,
+                                       const char* mimeType, UploadSource& source,
+                                       const char* sessionPath) {
+  size_t total = source.size();
+  if (total == 0) {
+    return DRIVE_UPLOAD_FAILED;
+  }
+  
+  String uri;
+  size_t offset = 0;
+  bool complete = false;
+  DriveUploadResult result;
+  
+  // Pick up an earlier session for this file
+  if (sessionPath && loadSession(sessionPath, uri, offset)) {
+    result = querySession(http, uri, total, offset, complete);
+    if (result == DRIVE_UPLOAD_INTERRUPTED) {
+      return result;
+    }
+    if (result == DRIVE_UPLOAD_FAILED) {
+      Serial.println("Upload session expired, starting over");
+      clearSession(sessionPath);
+      uri = "";
+      offset = 0;
+    } else {
+      Serial.printf("Resuming %s at %u/%u bytes\n", name.c_str(), (unsigned)offset, (unsigned)total);
+    }
+  }
+  
+  if (uri.length() == 0) {
+    result = createSession(http, accessToken, name, folderId, mimeType, total, uri);
+    if (result != DRIVE_UPLOAD_OK) {
+      return result;
+    }
+    saveSession(sessionPath, uri, 0);
+  }
+  
+  int stalls = 0;
+  while (!complete) {
+    // Chunk boundaries are where new activity can take the modem back
+    if (isUploadPauseRequested()) {
+      return DRIVE_UPLOAD_PAUSED;
+    }
+    
+    size_t committed = offset;
+    result = sendChunk(http, uri, source, offset, total, committed, complete);
+    if (result != DRIVE_UPLOAD_OK) {
+      return result;
+    }
+    
+    // The server may commit less than was sent, resend from its offset
+    if (committed > offset) {
+      offset = committed;
+      saveSession(sessionPath, uri, offset);
+      stalls = 0;
+    } else if (!complete && ++stalls >= DRIVE_UPLOAD_MAX_STALLS) {
+      Serial.println("Drive upload is not making progress");
+      return DRIVE_UPLOAD_INTERRUPTED;
+    }
+  }
+  
+  clearSession(sessionPath);
+  return DRIVE_UPLOAD_OK;
+}
@@ -0,0 +1,29 @@
+#ifndef DRIVE_RESUMABLE_H
+#define DRIVE_RESUMABLE_H
+
+#include <Arduino.h>
+#include "http_client.h"
+#include "upload_source.h"
+
+// Google Drive resumable upload protocol
+
+enum DriveUploadResult {
+  DRIVE_UPLOAD_OK,
+  DRIVE_UPLOAD_UNAUTHORIZED,  // Access token rejected, refresh and retry
+  DRIVE_UPLOAD_INTERRUPTED,   // Connection lost, the session can be resumed
+  DRIVE_UPLOAD_PAUSED,        // Stopped between chunks on request, resume later
+  DRIVE_UPLOAD_FAILED         // Rejected by the server
+};
+
+// Upload a source in DRIVE_UPLOAD_CHUNK_SIZE chunks. If sessionPath is set,
+// the session URI and committed offset are kept in that file so the upload
+// continues from the last acknowledged byte after a dropout or reboot.
+DriveUploadResult driveResumableUpload(HttpConnection& http, const String& accessToken,
+                                       const String& name, const String& folderId,
+                                       const char* mimeType, UploadSource& source,
+                                       const char* sessionPath);
+
+// Session file for a capture ("<capture>.ses")
+String getUploadSessionPath(const char* capturePath);
+
+#endif // DRIVE_RESUMABLE_H
@@ -1,245 +1,333 @@
 #include "google_drive.h"
-#include "storage.h"
+#include "drive_resumable.h"
+#include "drive_folders.h"
+#include "http_client.h"
+#include "token_cache.h"
+#include "credentials.h"
 #include "cellular.h"
-#include "led_control.h"
 #include "config.h"
-#include <LittleFS.h>
 #include <ArduinoJson.h>
 #include <GDrive.h>
 
-// Credentials storage
-#define CREDENTIALS_FILE "/google_creds.json"
+// OAuth token endpoint
+#define OAUTH_TOKEN_HOST "oauth2.googleapis.com"
+#define OAUTH_TOKEN_PATH "/token"
+
+// Drive metadata API
+#define DRIVE_API_HOST "www.googleapis.com"
+#define DRIVE_FILES_PATH "/drive/v3/files"
 
 // Google Drive API parameters
 GDrive gDrive;
 bool driveInitialized = false;
 
-// Google Drive credentials
-String client_id;
-String client_secret;
-String refresh_token;
-String folder_id;
+// Resumable uploads over the HTTPS transport, when one is available
+HttpConnection driveHttp;
+
+bool requestAccessToken(String& token, uint32_t& expiresIn);
 
 bool isGoogleDriveConfigured() {
-  if (!LittleFS.begin(true)) {
-    Serial.println("Failed to mount LittleFS");
+  return hasDriveCredentials();
+}
+
+bool initGoogleDrive() {
+  if (!hasDriveCredentials()) {
     return false;
   }
   
-  if (!LittleFS.exists(CREDENTIALS_FILE)) {
-    Serial.println("Google Drive credentials not found");
-    return false;
+  const DriveCredentials& credentials = getDriveCredentials();
+  
+  // Initialize Google Drive client once per set of credentials
+  if (!driveInitialized) {
+    gDrive.begin(credentials.clientId.c_str(), credentials.clientSecret.c_str(),
+                 credentials.refreshToken.c_str());
+    initTokenCache(requestAccessToken);
   }
   
-  File file = LittleFS.open(CREDENTIALS_FILE, "r");
-  if (!file) {
-    Serial.println("Failed to open credentials file");
-    return false;
+  // With our own transport, a valid token proves the credentials work;
+  // a cached one costs no round trip
+  if (getHttpsClient()) {
+    String token;
+    if (!getAccessToken(token)) {
+      Serial.println("Failed to get a Google Drive access token");
+      return false;
+    }
   }
   
-  // Check if file is empty or malformed
-  if (file.size() == 0) {
-    file.close();
-    Serial.println("Credentials file is empty");
+  driveInitialized = true;
+  Serial.println("Google Drive initialized successfully");
+  return true;
+}
+
+// Exchange the refresh token for an access token, called by the token cache
+bool requestAccessToken(String& token, uint32_t& expiresIn) {
+  driveHttp.setClient(getHttpsClient());
+  
+  const DriveCredentials& credentials = getDriveCredentials();
+  String body = "client_id=" + urlEncode(credentials.clientId) +
+                "&client_secret=" + urlEncode(credentials.clientSecret) +
+                "&refresh_token=" + urlEncode(credentials.refreshToken) +
+                "&grant_type=refresh_token";
+  String headers = "Content-Type: application/x-www-form-urlencoded\r\n";
+  
+  HttpResponse response;
+  if (!driveHttp.request("POST", OAUTH_TOKEN_HOST, 443, OAUTH_TOKEN_PATH, headers, body, response, 2048)) {
+    Serial.println("Failed to reach OAuth server");
     return false;
   }
   
-  // Parse JSON credentials
-  StaticJsonDocument<512> doc;
-  DeserializationError error = deserializeJson(doc, file);
-  file.close();
-  
-  if (error) {
-    Serial.println("Failed to parse credentials JSON");
+  if (response.status != 200) {
+    Serial.printf("Access token refresh failed (HTTP %d)\n", response.status);
     return false;
   }
   
-  // Check if all required fields are present
-  if (!doc.containsKey("client_id") || 
-      !doc.containsKey("client_secret") || 
-      !doc.containsKey("refresh_token") || 
-      !doc.containsKey("folder_id")) {
-    Serial.println("Missing required credential fields");
+  DynamicJsonDocument doc(2048);
+  if (deserializeJson(doc, response.body)) {
+    Serial.println("Failed to parse token response");
     return false;
   }
   
-  // Everything looks valid
-  return true;
+  token = doc["access_token"] | "";
+  expiresIn = doc["expires_in"] | 3600;
+  return token.length() > 0;
 }
 
-bool initGoogleDrive() {
-  if (!LittleFS.begin(true)) {
-    Serial.println("Failed to mount LittleFS");
+// Split "20261018/capture.jpg" into the day's subfolder ID and the file name;
+// names without a folder, or without our own transport, use the configured folder
+bool resolveDriveTarget(const String& name, bool create, String& folderId, String& basename) {
+  int slash = name.indexOf('/');
+  basename = slash == -1 ? name : name.substring(slash + 1);
+  folderId = getDriveCredentials().folderId;
+  if (slash == -1 || !getHttpsClient()) {
+    return true;
+  }
+  
+  String accessToken;
+  if (!getAccessToken(accessToken)) {
     return false;
   }
   
-  if (!LittleFS.exists(CREDENTIALS_FILE)) {
-    Serial.println("Google Drive credentials not found");
+  driveHttp.setClient(getHttpsClient());
+  return getDriveDayFolder(driveHttp, accessToken, folderId, name.substring(0, slash), create, folderId);
+}
+
+// Upload through a resumable session, refreshing the token or resuming as needed
+bool uploadSourceResumable(const String& basename, const String& folderId, UploadSource& source,
+                           const char* sessionPath) {
+  const char* mimeType = getUploadMimeType(basename);
+  driveHttp.setClient(getHttpsClient());
+  
+  String accessToken;
+  if (!getAccessToken(accessToken)) {
     return false;
   }
   
-  File file = LittleFS.open(CREDENTIALS_FILE, "r");
-  if (!file) {
-    Serial.println("Failed to open credentials file");
+  bool refreshed = false;
+  int interruptions = 0;
+  
+  while (true) {
+    DriveUploadResult result = driveResumableUpload(driveHttp, accessToken, basename, folderId,
+                                                    mimeType, source, sessionPath);
+    switch (result) {
+      case DRIVE_UPLOAD_OK:
+        return true;
+        
+      case DRIVE_UPLOAD_UNAUTHORIZED:
+        // Only one refresh per file, a second 401 means the credentials are bad
+        if (refreshed || !renewAccessToken(accessToken, accessToken)) {
+          return false;
+        }
+        refreshed = true;
+        break;
+        
+      case DRIVE_UPLOAD_INTERRUPTED:
+        // The committed offset is kept, so a retry sends only the rest
+        if (++interruptions > CELLULAR_RETRY_COUNT) {
+          Serial.println("Upload interrupted, will resume later");
+          return false;
+        }
+        Serial.println("Upload interrupted, resuming");
+        if (!isCellularConnected() && !connectCellular()) {
+          return false;
+        }
+        break;
+        
+      case DRIVE_UPLOAD_PAUSED:
+        Serial.println("Upload paused, will resume later");
+        return false;
+        
+      case DRIVE_UPLOAD_FAILED:
+      default:
+        return false;
+    }
+  }
+}
+
+// DNS, then the folder's id: one small authenticated request that proves
+// the token, the folder and the data path all work
+bool probeGoogleDrive() {
+  if (!resolveHost(DRIVE_API_HOST)) {
     return false;
   }
   
-  // Parse JSON credentials
-  StaticJsonDocument<512> doc;
-  DeserializationError error = deserializeJson(doc, file);
-  file.close();
+  // Without our own transport the library does its own requests
+  if (!getHttpsClient()) {
+    return true;
+  }
   
-  if (error) {
-    Serial.println("Failed to parse credentials JSON");
+  String accessToken;
+  if (!getAccessToken(accessToken)) {
     return false;
   }
   
-  // Extract credentials
-  client_id = doc["client_id"].as<String>();
-  client_secret = doc["client_secret"].as<String>();
-  refresh_token = doc["refresh_token"].as<String>();
-  folder_id = doc["folder_id"].as<String>();
+  String path = String(DRIVE_FILES_PATH) + "/" + urlEncode(getDriveCredentials().folderId) + "?fields=id";
+  String headers = "Authorization: Bearer " + accessToken + "\r\n";
   
-  // Initialize Google Drive client
-  gDrive.begin(client_id.c_str(), client_secret.c_str(), refresh_token.c_str());
+  driveHttp.setClient(getHttpsClient());
+  HttpResponse response;
+  if (!driveHttp.request("GET", DRIVE_API_HOST, 443, path.c_str(), headers, "", response, 256)) {
+    return false;
+  }
   
-  driveInitialized = true;
-  Serial.println("Google Drive initialized successfully");
+  if (response.status != 200) {
+    Serial.printf("Drive probe failed (HTTP %d)\n", response.status);
+    return false;
+  }
   return true;
 }
 
-bool uploadFilesToGoogleDrive() {
-  if (!driveInitialized && !initGoogleDrive()) {
-    Serial.println("Google Drive not initialized");
+// Look for a file of this name in the folder with the same size and, unless
+// sha256 is NULL, the same SHA-256
+bool findDriveFile(const String& name, const uint8_t* sha256, size_t size) {
+  if (!getHttpsClient()) {
     return false;
   }
   
-  if (!isCellularConnected() && !connectCellular()) {
-    Serial.println("Failed to connect cellular for upload");
+  // A day folder that doesn't exist yet can't hold the file
+  String folderId, basename;
+  if (!resolveDriveTarget(name, false, folderId, basename)) {
     return false;
   }
   
-  // Get file count
-  int fileCount = getFileCount();
-  if (fileCount == 0) {
-    Serial.println("No files to upload");
-    return true;  // Not an error
+  String accessToken;
+  if (!getAccessToken(accessToken)) {
+    return false;
   }
   
-  Serial.printf("Found %d files to upload\n", fileCount);
-  
-  // Iterate through files and upload each one
-  bool allSuccess = true;
+  String query = "name='" + basename + "' and '" + folderId + "' in parents and trashed=false";
+  String path = String(DRIVE_FILES_PATH) + "?fields=" + urlEncode("files(size,sha256Checksum)") +
+                "&q=" + urlEncode(query);
+  String headers = "Authorization: Bearer " + accessToken + "\r\n";
   
-  for (int i = 0; i < fileCount; i++) {
-    String filename = getFileName(i);
-    if (filename.length() == 0) {
-      continue;  // Skip if filename is empty
-    }
-    
-    Serial.printf("Uploading file %d/%d: %s\n", i+1, fileCount, filename.c_str());
-    
-    // Update LED to show upload activity
-    setLEDState(LED_UPLOADING);
-    
-    if (!uploadFileToGoogleDrive(filename)) {
-      Serial.printf("Failed to upload file: %s\n", filename.c_str());
-      allSuccess = false;
-    } else {
-      Serial.printf("Successfully uploaded: %s\n", filename.c_str());
-    }
+  driveHttp.setClient(getHttpsClient());
+  HttpResponse response;
+  if (!driveHttp.request("GET", DRIVE_API_HOST, 443, path.c_str(), headers, "", response, 2048) ||
+      response.status != 200) {
+    return false;
   }
   
-  return allSuccess;
-}
-
-bool uploadFileToGoogleDrive(const String& filename) {
-  if (!driveInitialized && !initGoogleDrive()) {
+  DynamicJsonDocument doc(2048);
+  if (deserializeJson(doc, response.body)) {
     return false;
   }
   
-  if (!isCellularConnected() && !connectCellular()) {
-    return false;
+  char hex[65] = "";
+  for (int i = 0; sha256 && i < 32; i++) {
+    sprintf(hex + i * 2, "%02x", sha256[i]);
   }
   
-  if (!SD.exists(filename)) {
-    Serial.printf("File not found: %s\n", filename.c_str());
-    return false;
+  for (JsonObject file : doc["files"].as<JsonArray>()) {
+    // Drive reports sizes as strings
+    String checksum = file["sha256Checksum"] | "";
+    if ((!sha256 || checksum.equalsIgnoreCase(hex)) && strtoul(file["size"] | "0", NULL, 10) == size) {
+      return true;
+    }
   }
+  return false;
+}
+
+// Google Drive as an upload backend
+class DriveUploadBackend : public UploadBackend {
+public:
+  const char* name() override { return "Google Drive"; }
   
-  // Extract just the filename part (without path)
-  String basename = filename;
-  if (basename.startsWith("/")) {
-    basename = basename.substring(1);
+  bool isConfigured() override { return isGoogleDriveConfigured(); }
+  
+  bool begin() override {
+    return driveInitialized || initGoogleDrive();
   }
   
-  // Open the file
-  File file = SD.open(filename, FILE_READ);
-  if (!file) {
-    Serial.printf("Failed to open file: %s\n", filename.c_str());
-    return false;
+  bool probe() override { return probeGoogleDrive(); }
+  
+  bool upload(const String& name, UploadSource& source, const char* localPath) override {
+    String folderId, basename;
+    if (!resolveDriveTarget(name, true, folderId, basename)) {
+      Serial.printf("No Drive folder for %s\n", name.c_str());
+      return false;
+    }
+    
+    // Chunked resumable upload when there is an HTTPS transport; frames
+    // held in memory don't outlive a reboot, so their session isn't persisted
+    if (getHttpsClient()) {
+      String sessionPath = localPath ? getUploadSessionPath(localPath) : String();
+      return uploadSourceResumable(basename, folderId, source, localPath ? sessionPath.c_str() : NULL);
+    }
+    
+    return gDrive.uploadFile(basename.c_str(), getUploadMimeType(name), folderId.c_str(), 
+                             [&source](uint8_t *buffer, size_t bufferSize) -> size_t {
+                               return source.read(buffer, bufferSize);
+                             },
+                             source.size());
   }
   
-  // Get file size
-  size_t fileSize = file.size();
-  if (fileSize == 0) {
-    Serial.println("File is empty");
-    file.close();
-    return false;
+  // Look the file up again: the plain upload doesn't report what the
+  // server stored, and the resumable one is checked the same way
+  bool verify(const String& name, size_t size, const uint8_t* sha256) override {
+    return findDriveFile(name, sha256, size);
   }
   
-  // Set up upload parameters
-  bool result = gDrive.uploadFile(basename.c_str(), "image/jpeg", folder_id.c_str(), 
-                                 [&file](uint8_t *buffer, size_t bufferSize) -> size_t {
-                                   return file.read(buffer, bufferSize);
-                                 },
-                                 fileSize);
+  bool hasRemoteCopy(const String& name, const uint8_t* sha256, size_t size) override {
+    return findDriveFile(name, sha256, size);
+  }
+  
+  void close() override { driveHttp.stop(); }
   
-  file.close();
+  HttpConnection* getConnection() override { return &driveHttp; }
   
-  return result;
+  void printStats() override {
+    printTokenCacheStats();
+    printDriveFolderStats();
+  }
+};
+
+DriveUploadBackend driveBackend;
+
+UploadBackend* getGoogleDriveBackend() {
+  return &driveBackend;
 }
 
 bool saveGoogleDriveCredentials(const String& clientId, const String& clientSecret, 
                                const String& refreshToken, const String& folderId) {
-  if (!LittleFS.begin(true)) {
-    Serial.println("Failed to mount LittleFS");
-    return false;
-  }
-  
-  // Create JSON document with credentials
-  StaticJsonDocument<512> doc;
-  doc["client_id"] = clientId;
-  doc["client_secret"] = clientSecret;
-  doc["refresh_token"] = refreshToken;
-  doc["folder_id"] = folderId;
+  DriveCredentials credentials;
+  credentials.clientId = clientId;
+  credentials.clientSecret = clientSecret;
+  credentials.refreshToken = refreshToken;
+  credentials.folderId = folderId;
   
-  // Open file for writing
-  File file = LittleFS.open(CREDENTIALS_FILE, "w");
-  if (!file) {
-    Serial.println("Failed to open credentials file for writing");
+  if (!storeDriveCredentials(credentials)) {
     return false;
   }
   
-  // Serialize JSON to file
-  if (serializeJson(doc, file) == 0) {
-    Serial.println("Failed to write credentials to file");
-    file.close();
-    return false;
-  }
-  
-  file.close();
-  
-  // Update the global variables
-  client_id = clientId;
-  client_secret = clientSecret;
-  refresh_token = refreshToken;
-  folder_id = folderId;
+  // Tokens issued for the old credentials must not be used, and day
+  // folders may belong to another parent
+  clearAccessToken();
+  clearDriveFolderCache();
+  driveInitialized = false;
   
   Serial.println("Google Drive credentials saved successfully");
   return true;
 }
 
 String getGoogleDriveFolderId() {
-  return folder_id;
+  return getDriveCredentials().folderId;
 }
@@ -2,6 +2,7 @@
 #define GOOGLE_DRIVE_H
 
 #include <Arduino.h>
+#include "upload_backend.h"
 
 // Check if Google Drive credentials are configured
 bool isGoogleDriveConfigured();
@@ -9,11 +10,8 @@ bool isGoogleDriveConfigured();
 // Initialize Google Drive API
 bool initGoogleDrive();
 
-// Upload files to Google Drive
-bool uploadFilesToGoogleDrive();
-
-// Upload a specific file to Google Drive
-bool uploadFileToGoogleDrive(const String& filename);
+// Google Drive as an upload backend
+UploadBackend* getGoogleDriveBackend();
 
 // Save Google Drive credentials to flash storage
 bool saveGoogleDriveCredentials(const String& clientId, const String& clientSecret, const String& refreshToken, const String& folderId);
@@ -0,0 +1,386 @@
+#include "http_client.h"
+#include "config.h"
+
+Client* httpsClient = NULL;
+Client* httpClient = NULL;
+
+void setHttpsClient(Client* client) {
+  httpsClient = client;
+}
+
+Client* getHttpsClient() {
+  return httpsClient;
+}
+
+void setHttpClient(Client* client) {
+  httpClient = client;
+}
+
+Client* getHttpClient() {
+  return httpClient;
+}
+
+String urlEncode(const String& value) {
+  static const char hex[] = "0123456789ABCDEF";
+  String encoded;
+  encoded.reserve(value.length() * 3 / 2);
+  
+  for (size_t i = 0; i < value.length(); i++) {
+    char c = value[i];
+    if (isalnum((unsigned char)c) || c == '-' || c == '_' || c == '.' || c == '~') {
+      encoded += c;
+    } else {
+      encoded += '%';
+      encoded += hex[(c >> 4) & 0x0F];
+      encoded += hex[c & 0x0F];
+    }
+  }
+  
+  return encoded;
+}
+
+bool splitUrl(const String& url, String& host, String& path, uint16_t& port) {
+  int schemeEnd = url.indexOf("://");
+  if (schemeEnd == -1) {
+    return false;
+  }
+  
+  port = url.startsWith("https") ? 443 : 80;
+  
+  int hostStart = schemeEnd + 3;
+  int pathStart = url.indexOf('/', hostStart);
+  String hostPort = pathStart == -1 ? url.substring(hostStart) : url.substring(hostStart, pathStart);
+  path = pathStart == -1 ? "/" : url.substring(pathStart);
+  
+  int colon = hostPort.indexOf(':');
+  if (colon != -1) {
+    port = hostPort.substring(colon + 1).toInt();
+    host = hostPort.substring(0, colon);
+  } else {
+    host = hostPort;
+  }
+  
+  return host.length() > 0;
+}
+
+HttpConnection::HttpConnection() : client(NULL), connectedPort(0), reusedConnection(false),
+                                   headRequest(false), responseStarted(false) {
+  resetStats();
+}
+
+void HttpConnection::resetStats() {
+  memset(&stats, 0, sizeof(stats));
+}
+
+void HttpConnection::setClient(Client* newClient) {
+  if (newClient != client) {
+    stop();
+    client = newClient;
+  }
+}
+
+bool HttpConnection::isConnected() {
+  return client && client->connected();
+}
+
+bool HttpConnection::connect(const char* host, uint16_t port) {
+  if (!client) {
+    return false;
+  }
+  
+  // Keep the open connection if it goes to the same server
+  if (client->connected() && connectedHost == host && connectedPort == port) {
+    reusedConnection = true;
+    return true;
+  }
+  
+  stop();
+  reusedConnection = false;
+  stats.connects++;
+  if (!client->connect(host, port)) {
+    Serial.printf("HTTP connect to %s:%u failed\n", host, port);
+    return false;
+  }
+  
+  connectedHost = host;
+  connectedPort = port;
+  return true;
+}
+
+void HttpConnection::stop() {
+  if (client) {
+    client->stop();
+  }
+  connectedHost = "";
+  connectedPort = 0;
+}
+
+bool HttpConnection::beginRequest(const char* method, const char* host, const char* path,
+                                  const String& extraHeaders, size_t contentLength) {
+  String head = String(method) + " " + path + " HTTP/1.1\r\n";
+  head += "Host: " + String(host) + "\r\n";
+  head += "Connection: keep-alive\r\n";
+  head += "Content-Length: " + String((unsigned long)contentLength) + "\r\n";
+  head += extraHeaders;
+  head += "\r\n";
+  
+  stats.requests++;
+  headRequest = strcmp(method, "HEAD") == 0;
+  responseStarted = false;
+  return write((const uint8_t*)head.c_str(), head.length());
+}
+
+bool HttpConnection::write(const uint8_t* data, size_t len) {
+  if (!client) {
+    return false;
+  }
+  
+  size_t sent = 0;
+  unsigned long lastProgress = millis();
+  
+  while (sent < len) {
+    size_t n = client->write(data + sent, len - sent);
+    if (n > 0) {
+      sent += n;
+      stats.bytesSent += n;
+      lastProgress = millis();
+    } else if (!client->connected() || millis() - lastProgress > HTTP_TIMEOUT_MS) {
+      Serial.println("HTTP write failed");
+      stop();
+      return false;
+    } else {
+      delay(1);
+    }
+  }
+  
+  return true;
+}
+
+int HttpConnection::readByte(unsigned long timeout) {
+  unsigned long start = millis();
+  while (millis() - start < timeout) {
+    if (client->available()) {
+      int c = client->read();
+      if (c >= 0) {
+        stats.bytesReceived++;
+        responseStarted = true;
+      }
+      return c;
+    }
+    if (!client->connected()) {
+      return -1;
+    }
+    delay(1);
+  }
+  return -1;
+}
+
+bool HttpConnection::readLine(String& line, unsigned long timeout) {
+  line = "";
+  while (true) {
+    int c = readByte(timeout);
+    if (c < 0) {
+      return false;
+    }
+    if (c == '\n') {
+      break;
+    }
+    if (c != '\r') {
+      line += (char)c;
+    }
+  }
+  return true;
+}
+
+bool HttpConnection::readResponse(HttpResponse& response, size_t maxBody) {
+  response.status = 0;
+  response.contentLength = -1;
+  response.location = "";
+  response.range = "";
+  response.body = "";
+  response.keepAlive = true;
+  
+  if (!client) {
+    return false;
+  }
+  
+  // Status line: "HTTP/1.1 308 Resume Incomplete"
+  String line;
+  if (!readLine(line, HTTP_TIMEOUT_MS) || !line.startsWith("HTTP/")) {
+    Serial.println("HTTP response timeout");
+    stop();
+    return false;
+  }
+  
+  int space = line.indexOf(' ');
+  response.status = line.substring(space + 1).toInt();
+  
+  // Headers
+  bool chunked = false;
+  while (true) {
+    if (!readLine(line, HTTP_TIMEOUT_MS)) {
+      stop();
+      return false;
+    }
+    if (line.length() == 0) {
+      break;
+    }
+    
+    int colon = line.indexOf(':');
+    if (colon == -1) {
+      continue;
+    }
+    
+    String name = line.substring(0, colon);
+    String value = line.substring(colon + 1);
+    value.trim();
+    name.toLowerCase();
+    
+    if (name == "content-length") {
+      response.contentLength = value.toInt();
+    } else if (name == "location") {
+      response.location = value;
+    } else if (name == "range") {
+      response.range = value;
+    } else if (name == "transfer-encoding") {
+      chunked = value.equalsIgnoreCase("chunked");
+    } else if (name == "connection") {
+      response.keepAlive = !value.equalsIgnoreCase("close");
+    }
+  }
+  
+  // Body, always drained so the connection can be reused
+  long remaining = headRequest ? 0 : response.contentLength;
+  if (chunked && !headRequest) {
+    while (true) {
+      if (!readLine(line, HTTP_TIMEOUT_MS)) {
+        stop();
+        return false;
+      }
+      long chunkLen = strtol(line.c_str(), NULL, 16);
+      if (chunkLen <= 0) {
+        readLine(line, HTTP_TIMEOUT_MS);  // Trailing CRLF
+        break;
+      }
+      for (long i = 0; i < chunkLen; i++) {
+        int c = readByte(HTTP_TIMEOUT_MS);
+        if (c < 0) {
+          stop();
+          return false;
+        }
+        if (response.body.length() < maxBody) {
+          response.body += (char)c;
+        }
+      }
+      readLine(line, HTTP_TIMEOUT_MS);  // CRLF after the chunk
+    }
+  } else if (remaining >= 0) {
+    while (remaining > 0) {
+      int c = readByte(HTTP_TIMEOUT_MS);
+      if (c < 0) {
+        stop();
+        return false;
+      }
+      if (response.body.length() < maxBody) {
+        response.body += (char)c;
+      }
+      remaining--;
+    }
+  } else {
+    // No length, the body runs until the server closes
+    response.keepAlive = false;
+    int c;
+    while ((c = readByte(HTTP_TIMEOUT_MS)) >= 0) {
+      if (response.body.length() < maxBody) {
+        response.body += (char)c;
+      }
+    }
+  }
+  
+  if (!response.keepAlive) {
+    stop();
+  }
+  
+  return true;
+}
+
+// Only a stale kept-alive connection is worth a second try, and only when
+// the server can't have acted on the request or doing so twice is harmless:
+// nothing came back yet and the method is idempotent. A repeated POST would
+// make a second folder or upload session.
+bool HttpConnection::canRetry(const char* method, bool reused) const {
+  if (!reused || responseStarted) {
+    return false;
+  }
+  return strcmp(method, "GET") == 0 || strcmp(method, "HEAD") == 0 || strcmp(method, "PUT") == 0;
+}
+
+bool HttpConnection::request(const char* method, const char* host, uint16_t port, const char* path,
+                             const String& extraHeaders, const String& body, HttpResponse& response,
+                             size_t maxBody) {
+  for (int attempt = 0; attempt < 2; attempt++) {
+    if (!connect(host, port)) {
+      return false;
+    }
+    
+    bool reused = reusedConnection;
+    if (beginRequest(method, host, path, extraHeaders, body.length()) &&
+        (body.length() == 0 || write((const uint8_t*)body.c_str(), body.length())) &&
+        readResponse(response, maxBody)) {
+      return true;
+    }
+    
+    if (!canRetry(method, reused)) {
+      return false;
+    }
+    stop();
+    stats.reconnects++;
+  }
+  
+  return false;
+}
+
+bool HttpConnection::writeSource(UploadSource& source) {
+  if (!source.seek(0)) {
+    return false;
+  }
+  
+  uint8_t buffer[HTTP_WRITE_BUFFER_SIZE];
+  size_t total = source.size();
+  size_t sent = 0;
+  while (sent < total) {
+    size_t n = source.read(buffer, min(sizeof(buffer), total - sent));
+    if (n == 0 || !write(buffer, n)) {
+      return false;
+    }
+    sent += n;
+  }
+  
+  return true;
+}
+
+bool HttpConnection::request(const char* method, const char* host, uint16_t port, const char* path,
+                             const String& extraHeaders, UploadSource& body, HttpResponse& response,
+                             size_t maxBody) {
+  for (int attempt = 0; attempt < 2; attempt++) {
+    if (!connect(host, port)) {
+      return false;
+    }
+    
+    bool reused = reusedConnection;
+    if (beginRequest(method, host, path, extraHeaders, body.size()) &&
+        writeSource(body) &&
+        readResponse(response, maxBody)) {
+      return true;
+    }
+    
+    if (!canRetry(method, reused)) {
+      stop();
+      return false;
+    }
+    stop();
+    stats.reconnects++;
+  }
+  
+  return false;
+}
@@ -0,0 +1,96 @@
+#ifndef HTTP_CLIENT_H
+#define HTTP_CLIENT_H
+
+#include <Arduino.h>
+#include <Client.h>
+#include "upload_source.h"
+
+// Minimal HTTP/1.1 over any Arduino Client (TLS or plain TCP)
+
+// Parsed response, bodies are only kept up to the caller's limit
+struct HttpResponse {
+  int status;
+  long contentLength;
+  String location;
+  String range;
+  String body;
+  bool keepAlive;
+};
+
+// Connection counters, a connect is a TCP (and TLS) handshake
+struct HttpStats {
+  uint32_t connects;
+  uint32_t reconnects;
+  uint32_t requests;
+  uint64_t bytesSent;
+  uint64_t bytesReceived;
+};
+
+class HttpConnection {
+public:
+  HttpConnection();
+  
+  const HttpStats& getStats() const { return stats; }
+  void resetStats();
+  
+  // Transport used for the connection (not owned)
+  void setClient(Client* client);
+  Client* getClient() { return client; }
+  
+  // Connect, reusing an open connection to the same host
+  bool connect(const char* host, uint16_t port);
+  void stop();
+  bool isConnected();
+  
+  // Send the request line and headers; extraHeaders are "Name: value\r\n" lines
+  bool beginRequest(const char* method, const char* host, const char* path,
+                    const String& extraHeaders, size_t contentLength);
+  
+  // Send (part of) the request body
+  bool write(const uint8_t* data, size_t len);
+  
+  // Read status, headers and up to maxBody bytes of body
+  bool readResponse(HttpResponse& response, size_t maxBody = 1024);
+  
+  // Request with an in-memory body, retried once on a fresh connection if
+  // a kept-alive connection fails before any of the response came back
+  // (GET, HEAD and PUT only, a POST is never sent twice)
+  bool request(const char* method, const char* host, uint16_t port, const char* path,
+               const String& extraHeaders, const String& body, HttpResponse& response,
+               size_t maxBody = 1024);
+  
+  // Same, streaming the body from a source in HTTP_WRITE_BUFFER_SIZE pieces
+  bool request(const char* method, const char* host, uint16_t port, const char* path,
+               const String& extraHeaders, UploadSource& body, HttpResponse& response,
+               size_t maxBody = 1024);
+
+private:
+  bool readLine(String& line, unsigned long timeout);
+  int readByte(unsigned long timeout);
+  bool writeSource(UploadSource& source);
+  bool canRetry(const char* method, bool reused) const;
+  
+  Client* client;
+  String connectedHost;
+  uint16_t connectedPort;
+  bool reusedConnection;
+  bool headRequest;  // HEAD responses have no body whatever Content-Length says
+  bool responseStarted;  // A byte of the current response came in
+  HttpStats stats;
+};
+
+// Percent-encode a form or query value
+String urlEncode(const String& value);
+
+// Split "https://host/path" into its parts
+bool splitUrl(const String& url, String& host, String& path, uint16_t& port);
+
+// Transport for HTTPS requests, set up by the network code (NULL if none)
+void setHttpsClient(Client* client);
+Client* getHttpsClient();
+
+// Plain TCP transport for http:// servers (NULL if none)
+void setHttpClient(Client* client);
+Client* getHttpClient();
+
+#endif // HTTP_CLIENT_H
@@ -49,10 +49,12 @@
 #define SD_SCK_PIN        36
 
 // SIM7000G Cellular Module
-#define SIM7000_RX_PIN    43
+#define SIM7000_RX_PIN    43 // UART0's default pins, console is on USB-CDC
 #define SIM7000_TX_PIN    44
 #define SIM7000_RST_PIN   2
 #define SIM7000_PWR_PIN   3
+#define SIM7000_RTS_PIN   -1 // Flow control, -1 when not wired
+#define SIM7000_CTS_PIN   -1
 
 // Boot mode selection button
 #define BOOT_MODE_PIN     0  // Usually GPIO0 is used as boot mode selection
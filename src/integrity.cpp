@@ -0,0 +1,234 @@
+#include "integrity.h"
+#include "config.h"
+#include "storage.h"
+
+// Bytes at the end of a JPEG searched for the EOI marker, some encoders pad
+#define JPEG_EOI_SEARCH_BYTES 32
+
+// Hashing cost statistics
+static uint64_t hashedBytes = 0;
+static uint64_t hashMicrosTotal = 0;
+static uint64_t writeMicrosTotal = 0;
+static uint32_t hashedCaptures = 0;
+
+CaptureHasher::CaptureHasher() : length(0) {
+  mbedtls_sha256_init(&ctx);
+}
+
+CaptureHasher::~CaptureHasher() {
+  mbedtls_sha256_free(&ctx);
+}
+
+void CaptureHasher::begin() {
+  length = 0;
+  mbedtls_sha256_starts(&ctx, 0);
+}
+
+void CaptureHasher::update(const uint8_t* data, size_t len) {
+  mbedtls_sha256_update(&ctx, data, len);
+  length += len;
+}
+
+void CaptureHasher::finish(CaptureDigest& digest) {
+  mbedtls_sha256_finish(&ctx, digest.hash);
+  digest.size = length;
+}
+
+bool isJpegComplete(const uint8_t* head, size_t headLen, const uint8_t* tail, size_t tailLen) {
+  // Start of image
+  if (headLen < 2 || head[0] != 0xFF || head[1] != 0xD8) {
+    return false;
+  }
+  
+  // End of image, allowing for trailing padding
+  for (size_t i = tailLen; i >= 2; i--) {
+    if (tail[i - 2] == 0xFF && tail[i - 1] == 0xD9) {
+      return true;
+    }
+  }
+  
+  return false;
+}
+
+String getSidecarPath(const char* capturePath) {
+  return String(capturePath) + INTEGRITY_SIDECAR_EXT;
+}
+
+bool writeDigestSidecar(StorageBackend* storage, const char* capturePath, const CaptureDigest& digest) {
+  // "<sha256 hex> <size>\n"
+  char line[CAPTURE_HASH_SIZE * 2 + 16];
+  for (int i = 0; i < CAPTURE_HASH_SIZE; i++) {
+    snprintf(line + i * 2, 3, "%02x", digest.hash[i]);
+  }
+  int len = CAPTURE_HASH_SIZE * 2;
+  len += snprintf(line + len, sizeof(line) - len, " %u\n", (unsigned)digest.size);
+  
+  StorageFilePtr file = storage->open(getSidecarPath(capturePath).c_str(), STORAGE_WRITE);
+  if (!file) {
+    return false;
+  }
+  
+  size_t written = file->write((const uint8_t*)line, len);
+  file->close();
+  return written == (size_t)len;
+}
+
+bool readDigestSidecar(StorageBackend* storage, const char* capturePath, CaptureDigest& digest) {
+  StorageFilePtr file = storage->open(getSidecarPath(capturePath).c_str(), STORAGE_READ);
+  if (!file) {
+    return false;
+  }
+  
+  char line[CAPTURE_HASH_SIZE * 2 + 16];
+  size_t len = file->read((uint8_t*)line, sizeof(line) - 1);
+  file->close();
+  line[len] = '\0';
+  
+  if (len < CAPTURE_HASH_SIZE * 2 + 2 || line[CAPTURE_HASH_SIZE * 2] != ' ') {
+    return false;
+  }
+  
+  for (int i = 0; i < CAPTURE_HASH_SIZE; i++) {
+    char hex[3] = { line[i * 2], line[i * 2 + 1], '\0' };
+    char* end;
+    digest.hash[i] = (uint8_t)strtoul(hex, &end, 16);
+    if (*end != '\0') {
+      return false;
+    }
+  }
+  
+  digest.size = strtoul(line + CAPTURE_HASH_SIZE * 2 + 1, NULL, 10);
+  return true;
+}
+
+IntegrityResult verifyCaptureFile(StorageBackend* storage, const char* capturePath) {
+  StorageFilePtr file = storage->open(capturePath, STORAGE_READ);
+  if (!file) {
+    return INTEGRITY_READ_ERROR;
+  }
+  
+  CaptureDigest expected;
+  bool haveSidecar = readDigestSidecar(storage, capturePath, expected);
+  
+  size_t fileSize = file->size();
+  if (haveSidecar && fileSize != expected.size) {
+    file->close();
+    return INTEGRITY_BAD_SIZE;
+  }
+  
+  // Hash the file and keep its first and last bytes for the structure check
+  CaptureHasher hasher;
+  hasher.begin();
+  
+  uint8_t buffer[INTEGRITY_READ_CHUNK_SIZE];
+  uint8_t head[2] = { 0, 0 };
+  uint8_t tail[JPEG_EOI_SEARCH_BYTES];
+  size_t headLen = 0;
+  size_t tailLen = 0;
+  size_t total = 0;
+  
+  while (total < fileSize) {
+    size_t n = file->read(buffer, sizeof(buffer));
+    if (n == 0) {
+      break;
+    }
+    
+    if (haveSidecar) {
+      hasher.update(buffer, n);
+    }
+    
+    for (size_t i = 0; i < n && headLen < sizeof(head); i++) {
+      head[headLen++] = buffer[i];
+    }
+    
+    if (n >= sizeof(tail)) {
+      memcpy(tail, buffer + n - sizeof(tail), sizeof(tail));
+      tailLen = sizeof(tail);
+    } else {
+      size_t keep = min(tailLen, sizeof(tail) - n);
+      memmove(tail, tail + tailLen - keep, keep);
+      memcpy(tail + keep, buffer, n);
+      tailLen = keep + n;
+    }
+    
+    total += n;
+  }
+  file->close();
+  
+  if (total != fileSize) {
+    return INTEGRITY_READ_ERROR;
+  }
+  
+  if (!isJpegComplete(head, headLen, tail, tailLen)) {
+    return INTEGRITY_BAD_JPEG;
+  }
+  
+  if (!haveSidecar) {
+    return INTEGRITY_UNVERIFIED;
+  }
+  
+  CaptureDigest actual;
+  hasher.finish(actual);
+  if (memcmp(actual.hash, expected.hash, CAPTURE_HASH_SIZE) != 0) {
+    return INTEGRITY_BAD_HASH;
+  }
+  
+  return INTEGRITY_OK;
+}
+
+const char* getIntegrityResultName(IntegrityResult result) {
+  switch (result) {
+    case INTEGRITY_OK:          return "ok";
+    case INTEGRITY_UNVERIFIED:  return "unverified";
+    case INTEGRITY_BAD_SIZE:    return "size mismatch";
+    case INTEGRITY_BAD_HASH:    return "hash mismatch";
+    case INTEGRITY_BAD_JPEG:    return "truncated JPEG";
+    case INTEGRITY_READ_ERROR:  return "read error";
+    default:                    return "unknown";
+  }
+}
+
+bool quarantineFile(StorageBackend* storage, const char* capturePath) {
+  if (!storage->mkdir(QUARANTINE_DIR)) {
+    Serial.println("Failed to create quarantine directory");
+    return false;
+  }
+  
+  const char* name = strrchr(capturePath, '/');
+  name = name ? name + 1 : capturePath;
+  
+  String target = String(QUARANTINE_DIR) + "/" + name;
+  if (storage->exists(target.c_str())) {
+    storage->remove(target.c_str());
+  }
+  
+  if (!storage->rename(capturePath, target.c_str())) {
+    Serial.printf("Failed to quarantine %s\n", capturePath);
+    return false;
+  }
+  
+  // The digest is evidence of what the file should have been, the other
+  // sidecars go along so nothing is left behind for a missing capture
+  moveCaptureSidecars(storage, capturePath, target.c_str());
+  
+  Serial.printf("Quarantined %s\n", capturePath);
+  return true;
+}
+
+void recordCaptureHashTiming(size_t bytes, unsigned long hashMicros, unsigned long writeMicros) {
+  hashedBytes += bytes;
+  hashMicrosTotal += hashMicros;
+  writeMicrosTotal += writeMicros;
+  hashedCaptures++;
+}
+
+void printIntegrityStats() {
+  if (hashedCaptures == 0 || hashMicrosTotal == 0) {
+    return;
+  }
+  
+  float hashMBps = (float)hashedBytes / (float)hashMicrosTotal;
+  float share = writeMicrosTotal > 0 ? 100.0f * hashMicrosTotal / writeMicrosTotal : 0.0f;
+  Serial.printf("Capture hashing: %lu captures, %.2f MB/s, %.1f%% of SD write time\n",
+                (unsigned long)hashedCaptures, hashMBps, share);
+}
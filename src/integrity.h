@@ -0,0 +1,60 @@
+#ifndef INTEGRITY_H
+#define INTEGRITY_H
+
+#include <Arduino.h>
+#include "storage_backend.h"
+#include "mbedtls/sha256.h"
+
+#define CAPTURE_HASH_SIZE 32  // SHA-256
+
+// Digest of a capture file, stored next to it in a sidecar file
+struct CaptureDigest {
+  uint8_t hash[CAPTURE_HASH_SIZE];
+  size_t size;
+};
+
+// Result of verifying a capture file before upload
+enum IntegrityResult {
+  INTEGRITY_OK,
+  INTEGRITY_UNVERIFIED,   // No sidecar (older capture), JPEG structure OK
+  INTEGRITY_BAD_SIZE,
+  INTEGRITY_BAD_HASH,
+  INTEGRITY_BAD_JPEG,
+  INTEGRITY_READ_ERROR
+};
+
+// Streaming SHA-256, uses the hardware SHA accelerator on the ESP32-S3
+class CaptureHasher {
+public:
+  CaptureHasher();
+  ~CaptureHasher();
+  
+  void begin();
+  void update(const uint8_t* data, size_t len);
+  void finish(CaptureDigest& digest);
+
+private:
+  mbedtls_sha256_context ctx;
+  size_t length;
+};
+
+// Check for the JPEG SOI marker at the start and EOI marker at the end
+bool isJpegComplete(const uint8_t* head, size_t headLen, const uint8_t* tail, size_t tailLen);
+
+// Sidecar handling ("<capture>.sum")
+String getSidecarPath(const char* capturePath);
+bool writeDigestSidecar(StorageBackend* storage, const char* capturePath, const CaptureDigest& digest);
+bool readDigestSidecar(StorageBackend* storage, const char* capturePath, CaptureDigest& digest);
+
+// Verify a capture file against its sidecar and JPEG structure
+IntegrityResult verifyCaptureFile(StorageBackend* storage, const char* capturePath);
+const char* getIntegrityResultName(IntegrityResult result);
+
+// Move a corrupt capture and its sidecars to the quarantine directory
+bool quarantineFile(StorageBackend* storage, const char* capturePath);
+
+// Hashing cost on the capture path
+void recordCaptureHashTiming(size_t bytes, unsigned long hashMicros, unsigned long writeMicros);
+void printIntegrityStats();
+
+#endif // INTEGRITY_H
@@ -5,14 +5,22 @@
 #include "camera.h"
 #include "sensors.h"
 #include "storage.h"
+#include "capture_spool.h"
 #include "cellular.h"
-#include "google_drive.h"
+#include "modem_client.h"
+#include "modem_serial.h"
+#include "uploader.h"
+#include "upload_task.h"
+#include "modem_task.h"
+#include "at_engine.h"
+#include "credentials.h"
 #include "led_control.h"
 #include "time_sync.h"
 #include "provisioning.h"
 #include "ota.h"
 #include "button_control.h"
 #include "sms_messaging.h"
+#include "backoff.h"
 #include <LittleFS.h>
 
 // Global state
@@ -38,14 +46,26 @@ unsigned long lastSyncTime = 0;
 unsigned long lastGDriveCheckTime = 0;
 unsigned long weeklyPhotoCheckTime = 0;
 unsigned long minuteCounterTime = 0;
+unsigned long lastSDCheckTime = 0;
 bool gdriveCommOK = false;
+bool connectivityReported = false;         // An OK/no-communication SMS went out since boot
+bool timestampBackfillDue = false;         // Clock set, unsynced captures not renamed yet
+Backoff ntpBackoff("NTP sync", NTP_BACKOFF_BASE_MS, NTP_BACKOFF_MAX_MS);
+ModemJob timeSyncJob = {};                 // Modem work for the main loop, run on the modem task
+ModemJob dailyProbeJob = {};
+ModemJob uploadProbeJob = {};
 int minuteCounter = 0;
-bool driveCheckNeeded = true;
 bool otaRequested = false;
 bool factoryResetRequested = false;
 bool provisioningRequested = false;
 bool uploadInterrupted = false;
 bool isProvisioned = false;
+unsigned long lastLoopTime = 0;
+unsigned long worstTriggerLatencyMs = 0;  // Longest gap between sensor polls
+int eventFrameCount = 0;                   // Frames captured in the current event
+uint8_t eventConfidence = 0;               // Strongest trigger seen in the current event
+char lastEventCapture[64] = "";            // Newest frame of the current event
+unsigned long eventTriggerTime = 0;        // When the sensor that started the event fired
 
 // Function prototypes
 void checkSensors();
@@ -54,6 +74,11 @@ void checkTimeEvents();
 bool checkWeeklyPhotoTime();
 bool checkDailyDriveCheckTime();
 void captureAndSavePhoto();
+void reportConnectivity(bool ok);
+bool runTimeSync(void* arg);
+bool runUploadProbe(void* arg);
+bool runDailyUploadProbe(void* arg);
+void checkStorageRecovery();
 void checkButton();
 void setupFromScratch();
 void factoryReset();
@@ -118,11 +143,16 @@ void setup() {
   }
   
   // Normal initialization
+  bool spoolReady = initCaptureSpool();
   if (!initStorage()) {
-    Serial.println("Storage initialization failed!");
-    currentState = STATE_ERROR;
-    setLEDState(LED_ERROR);
-    return;
+    if (!spoolReady) {
+      Serial.println("Storage initialization failed!");
+      currentState = STATE_ERROR;
+      setLEDState(LED_ERROR);
+      return;
+    }
+    // Keep capturing into PSRAM, the card is retried in the background
+    Serial.println("Storage initialization failed, spooling captures to PSRAM");
   }
   
   if (!initCamera()) {
@@ -145,27 +175,42 @@ void setup() {
     Serial.println("Will retry cellular connection later");
   }
   
+  // HTTP and HTTPS run on the ESP32 over the modem's TCP socket
+  beginModemTransport();
+  
   // Initialize SMS messaging
   if (!initSMSMessaging()) {
     Serial.println("SMS messaging not configured, will use defaults");
   }
   
+  // Uploads run beside the main loop
+  if (!startUploadTask()) {
+    Serial.println("Upload task not started, uploads disabled");
+  }
+  
+  // So do SMS, time syncs and probes
+  if (!startModemTask()) {
+    Serial.println("Modem task not started, modem work will block the main loop");
+  }
+  
   // Try to sync time
   if (syncTimeWithNTP()) {
     lastSyncTime = millis();
     Serial.println("Time synchronized successfully");
+    backfillCaptureTimestamps();
   } else {
     Serial.println("Time sync failed, will retry later");
+    ntpBackoff.failure();
   }
   
-  // Check Google Drive connectivity (returns false if not configured)
-  if (isGoogleDriveConfigured()) {
-    // Initialize Google Drive API
-    if (initGoogleDrive()) {
-      Serial.println("Google Drive initialized successfully");
+  // Check upload connectivity (returns false if not configured)
+  if (isUploadConfigured()) {
+    // Initialize the upload backend
+    if (initUploader()) {
+      Serial.printf("%s initialized successfully\n", getUploadBackend()->name());
       
       // Check for unsent files on SD
-      int fileCount = getFileCount();
+      int fileCount = getFileCount() + getSpoolCount();
       if (fileCount > 0) {
         Serial.printf("Found %d unsent files, starting upload\n", fileCount);
         currentState = STATE_UPLOADING;
@@ -177,12 +222,12 @@ void setup() {
         setLEDState(LED_IDLE);
       }
     } else {
-      Serial.println("Google Drive initialization failed, entering provisioning mode");
+      Serial.printf("%s initialization failed, entering provisioning mode\n", getUploadBackend()->name());
       setupFromScratch();
       return;
     }
   } else {
-    Serial.println("Google Drive not configured, entering provisioning mode");
+    Serial.println("Upload target not configured, entering provisioning mode");
     setupFromScratch();
     return;
   }
@@ -191,6 +236,7 @@ void setup() {
   weeklyPhotoCheckTime = millis();
   lastGDriveCheckTime = millis();
   minuteCounterTime = millis();
+  lastSDCheckTime = millis();
 }
 
 void loop() {
@@ -212,7 +258,7 @@ void loop() {
     updateLED(); // Update LED for blinking effects
     
     // Check if provisioning is complete
-    if (!isProvisioningActive() && isGoogleDriveConfigured()) {
+    if (!isProvisioningActive() && isUploadConfigured()) {
       Serial.println("Provisioning complete, restarting device");
       delay(1000);
       ESP.restart();
@@ -220,6 +266,13 @@ void loop() {
     return;
   }
   
+  // The longest gap between loop passes is the worst delay a trigger can see
+  unsigned long loopTime = millis();
+  if (lastLoopTime != 0 && loopTime - lastLoopTime > worstTriggerLatencyMs) {
+    worstTriggerLatencyMs = loopTime - lastLoopTime;
+  }
+  lastLoopTime = loopTime;
+  
   // Handle the current state
   handleStateMachine();
   
@@ -257,6 +310,14 @@ void handleStateMachine() {
       if (millis() - lastActivityTime > INACTIVITY_TIMEOUT_MS) {
         // No activity for a while, stop capturing and start uploading
         Serial.println("Inactivity timeout reached, starting upload");
+        
+        // The last frame of an event is worth sending early
+        if (eventFrameCount > 0) {
+          noteCaptureHint(lastEventCapture, true, eventConfidence);
+        }
+        eventFrameCount = 0;
+        eventConfidence = 0;
+        
         currentState = STATE_UPLOADING;
         setLEDState(LED_UPLOADING);
         // Send SMS notification for activity detection
@@ -280,8 +341,9 @@ void handleStateMachine() {
       // Check if monitoring is enabled and if new activity is detected
       if (isMonitoringEnabled()) {
         if (isPIRTriggered() || isSoundDetected()) {
-          // New activity detected, return to capturing
+          // New activity detected, pause the upload and return to capturing
           Serial.println("Activity detected during upload, resuming capture");
+          pauseUpload();
           currentState = STATE_CAPTURING;
           setLEDState(LED_CAPTURING);
           lastActivityTime = millis();
@@ -290,39 +352,49 @@ void handleStateMachine() {
         }
       }
       
-      // Check if we have connectivity to Google Drive
-      if (!gdriveCommOK && driveCheckNeeded) {
-        // Try to check connectivity first
-        if (isGoogleDriveConfigured() && initGoogleDrive()) {
-          gdriveCommOK = true;
-          sendCommunicationOkSMS();
-        } else {
-          gdriveCommOK = false;
-          sendNoCommunicationSMS();
+      // The upload task deletes each file once it is sent
+      switch (getUploadTaskState()) {
+        case UPLOAD_TASK_IDLE:
+        case UPLOAD_TASK_PAUSED: {
+          // Only proceed with upload if we have connectivity; the probe is
+          // cached, and during an outage it backs off instead of waking
+          // the modem on every trigger. It runs on the modem task, the
+          // result is picked up on a later pass.
+          bool reachable;
+          if (!takeModemJobResult(uploadProbeJob, reachable)) {
+            queueModemJob("upload probe", runUploadProbe, NULL, &uploadProbeJob);
+            break;
+          }
+          if (!reachable) {
+            reportConnectivity(false);
+            Serial.println("Upload target unreachable, skipping upload");
+            currentState = STATE_IDLE;
+            setLEDState(LED_IDLE);
+            break;
+          }
+          reportConnectivity(true);
+          worstTriggerLatencyMs = 0;
+          requestUpload();
+          break;
         }
-        driveCheckNeeded = false;
-      }
-      
-      // Only proceed with upload if we have connectivity
-      if (gdriveCommOK) {
-        // Upload files and delete after successful upload
-        if (uploadFilesToGoogleDrive()) {
-          Serial.println("All files uploaded successfully");
-          deleteAllFiles();
-          uploadInterrupted = false;
-          currentState = STATE_IDLE;
-          setLEDState(LED_IDLE);
-        } else {
-          Serial.println("Upload failed or was interrupted, will retry later");
-          // For now, just go back to idle and retry later
+        
+        case UPLOAD_TASK_RUNNING:
+          // Keep polling sensors, the button and the LED meanwhile
+          break;
+          
+        case UPLOAD_TASK_DONE:
+        case UPLOAD_TASK_FAILED:
+          if (getUploadTaskState() == UPLOAD_TASK_DONE) {
+            Serial.println("All files uploaded successfully");
+            uploadInterrupted = false;
+          } else {
+            Serial.println("Upload failed or was interrupted, will retry later");
+          }
+          Serial.printf("Worst trigger latency during upload: %lu ms\n", worstTriggerLatencyMs);
+          acknowledgeUploadResult();
           currentState = STATE_IDLE;
           setLEDState(LED_IDLE);
-        }
-      } else {
-        // No Google Drive connectivity, go back to idle
-        Serial.println("No Google Drive connectivity, skipping upload");
-        currentState = STATE_IDLE;
-        setLEDState(LED_IDLE);
+          break;
       }
       break;
       
@@ -354,6 +426,10 @@ void checkSensors() {
   // Check PIR sensor
   if (isPIRTriggered()) {
     Serial.println("Motion detected by PIR sensor");
+    if (eventFrameCount == 0) {
+      eventTriggerTime = millis();
+    }
+    eventConfidence = max(eventConfidence, (uint8_t)TRIGGER_CONFIDENCE_PIR);
     currentState = STATE_MOTION_DETECTED;
     setLEDState(LED_PIR_DETECTED);
     lastActivityTime = millis();
@@ -362,6 +438,10 @@ void checkSensors() {
   // Check sound level
   if (isSoundDetected()) {
     Serial.println("Sound detected by MEMS microphone");
+    if (eventFrameCount == 0) {
+      eventTriggerTime = millis();
+    }
+    eventConfidence = max(eventConfidence, (uint8_t)TRIGGER_CONFIDENCE_SOUND);
     currentState = STATE_SOUND_DETECTED;
     setLEDState(LED_SOUND_DETECTED);
     lastActivityTime = millis();
@@ -371,31 +451,63 @@ void checkSensors() {
 void checkTimeEvents() {
   unsigned long currentTime = millis();
   
-  // Check if we need to sync time (once a day)
-  if (currentTime - lastSyncTime > NTP_UPDATE_INTERVAL_MS) {
-    Serial.println("Performing daily time sync");
-    if (syncTimeWithNTP()) {
-      lastSyncTime = currentTime;
+  // Modem checks wait while the upload task has the modem
+  bool modemBusy = getUploadTaskState() == UPLOAD_TASK_RUNNING;
+  
+  // Time sync and the connectivity check run on the modem task, their
+  // results are picked up here
+  bool ok;
+  if (takeModemJobResult(timeSyncJob, ok)) {
+    if (ok) {
+      lastSyncTime = millis();
+      ntpBackoff.success();
       Serial.println("Time synchronized successfully");
+      timestampBackfillDue = true;
     } else {
+      ntpBackoff.failure();
       Serial.println("Time sync failed, will retry later");
     }
   }
   
-  // Check if we need to check Google Drive connectivity (once a day)
-  if (checkDailyDriveCheckTime() || (currentTime - lastGDriveCheckTime > NTP_UPDATE_INTERVAL_MS)) {
-    Serial.println("Performing daily Google Drive connectivity check");
-    
-    if (isGoogleDriveConfigured() && initGoogleDrive()) {
-      gdriveCommOK = true;
-      sendCommunicationOkSMS();
-      Serial.println("Google Drive connectivity OK");
-    } else {
-      gdriveCommOK = false;
-      sendNoCommunicationSMS();
-      Serial.println("Failed to connect to Google Drive");
-    }
-    
+  if (takeModemJobResult(dailyProbeJob, ok)) {
+    Serial.println(ok ? "Upload connectivity OK" : "Upload target unreachable");
+    reportConnectivity(ok);
+    printBackoffStats();
+    printModemSerialStats();
+    printAtEngineStats();
+    printTcpSendStats();
+    printModemClientStats();
+    Serial.printf("SMS: %u pending, %lu dropped\n", getPendingSMSCount(), (unsigned long)getDroppedSMSCount());
+  }
+  
+  // Renaming captures waits for the upload task, which may have them or
+  // their sidecars open; only this loop wakes it, so it stays idle meanwhile
+  if (timestampBackfillDue && !isUploadTaskBusy()) {
+    backfillCaptureTimestamps();
+    timestampBackfillDue = false;
+  }
+  
+  // Alerts held while SMS backed off go out once it allows, and commands sent by SMS are read
+  if (!modemBusy) {
+    retryPendingSMS();
+    checkReceivedSMS();
+  }
+  
+  // Check if we need to sync time (once a day, or until the first sync
+  // succeeds), backing off while it fails
+  if (!modemBusy && !timeSyncJob.pending &&
+      (!isTimeSet() || currentTime - lastSyncTime > NTP_UPDATE_INTERVAL_MS) && ntpBackoff.ready()) {
+    Serial.println("Performing daily time sync");
+    queueModemJob("time sync", runTimeSync, NULL, &timeSyncJob);
+  }
+  
+  // Check if we need to check upload connectivity (once a day) with a fresh
+  // probe; the check minute only counts once
+  if (!modemBusy && !dailyProbeJob.pending &&
+      ((checkDailyDriveCheckTime() && currentTime - lastGDriveCheckTime > 60000) ||
+       (currentTime - lastGDriveCheckTime > NTP_UPDATE_INTERVAL_MS))) {
+    Serial.println("Performing daily upload connectivity check");
+    queueModemJob("connectivity check", runDailyUploadProbe, NULL, &dailyProbeJob);
     lastGDriveCheckTime = currentTime;
   }
   
@@ -406,6 +518,7 @@ void checkTimeEvents() {
     if (checkWeeklyPhotoTime() && currentState == STATE_IDLE && isMonitoringEnabled()) {
       Serial.println("Taking weekly photo (no activity detected)");
       captureAndSavePhoto();
+      eventFrameCount = 0;
       
       // Send "no activity" SMS
       sendNoActivityDetectedSMS();
@@ -416,6 +529,12 @@ void checkTimeEvents() {
     }
   }
   
+  // Remount the SD card and flush spooled frames after a card fault
+  if (currentTime - lastSDCheckTime > SD_CHECK_INTERVAL_MS) {
+    lastSDCheckTime = currentTime;
+    checkStorageRecovery();
+  }
+  
   // Update minute counter for delayed events
   if (currentTime - minuteCounterTime > 60000) { // Every minute
     minuteCounter++;
@@ -468,16 +587,9 @@ void captureAndSavePhoto() {
     enableIRCut(true);  // Enable IR cut (block IR light)
   }
   
-  // Get current time for filename
-  char timestamp[20];
-  getTimestampString(timestamp, sizeof(timestamp));
-  
-  // Get base filename from preferences (or use default)
-  String baseFilename = getBaseFilename();
-  
-  // Create filename
-  char filename[50];
-  snprintf(filename, sizeof(filename), "/%s_%s.jpg", baseFilename.c_str(), timestamp);
+  // Create a unique filename (boot counter, sequence and time if known)
+  char filename[64];
+  makeCaptureFilename(filename, sizeof(filename));
   
   // Capture photo
   camera_fb_t* fb = capturePhoto();
@@ -486,17 +598,96 @@ void captureAndSavePhoto() {
     return;
   }
   
-  // Save to SD card
-  if (!savePhotoToSD(filename, fb->buf, fb->len)) {
+  // Save to SD card, or hold it in PSRAM until the card is back
+  bool saved = savePhotoToSD(filename, fb->buf, fb->len);
+  if (!saved) {
     Serial.println("Failed to save photo to SD card");
+    spoolCapture(filename, fb->buf, fb->len);
   } else {
     Serial.printf("Photo saved: %s\n", filename);
   }
   
+  // Upload priority: the first frame of an event and how sure the trigger was
+  bool firstFrame = eventFrameCount == 0;
+  noteCaptureHint(filename, firstFrame, eventConfidence);
+  strlcpy(lastEventCapture, filename, sizeof(lastEventCapture));
+  eventFrameCount++;
+  
+  // The first frame can go out straight from the frame buffer while capture
+  // continues on the second one; the upload task returns it to the camera
+  if (ALERT_FAST_PATH && firstFrame && saved && psramFound() &&
+      queueAlertFrame(fb, filename, eventTriggerTime)) {
+    return;
+  }
+  
   // Return the frame buffer back to the camera
   returnPhotoBuffer(fb);
 }
 
+// Text the connectivity status when it changes (and the first time it is known)
+void reportConnectivity(bool ok) {
+  if (connectivityReported && ok == gdriveCommOK) {
+    return;
+  }
+  
+  gdriveCommOK = ok;
+  connectivityReported = true;
+  if (ok) {
+    sendCommunicationOkSMS();
+  } else {
+    sendNoCommunicationSMS();
+  }
+}
+
+// Modem jobs for the main loop, run on the modem task
+bool runTimeSync(void* arg) {
+  return syncTimeWithNTP();
+}
+
+bool runUploadProbe(void* arg) {
+  return isUploadConfigured() && probeUploadTarget();
+}
+
+bool runDailyUploadProbe(void* arg) {
+  return isUploadConfigured() && probeUploadTarget(true);
+}
+
+void checkStorageRecovery() {
+  if (isStorageMounted() && getSpoolCount() == 0) {
+    return;
+  }
+  
+  if (isStorageMounted()) {
+    flushSpoolToStorage();
+    if (getSpoolCount() == 0) {
+      return;
+    }
+    
+    // A full card is not a fault, a remount won't make room; uploads and
+    // cleanup will
+    size_t freeMB = getFreeSpaceSD();
+    if (freeMB < MIN_SD_FREE_SPACE_MB) {
+      Serial.printf("SD card full (%u MB free), %d frames spooled\n", (unsigned)freeMB, getSpoolCount());
+      return;
+    }
+  }
+  
+  // The upload task (and its read-ahead reader) may have files open on the
+  // card, which a remount would pull from under them
+  if (isUploadTaskBusy()) {
+    Serial.printf("SD card remount deferred while uploading, %d frames spooled\n", getSpoolCount());
+    return;
+  }
+  
+  // A mounted card that still fails writes gets remounted too
+  if (!remountStorage()) {
+    Serial.printf("SD card still unavailable, %d frames spooled\n", getSpoolCount());
+    return;
+  }
+  
+  flushSpoolToStorage();
+}
+
 void checkButton() {
   // Process button actions
   ButtonAction action = handleButton();
@@ -524,7 +715,7 @@ void checkButton() {
 
 void setupFromScratch() {
   // Initialize storage for provisioning
-  if (!LittleFS.begin(true)) {
+  if (!mountConfigStorage()) {
     Serial.println("Failed to mount LittleFS for provisioning");
     currentState = STATE_ERROR;
     setLEDState(LED_ERROR);
@@ -563,9 +754,15 @@ void factoryReset() {
   preferences.clear();
   preferences.end();
   
+  // Clear upload backend settings
+  preferences.begin("upload", false);
+  preferences.clear();
+  preferences.end();
+  
   // Additional cleanup if needed
-  if (LittleFS.begin(true)) {
+  if (mountConfigStorage()) {
     LittleFS.format();
+    invalidateDriveCredentials();
   }
   
   Serial.println("Factory reset complete. Halting system.");
@@ -0,0 +1,226 @@
+#include "modem_client.h"
+#include "cellular.h"
+#include "http_client.h"
+#include <LittleFS.h>
+#include "tls_client.h"
+
+ModemClientStats modemClientStats;
+
+ModemClient::ModemClient() : txLength(0), rxStart(0), rxEnd(0), lastPoll(0), lastConnectMillis(0) {
+}
+
+int ModemClient::connect(IPAddress ip, uint16_t port) {
+  return connect(ip.toString().c_str(), port);
+}
+
+int ModemClient::connect(const char* host, uint16_t port) {
+  stop();
+  
+  unsigned long start = millis();
+  if (!connectTCP(host, port)) {
+    return 0;
+  }
+  
+  lastConnectMillis = millis() - start;
+  modemClientStats.connects++;
+  modemClientStats.connectMillis += lastConnectMillis;
+  return 1;
+}
+
+size_t ModemClient::write(uint8_t b) {
+  return write(&b, 1);
+}
+
+size_t ModemClient::write(const uint8_t* buf, size_t size) {
+  if (!isTCPConnected()) {
+    return 0;
+  }
+  modemClientStats.writes++;
+  
+  // TLS records and HTTP headers come in pieces of any size, the modem
+  // is best fed whole packets. The packet size can shrink between calls
+  // (a reconnect), so anything already at or past it goes out first
+  size_t packetSize = max((size_t)1, min(getTCPPacketSize(), sizeof(txBuffer)));
+  size_t taken = 0;
+  while (taken < size) {
+    if (txLength >= packetSize && !sendPending()) {
+      return 0;
+    }
+    size_t n = min(size - taken, packetSize - txLength);
+    memcpy(txBuffer + txLength, buf + taken, n);
+    txLength += n;
+    taken += n;
+  }
+  if (txLength >= packetSize && !sendPending()) {
+    return 0;
+  }
+  return size;
+}
+
+bool ModemClient::sendPending() {
+  if (txLength == 0) {
+    return true;
+  }
+  
+  bool ok = writeTCPData(txBuffer, txLength);
+  if (ok) {
+    modemClientStats.packets++;
+    modemClientStats.bytesSent += txLength;
+  }
+  txLength = 0;
+  return ok;
+}
+
+// One packet of received data, when the modem announced some or now and
+// then in case the announcement was missed
+bool ModemClient::fill() {
+  if (!hasTCPData() && (!isTCPConnected() || millis() - lastPoll < MODEM_CLIENT_POLL_MS)) {
+    return false;
+  }
+  lastPoll = millis();
+  
+  int n = readTCPData(rxBuffer, sizeof(rxBuffer));
+  if (n <= 0) {
+    modemClientStats.emptyPolls++;
+    return false;
+  }
+  
+  rxStart = 0;
+  rxEnd = n;
+  modemClientStats.fetches++;
+  modemClientStats.bytesReceived += n;
+  return true;
+}
+
+int ModemClient::available() {
+  // Whatever was written has to be out before an answer can come
+  sendPending();
+  
+  if (rxStart == rxEnd) {
+    fill();
+  }
+  return rxEnd - rxStart;
+}
+
+int ModemClient::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int ModemClient::read(uint8_t* buf, size_t size) {
+  if (available() == 0) {
+    return -1;
+  }
+  
+  size_t n = min(size, rxEnd - rxStart);
+  memcpy(buf, rxBuffer + rxStart, n);
+  rxStart += n;
+  return n;
+}
+
+int ModemClient::peek() {
+  return available() ? rxBuffer[rxStart] : -1;
+}
+
+void ModemClient::flush() {
+  sendPending();
+}
+
+void ModemClient::stop() {
+  txLength = 0;
+  rxStart = 0;
+  rxEnd = 0;
+  if (isTCPConnected()) {
+    disconnectTCP();
+  }
+}
+
+uint8_t ModemClient::connected() {
+  return rxStart < rxEnd || isTCPConnected();
+}
+
+// TLS with the handshake timed: the connect includes the TCP connect,
+// which the transport measures itself
+class TimedTlsClient : public TlsClient {
+public:
+  TimedTlsClient(ModemClient* transport) : TlsClient(transport), transport(transport) {}
+  
+  using TlsClient::connect;
+  
+  int connect(const char* host, uint16_t port) override {
+    unsigned long start = millis();
+    int result = TlsClient::connect(host, port);
+    if (result == 1) {
+      uint32_t handshake = millis() - start - transport->getLastConnectMillis();
+      modemClientStats.handshakes++;
+      modemClientStats.handshakeMillis += handshake;
+      modemClientStats.lastHandshakeMillis = handshake;
+      if (wasResumed()) {
+        modemClientStats.resumedHandshakes++;
+        modemClientStats.resumedMillis += handshake;
+      }
+      Serial.printf("TLS handshake with %s took %lu ms%s\n", host, (unsigned long)handshake,
+                    wasResumed() ? " (resumed)" : "");
+    }
+    return result;
+  }
+
+private:
+  ModemClient* transport;
+};
+
+ModemClient modemClient;
+TimedTlsClient modemTlsClient(&modemClient);
+String tlsRootCerts;  // Must outlive the client, which keeps the pointer
+
+bool beginModemTransport() {
+  // Plain TCP needs nothing else and is registered once
+  if (!getHttpClient()) {
+    memset(&modemClientStats, 0, sizeof(modemClientStats));
+    setHttpClient(&modemClient);
+  }
+  
+  // TLS is tried again on later calls until the certificates are there
+  // (storage came up late, or they were provisioned since)
+  if (getHttpsClient()) {
+    return true;
+  }
+  
+  // Without root certificates the server can't be checked, so no HTTPS
+  File file = LittleFS.open(TLS_CA_FILE, "r");
+  if (!file) {
+    Serial.printf("No root certificates in %s, HTTPS over cellular disabled\n", TLS_CA_FILE);
+    return false;
+  }
+  tlsRootCerts = file.readString();
+  file.close();
+  
+  modemTlsClient.setCACert(tlsRootCerts.c_str());
+  modemTlsClient.setHandshakeTimeout(TLS_HANDSHAKE_TIMEOUT_S);
+  setHttpsClient(&modemTlsClient);
+  return true;
+}
+
+const ModemClientStats& getModemClientStats() {
+  return modemClientStats;
+}
+
+void printModemClientStats() {
+  const ModemClientStats& stats = modemClientStats;
+  uint32_t full = stats.handshakes - stats.resumedHandshakes;
+  Serial.printf("Modem client: %lu connects (avg %lu ms), %lu TLS handshakes (last %lu ms): "
+                "%lu full (avg %lu ms), %lu resumed (avg %lu ms)\n",
+                (unsigned long)stats.connects,
+                stats.connects ? (unsigned long)(stats.connectMillis / stats.connects) : 0UL,
+                (unsigned long)stats.handshakes, (unsigned long)stats.lastHandshakeMillis,
+                (unsigned long)full,
+                full ? (unsigned long)((stats.handshakeMillis - stats.resumedMillis) / full) : 0UL,
+                (unsigned long)stats.resumedHandshakes,
+                stats.resumedHandshakes ? (unsigned long)(stats.resumedMillis / stats.resumedHandshakes) : 0UL);
+  Serial.printf("Modem client: %llu bytes sent in %lu writes (avg %lu) and %lu packets, "
+                "%llu bytes received in %lu fetches, %lu empty polls\n",
+                (unsigned long long)stats.bytesSent, (unsigned long)stats.writes,
+                stats.writes ? (unsigned long)(stats.bytesSent / stats.writes) : 0UL,
+                (unsigned long)stats.packets, (unsigned long long)stats.bytesReceived,
+                (unsigned long)stats.fetches, (unsigned long)stats.emptyPolls);
+}
@@ -0,0 +1,71 @@
+#ifndef MODEM_CLIENT_H
+#define MODEM_CLIENT_H
+
+#include <Arduino.h>
+#include <Client.h>
+#include "config.h"
+
+// Arduino Client over the modem's TCP socket, so HTTP and TLS run on the
+// ESP32 instead of the modem's own HTTP stack
+
+struct ModemClientStats {
+  uint32_t connects;
+  uint32_t connectMillis;   // TCP connects, summed
+  uint32_t writes;          // Calls to write(), one per TLS record
+  uint32_t packets;         // Coalesced writes handed to the modem
+  uint64_t bytesSent;
+  uint64_t bytesReceived;
+  uint32_t fetches;         // AT+CIPRXGET reads that returned data
+  uint32_t emptyPolls;      // Reads that found nothing
+  uint32_t handshakes;      // TLS, timed from the end of the TCP connect
+  uint32_t handshakeMillis;
+  uint32_t lastHandshakeMillis;
+  uint32_t resumedHandshakes;  // Of those, resumed from a cached session
+  uint32_t resumedMillis;
+};
+
+class ModemClient : public Client {
+public:
+  ModemClient();
+  
+  int connect(IPAddress ip, uint16_t port) override;
+  int connect(const char* host, uint16_t port) override;
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t* buf, size_t size) override;
+  int available() override;
+  int read() override;
+  int read(uint8_t* buf, size_t size) override;
+  int peek() override;
+  void flush() override;
+  void stop() override;
+  uint8_t connected() override;
+  operator bool() override { return connected(); }
+  
+  unsigned long getLastConnectMillis() const { return lastConnectMillis; }
+
+private:
+  bool sendPending();
+  bool fill();
+  
+  // Writes are collected into whole packets; received data is fetched a
+  // packet at a time and handed out from here
+  uint8_t txBuffer[TCP_MAX_PACKET_SIZE];
+  size_t txLength;
+  uint8_t rxBuffer[TCP_MAX_PACKET_SIZE];
+  size_t rxStart;
+  size_t rxEnd;
+  unsigned long lastPoll;
+  unsigned long lastConnectMillis;
+};
+
+// Plain TCP and TLS (root certificates from TLS_CA_FILE, sessions resumed
+// per host, see TlsClient) over the modem,
+// registered as the HTTP and HTTPS transports. Safe to call again: the
+// uploader does before each batch, so HTTPS comes up once the certificates
+// can be read. False while there is no HTTPS.
+bool beginModemTransport();
+
+const ModemClientStats& getModemClientStats();
+void printModemClientStats();
+
+#endif // MODEM_CLIENT_H
@@ -0,0 +1,212 @@
+#include "modem_serial.h"
+#include "hw_config.h"
+#include "config.h"
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#ifdef MODEM_SIMULATOR
+#include "modem_simulator.h"
+#include <LittleFS.h>
+#endif
+
+// Writes at least this long count towards the sustained send rate
+#define MODEM_BULK_WRITE_MIN 256
+
+#ifdef MODEM_SIMULATOR
+// A simulated SIM7000G in place of the UART, for running without a SIM
+static uint32_t simulatorClock() {
+  return millis();
+}
+
+ModemSimulator modemSimulator(simulatorClock, {MODEM_SIM_LATENCY_MS, MODEM_SIM_BYTES_PER_SECOND,
+                                               MODEM_SIM_FAILURE_PERCENT, MODEM_SIM_SILENT_PERCENT,
+                                               MODEM_SIM_RSSI, 1, MODEM_SIM_EPOCH, 1});
+ModemSimulator& modemPort = modemSimulator;
+#else
+// UART1 routed to the modem pins. GPIO 43/44 are UART0's default pins on
+// the S3, so the console runs over USB-CDC (ARDUINO_USB_CDC_ON_BOOT) and
+// UART0 is left unused
+HardwareSerial modemUart(1);
+HardwareSerial& modemPort = modemUart;
+#endif
+SemaphoreHandle_t modemRxSignal = NULL;
+uint32_t modemBaud = 0;
+bool modemFlowControl = false;
+volatile bool modemWakeRequested = false;
+ModemSerialStats modemSerialStats;
+
+// The UART as a Stream, counting what goes through it
+class ModemStream : public Stream {
+public:
+  int available() override { return (int)modemPort.available(); }
+  int peek() override { return modemPort.peek(); }
+  
+  int read() override {
+    int c = modemPort.read();
+    if (c >= 0) {
+      modemSerialStats.rxBytes++;
+    }
+    return c;
+  }
+  
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  
+  size_t write(const uint8_t* buffer, size_t len) override {
+    int64_t start = esp_timer_get_time();
+    size_t n = modemPort.write(buffer, len);
+    modemSerialStats.txBytes += n;
+    if (len >= MODEM_BULK_WRITE_MIN) {
+      modemSerialStats.bulkTxBytes += n;
+      modemSerialStats.bulkTxMicros += esp_timer_get_time() - start;
+    }
+    return n;
+  }
+  
+  void flush() override {
+#ifndef MODEM_SIMULATOR
+    modemUart.flush();
+#endif
+  }
+};
+
+ModemStream modemStream;
+
+#ifndef MODEM_SIMULATOR
+// Called from the UART driver's event task when bytes arrive
+static void onModemReceive() {
+  xSemaphoreGive(modemRxSignal);
+}
+
+static void onModemError(hardwareSerial_error_t error) {
+  switch (error) {
+    case UART_FRAME_ERROR:
+      modemSerialStats.frameErrors++;
+      break;
+    case UART_PARITY_ERROR:
+      modemSerialStats.parityErrors++;
+      break;
+    case UART_BUFFER_FULL_ERROR:
+    case UART_FIFO_OVF_ERROR:
+      modemSerialStats.overflows++;
+      break;
+    case UART_BREAK_ERROR:
+      modemSerialStats.breaks++;
+      break;
+    default:
+      break;
+  }
+}
+#endif
+
+bool beginModemSerial() {
+  // Started once, a later modem init only finds the rate again
+  if (modemRxSignal) {
+    return true;
+  }
+  modemRxSignal = xSemaphoreCreateBinary();
+  resetModemSerialStats();
+
+#ifdef MODEM_SIMULATOR
+  // A recorded session on flash is replayed ahead of the built-in answers
+  File transcript = LittleFS.open(MODEM_SIM_TRANSCRIPT, "r");
+  if (transcript) {
+    modemSimulator.loadTranscript(transcript.readString().c_str());
+    transcript.close();
+  }
+  Serial.println("Modem simulator in place of the SIM7000G");
+  modemBaud = MODEM_DEFAULT_BAUD;
+  return true;
+#else
+  // The buffer size only takes effect before begin()
+  modemUart.setRxBufferSize(MODEM_RX_BUFFER_SIZE);
+  modemUart.begin(MODEM_DEFAULT_BAUD, SERIAL_8N1, SIM7000_RX_PIN, SIM7000_TX_PIN);
+  modemUart.onReceive(onModemReceive);
+  modemUart.onReceiveError(onModemError);
+  modemBaud = MODEM_DEFAULT_BAUD;
+  
+  if (SIM7000_RTS_PIN >= 0 && SIM7000_CTS_PIN >= 0) {
+    modemUart.setPins(SIM7000_RX_PIN, SIM7000_TX_PIN, SIM7000_CTS_PIN, SIM7000_RTS_PIN);
+    modemFlowControl = modemUart.setHwFlowCtrlMode(UART_HW_FLOWCTRL_CTS_RTS, MODEM_RTS_THRESHOLD);
+  }
+  
+  return true;
+#endif
+}
+
+Stream& getModemSerial() {
+  return modemStream;
+}
+
+bool waitModemData(unsigned long timeout) {
+  unsigned long start = millis();
+  while (modemPort.available() == 0) {
+    unsigned long elapsed = millis() - start;
+    if (elapsed >= timeout || modemWakeRequested) {
+      modemWakeRequested = false;
+      return false;
+    }
+#ifdef MODEM_SIMULATOR
+    // Nothing signals the simulator's output, it is polled every tick
+    xSemaphoreTake(modemRxSignal, 1);
+#else
+    // A stale signal from bytes already read just means one more check
+    xSemaphoreTake(modemRxSignal, pdMS_TO_TICKS(timeout - elapsed));
+#endif
+  }
+  return true;
+}
+
+void wakeModemReader() {
+  modemWakeRequested = true;
+  if (modemRxSignal) {
+    xSemaphoreGive(modemRxSignal);
+  }
+}
+
+void setModemBaud(uint32_t baud) {
+  if (baud == modemBaud) {
+    return;
+  }
+
+#ifndef MODEM_SIMULATOR
+  modemUart.flush();
+  modemUart.updateBaudRate(baud);
+#endif
+  modemBaud = baud;
+}
+
+uint32_t getModemBaud() {
+  return modemBaud;
+}
+
+bool hasModemFlowControl() {
+  return modemFlowControl;
+}
+
+const ModemSerialStats& getModemSerialStats() {
+  return modemSerialStats;
+}
+
+void resetModemSerialStats() {
+  memset(&modemSerialStats, 0, sizeof(modemSerialStats));
+}
+
+void printModemSerialStats() {
+  const ModemSerialStats& s = modemSerialStats;
+  float sendRate = s.bulkTxMicros > 0 ? s.bulkTxBytes * 1000000.0f / s.bulkTxMicros / 1024.0f : 0;
+  
+  Serial.printf("Modem UART at %lu baud%s: %llu KB in, %llu KB out, sustained send %.1f KB/s\n",
+                (unsigned long)modemBaud, modemFlowControl ? " with RTS/CTS" : "",
+                s.rxBytes / 1024, s.txBytes / 1024, sendRate);
+  Serial.printf("  Errors: %lu framing, %lu parity, %lu overflow, %lu break\n",
+                (unsigned long)s.frameErrors, (unsigned long)s.parityErrors,
+                (unsigned long)s.overflows, (unsigned long)s.breaks);
+
+#ifdef MODEM_SIMULATOR
+  const ModemSimulatorStats& sim = modemSimulator.getStats();
+  Serial.printf("  Simulator: %lu commands (%lu scripted), %lu HTTP requests, %llu KB payload, "
+                "%lu failures and %lu silences injected\n",
+                (unsigned long)sim.commands, (unsigned long)sim.scripted, (unsigned long)sim.httpRequests,
+                sim.payloadBytes / 1024, (unsigned long)sim.failures, (unsigned long)sim.silent);
+#endif
+}
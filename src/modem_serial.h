@@ -0,0 +1,45 @@
+#ifndef MODEM_SERIAL_H
+#define MODEM_SERIAL_H
+
+#include <Arduino.h>
+
+// Rate the SIM7000G answers at out of the box
+#define MODEM_DEFAULT_BAUD 115200
+
+// Link counters; the send rate only counts bulk writes, which block at line
+// speed (or on CTS), so it shows what a configuration sustains
+struct ModemSerialStats {
+  uint64_t rxBytes;
+  uint64_t txBytes;
+  uint64_t bulkTxBytes;
+  uint64_t bulkTxMicros;
+  uint32_t frameErrors;
+  uint32_t parityErrors;
+  uint32_t overflows;    // Driver buffer or FIFO full, bytes were dropped
+  uint32_t breaks;
+};
+
+// Hardware UART to the modem with a large driver receive buffer, and
+// RTS/CTS when both pins are wired
+bool beginModemSerial();
+
+// The link as a Stream, for AT commands and data
+Stream& getModemSerial();
+
+// Wait until received bytes are buffered, woken by the UART driver
+// instead of polling; false on timeout
+bool waitModemData(unsigned long timeout);
+
+// End a waitModemData() early (with false), e.g. when there is a command to send
+void wakeModemReader();
+
+// Change the local rate (the modem's side is set with AT+IPR)
+void setModemBaud(uint32_t baud);
+uint32_t getModemBaud();
+bool hasModemFlowControl();
+
+const ModemSerialStats& getModemSerialStats();
+void resetModemSerialStats();
+void printModemSerialStats();
+
+#endif // MODEM_SERIAL_H
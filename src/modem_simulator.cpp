@@ -0,0 +1,528 @@
+#include "modem_simulator.h"
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Longest request head kept while looking for its end
+#define SIM_MAX_HTTP_HEAD 4096
+
+// Longest reply to one AT+CIPRXGET=2 read
+#define SIM_MAX_RXGET 1460
+
+// Largest AT+CIPSEND, as AT+CIPSEND? reports it
+#define SIM_MAX_PACKET 1460
+
+static bool startsWith(const std::string& text, const char* prefix) {
+  return text.compare(0, strlen(prefix), prefix) == 0;
+}
+
+// Value of a header in a request head, case-insensitive name
+static std::string headerValue(const std::string& head, const char* name) {
+  size_t nameLength = strlen(name);
+  size_t pos = 0;
+  while ((pos = head.find("\r\n", pos)) != std::string::npos) {
+    pos += 2;
+    if (strncasecmp(head.c_str() + pos, name, nameLength) == 0 && head[pos + nameLength] == ':') {
+      size_t start = head.find_first_not_of(' ', pos + nameLength + 1);
+      size_t end = head.find("\r\n", pos);
+      return start == std::string::npos || start >= end ? std::string() : head.substr(start, end - start);
+    }
+  }
+  return std::string();
+}
+
+// Stands in for the server: PUT stores the size, HEAD reports it, MKCOL
+// creates, anything else succeeds with an empty body
+static std::string defaultHttpResponder(const std::string& head, size_t bodyLength, void* context) {
+  std::vector<std::pair<std::string, size_t> >& files = *(std::vector<std::pair<std::string, size_t> >*)context;
+  
+  size_t methodEnd = head.find(' ');
+  size_t pathEnd = head.find(' ', methodEnd + 1);
+  std::string method = head.substr(0, methodEnd);
+  std::string path = head.substr(methodEnd + 1, pathEnd - methodEnd - 1);
+  
+  if (method == "PUT") {
+    files.push_back(std::make_pair(path, bodyLength));
+    return "HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n";
+  }
+  if (method == "MKCOL") {
+    return "HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n";
+  }
+  if (method == "HEAD") {
+    for (size_t i = files.size(); i > 0; i--) {
+      if (files[i - 1].first == path) {
+        char response[96];
+        snprintf(response, sizeof(response), "HTTP/1.1 200 OK\r\nContent-Length: %u\r\n\r\n",
+                 (unsigned)files[i - 1].second);
+        return response;
+      }
+    }
+    return "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+  }
+  return "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+}
+
+static std::vector<std::pair<std::string, size_t> > defaultHttpFiles;
+
+ModemSimulator::ModemSimulator(uint32_t (*clock)(), const ModemSimulatorConfig& config)
+    : clock(clock), config(config), random(config.seed ? config.seed : 1), baud(115200), echo(true), skipLineFeed(false),
+      mode(SIM_COMMAND), payloadRemaining(0), payloadLength(0), smsReference(0), pdpActive(false),
+      tcpConnected(false), rxGetMode(false), quickSend(false), tcpSent(0), tcpAcked(0), uplinkFreeAt(0),
+      httpBodyRemaining(0), httpBodyLength(0), httpInBody(false),
+      httpResponder(defaultHttpResponder), httpContext(&defaultHttpFiles), transcriptPos(0) {
+  memset(&stats, 0, sizeof(stats));
+}
+
+void ModemSimulator::setHttpResponder(ModemSimHttpResponder responder, void* context) {
+  httpResponder = responder;
+  httpContext = context;
+}
+
+void ModemSimulator::addRule(const char* prefix, const char* reply) {
+  rules.push_back(std::make_pair(std::string(prefix), std::string(reply)));
+}
+
+void ModemSimulator::loadTranscript(const char* text) {
+  transcript.clear();
+  transcriptPos = 0;
+  
+  const char* p = text;
+  while (*p) {
+    const char* end = strchr(p, '\n');
+    std::string logLine = end ? std::string(p, end - p) : std::string(p);
+    p = end ? end + 1 : p + logLine.length();
+    
+    while (!logLine.empty() && (logLine.back() == '\r' || logLine.back() == ' ')) {
+      logLine.pop_back();
+    }
+    
+    if (startsWith(logLine, "AT> ")) {
+      Exchange exchange;
+      exchange.command = logLine.substr(4);
+      transcript.push_back(exchange);
+    } else if (!transcript.empty() && !logLine.empty() && !startsWith(logLine, "URC: ")) {
+      std::string& reply = transcript.back().reply;
+      reply += (startsWith(logLine, "AT< ") ? logLine.substr(4) : logLine) + "\n";
+    }
+  }
+}
+
+void ModemSimulator::injectUrc(const char* urc) {
+  sendLine(urc);
+}
+
+size_t ModemSimulator::available() {
+  if (output.empty() || (int32_t)(clock() - output.front().readyAt) < 0) {
+    return 0;
+  }
+  return output.front().data.length();
+}
+
+int ModemSimulator::peek() {
+  return available() ? (uint8_t)output.front().data[0] : -1;
+}
+
+int ModemSimulator::read() {
+  if (!available()) {
+    return -1;
+  }
+  
+  Output& front = output.front();
+  uint8_t c = front.data[0];
+  front.data.erase(0, 1);
+  if (front.data.empty()) {
+    output.pop_front();
+  }
+  return c;
+}
+
+void ModemSimulator::send(const std::string& data, uint32_t delayMs) {
+  uint32_t readyAt = clock() + config.latencyMs + delayMs;
+  
+  // Output stays in order, nothing overtakes a slower answer
+  if (!output.empty() && (int32_t)(output.back().readyAt - readyAt) > 0) {
+    readyAt = output.back().readyAt;
+  }
+  
+  Output chunk;
+  chunk.readyAt = readyAt;
+  chunk.data = data;
+  output.push_back(chunk);
+}
+
+void ModemSimulator::sendLine(const std::string& text, uint32_t delayMs) {
+  send("\r\n" + text + "\r\n", delayMs);
+}
+
+void ModemSimulator::sendRecorded(const std::string& reply) {
+  size_t start = 0;
+  while (start < reply.length()) {
+    size_t end = reply.find('\n', start);
+    std::string recorded = reply.substr(start, end - start);
+    start = end == std::string::npos ? reply.length() : end + 1;
+    
+    // A recorded prompt switches to payload input like the real one
+    if (recorded == ">") {
+      send("\r\n> ");
+    } else {
+      sendLine(recorded);
+    }
+  }
+}
+
+bool ModemSimulator::roll(uint8_t percent) {
+  if (percent == 0) {
+    return false;
+  }
+  
+  // xorshift32, reproducible from the seed
+  random ^= random << 13;
+  random ^= random >> 17;
+  random ^= random << 5;
+  return random % 100 < percent;
+}
+
+uint32_t ModemSimulator::transferMs(size_t bytes) const {
+  return config.bytesPerSecond ? (uint32_t)((uint64_t)bytes * 1000 / config.bytesPerSecond) : 0;
+}
+
+std::string ModemSimulator::clockString() const {
+  time_t now = (time_t)config.epoch + clock() / 1000;
+  struct tm timeinfo;
+  gmtime_r(&now, &timeinfo);
+  
+  char text[32];
+  strftime(text, sizeof(text), "\"%y/%m/%d,%H:%M:%S+00\"", &timeinfo);
+  return text;
+}
+
+size_t ModemSimulator::write(const uint8_t* data, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    uint8_t c = data[i];
+    
+    // The LF of a command's CRLF is not part of the payload it starts
+    bool afterCommand = skipLineFeed;
+    skipLineFeed = false;
+    if (afterCommand && c == '\n') {
+      continue;
+    }
+    
+    if (mode != SIM_COMMAND) {
+      handlePayload(c);
+      continue;
+    }
+    
+    if (c == '\r' || c == '\n') {
+      if (!line.empty()) {
+        std::string command = line;
+        line.clear();
+        handleCommand(command);
+        skipLineFeed = c == '\r';
+      }
+    } else {
+      line += (char)c;
+    }
+  }
+  return length;
+}
+
+void ModemSimulator::handlePayload(uint8_t c) {
+  if (mode == SIM_SMS_TEXT) {
+    if (c != 0x1A) {
+      smsText += (char)c;
+      return;
+    }
+    
+    mode = SIM_COMMAND;
+    if (roll(config.failurePercent)) {
+      stats.failures++;
+      sendLine("+CMS ERROR: 500", 1000);
+      return;
+    }
+    char reference[24];
+    snprintf(reference, sizeof(reference), "+CMGS: %u", (unsigned)++smsReference);
+    sendLine(reference, 1000);
+    sendLine("OK");
+    smsText.clear();
+    return;
+  }
+  
+  stats.payloadBytes++;
+  if (mode == SIM_TCP_DATA) {
+    handleHttpByte(c);
+  }
+  if (--payloadRemaining > 0) {
+    return;
+  }
+  
+  // The whole payload is in, answer once the uplink would have carried it
+  InputMode finished = mode;
+  mode = SIM_COMMAND;
+  if (finished == SIM_HTTP_DATA) {
+    sendLine("OK", transferMs(payloadLength));
+  } else if (roll(config.failurePercent)) {
+    stats.failures++;
+    sendLine("SEND FAIL", transferMs(payloadLength));
+  } else if (quickSend) {
+    // Buffered at once, acknowledged once the uplink has carried it
+    uint32_t now = clock();
+    if ((int32_t)(uplinkFreeAt - now) < 0) {
+      uplinkFreeAt = now;
+    }
+    uplinkFreeAt += transferMs(payloadLength);
+    tcpSent += payloadLength;
+    tcpAcks.push_back(std::make_pair(uplinkFreeAt + config.latencyMs, tcpSent));
+    sendLine("DATA ACCEPT:" + std::to_string(payloadLength));
+  } else {
+    sendLine("SEND OK", transferMs(payloadLength));
+  }
+  
+  if (!tcpReply.empty()) {
+    deliverTcpData(tcpReply);
+    tcpReply.clear();
+  }
+}
+
+void ModemSimulator::handleHttpByte(uint8_t c) {
+  if (httpInBody) {
+    if (--httpBodyRemaining == 0) {
+      finishHttpRequest();
+    }
+    return;
+  }
+  
+  if (httpHead.length() < SIM_MAX_HTTP_HEAD) {
+    httpHead += (char)c;
+  }
+  
+  size_t headEnd = httpHead.find("\r\n\r\n");
+  if (headEnd == std::string::npos) {
+    return;
+  }
+  
+  httpBodyLength = strtoul(headerValue(httpHead, "Content-Length").c_str(), NULL, 10);
+  httpBodyRemaining = httpBodyLength;
+  httpInBody = httpBodyRemaining > 0;
+  if (!httpInBody) {
+    finishHttpRequest();
+  }
+}
+
+void ModemSimulator::finishHttpRequest() {
+  stats.httpRequests++;
+  std::string response = httpResponder(httpHead, httpBodyLength, httpContext);
+  httpHead.clear();
+  httpInBody = false;
+  
+  // Goes out after the SEND OK of the payload that completed it
+  tcpReply += response;
+}
+
+// Server data: announced for AT+CIPRXGET reads, or pushed as +CIPRCV
+void ModemSimulator::deliverTcpData(const std::string& data) {
+  uint32_t delayMs = config.latencyMs;
+  if (rxGetMode) {
+    bool announce = rxBuffer.empty();
+    rxBuffer += data;
+    if (announce) {
+      sendLine("+CIPRXGET: 1", delayMs);
+    }
+    return;
+  }
+  
+  char head[32];
+  snprintf(head, sizeof(head), "+CIPRCV: %u,", (unsigned)data.length());
+  sendLine(head + data, delayMs);
+}
+
+void ModemSimulator::handleCommand(const std::string& command) {
+  stats.commands++;
+  
+  if (echo) {
+    send(command + "\r");
+  }
+  
+  if (roll(config.silentPercent)) {
+    stats.silent++;
+    return;
+  }
+  
+  if (handleScripted(command)) {
+    stats.scripted++;
+    return;
+  }
+  
+  handleBuiltIn(command);
+}
+
+bool ModemSimulator::handleScripted(const std::string& command) {
+  for (size_t i = 0; i < rules.size(); i++) {
+    if (startsWith(command, rules[i].first.c_str())) {
+      sendRecorded(rules[i].second);
+      return true;
+    }
+  }
+  
+  if (transcriptPos < transcript.size() && transcript[transcriptPos].command == command) {
+    // The log has the modem's echo too, which was already sent
+    std::string reply = transcript[transcriptPos++].reply;
+    if (startsWith(reply, (command + "\n").c_str())) {
+      reply.erase(0, command.length() + 1);
+    }
+    sendRecorded(reply);
+    return true;
+  }
+  return false;
+}
+
+void ModemSimulator::handleBuiltIn(const std::string& command) {
+  std::string upper = command;
+  for (size_t i = 0; i < upper.length(); i++) {
+    upper[i] = toupper((unsigned char)upper[i]);
+  }
+  
+  // Plain settings that only need an OK
+  static const char* const accepted[] = {
+    "AT+CMEE", "AT+CFUN", "AT+IFC", "AT+CIPMUX", "AT+CMGF", "AT+HTTPINIT", "AT+HTTPPARA",
+    "AT+HTTPTERM", "AT+CNTP=", "AT+CIPHEAD", "AT+CNMP", "AT+CMNB", "AT+CREG=", "AT+CGREG=",
+    "AT+CEREG=", "AT+CNMI", "AT+CMGD", "AT+CMGL"
+  };
+  
+  if (upper == "AT") {
+    sendLine("OK");
+  } else if (upper == "ATE0" || upper == "ATE1") {
+    echo = upper == "ATE1";
+    sendLine("OK");
+  } else if (startsWith(upper, "AT+IPR=")) {
+    // Answered at the old rate, then the modem switches
+    sendLine("OK");
+    baud = strtoul(command.c_str() + 7, NULL, 10);
+  } else if (upper == "AT+CPIN?") {
+    sendLine("+CPIN: READY");
+    sendLine("OK");
+  } else if (upper == "AT+CREG?" || upper == "AT+CGREG?" || upper == "AT+CEREG?") {
+    sendLine(upper.substr(2, upper.length() - 3) + ": 1," + std::to_string(config.registration));
+    sendLine("OK");
+  } else if (upper == "AT+CSQ") {
+    sendLine("+CSQ: " + std::to_string(config.rssi) + ",99");
+    sendLine("OK");
+  } else if (startsWith(upper, "AT+SAPBR=3")) {
+    sendLine("OK");
+  } else if (startsWith(upper, "AT+SAPBR=1")) {
+    bool registered = config.registration == 1 || config.registration == 5;
+    pdpActive = registered && !roll(config.failurePercent);
+    sendLine(pdpActive ? "OK" : "ERROR", 500);
+  } else if (startsWith(upper, "AT+SAPBR=2")) {
+    sendLine(pdpActive ? "+SAPBR: 1,1,\"10.64.0.2\"" : "+SAPBR: 1,3,\"0.0.0.0\"");
+    sendLine("OK");
+  } else if (startsWith(upper, "AT+SAPBR=0")) {
+    pdpActive = false;
+    sendLine("OK");
+  } else if (upper == "AT+CNTP") {
+    sendLine("OK");
+    sendLine(roll(config.failurePercent) ? "+CNTP: 61" : "+CNTP: 1", 500);
+  } else if (upper == "AT+CCLK?") {
+    sendLine("+CCLK: " + clockString());
+    sendLine("OK");
+  } else if (startsWith(upper, "AT+CMGS=")) {
+    mode = SIM_SMS_TEXT;
+    smsText.clear();
+    send("\r\n> ");
+  } else if (startsWith(upper, "AT+CDNSGIP=")) {
+    size_t start = command.find('"');
+    std::string host = command.substr(start + 1, command.rfind('"') - start - 1);
+    sendLine("OK");
+    if (!pdpActive || roll(config.failurePercent)) {
+      stats.failures += pdpActive ? 1 : 0;
+      sendLine("+CDNSGIP: 0,8", 1000);
+    } else {
+      sendLine("+CDNSGIP: 1,\"" + host + "\",\"10.0.0.1\"", 300);
+    }
+  } else if (startsWith(upper, "AT+CIPSTART=")) {
+    sendLine("OK");
+    if (!pdpActive || roll(config.failurePercent)) {
+      stats.failures += pdpActive ? 1 : 0;
+      sendLine("CONNECT FAIL", 1000);
+    } else {
+      tcpConnected = true;
+      httpHead.clear();
+      httpInBody = false;
+      tcpSent = 0;
+      tcpAcked = 0;
+      tcpAcks.clear();
+      sendLine("CONNECT OK", 600);
+    }
+  } else if (startsWith(upper, "AT+CIPQSEND=")) {
+    quickSend = atoi(command.c_str() + 12) == 1;
+    sendLine("OK");
+  } else if (upper == "AT+CIPSEND?") {
+    sendLine("+CIPSEND: " + std::to_string(SIM_MAX_PACKET));
+    sendLine("OK");
+  } else if (upper == "AT+CIPACK") {
+    uint32_t now = clock();
+    while (!tcpAcks.empty() && (int32_t)(tcpAcks.front().first - now) <= 0) {
+      tcpAcked = tcpAcks.front().second;
+      tcpAcks.pop_front();
+    }
+    sendLine("+CIPACK: " + std::to_string(tcpSent) + "," + std::to_string(tcpAcked) + "," +
+             std::to_string(tcpSent - tcpAcked));
+    sendLine("OK");
+  } else if (startsWith(upper, "AT+CIPSEND=")) {
+    payloadLength = strtoul(command.c_str() + 11, NULL, 10);
+    if (!tcpConnected || payloadLength == 0) {
+      sendLine("ERROR");
+      return;
+    }
+    payloadRemaining = payloadLength;
+    mode = SIM_TCP_DATA;
+    send("\r\n> ");
+  } else if (upper == "AT+CIPRXGET=1") {
+    rxGetMode = true;
+    sendLine("OK");
+  } else if (startsWith(upper, "AT+CIPRXGET=2,")) {
+    size_t wanted = strtoul(command.c_str() + 14, NULL, 10);
+    size_t n = std::min(std::min(wanted, rxBuffer.length()), (size_t)SIM_MAX_RXGET);
+    std::string head = "+CIPRXGET: 2," + std::to_string(n) + "," + std::to_string(rxBuffer.length() - n);
+    send("\r\n" + head + "\r\n" + rxBuffer.substr(0, n));
+    rxBuffer.erase(0, n);
+    sendLine("OK");
+  } else if (upper == "AT+CIPRXGET=4") {
+    sendLine("+CIPRXGET: 4," + std::to_string(rxBuffer.length()));
+    sendLine("OK");
+  } else if (upper == "AT+CIPCLOSE") {
+    sendLine(tcpConnected ? "CLOSE OK" : "ERROR");
+    tcpConnected = false;
+    rxBuffer.clear();
+  } else if (upper == "AT+CIPSHUT") {
+    tcpConnected = false;
+    rxBuffer.clear();
+    sendLine("SHUT OK");
+  } else if (startsWith(upper, "AT+HTTPDATA=")) {
+    payloadLength = strtoul(command.c_str() + 12, NULL, 10);
+    payloadRemaining = payloadLength;
+    mode = payloadLength > 0 ? SIM_HTTP_DATA : SIM_COMMAND;
+    sendLine("DOWNLOAD");
+  } else if (startsWith(upper, "AT+HTTPACTION=")) {
+    int method = atoi(command.c_str() + 14);
+    sendLine("OK");
+    if (!pdpActive || roll(config.failurePercent)) {
+      stats.failures += pdpActive ? 1 : 0;
+      sendLine("+HTTPACTION: " + std::to_string(method) + ",601,0", 2000);
+    } else {
+      sendLine("+HTTPACTION: " + std::to_string(method) + ",200,0", 800);
+    }
+  } else if (upper == "AT+HTTPREAD") {
+    sendLine("+HTTPREAD: 0");
+    sendLine("OK");
+  } else {
+    for (size_t i = 0; i < sizeof(accepted) / sizeof(accepted[0]); i++) {
+      if (startsWith(upper, accepted[i])) {
+        sendLine("OK");
+        return;
+      }
+    }
+    sendLine("ERROR");
+  }
+}
@@ -0,0 +1,145 @@
+#ifndef MODEM_SIMULATOR_H
+#define MODEM_SIMULATOR_H
+
+// A stand-in SIM7000G, so the cellular, SMS, time sync and upload code can
+// run without a SIM. It answers the AT commands this firmware uses, accepts
+// TCP and HTTP payloads at a set uplink rate and can inject failures.
+// Scripted rules and recorded transcripts (the "AT>" / "AT<" lines of the
+// serial log) take precedence over the built-in answers. Free of Arduino
+// includes so it can be built on a host machine; on the device it replaces
+// the UART when built with -DMODEM_SIMULATOR.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct ModemSimulatorConfig {
+  uint32_t latencyMs;        // Before every answer
+  uint32_t bytesPerSecond;   // Uplink rate for TCP/HTTP payloads, 0 for no limit
+  uint8_t failurePercent;    // Chance that a connect, DNS lookup, send or SMS fails
+  uint8_t silentPercent;     // Chance that a command gets no answer at all
+  uint8_t rssi;              // +CSQ value, 99 for unknown
+  uint8_t registration;      // +CREG/+CGREG/+CEREG stat: 1 home, 5 roaming, 2 searching
+  uint32_t epoch;            // +CCLK time at clock() == 0 (UTC seconds)
+  uint32_t seed;             // For the failure injection
+};
+
+struct ModemSimulatorStats {
+  uint32_t commands;
+  uint32_t scripted;         // Answered by a rule or the transcript
+  uint32_t failures;         // Injected
+  uint32_t silent;           // Injected
+  uint64_t payloadBytes;     // TCP and HTTP data accepted
+  uint32_t httpRequests;     // Complete requests seen on the TCP connection
+};
+
+// Answer to a complete HTTP request sent over the simulated TCP connection
+typedef std::string (*ModemSimHttpResponder)(const std::string& head, size_t bodyLength, void* context);
+
+class ModemSimulator {
+public:
+  // clock returns milliseconds, it paces answers and payloads
+  ModemSimulator(uint32_t (*clock)(), const ModemSimulatorConfig& config);
+  
+  // Bytes the firmware writes to the modem, all of them are taken
+  size_t write(const uint8_t* data, size_t length);
+  
+  // Bytes the modem has sent by now
+  size_t available();
+  int read();
+  int peek();
+  
+  // Answer commands starting with prefix with these lines ("\n" between
+  // lines, "" for no answer); checked before everything else
+  void addRule(const char* prefix, const char* reply);
+  
+  // Replay a serial log: each "AT> command" line is expected in order and
+  // answered with the lines up to the next one ("AT< " is stripped)
+  void loadTranscript(const char* text);
+  
+  // Send an unsolicited line, e.g. "+APP PDP: 0,DEACTIVE"
+  void injectUrc(const char* line);
+  
+  void setHttpResponder(ModemSimHttpResponder responder, void* context);
+  void setConfig(const ModemSimulatorConfig& newConfig) { config = newConfig; }
+  uint32_t getBaud() const { return baud; }
+  const ModemSimulatorStats& getStats() const { return stats; }
+
+private:
+  enum InputMode {
+    SIM_COMMAND,
+    SIM_SMS_TEXT,    // Until Ctrl+Z
+    SIM_TCP_DATA,    // After AT+CIPSEND=<n>
+    SIM_HTTP_DATA    // After AT+HTTPDATA=<n>
+  };
+  
+  struct Output {
+    uint32_t readyAt;
+    std::string data;
+  };
+  
+  struct Exchange {
+    std::string command;
+    std::string reply;
+  };
+  
+  void handleCommand(const std::string& command);
+  bool handleScripted(const std::string& command);
+  void handleBuiltIn(const std::string& command);
+  void handlePayload(uint8_t c);
+  void handleHttpByte(uint8_t c);
+  void finishHttpRequest();
+  void deliverTcpData(const std::string& data);
+  
+  // Queue output delayMs after the latency; lines are framed as "\r\n<line>\r\n"
+  void send(const std::string& data, uint32_t delayMs = 0);
+  void sendLine(const std::string& line, uint32_t delayMs = 0);
+  void sendRecorded(const std::string& reply);
+  
+  bool roll(uint8_t percent);
+  uint32_t transferMs(size_t bytes) const;
+  std::string clockString() const;
+  
+  uint32_t (*clock)();
+  ModemSimulatorConfig config;
+  ModemSimulatorStats stats;
+  uint32_t random;
+  uint32_t baud;
+  bool echo;
+  bool skipLineFeed;
+  
+  InputMode mode;
+  std::string line;
+  std::string smsText;
+  size_t payloadRemaining;
+  size_t payloadLength;
+  uint32_t smsReference;
+  
+  bool pdpActive;
+  bool tcpConnected;
+  bool rxGetMode;           // AT+CIPRXGET=1, data is fetched on request
+  bool quickSend;           // AT+CIPQSEND=1, DATA ACCEPT instead of SEND OK
+  uint32_t tcpSent;
+  uint32_t tcpAcked;
+  uint32_t uplinkFreeAt;    // When the uplink has carried everything sent so far
+  std::deque<std::pair<uint32_t, uint32_t> > tcpAcks;  // Time each send is acked, bytes sent by then
+  std::string rxBuffer;
+  
+  std::string httpHead;     // Request being received over TCP
+  size_t httpBodyRemaining;
+  size_t httpBodyLength;
+  std::string tcpReply;     // Server answer waiting for the SEND OK
+  bool httpInBody;
+  ModemSimHttpResponder httpResponder;
+  void* httpContext;
+  
+  std::deque<Output> output;
+  std::vector<std::pair<std::string, std::string> > rules;
+  std::vector<Exchange> transcript;
+  size_t transcriptPos;
+};
+
+#endif // MODEM_SIMULATOR_H
@@ -0,0 +1,92 @@
+#include "modem_task.h"
+#include "config.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+struct QueuedModemJob {
+  const char* name;
+  ModemJobFunction run;
+  void* arg;
+  ModemJob* job;
+};
+
+TaskHandle_t modemTaskHandle = NULL;
+QueueHandle_t modemJobQueue = NULL;
+
+static void runModemJob(const QueuedModemJob& queued) {
+  unsigned long start = millis();
+  bool ok = queued.run(queued.arg);
+  Serial.printf("Modem job %s %s in %lu ms\n", queued.name, ok ? "done" : "failed", millis() - start);
+  
+  if (queued.job) {
+    queued.job->ok = ok;
+    queued.job->finished = true;
+    queued.job->pending = false;
+  }
+}
+
+static void modemTask(void* param) {
+  QueuedModemJob queued;
+  while (true) {
+    if (xQueueReceive(modemJobQueue, &queued, portMAX_DELAY) == pdTRUE) {
+      runModemJob(queued);
+    }
+  }
+}
+
+bool startModemTask() {
+  if (modemTaskHandle) {
+    return true;
+  }
+  
+  modemJobQueue = xQueueCreate(MODEM_TASK_QUEUE_LENGTH, sizeof(QueuedModemJob));
+  
+  // Core 0 beside the upload task; both take the modem lock
+  BaseType_t result = xTaskCreatePinnedToCore(modemTask, "modem", MODEM_TASK_STACK_SIZE, NULL,
+                                              MODEM_TASK_PRIORITY, &modemTaskHandle, 0);
+  if (result != pdPASS) {
+    Serial.println("Failed to start modem task");
+    modemTaskHandle = NULL;
+    return false;
+  }
+  
+  return true;
+}
+
+bool queueModemJob(const char* name, ModemJobFunction run, void* arg, ModemJob* job) {
+  if (job && job->pending) {
+    return false;
+  }
+  
+  QueuedModemJob queued = {name, run, arg, job};
+  if (job) {
+    job->pending = true;
+    job->finished = false;
+  }
+  
+  // Without the task, run it in the caller as before
+  if (!modemTaskHandle) {
+    runModemJob(queued);
+    return true;
+  }
+  
+  if (xQueueSend(modemJobQueue, &queued, 0) != pdTRUE) {
+    Serial.printf("Modem job queue full, %s dropped\n", name);
+    if (job) {
+      job->pending = false;
+    }
+    return false;
+  }
+  return true;
+}
+
+bool takeModemJobResult(ModemJob& job, bool& ok) {
+  if (!job.finished) {
+    return false;
+  }
+  
+  job.finished = false;
+  ok = job.ok;
+  return true;
+}
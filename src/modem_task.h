@@ -0,0 +1,29 @@
+#ifndef MODEM_TASK_H
+#define MODEM_TASK_H
+
+#include <Arduino.h>
+
+// Work that needs the modem for more than a moment (SMS, time sync,
+// reachability probes) runs on its own task, one job at a time, so the main
+// loop never waits on the modem
+
+typedef bool (*ModemJobFunction)(void* arg);
+
+// Outcome of a queued job, polled from the main loop
+struct ModemJob {
+  volatile bool pending;
+  volatile bool finished;
+  volatile bool ok;
+};
+
+// Create the task (once, from setup)
+bool startModemTask();
+
+// Queue a job; job (optional) reports when it is done. False if the queue
+// is full or that job is still pending.
+bool queueModemJob(const char* name, ModemJobFunction run, void* arg, ModemJob* job = NULL);
+
+// True once after the job finished, with its result in ok
+bool takeModemJobResult(ModemJob& job, bool& ok);
+
+#endif // MODEM_TASK_H
@@ -1,4 +1,5 @@
 #include "ota.h"
+#include "storage.h"
 #include "led_control.h"
 #include "config.h"
 #include <WiFi.h>
@@ -64,7 +65,7 @@ bool initOTA() {
   setLEDState(LED_OTA_MODE);
   
   // Initialize LittleFS for web files
-  if (!LittleFS.begin(true)) {
+  if (!mountConfigStorage()) {
     Serial.println("Failed to mount LittleFS for OTA");
     return false;
   }
@@ -0,0 +1,158 @@
+#include "preview.h"
+#include "config.h"
+#include "esp_jpg_decode.h"
+#include "img_converters.h"
+
+// Generation timing
+static uint32_t previewCount = 0;
+static uint64_t previewMicrosTotal = 0;
+static unsigned long previewMicrosMax = 0;
+static uint64_t previewBytesIn = 0;
+static uint64_t previewBytesOut = 0;
+static uint32_t previewFailures = 0;
+
+// Decoder state: the capture is read through the storage backend, the
+// scaled pixels go to an RGB888 buffer
+struct PreviewDecoder {
+  StorageFile* file;
+  size_t position;
+  uint8_t* pixels;
+  uint16_t width;
+  uint16_t height;
+};
+
+static size_t readCapture(void* arg, size_t index, uint8_t* buffer, size_t len) {
+  PreviewDecoder* decoder = (PreviewDecoder*)arg;
+  if (index != decoder->position && !decoder->file->seek(index)) {
+    return 0;
+  }
+  decoder->position = index;
+  
+  // No buffer means skip
+  if (!buffer) {
+    if (!decoder->file->seek(index + len)) {
+      return 0;
+    }
+    decoder->position += len;
+    return len;
+  }
+  
+  size_t n = decoder->file->read(buffer, len);
+  decoder->position += n;
+  return n;
+}
+
+static bool writePixels(void* arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t* data) {
+  PreviewDecoder* decoder = (PreviewDecoder*)arg;
+  
+  // Called without data at the start (with the output size) and at the end
+  if (!data) {
+    if (x == 0 && y == 0 && !decoder->pixels) {
+      size_t bytes = (size_t)w * h * 3;
+      decoder->pixels = (uint8_t*)(psramFound() ? ps_malloc(bytes) : malloc(bytes));
+      decoder->width = w;
+      decoder->height = h;
+      return decoder->pixels != NULL;
+    }
+    return true;
+  }
+  
+  // The JPEG encoder takes BGR, the decoder gives RGB
+  size_t stride = (size_t)decoder->width * 3;
+  for (uint16_t row = 0; row < h; row++) {
+    uint8_t* out = decoder->pixels + (y + row) * stride + x * 3;
+    for (uint16_t col = 0; col < w; col++) {
+      out[0] = data[2];
+      out[1] = data[1];
+      out[2] = data[0];
+      out += 3;
+      data += 3;
+    }
+  }
+  return true;
+}
+
+bool makePreview(StorageBackend* storage, const char* capturePath, uint8_t** jpeg, size_t* len) {
+  unsigned long start = micros();
+  
+  StorageFilePtr file = storage->open(capturePath, STORAGE_READ);
+  if (!file) {
+    return false;
+  }
+  
+  size_t captureSize = file->size();
+  PreviewDecoder decoder = { file.get(), 0, NULL, 0, 0 };
+  esp_err_t err = esp_jpg_decode(captureSize, PREVIEW_SCALE, readCapture, writePixels, &decoder);
+  file->close();
+  
+  bool result = false;
+  if (err != ESP_OK || !decoder.pixels) {
+    Serial.printf("Failed to decode %s for a preview\n", capturePath);
+  } else {
+    result = fmt2jpg(decoder.pixels, (size_t)decoder.width * decoder.height * 3, decoder.width,
+                     decoder.height, PIXFORMAT_RGB888, PREVIEW_JPEG_QUALITY, jpeg, len);
+    if (!result) {
+      Serial.printf("Failed to encode preview of %s\n", capturePath);
+    }
+  }
+  free(decoder.pixels);
+  
+  if (result) {
+    unsigned long elapsed = micros() - start;
+    previewCount++;
+    previewMicrosTotal += elapsed;
+    previewMicrosMax = max(previewMicrosMax, elapsed);
+    previewBytesIn += captureSize;
+    previewBytesOut += *len;
+  }
+  return result;
+}
+
+String getPreviewName(const String& captureName) {
+  int dot = captureName.lastIndexOf('.');
+  String base = dot == -1 ? captureName : captureName.substring(0, dot);
+  return base + "_p.jpg";
+}
+
+String getPreviewMarkerPath(const char* capturePath) {
+  return String(capturePath) + PREVIEW_MARKER_EXT;
+}
+
+bool isPreviewSent(StorageBackend* storage, const char* capturePath) {
+  return storage->exists(getPreviewMarkerPath(capturePath).c_str());
+}
+
+void markPreviewSent(StorageBackend* storage, const char* capturePath) {
+  StorageFilePtr file = storage->open(getPreviewMarkerPath(capturePath).c_str(), STORAGE_WRITE);
+  if (file) {
+    file->close();
+  }
+}
+
+bool isPreviewFailed(StorageBackend* storage, const char* capturePath) {
+  size_t size;
+  return storage->stat(getPreviewMarkerPath(capturePath).c_str(), &size) && size > 0;
+}
+
+void markPreviewFailed(StorageBackend* storage, const char* capturePath) {
+  StorageFilePtr file = storage->open(getPreviewMarkerPath(capturePath).c_str(), STORAGE_WRITE);
+  if (file) {
+    file->write((const uint8_t*)PREVIEW_FAILED_MARKER, strlen(PREVIEW_FAILED_MARKER));
+    file->close();
+  }
+  previewFailures++;
+}
+
+void printPreviewStats() {
+  if (previewFailures > 0) {
+    Serial.printf("Previews: %lu captures had none, originals sent instead\n", (unsigned long)previewFailures);
+  }
+  if (previewCount == 0) {
+    return;
+  }
+  
+  Serial.printf("Previews: %lu frames, %lu ms average (%lu ms max), %lu KB -> %lu KB\n",
+                (unsigned long)previewCount, (unsigned long)(previewMicrosTotal / previewCount / 1000),
+                previewMicrosMax / 1000, (unsigned long)(previewBytesIn / 1024),
+                (unsigned long)(previewBytesOut / 1024));
+}
@@ -0,0 +1,30 @@
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include <Arduino.h>
+#include "storage_backend.h"
+
+// Small previews of captures, uploaded ahead of the full resolution files
+
+// Decode a capture at PREVIEW_SCALE and re-encode it as a small JPEG. At 1/8
+// the decoder only uses the DC coefficients, so this is cheap. The caller
+// frees the returned buffer with free().
+bool makePreview(StorageBackend* storage, const char* capturePath, uint8_t** jpeg, size_t* len);
+
+// Name of the preview on the server ("capture_..._p.jpg")
+String getPreviewName(const String& captureName);
+
+// Marker left once a capture's preview has been uploaded ("<capture>.pv")
+String getPreviewMarkerPath(const char* capturePath);
+bool isPreviewSent(StorageBackend* storage, const char* capturePath);
+void markPreviewSent(StorageBackend* storage, const char* capturePath);
+
+// The same marker, holding PREVIEW_FAILED_MARKER, when no preview could be made (the
+// capture doesn't decode); the original is sent in its place
+bool isPreviewFailed(StorageBackend* storage, const char* capturePath);
+void markPreviewFailed(StorageBackend* storage, const char* capturePath);
+
+// Generation cost per frame (done by the upload task, not the capture path)
+void printPreviewStats();
+
+#endif // PREVIEW_H
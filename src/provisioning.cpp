@@ -2,6 +2,8 @@
 #include "led_control.h"
 #include "config.h"
 #include "google_drive.h"
+#include "webdav_upload.h"
+#include "uploader.h"
 #include "sms_messaging.h"
 #include "storage.h"
 #include <WiFi.h>
@@ -70,6 +72,7 @@ void setupWebServer();
 void setupBLE();
 void handleRoot();
 void handleSetCredentials();
+void handleSetWebDav();
 void handleSetSettings();
 void handleProvisioningJSON(String jsonData);
 void markAsProvisioned();
@@ -162,6 +165,7 @@ void setupWebServer() {
   // Set up web server routes
   server.on("/", handleRoot);
   server.on("/setcredentials", HTTP_POST, handleSetCredentials);
+  server.on("/setwebdav", HTTP_POST, handleSetWebDav);
   server.on("/setsettings", HTTP_POST, handleSetSettings);
   
   // Start server
@@ -227,6 +231,15 @@ void handleRoot() {
     html += "<input type='submit' value='Save Credentials'>";
     html += "</form>";
     
+    // Upload server form, used instead of Google Drive
+    html += "<h2>Upload Server (WebDAV)</h2>";
+    html += "<form action='/setwebdav' method='post'>";
+    html += "Folder URL: <input type='url' name='webdav_url'><br>";
+    html += "User: <input type='text' name='webdav_user'><br>";
+    html += "Password: <input type='password' name='webdav_password'><br>";
+    html += "<input type='submit' value='Save Server'>";
+    html += "</form>";
+    
     // Device settings form
     html += "<h2>Device Settings</h2>";
     html += "<form action='/setsettings' method='post'>";
@@ -261,6 +274,7 @@ void handleSetCredentials() {
   }
   
   if (saveGoogleDriveCredentials(client_id, client_secret, refresh_token, folder_id)) {
+    selectUploadBackend("drive");
     server.send(200, "text/plain", "Credentials saved successfully");
     markAsProvisioned();
   } else {
@@ -268,6 +282,25 @@ void handleSetCredentials() {
   }
 }
 
+void handleSetWebDav() {
+  String url = server.arg("webdav_url");
+  String user = server.arg("webdav_user");
+  String password = server.arg("webdav_password");
+  
+  if (url.length() == 0) {
+    server.send(400, "text/plain", "Missing server URL");
+    return;
+  }
+  
+  if (saveWebDavSettings(url, user, password)) {
+    selectUploadBackend("webdav");
+    server.send(200, "text/plain", "Upload server saved successfully");
+    markAsProvisioned();
+  } else {
+    server.send(500, "text/plain", "Failed to save upload server");
+  }
+}
+
 void handleSetSettings() {
   // Retrieve form values
   String lightThresholdStr = server.arg("light_threshold");
@@ -403,6 +436,7 @@ void handleProvisioningJSON(String jsonData) {
   
   // Determine if this is credentials or settings
   bool isCredentials = doc.containsKey("client_id") && doc.containsKey("client_secret");
+  bool isWebDav = doc.containsKey("webdav_url");
   bool isSettings = doc.containsKey("light_threshold") || doc.containsKey("sound_threshold") || 
                     doc.containsKey("base_filename") || doc.containsKey("phone_number");
   
@@ -426,10 +460,26 @@ void handleProvisioningJSON(String jsonData) {
       if (!saveGoogleDriveCredentials(client_id, client_secret, refresh_token, folder_id)) {
         errorMsg += "Failed to save Google Drive credentials. ";
         success = false;
+      } else {
+        selectUploadBackend("drive");
       }
     }
   }
   
+  // Process upload server settings if present
+  if (isWebDav) {
+    String url = doc["webdav_url"] | "";
+    String user = doc["webdav_user"] | "";
+    String password = doc["webdav_password"] | "";
+    
+    if (!saveWebDavSettings(url, user, password)) {
+      errorMsg += "Failed to save upload server. ";
+      success = false;
+    } else {
+      selectUploadBackend("webdav");
+    }
+  }
+  
   // Process device settings if present
   if (isSettings) {
     // Light threshold
@@ -536,7 +586,7 @@ void handleProvisioningJSON(String jsonData) {
   }
   
   // If success and both credentials and settings are provided, we can stop provisioning
-  if (success && isCredentials) {
+  if (success && (isCredentials || isWebDav)) {
     // But wait a bit to allow the BLE client to receive the response
     delay(1000);
     stopProvisioning();
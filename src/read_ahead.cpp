@@ -0,0 +1,182 @@
+#include "read_ahead.h"
+#include "config.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+// Buffers and queues are allocated once and shared, uploads run one at a time
+uint8_t* readAheadArena = NULL;
+QueueHandle_t freeBlocks = NULL;     // Buffer indices ready to be filled
+QueueHandle_t filledBlocks = NULL;   // Blocks ready to be sent, in order
+SemaphoreHandle_t readerStopped = NULL;
+ReadAheadStats readAheadStats;
+
+ReadAheadUploadSource::ReadAheadUploadSource(UploadSource& source)
+    : source(source), total(source.size()), ready(false), readerRunning(false),
+      stopRequested(false), readOffset(0), position(0), currentPos(0), hasCurrent(false) {
+}
+
+ReadAheadUploadSource::~ReadAheadUploadSource() {
+  end();
+}
+
+bool ReadAheadUploadSource::begin() {
+  if (READ_AHEAD_BUFFER_COUNT < 2 || !psramFound()) {
+    return false;
+  }
+  
+  if (!readAheadArena) {
+    readAheadArena = (uint8_t*)ps_malloc((size_t)READ_AHEAD_BUFFER_COUNT * READ_AHEAD_BUFFER_SIZE);
+    if (!readAheadArena) {
+      Serial.println("Failed to allocate read-ahead buffers");
+      return false;
+    }
+    freeBlocks = xQueueCreate(READ_AHEAD_BUFFER_COUNT, sizeof(uint8_t));
+    filledBlocks = xQueueCreate(READ_AHEAD_BUFFER_COUNT, sizeof(Block));
+    readerStopped = xSemaphoreCreateBinary();
+  }
+  
+  ready = true;
+  return true;
+}
+
+void ReadAheadUploadSource::end() {
+  stopReader();
+  ready = false;
+}
+
+void ReadAheadUploadSource::readerTask(void* param) {
+  ReadAheadUploadSource* self = (ReadAheadUploadSource*)param;
+  
+  while (!self->stopRequested && self->readOffset < self->total) {
+    // Time spent here is storage sitting idle behind the network
+    uint8_t index;
+    unsigned long waitStart = micros();
+    bool got = xQueueReceive(freeBlocks, &index, pdMS_TO_TICKS(100)) == pdTRUE;
+    readAheadStats.storageIdleMicros += micros() - waitStart;
+    if (!got) {
+      continue;
+    }
+    
+    unsigned long readStart = micros();
+    size_t want = min((size_t)READ_AHEAD_BUFFER_SIZE, self->total - self->readOffset);
+    Block block = { index, self->source.read(readAheadArena + (size_t)index * READ_AHEAD_BUFFER_SIZE, want) };
+    readAheadStats.readMicros += micros() - readStart;
+    
+    // Never blocks, there are only as many blocks as buffers
+    xQueueSend(filledBlocks, &block, portMAX_DELAY);
+    if (block.len == 0) {
+      break;
+    }
+    self->readOffset += block.len;
+  }
+  
+  xSemaphoreGive(readerStopped);
+  vTaskDelete(NULL);
+}
+
+void ReadAheadUploadSource::startReader(size_t offset) {
+  xQueueReset(freeBlocks);
+  xQueueReset(filledBlocks);
+  for (uint8_t i = 0; i < READ_AHEAD_BUFFER_COUNT; i++) {
+    xQueueSend(freeBlocks, &i, 0);
+  }
+  
+  readOffset = offset;
+  position = offset;
+  hasCurrent = false;
+  stopRequested = false;
+  xSemaphoreTake(readerStopped, 0);
+  
+  // Core 1, so storage reads overlap the modem writes of the upload task on core 0
+  readerRunning = xTaskCreatePinnedToCore(readerTask, "readahead", READ_AHEAD_TASK_STACK_SIZE, this,
+                                          UPLOAD_TASK_PRIORITY, NULL, 1) == pdPASS;
+  if (!readerRunning) {
+    Serial.println("Failed to start read-ahead task");
+  }
+}
+
+void ReadAheadUploadSource::stopReader() {
+  if (!readerRunning) {
+    return;
+  }
+  
+  stopRequested = true;
+  xSemaphoreTake(readerStopped, portMAX_DELAY);
+  readerRunning = false;
+  hasCurrent = false;
+}
+
+bool ReadAheadUploadSource::seek(size_t offset) {
+  // Sequential chunks land where the reader already is
+  if (readerRunning && offset == position) {
+    return true;
+  }
+  
+  stopReader();
+  if (!ready || offset > total || !source.seek(offset)) {
+    return false;
+  }
+  startReader(offset);
+  return readerRunning;
+}
+
+size_t ReadAheadUploadSource::read(uint8_t* buffer, size_t len) {
+  if (!readerRunning && !seek(position)) {
+    return 0;
+  }
+  
+  size_t copied = 0;
+  while (copied < len && position < total) {
+    if (!hasCurrent) {
+      // Time spent here is the network waiting for storage
+      unsigned long waitStart = micros();
+      bool got = xQueueReceive(filledBlocks, &current, pdMS_TO_TICKS(HTTP_TIMEOUT_MS)) == pdTRUE;
+      readAheadStats.sendWaitMicros += micros() - waitStart;
+      if (!got) {
+        break;
+      }
+      if (current.len == 0) {
+        Serial.println("Read-ahead: storage read failed");
+        xQueueSend(freeBlocks, &current.index, 0);
+        break;
+      }
+      hasCurrent = true;
+      currentPos = 0;
+    }
+    
+    size_t n = min(len - copied, current.len - currentPos);
+    memcpy(buffer + copied, readAheadArena + (size_t)current.index * READ_AHEAD_BUFFER_SIZE + currentPos, n);
+    copied += n;
+    currentPos += n;
+    position += n;
+    
+    if (currentPos == current.len) {
+      xQueueSend(freeBlocks, &current.index, 0);
+      hasCurrent = false;
+    }
+  }
+  
+  readAheadStats.bytes += copied;
+  return copied;
+}
+
+const ReadAheadStats& getReadAheadStats() {
+  return readAheadStats;
+}
+
+void resetReadAheadStats() {
+  memset(&readAheadStats, 0, sizeof(readAheadStats));
+}
+
+void printReadAheadStats() {
+  if (readAheadStats.bytes == 0) {
+    return;
+  }
+  
+  Serial.printf("  Read-ahead (%d x %u KB): storage busy %lu ms, idle %lu ms, sender waited %lu ms\n",
+                READ_AHEAD_BUFFER_COUNT, (unsigned)(READ_AHEAD_BUFFER_SIZE / 1024),
+                (unsigned long)(readAheadStats.readMicros / 1000),
+                (unsigned long)(readAheadStats.storageIdleMicros / 1000),
+                (unsigned long)(readAheadStats.sendWaitMicros / 1000));
+}
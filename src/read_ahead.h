@@ -0,0 +1,59 @@
+#ifndef READ_AHEAD_H
+#define READ_AHEAD_H
+
+#include <Arduino.h>
+#include "upload_source.h"
+
+// Double (or more) buffered reads for uploads: a reader task fills PSRAM
+// buffers from storage while the network drains the ones before them
+
+// Totals over all read-ahead uploads since the last reset
+struct ReadAheadStats {
+  uint64_t bytes;
+  uint64_t readMicros;         // Storage busy reading
+  uint64_t storageIdleMicros;  // Reader waiting for the network to free a buffer
+  uint64_t sendWaitMicros;     // Sender waiting for the reader
+};
+
+class ReadAheadUploadSource : public UploadSource {
+public:
+  explicit ReadAheadUploadSource(UploadSource& source);
+  ~ReadAheadUploadSource();
+  
+  // False when the buffers can't be had (no PSRAM); read the source directly then
+  bool begin();
+  
+  // Stop the reader, must be called before the underlying file is closed
+  void end();
+  
+  size_t size() override { return total; }
+  bool seek(size_t offset) override;
+  size_t read(uint8_t* buffer, size_t len) override;
+
+private:
+  struct Block {
+    uint8_t index;
+    size_t len;        // 0 on a read error
+  };
+  
+  static void readerTask(void* param);
+  void startReader(size_t offset);
+  void stopReader();
+  
+  UploadSource& source;
+  size_t total;
+  bool ready;
+  volatile bool readerRunning;
+  volatile bool stopRequested;
+  size_t readOffset;   // Next byte the reader fetches
+  size_t position;     // Next byte handed to the sender
+  Block current;       // Block being drained
+  size_t currentPos;
+  bool hasCurrent;
+};
+
+const ReadAheadStats& getReadAheadStats();
+void resetReadAheadStats();
+void printReadAheadStats();
+
+#endif // READ_AHEAD_H
@@ -1,6 +1,11 @@
 #include "sms_messaging.h"
 #include "cellular.h"
 #include "config.h"
+#include "backoff.h"
+#include "modem_task.h"
+#include "at_engine.h"
+#include "at_parser.h"
+#include "upload_task.h"
 #include <Preferences.h>
 
 // Default SMS messages
@@ -12,8 +17,33 @@ String communicationOkMsg = "Communication to Google Drive OK";
 String monitoringDisabledMsg = "Monitoring disabled";
 String monitoringEnabledMsg = "Monitoring enabled";
 
+Backoff smsBackoff("SMS", SMS_BACKOFF_BASE_MS, SMS_BACKOFF_MAX_MS);
+
+// Messages waiting for the backoff or the modem, oldest first; only the
+// modem task touches them
+String pendingSMS[SMS_PENDING_MAX];
+volatile uint8_t pendingSMSCount = 0;
+uint32_t droppedSMSCount = 0;
+ModemJob smsRetry = {};
+
+// Set by the +CMTI URC, the messages are read from the modem task
+volatile bool smsReceived = false;
+ModemJob smsRead = {};
+
+// A message was stored on the SIM; reading it needs the modem, not the reader task
+static void onSmsReceivedUrc(const AtSlice& line, void* context) {
+  smsReceived = true;
+}
+
 // Initialize SMS messaging
 bool initSMSMessaging() {
+  // Commands come in as SMS; anything that arrived while off is read once
+  static bool urcRegistered = false;
+  if (!urcRegistered) {
+    urcRegistered = onAtUrc("+CMTI:", onSmsReceivedUrc);
+  }
+  smsReceived = true;
+  
   // Load settings from preferences
   Preferences preferences;
   if (preferences.begin("sms", false)) {
@@ -124,14 +154,10 @@ bool sendMonitoringEnabledSMS() {
   return sendSMS(monitoringEnabledMsg);
 }
 
-// Generic SMS sender
-bool sendSMS(const String& message) {
-  if (phoneNumber.length() == 0) {
-    Serial.println("No phone number configured for SMS");
-    return false;
-  }
-  
-  if (!isCellularConnected() && !connectCellular()) {
+// AT exchange for one message, called with the modem locked
+static bool transmitSMS(const String& message) {
+  // Text messages need the network, not the data bearer
+  if (!isCellularRegistered() && !registerCellular()) {
     Serial.println("Failed to connect cellular for SMS");
     return false;
   }
@@ -148,16 +174,14 @@ bool sendSMS(const String& message) {
   
   // Set phone number
   String cmd = "AT+CMGS=\"" + phoneNumber + "\"";
-  response = sendATCommand(cmd, 5000);
-  
-  if (response.indexOf(">") == -1) {
+  if (!sendATPrompt(cmd, 5000)) {
     Serial.println("Failed to set SMS recipient");
     return false;
   }
   
   // Send the message content followed by Ctrl+Z (ASCII 26)
   String msgWithCtrlZ = message + char(26);
-  response = sendATCommand(msgWithCtrlZ, 10000);
+  response = sendATData((const uint8_t*)msgWithCtrlZ.c_str(), msgWithCtrlZ.length(), 60000);
   
   if (response.indexOf("+CMGS:") == -1) {
     Serial.println("Failed to send SMS");
@@ -168,6 +192,186 @@ bool sendSMS(const String& message) {
   return true;
 }
 
+// Keep a message for later; with the list full the oldest one goes
+static void deferSMS(const String& message) {
+  if (pendingSMSCount == SMS_PENDING_MAX) {
+    droppedSMSCount++;
+    Serial.printf("SMS pending list full, dropped \"%s\" (%lu dropped so far)\n",
+                  pendingSMS[0].c_str(), (unsigned long)droppedSMSCount);
+    for (uint8_t i = 1; i < SMS_PENDING_MAX; i++) {
+      pendingSMS[i - 1] = pendingSMS[i];
+    }
+    pendingSMSCount--;
+  }
+  pendingSMS[pendingSMSCount++] = message;
+}
+
+// Send what is pending, in order, until the list is empty or sending fails
+static bool flushPendingSMS() {
+  // Keep the upload task off the modem until the messages are out
+  ModemLock lock;
+  if (!lock.isLocked()) {
+    Serial.printf("Modem busy, %u SMS held for later\n", pendingSMSCount);
+    return false;
+  }
+  
+  while (pendingSMSCount > 0) {
+    // While the network keeps refusing, don't wake the modem for every message
+    if (!smsBackoff.ready()) {
+      Serial.printf("SMS backing off, %u held for later (%lu s left)\n", pendingSMSCount,
+                    smsBackoff.remainingMs() / 1000);
+      return false;
+    }
+    
+    if (!transmitSMS(pendingSMS[0])) {
+      smsBackoff.failure();
+      return false;
+    }
+    smsBackoff.success();
+    
+    for (uint8_t i = 1; i < pendingSMSCount; i++) {
+      pendingSMS[i - 1] = pendingSMS[i];
+    }
+    pendingSMS[--pendingSMSCount] = "";
+  }
+  return true;
+}
+
+// Runs on the modem task; the message was copied when it was queued and
+// goes out behind anything still pending
+static bool smsJob(void* arg) {
+  deferSMS(*(String*)arg);
+  delete (String*)arg;
+  return flushPendingSMS();
+}
+
+static bool smsRetryJob(void* arg) {
+  return flushPendingSMS();
+}
+
+// Generic SMS sender
+bool sendSMS(const String& message) {
+  if (phoneNumber.length() == 0) {
+    Serial.println("No phone number configured for SMS");
+    return false;
+  }
+  
+  String* copy = new String(message);
+  if (!queueModemJob("SMS", smsJob, copy)) {
+    delete copy;
+    return false;
+  }
+  return true;
+}
+
+// Same number, whether or not either side has the international prefix
+static bool isFromConfiguredPhone(const AtSlice& sender) {
+  String from = String(sender.data).substring(0, sender.length);
+  String own = phoneNumber.startsWith("+") ? phoneNumber.substring(1) : phoneNumber;
+  return own.length() > 0 && from.endsWith(own);
+}
+
+// "FULL <name>": the name as it shows on the server, a capture or its
+// preview, with or without the day folder
+static void handleSMSCommand(const String& text) {
+  String command = text;
+  command.trim();
+  if (!command.startsWith(SMS_UPLOAD_COMMAND " ")) {
+    Serial.printf("Unknown SMS command: %s\n", command.c_str());
+    return;
+  }
+  
+  String name = command.substring(strlen(SMS_UPLOAD_COMMAND) + 1);
+  name.trim();
+  name = name.substring(name.lastIndexOf('/') + 1);
+  int preview = name.lastIndexOf("_p.");
+  if (preview != -1) {
+    name = name.substring(0, preview) + name.substring(preview + 2);
+  }
+  
+  String path = "/" + name;
+  if (!queueCaptureUpload(path.c_str())) {
+    Serial.printf("Full upload of %s not queued, another one is waiting\n", path.c_str());
+    return;
+  }
+  Serial.printf("Full upload of %s requested by SMS\n", path.c_str());
+}
+
+// Read the unread messages, act on those from the configured number and
+// delete them all so the SIM doesn't fill up
+static bool smsReadJob(void* arg) {
+  ModemLock lock;
+  if (!lock.isLocked()) {
+    smsReceived = true;
+    return false;
+  }
+  
+  sendATCommand("AT+CMGF=1");
+  String response = sendATCommand("AT+CMGL=\"REC UNREAD\"", 10000);
+  if (response.indexOf("OK") == -1) {
+    smsReceived = true;
+    return false;
+  }
+  
+  // +CMGL: <index>,<stat>,<sender>,<alpha>,<time>, the text on the next line
+  int start = 0;
+  while (start < (int)response.length()) {
+    int end = response.indexOf('\n', start);
+    if (end == -1) {
+      end = response.length();
+    }
+    AtSlice line = AtSlice(response.c_str() + start, end - start).trim();
+    start = end + 1;
+    
+    AtFields fields;
+    if (!fields.parse(line, "+CMGL:") || fields.size() < 3) {
+      continue;
+    }
+    
+    end = response.indexOf('\n', start);
+    if (end == -1) {
+      end = response.length();
+    }
+    String text = response.substring(start, end);
+    start = end + 1;
+    
+    if (isFromConfiguredPhone(fields.get(2))) {
+      handleSMSCommand(text);
+    } else {
+      Serial.println("Ignoring SMS from an unknown number");
+    }
+  }
+  
+  // Everything read so far (delete flag 1), unread ones stay
+  sendATCommand("AT+CMGD=1,1", 10000);
+  return true;
+}
+
+void checkReceivedSMS() {
+  bool ok;
+  takeModemJobResult(smsRead, ok);
+  if (smsReceived && !smsRead.pending) {
+    smsReceived = false;
+    queueModemJob("SMS read", smsReadJob, NULL, &smsRead);
+  }
+}
+
+void retryPendingSMS() {
+  bool ok;
+  takeModemJobResult(smsRetry, ok);
+  if (pendingSMSCount > 0 && !smsRetry.pending && smsBackoff.remainingMs() == 0) {
+    queueModemJob("SMS retry", smsRetryJob, NULL, &smsRetry);
+  }
+}
+
+uint8_t getPendingSMSCount() {
+  return pendingSMSCount;
+}
+
+uint32_t getDroppedSMSCount() {
+  return droppedSMSCount;
+}
+
 // Get phone number
 String getPhoneNumber() {
   return phoneNumber;
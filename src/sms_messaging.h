@@ -35,9 +35,23 @@ bool sendMonitoringDisabledSMS();
 // Send SMS for monitoring enabled
 bool sendMonitoringEnabledSMS();
 
-// Generic SMS sender
+// Generic SMS sender; the message goes out from the modem task, true once queued
 bool sendSMS(const String& message);
 
+// Messages that couldn't go out (modem busy, backing off, send failed) are
+// held, up to SMS_PENDING_MAX; call from the main loop to send them once
+// the backoff allows
+void retryPendingSMS();
+
+// Read SMS that came in (+CMTI) on the modem task; call from the main loop.
+// Messages from the configured number are commands: SMS_UPLOAD_COMMAND and a
+// capture or preview name uploads that capture's original.
+void checkReceivedSMS();
+
+// Messages held for a retry, and those dropped because the list was full
+uint8_t getPendingSMSCount();
+uint32_t getDroppedSMSCount();
+
 // Get phone number
 String getPhoneNumber();
 
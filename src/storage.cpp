@@ -1,44 +1,105 @@
 #include "storage.h"
 #include "config.h"
+#ifdef ARDUINO
+#include "hw_config.h"
+#endif
+#include "integrity.h"
+#include "preview.h"
+#include "drive_resumable.h"
+#include "time_sync.h"
 #include <LittleFS.h>
-#include <SD.h>
+#include <Preferences.h>
+#include <vector>
 
 // Global variables
 String baseName = BASE_FILENAME;
-bool sdCardInitialized = false;
 bool fsInitialized = false;
 
-// Initialize storage (SD card and LittleFS)
-bool initStorage() {
-  // Initialize LittleFS for config storage
+// Capture naming: "<base>_<boot>_<sequence>_<time>.jpg"
+uint32_t bootCounter = 0;
+uint32_t captureSequence = 0;
+
+// Captures named before the clock was set, renamed once it is
+struct PendingCapture {
+  String path;
+  unsigned long capturedAt;
+};
+std::vector<PendingCapture> pendingCaptures;
+
+// Capture storage, the SD card unless a backend was injected
+#ifdef ARDUINO
+SDStorageBackend sdBackend(SD_CS_PIN);
+#define DEFAULT_STORAGE_BACKEND (&sdBackend)
+#else
+#define DEFAULT_STORAGE_BACKEND NULL  // Host builds always inject one
+#endif
+StorageBackend* storageBackend = DEFAULT_STORAGE_BACKEND;
+
+void setStorageBackend(StorageBackend* backend) {
+  storageBackend = backend ? backend : DEFAULT_STORAGE_BACKEND;
+}
+
+StorageBackend* getStorageBackend() {
+  return storageBackend;
+}
+
+// Load the naming state once per boot so naming a capture needs no NVS access
+void initCaptureNaming() {
+  Preferences preferences;
+  if (preferences.begin("storage", false)) {
+    bootCounter = preferences.getUInt("boot_count", 0) + 1;
+    preferences.putUInt("boot_count", bootCounter);
+    baseName = preferences.getString("basename", BASE_FILENAME);
+    preferences.end();
+  }
+  
+  captureSequence = 0;
+  Serial.printf("Boot %lu, captures named %s_%06lu_*\n",
+                (unsigned long)bootCounter, baseName.c_str(), (unsigned long)bootCounter);
+}
+
+// Mount LittleFS for config storage, once per boot
+bool mountConfigStorage() {
+  if (fsInitialized) {
+    return true;
+  }
+  
   if (!LittleFS.begin(true)) {
     Serial.println("Failed to mount LittleFS");
-    fsInitialized = false;
-  } else {
-    fsInitialized = true;
-    Serial.println("LittleFS mounted successfully");
+    return false;
   }
   
-  // Initialize SD card
-  SPI.begin(SD_SCK_PIN, SD_MISO_PIN, SD_MOSI_PIN);
+  fsInitialized = true;
+  Serial.println("LittleFS mounted successfully");
+  return true;
+}
+
+// Initialize storage (SD card and LittleFS)
+bool initStorage() {
+  initCaptureNaming();
   
-  if (!SD.begin(SD_CS_PIN)) {
+  mountConfigStorage();
+  
+  // Initialize SD card
+  if (!storageBackend->begin()) {
     Serial.println("Failed to mount SD card");
-    sdCardInitialized = false;
     return false; // SD card is critical for operation
   }
   
-  sdCardInitialized = true;
   Serial.println("SD card mounted successfully");
   
   // Check SD card space
-  uint64_t cardSize = SD.cardSize() / (1024 * 1024);
-  uint64_t usedSpace = getUsedSpace() / (1024 * 1024);
+  uint64_t totalBytes = 0;
+  uint64_t usedBytes = 0;
+  storageBackend->usage(&totalBytes, &usedBytes);
+  
+  uint64_t cardSize = totalBytes / (1024 * 1024);
+  uint64_t usedSpace = usedBytes / (1024 * 1024);
   uint64_t freeSpace = cardSize - usedSpace;
   
-  Serial.printf("SD Card Size: %lluMB\n", cardSize);
-  Serial.printf("Used: %lluMB\n", usedSpace);
-  Serial.printf("Free: %lluMB\n", freeSpace);
+  Serial.printf("SD Card Size: %lluMB\n", (unsigned long long)cardSize);
+  Serial.printf("Used: %lluMB\n", (unsigned long long)usedSpace);
+  Serial.printf("Free: %lluMB\n", (unsigned long long)freeSpace);
   
   if (freeSpace < MIN_SD_FREE_SPACE_MB) {
     Serial.println("Warning: Low SD card space");
@@ -53,51 +114,142 @@ bool initStorage() {
   return true;
 }
 
+// Check if the SD card is mounted
+bool isStorageMounted() {
+  return storageBackend->isMounted();
+}
+
+// Try to mount the SD card again after a fault
+bool remountStorage() {
+  storageBackend->end();
+  if (!storageBackend->begin()) {
+    return false;
+  }
+  
+  Serial.println("SD card remounted");
+  return true;
+}
+
 // Save photo to SD card
-bool savePhotoToSD(const String& filename, uint8_t* data, size_t length) {
-  if (!sdCardInitialized) {
+bool savePhotoToSD(const char* filename, const uint8_t* data, size_t length) {
+  if (!storageBackend->isMounted()) {
     Serial.println("SD card not initialized");
     return false;
   }
   
   // Check if file already exists
-  if (SD.exists(filename)) {
-    Serial.printf("File %s already exists, deleting\n", filename.c_str());
-    SD.remove(filename);
+  if (storageBackend->exists(filename)) {
+    Serial.printf("File %s already exists, deleting\n", filename);
+    storageBackend->remove(filename);
+    removeCaptureSidecars(storageBackend, filename);
+  }
+  
+  // Warn about frames the camera did not finish encoding
+  size_t tailLen = min(length, (size_t)32);
+  if (!isJpegComplete(data, length, data + length - tailLen, tailLen)) {
+    Serial.printf("Warning: %s is not a complete JPEG\n", filename);
   }
   
   // Create new file
-  File file = SD.open(filename, FILE_WRITE);
+  StorageFilePtr file = storageBackend->open(filename, STORAGE_WRITE);
   if (!file) {
-    Serial.printf("Failed to create file: %s\n", filename.c_str());
+    Serial.printf("Failed to create file: %s\n", filename);
     return false;
   }
   
-  // Write data to file
-  size_t bytesWritten = file.write(data, length);
-  file.close();
+  // Write data to file in chunks, hashing each chunk as it goes out
+  CaptureHasher hasher;
+  hasher.begin();
+  
+  size_t bytesWritten = 0;
+  unsigned long hashMicros = 0;
+  unsigned long startMicros = micros();
+  
+  while (bytesWritten < length) {
+    size_t chunk = min(length - bytesWritten, (size_t)SD_WRITE_CHUNK_SIZE);
+    
+    unsigned long hashStart = micros();
+    hasher.update(data + bytesWritten, chunk);
+    hashMicros += micros() - hashStart;
+    
+    size_t n = file->write(data + bytesWritten, chunk);
+    bytesWritten += n;
+    if (n != chunk) {
+      break;
+    }
+  }
+  file->close();
   
   if (bytesWritten != length) {
     Serial.println("Failed to write complete file");
     return false;
   }
   
-  Serial.printf("Photo saved to SD card: %s (%u bytes)\n", filename.c_str(), length);
+  CaptureDigest digest;
+  hasher.finish(digest);
+  recordCaptureHashTiming(length, hashMicros, micros() - startMicros);
+  
+  if (!writeDigestSidecar(storageBackend, filename, digest)) {
+    Serial.printf("Failed to write digest for %s\n", filename);
+  }
+  
+  Serial.printf("Photo saved to SD card: %s (%u bytes)\n", filename, (unsigned)length);
   return true;
 }
 
+// Check if a path is a capture (not a sidecar or other bookkeeping file)
+bool isCaptureFile(const char* path) {
+  size_t len = strlen(path);
+  size_t extLen = strlen(CAPTURE_FILE_EXT);
+  return len > extLen && strcmp(path + len - extLen, CAPTURE_FILE_EXT) == 0;
+}
+
+// Check if a file exists on the SD card
+bool fileExists(const char* filename) {
+  return storageBackend->isMounted() && storageBackend->exists(filename);
+}
+
+void getCaptureSidecars(const char* capturePath, String sidecars[CAPTURE_SIDECAR_COUNT]) {
+  sidecars[0] = getSidecarPath(capturePath);
+  sidecars[1] = getPreviewMarkerPath(capturePath);
+  sidecars[2] = getUploadSessionPath(capturePath);
+}
+
+void removeCaptureSidecars(StorageBackend* storage, const char* capturePath) {
+  String sidecars[CAPTURE_SIDECAR_COUNT];
+  getCaptureSidecars(capturePath, sidecars);
+  for (int i = 0; i < CAPTURE_SIDECAR_COUNT; i++) {
+    storage->remove(sidecars[i].c_str());
+  }
+}
+
+// Sidecars already at the target belong to an older file of that name
+void moveCaptureSidecars(StorageBackend* storage, const char* from, const char* to) {
+  String sources[CAPTURE_SIDECAR_COUNT];
+  String targets[CAPTURE_SIDECAR_COUNT];
+  getCaptureSidecars(from, sources);
+  getCaptureSidecars(to, targets);
+  for (int i = 0; i < CAPTURE_SIDECAR_COUNT; i++) {
+    storage->remove(targets[i].c_str());
+    if (storage->exists(sources[i].c_str())) {
+      storage->rename(sources[i].c_str(), targets[i].c_str());
+    }
+  }
+}
+
 // Delete file from SD card
 bool deleteFile(const String& filename) {
-  if (!sdCardInitialized) {
+  if (!storageBackend->isMounted()) {
     return false;
   }
   
-  if (!SD.exists(filename)) {
+  if (!storageBackend->exists(filename.c_str())) {
     Serial.printf("File not found: %s\n", filename.c_str());
     return false;
   }
   
-  if (SD.remove(filename)) {
+  if (storageBackend->remove(filename.c_str())) {
+    removeCaptureSidecars(storageBackend, filename.c_str());
     Serial.printf("File deleted: %s\n", filename.c_str());
     return true;
   } else {
@@ -106,149 +258,110 @@ bool deleteFile(const String& filename) {
   }
 }
 
-// Delete all files from SD card
-bool deleteAllFiles() {
-  if (!sdCardInitialized) {
-    return false;
+// Print all files on the SD card
+void listAllFiles() {
+  if (!storageBackend->isMounted()) {
+    return;
   }
   
-  File root = SD.open("/");
-  if (!root) {
-    Serial.println("Failed to open root directory");
+  storageBackend->list("/", [](const char* path, size_t size) {
+    Serial.printf("  %s (%u bytes)\n", path, (unsigned)size);
+    return true;
+  });
+}
+
+// Delete all files from SD card
+bool deleteAllFiles() {
+  if (!storageBackend->isMounted()) {
     return false;
   }
   
-  if (!root.isDirectory()) {
-    Serial.println("Root is not a directory");
-    root.close();
-    return false;
-  }
+  // Collect the names first, removing entries while iterating a FAT
+  // directory is not safe
+  std::vector<String> filenames;
+  storageBackend->list("/", [&filenames](const char* path, size_t size) {
+    filenames.push_back(path);
+    return true;
+  });
   
   bool success = true;
   
-  File file = root.openNextFile();
-  while (file) {
-    if (!file.isDirectory()) {
-      String filename = "/" + String(file.name());
-      file.close();
-      
-      if (!SD.remove(filename)) {
-        Serial.printf("Failed to delete file: %s\n", filename.c_str());
-        success = false;
-      } else {
-        Serial.printf("Deleted file: %s\n", filename.c_str());
-      }
+  for (const String& filename : filenames) {
+    if (!storageBackend->remove(filename.c_str())) {
+      Serial.printf("Failed to delete file: %s\n", filename.c_str());
+      success = false;
+    } else {
+      Serial.printf("Deleted file: %s\n", filename.c_str());
     }
-    file = root.openNextFile();
   }
   
-  root.close();
   return success;
 }
 
 // Get number of files on SD card
 int getFileCount() {
-  if (!sdCardInitialized) {
-    return 0;
-  }
-  
-  File root = SD.open("/");
-  if (!root) {
-    Serial.println("Failed to open root directory");
-    return 0;
-  }
-  
-  if (!root.isDirectory()) {
-    Serial.println("Root is not a directory");
-    root.close();
+  if (!storageBackend->isMounted()) {
     return 0;
   }
   
   int count = 0;
-  
-  File file = root.openNextFile();
-  while (file) {
-    if (!file.isDirectory()) {
+  storageBackend->list("/", [&count](const char* path, size_t size) {
+    if (isCaptureFile(path)) {
       count++;
     }
-    file.close();
-    file = root.openNextFile();
-  }
+    return true;
+  });
   
-  root.close();
   return count;
 }
 
 // Get filename by index
 String getFileName(int index) {
-  if (!sdCardInitialized || index < 0) {
-    return "";
-  }
-  
-  File root = SD.open("/");
-  if (!root) {
-    Serial.println("Failed to open root directory");
-    return "";
-  }
-  
-  if (!root.isDirectory()) {
-    Serial.println("Root is not a directory");
-    root.close();
+  if (!storageBackend->isMounted() || index < 0) {
     return "";
   }
   
   int count = 0;
   String filename = "";
   
-  File file = root.openNextFile();
-  while (file) {
-    if (!file.isDirectory()) {
-      if (count == index) {
-        filename = "/" + String(file.name());
-        file.close();
-        break;
-      }
-      count++;
+  storageBackend->list("/", [&](const char* path, size_t size) {
+    if (!isCaptureFile(path)) {
+      return true;
     }
-    file.close();
-    file = root.openNextFile();
-  }
+    if (count == index) {
+      filename = path;
+      return false;
+    }
+    count++;
+    return true;
+  });
   
-  root.close();
   return filename;
 }
 
 // Get used space on SD card
 uint64_t getUsedSpace() {
-  if (!sdCardInitialized) {
+  uint64_t usedBytes = 0;
+  if (!storageBackend->isMounted() || !storageBackend->usage(NULL, &usedBytes)) {
     return 0;
   }
   
-  File root = SD.open("/");
-  if (!root) {
-    Serial.println("Failed to open root directory");
+  return usedBytes;
+}
+
+// Get free space on SD card in MB
+size_t getFreeSpaceSD() {
+  uint64_t totalBytes = 0;
+  uint64_t usedBytes = 0;
+  if (!storageBackend->isMounted() || !storageBackend->usage(&totalBytes, &usedBytes)) {
     return 0;
   }
   
-  if (!root.isDirectory()) {
-    Serial.println("Root is not a directory");
-    root.close();
+  if (usedBytes >= totalBytes) {
     return 0;
   }
   
-  uint64_t usedSpace = 0;
-  
-  File file = root.openNextFile();
-  while (file) {
-    if (!file.isDirectory()) {
-      usedSpace += file.size();
-    }
-    file.close();
-    file = root.openNextFile();
-  }
-  
-  root.close();
-  return usedSpace;
+  return (size_t)((totalBytes - usedBytes) / (1024 * 1024));
 }
 
 // Set base filename
@@ -275,16 +388,113 @@ bool setBaseFilename(const String& name) {
 
 // Get base filename
 String getBaseFilename() {
-  // Try to load from preferences first
-  Preferences preferences;
-  if (preferences.begin("storage", true)) {
-    String name = preferences.getString("basename", BASE_FILENAME);
-    preferences.end();
+  return baseName;
+}
+
+// Build a unique, sortable name for the next capture
+void makeCaptureFilename(char* buffer, size_t bufferSize) {
+  captureSequence++;
+  
+  char timestamp[20];
+  bool timeKnown = getTimestampString(timestamp, sizeof(timestamp));
+  if (!timeKnown) {
+    strncpy(timestamp, UNSYNCED_TIMESTAMP, sizeof(timestamp));
+  }
+  
+  snprintf(buffer, bufferSize, "/%s_%06lu_%06lu_%s%s", baseName.c_str(),
+           (unsigned long)bootCounter, (unsigned long)captureSequence, timestamp, CAPTURE_FILE_EXT);
+  
+  if (!timeKnown && pendingCaptures.size() < MAX_BACKFILL_CAPTURES) {
+    PendingCapture pending = { String(buffer), millis() };
+    pendingCaptures.push_back(pending);
+  }
+}
+
+// Capture order from a name made by makeCaptureFilename, newer is higher
+uint64_t getCaptureOrder(const char* path) {
+  const char* field = strchr(path, '_');
+  if (!field) {
+    return 0;
+  }
+  
+  char* end;
+  unsigned long boot = strtoul(field + 1, &end, 10);
+  if (*end != '_') {
+    return 0;
+  }
+  unsigned long sequence = strtoul(end + 1, NULL, 10);
+  return ((uint64_t)boot << 32) | sequence;
+}
+
+// Capture time from the timestamp ahead of the extension, 0 before time sync
+time_t getCaptureTime(const char* path) {
+  char stamp[20];
+  formatTimestamp(0, stamp, sizeof(stamp));  // Same length as any other timestamp
+  size_t stampLen = strlen(stamp);
+  size_t extLen = strlen(CAPTURE_FILE_EXT);
+  size_t len = strlen(path);
+  if (len < stampLen + extLen) {
+    return 0;
+  }
+  
+  memcpy(stamp, path + len - extLen - stampLen, stampLen);
+  stamp[stampLen] = '\0';
+  return parseTimestamp(stamp);
+}
+
+// Give captures taken before time sync their timestamps. Those of this boot
+// listed in pendingCaptures get the time they were taken. Those of an earlier
+// boot that never had the time (the list doesn't survive a reboot) get the
+// latest time they can have been taken, when this boot started; boot and
+// sequence keep their order.
+int backfillCaptureTimestamps() {
+  if (!isTimeSet() || !storageBackend->isMounted()) {
+    return 0;
+  }
+  
+  std::vector<String> unsynced;
+  storageBackend->list("/", [&unsynced](const char* path, size_t size) {
+    if (isCaptureFile(path) && strstr(path, UNSYNCED_TIMESTAMP)) {
+      unsynced.push_back(path);
+    }
+    return true;
+  });
+  
+  time_t now = time(NULL);
+  unsigned long nowMillis = millis();
+  time_t bootStart = now - (time_t)(nowMillis / 1000);
+  int renamed = 0;
+  
+  for (const String& path : unsynced) {
+    // The latest it can have been taken, unless the list knows better
+    time_t capturedAt = (getCaptureOrder(path.c_str()) >> 32) == bootCounter ? now : bootStart;
+    for (const PendingCapture& pending : pendingCaptures) {
+      if (pending.path == path) {
+        capturedAt = now - (time_t)((nowMillis - pending.capturedAt) / 1000);
+        break;
+      }
+    }
     
-    // Update global variable
-    baseName = name;
-    return name;
+    char timestamp[20];
+    formatTimestamp(capturedAt, timestamp, sizeof(timestamp));
+    
+    String newPath = path;
+    newPath.replace(UNSYNCED_TIMESTAMP, timestamp);
+    
+    if (storageBackend->rename(path.c_str(), newPath.c_str())) {
+      // A session started under the old name would finish under it
+      storageBackend->remove(getUploadSessionPath(path.c_str()).c_str());
+      moveCaptureSidecars(storageBackend, path.c_str(), newPath.c_str());
+      renamed++;
+    } else {
+      Serial.printf("Failed to rename %s\n", path.c_str());
+    }
   }
   
-  return baseName;
+  pendingCaptures.clear();
+  
+  if (renamed > 0) {
+    Serial.printf("Backfilled timestamps of %d captures\n", renamed);
+  }
+  return renamed;
 }
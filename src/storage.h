@@ -2,25 +2,48 @@
 #define STORAGE_H
 
 #include <Arduino.h>
-#include <FS.h>
-#include <SD.h>
-#include <SPI.h>
+#include "storage_backend.h"
 
 // Initialization
 bool initStorage();
+bool mountConfigStorage();
+bool isStorageMounted();
+bool remountStorage();
+
+// Storage backend used for captures (defaults to the SD card)
+void setStorageBackend(StorageBackend* backend);
+StorageBackend* getStorageBackend();
 
 // File operations
 bool savePhotoToSD(const char* filename, const uint8_t* data, size_t len);
 bool fileExists(const char* filename);
+bool isCaptureFile(const char* path);
+bool deleteFile(const String& filename);
+
+// Files kept beside a capture, named by appending an extension to its path:
+// digest (.sum), preview marker (.pv) and resumable upload session (.ses).
+// They go wherever the capture goes (delete, rename, quarantine).
+#define CAPTURE_SIDECAR_COUNT 3
+void getCaptureSidecars(const char* capturePath, String sidecars[CAPTURE_SIDECAR_COUNT]);
+void removeCaptureSidecars(StorageBackend* storage, const char* capturePath);
+void moveCaptureSidecars(StorageBackend* storage, const char* from, const char* to);
 void listAllFiles();
-void deleteAllFiles();
+bool deleteAllFiles();
 size_t getFreeSpaceSD();
+uint64_t getUsedSpace();
 
-// File listing for upload
+// File listing for upload (capture files only)
 int getFileCount();
 String getFileName(int index);
 
-// Time utilities
-void getTimestampString(char* buffer, size_t bufferSize);
+// Base filename for captures
+bool setBaseFilename(const String& name);
+String getBaseFilename();
+
+// Capture naming
+void makeCaptureFilename(char* buffer, size_t bufferSize);
+int backfillCaptureTimestamps();
+uint64_t getCaptureOrder(const char* path);
+time_t getCaptureTime(const char* path);
 
 #endif // STORAGE_H
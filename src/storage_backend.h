@@ -0,0 +1,147 @@
+#ifndef STORAGE_BACKEND_H
+#define STORAGE_BACKEND_H
+
+// Filesystem abstraction used by the storage and upload code.
+// This header must stay free of Arduino includes so that the POSIX and RAM
+// backends can be built on a host machine.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+// File open modes
+enum StorageOpenMode {
+  STORAGE_READ,
+  STORAGE_WRITE,   // Create or truncate
+  STORAGE_APPEND   // Create or append
+};
+
+// An open file on a storage backend
+class StorageFile {
+public:
+  virtual ~StorageFile() {}
+  virtual size_t read(uint8_t* buffer, size_t length) = 0;
+  virtual size_t write(const uint8_t* data, size_t length) = 0;
+  virtual bool seek(size_t position) = 0;
+  virtual size_t position() = 0;
+  virtual size_t size() = 0;
+  virtual void close() = 0;
+};
+
+typedef std::unique_ptr<StorageFile> StorageFilePtr;
+
+// Called for each regular file found by list(); return false to stop
+typedef std::function<bool(const char* path, size_t size)> StorageListCallback;
+
+// A mountable filesystem. Paths are absolute, e.g. "/capture_001.jpg".
+class StorageBackend {
+public:
+  virtual ~StorageBackend() {}
+  
+  virtual bool begin() = 0;
+  virtual void end() = 0;
+  virtual bool isMounted() const = 0;
+  
+  virtual StorageFilePtr open(const char* path, StorageOpenMode mode) = 0;
+  virtual bool exists(const char* path) = 0;
+  virtual bool remove(const char* path) = 0;
+  virtual bool rename(const char* from, const char* to) = 0;
+  virtual bool mkdir(const char* path) = 0;
+  
+  // Get the size of a regular file
+  virtual bool stat(const char* path, size_t* size) = 0;
+  
+  // List regular files in a directory (not recursive), returns files visited
+  virtual int list(const char* dir, StorageListCallback callback) = 0;
+  
+  // Get capacity and used bytes of the filesystem
+  virtual bool usage(uint64_t* totalBytes, uint64_t* usedBytes) = 0;
+};
+
+#ifdef ARDUINO
+// SD card on the SPI bus (device)
+class SDStorageBackend : public StorageBackend {
+public:
+  explicit SDStorageBackend(int csPin);
+  
+  bool begin() override;
+  void end() override;
+  bool isMounted() const override { return mounted; }
+  
+  StorageFilePtr open(const char* path, StorageOpenMode mode) override;
+  bool exists(const char* path) override;
+  bool remove(const char* path) override;
+  bool rename(const char* from, const char* to) override;
+  bool mkdir(const char* path) override;
+  bool stat(const char* path, size_t* size) override;
+  int list(const char* dir, StorageListCallback callback) override;
+  bool usage(uint64_t* totalBytes, uint64_t* usedBytes) override;
+
+private:
+  int csPin;
+  bool mounted;
+};
+#endif
+
+#ifndef ARDUINO
+// A directory on the host filesystem (host tests and benchmarks)
+class PosixStorageBackend : public StorageBackend {
+public:
+  explicit PosixStorageBackend(const std::string& rootDir);
+  
+  bool begin() override;
+  void end() override;
+  bool isMounted() const override { return mounted; }
+  
+  StorageFilePtr open(const char* path, StorageOpenMode mode) override;
+  bool exists(const char* path) override;
+  bool remove(const char* path) override;
+  bool rename(const char* from, const char* to) override;
+  bool mkdir(const char* path) override;
+  bool stat(const char* path, size_t* size) override;
+  int list(const char* dir, StorageListCallback callback) override;
+  bool usage(uint64_t* totalBytes, uint64_t* usedBytes) override;
+
+private:
+  std::string fullPath(const char* path) const;
+  
+  std::string rootDir;
+  bool mounted;
+};
+#endif
+
+// Files held in RAM with a fixed capacity (host tests and benchmarks)
+class RamStorageBackend : public StorageBackend {
+public:
+  explicit RamStorageBackend(uint64_t capacityBytes);
+  
+  bool begin() override;
+  void end() override;
+  bool isMounted() const override { return mounted; }
+  
+  StorageFilePtr open(const char* path, StorageOpenMode mode) override;
+  bool exists(const char* path) override;
+  bool remove(const char* path) override;
+  bool rename(const char* from, const char* to) override;
+  bool mkdir(const char* path) override;
+  bool stat(const char* path, size_t* size) override;
+  int list(const char* dir, StorageListCallback callback) override;
+  bool usage(uint64_t* totalBytes, uint64_t* usedBytes) override;
+  
+  // Bytes currently stored, used by open files to enforce the capacity
+  uint64_t bytesUsed() const;
+  uint64_t capacity() const { return capacityBytes; }
+
+private:
+  std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> files;
+  std::set<std::string> directories;
+  uint64_t capacityBytes;
+  bool mounted;
+};
+
+#endif // STORAGE_BACKEND_H
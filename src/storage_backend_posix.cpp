@@ -0,0 +1,201 @@
+#ifndef ARDUINO
+
+#include "storage_backend.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+
+// Wraps a stdio FILE
+class PosixStorageFile : public StorageFile {
+public:
+  explicit PosixStorageFile(FILE* fp) : fp(fp) {}
+  ~PosixStorageFile() override { close(); }
+  
+  size_t read(uint8_t* buffer, size_t length) override {
+    return fp ? fread(buffer, 1, length, fp) : 0;
+  }
+  
+  size_t write(const uint8_t* data, size_t length) override {
+    return fp ? fwrite(data, 1, length, fp) : 0;
+  }
+  
+  bool seek(size_t position) override {
+    return fp && fseek(fp, (long)position, SEEK_SET) == 0;
+  }
+  
+  size_t position() override {
+    if (!fp) {
+      return 0;
+    }
+    long pos = ftell(fp);
+    return pos < 0 ? 0 : (size_t)pos;
+  }
+  
+  size_t size() override {
+    if (!fp) {
+      return 0;
+    }
+    fflush(fp);
+    struct stat st;
+    if (fstat(fileno(fp), &st) != 0) {
+      return 0;
+    }
+    return (size_t)st.st_size;
+  }
+  
+  void close() override {
+    if (fp) {
+      fclose(fp);
+      fp = NULL;
+    }
+  }
+
+private:
+  FILE* fp;
+};
+
+PosixStorageBackend::PosixStorageBackend(const std::string& rootDir)
+  : rootDir(rootDir), mounted(false) {
+  // Paths passed in always start with '/'
+  while (!this->rootDir.empty() && this->rootDir.back() == '/') {
+    this->rootDir.pop_back();
+  }
+}
+
+std::string PosixStorageBackend::fullPath(const char* path) const {
+  std::string full = rootDir;
+  if (path[0] != '/') {
+    full += '/';
+  }
+  full += path;
+  return full;
+}
+
+bool PosixStorageBackend::begin() {
+  struct stat st;
+  mounted = (::stat(rootDir.empty() ? "/" : rootDir.c_str(), &st) == 0) && S_ISDIR(st.st_mode);
+  return mounted;
+}
+
+void PosixStorageBackend::end() {
+  mounted = false;
+}
+
+StorageFilePtr PosixStorageBackend::open(const char* path, StorageOpenMode mode) {
+  if (!mounted) {
+    return StorageFilePtr();
+  }
+  
+  const char* fsMode = "rb";
+  if (mode == STORAGE_WRITE) {
+    fsMode = "wb";
+  } else if (mode == STORAGE_APPEND) {
+    fsMode = "ab";
+  }
+  
+  FILE* fp = fopen(fullPath(path).c_str(), fsMode);
+  if (!fp) {
+    return StorageFilePtr();
+  }
+  
+  return StorageFilePtr(new PosixStorageFile(fp));
+}
+
+bool PosixStorageBackend::exists(const char* path) {
+  struct stat st;
+  return mounted && ::stat(fullPath(path).c_str(), &st) == 0;
+}
+
+bool PosixStorageBackend::remove(const char* path) {
+  return mounted && ::remove(fullPath(path).c_str()) == 0;
+}
+
+bool PosixStorageBackend::rename(const char* from, const char* to) {
+  return mounted && ::rename(fullPath(from).c_str(), fullPath(to).c_str()) == 0;
+}
+
+bool PosixStorageBackend::mkdir(const char* path) {
+  if (!mounted) {
+    return false;
+  }
+  struct stat st;
+  std::string full = fullPath(path);
+  if (::stat(full.c_str(), &st) == 0) {
+    return S_ISDIR(st.st_mode);
+  }
+  return ::mkdir(full.c_str(), 0755) == 0;
+}
+
+bool PosixStorageBackend::stat(const char* path, size_t* size) {
+  if (!mounted) {
+    return false;
+  }
+  
+  struct stat st;
+  if (::stat(fullPath(path).c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+    return false;
+  }
+  
+  if (size) {
+    *size = (size_t)st.st_size;
+  }
+  return true;
+}
+
+int PosixStorageBackend::list(const char* dir, StorageListCallback callback) {
+  if (!mounted) {
+    return 0;
+  }
+  
+  std::string full = fullPath(dir);
+  DIR* d = opendir(full.c_str());
+  if (!d) {
+    return 0;
+  }
+  
+  std::string prefix = dir;
+  if (prefix.empty() || prefix.back() != '/') {
+    prefix += '/';
+  }
+  
+  int count = 0;
+  struct dirent* entry;
+  while ((entry = readdir(d)) != NULL) {
+    std::string path = prefix + entry->d_name;
+    
+    struct stat st;
+    if (::stat(fullPath(path.c_str()).c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+      continue;
+    }
+    
+    count++;
+    if (callback && !callback(path.c_str(), (size_t)st.st_size)) {
+      break;
+    }
+  }
+  
+  closedir(d);
+  return count;
+}
+
+bool PosixStorageBackend::usage(uint64_t* totalBytes, uint64_t* usedBytes) {
+  if (!mounted) {
+    return false;
+  }
+  
+  struct statvfs vfs;
+  if (statvfs(rootDir.empty() ? "/" : rootDir.c_str(), &vfs) != 0) {
+    return false;
+  }
+  
+  if (totalBytes) {
+    *totalBytes = (uint64_t)vfs.f_blocks * vfs.f_frsize;
+  }
+  if (usedBytes) {
+    *usedBytes = (uint64_t)(vfs.f_blocks - vfs.f_bfree) * vfs.f_frsize;
+  }
+  return true;
+}
+
+#endif // ARDUINO
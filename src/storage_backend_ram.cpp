@@ -0,0 +1,239 @@
+#include "storage_backend.h"
+#include <string.h>
+
+// Get the directory part of a path ("/a/b.jpg" -> "/a", "/b.jpg" -> "/")
+static std::string parentDir(const std::string& path) {
+  size_t slash = path.find_last_of('/');
+  if (slash == std::string::npos || slash == 0) {
+    return "/";
+  }
+  return path.substr(0, slash);
+}
+
+// Normalise a directory path to have no trailing slash (except the root)
+static std::string normaliseDir(const char* dir) {
+  std::string d = dir;
+  while (d.size() > 1 && d.back() == '/') {
+    d.pop_back();
+  }
+  return d.empty() ? "/" : d;
+}
+
+// A handle sharing the file's data with the backend, so the data outlives a
+// remove or rename while the handle is open (as an unlinked POSIX file does)
+class RamStorageFile : public StorageFile {
+public:
+  RamStorageFile(RamStorageBackend* backend, const std::shared_ptr<std::vector<uint8_t>>& data, size_t pos)
+    : backend(backend), data(data), pos(pos) {}
+  ~RamStorageFile() override { close(); }
+  
+  size_t read(uint8_t* buffer, size_t length) override {
+    if (!data || pos >= data->size()) {
+      return 0;
+    }
+    size_t n = data->size() - pos;
+    if (n > length) {
+      n = length;
+    }
+    memcpy(buffer, data->data() + pos, n);
+    pos += n;
+    return n;
+  }
+  
+  size_t write(const uint8_t* buf, size_t length) override {
+    if (!data) {
+      return 0;
+    }
+    
+    // Only growth past the current end counts against the capacity
+    size_t end = pos + length;
+    if (end > data->size()) {
+      uint64_t growth = end - data->size();
+      uint64_t available = backend->capacity() - backend->bytesUsed();
+      if (growth > available) {
+        length -= (size_t)(growth - available);
+        end = pos + length;
+      }
+      if (end > data->size()) {
+        data->resize(end);
+      }
+    }
+    
+    memcpy(data->data() + pos, buf, length);
+    pos += length;
+    return length;
+  }
+  
+  bool seek(size_t position) override {
+    if (!data || position > data->size()) {
+      return false;
+    }
+    pos = position;
+    return true;
+  }
+  
+  size_t position() override {
+    return pos;
+  }
+  
+  size_t size() override {
+    return data ? data->size() : 0;
+  }
+  
+  void close() override {
+    data.reset();
+  }
+
+private:
+  RamStorageBackend* backend;
+  std::shared_ptr<std::vector<uint8_t>> data;
+  size_t pos;
+};
+
+RamStorageBackend::RamStorageBackend(uint64_t capacityBytes)
+  : capacityBytes(capacityBytes), mounted(false) {
+  directories.insert("/");
+}
+
+bool RamStorageBackend::begin() {
+  mounted = true;
+  return true;
+}
+
+void RamStorageBackend::end() {
+  mounted = false;
+}
+
+uint64_t RamStorageBackend::bytesUsed() const {
+  uint64_t used = 0;
+  for (const auto& entry : files) {
+    used += entry.second->size();
+  }
+  return used;
+}
+
+StorageFilePtr RamStorageBackend::open(const char* path, StorageOpenMode mode) {
+  if (!mounted) {
+    return StorageFilePtr();
+  }
+  
+  std::string key = path;
+  auto it = files.find(key);
+  
+  if (mode == STORAGE_READ) {
+    if (it == files.end()) {
+      return StorageFilePtr();
+    }
+    return StorageFilePtr(new RamStorageFile(this, it->second, 0));
+  }
+  
+  // Writing requires the parent directory to exist, as on a real filesystem
+  if (it == files.end()) {
+    if (directories.count(parentDir(key)) == 0) {
+      return StorageFilePtr();
+    }
+    it = files.emplace(key, std::make_shared<std::vector<uint8_t>>()).first;
+  } else if (mode == STORAGE_WRITE) {
+    it->second->clear();
+  }
+  
+  size_t pos = (mode == STORAGE_APPEND) ? it->second->size() : 0;
+  return StorageFilePtr(new RamStorageFile(this, it->second, pos));
+}
+
+bool RamStorageBackend::exists(const char* path) {
+  if (!mounted) {
+    return false;
+  }
+  return files.count(path) > 0 || directories.count(normaliseDir(path)) > 0;
+}
+
+bool RamStorageBackend::remove(const char* path) {
+  return mounted && files.erase(path) > 0;
+}
+
+bool RamStorageBackend::rename(const char* from, const char* to) {
+  if (!mounted) {
+    return false;
+  }
+  
+  auto it = files.find(from);
+  if (it == files.end() || directories.count(parentDir(to)) == 0) {
+    return false;
+  }
+  
+  // Open handles keep the data and see it under the new name
+  std::shared_ptr<std::vector<uint8_t>> data = it->second;
+  files.erase(it);
+  files[to] = data;
+  return true;
+}
+
+bool RamStorageBackend::mkdir(const char* path) {
+  if (!mounted) {
+    return false;
+  }
+  
+  std::string dir = normaliseDir(path);
+  if (directories.count(parentDir(dir)) == 0) {
+    return false;
+  }
+  directories.insert(dir);
+  return true;
+}
+
+bool RamStorageBackend::stat(const char* path, size_t* size) {
+  if (!mounted) {
+    return false;
+  }
+  
+  auto it = files.find(path);
+  if (it == files.end()) {
+    return false;
+  }
+  
+  if (size) {
+    *size = it->second->size();
+  }
+  return true;
+}
+
+int RamStorageBackend::list(const char* dir, StorageListCallback callback) {
+  if (!mounted) {
+    return 0;
+  }
+  
+  std::string d = normaliseDir(dir);
+  int count = 0;
+  
+  // Collect first so the callback may remove or rename the listed files
+  std::vector<std::pair<std::string, size_t>> entries;
+  for (const auto& entry : files) {
+    if (parentDir(entry.first) == d) {
+      entries.push_back(std::make_pair(entry.first, entry.second->size()));
+    }
+  }
+  
+  for (const auto& entry : entries) {
+    count++;
+    if (callback && !callback(entry.first.c_str(), entry.second)) {
+      break;
+    }
+  }
+  
+  return count;
+}
+
+bool RamStorageBackend::usage(uint64_t* totalBytes, uint64_t* usedBytes) {
+  if (!mounted) {
+    return false;
+  }
+  
+  if (totalBytes) {
+    *totalBytes = capacityBytes;
+  }
+  if (usedBytes) {
+    *usedBytes = bytesUsed();
+  }
+  return true;
+}
@@ -0,0 +1,178 @@
+#ifdef ARDUINO
+
+#include "storage_backend.h"
+#include "hw_config.h"
+#include <Arduino.h>
+#include <FS.h>
+#include <SD.h>
+#include <SPI.h>
+
+// Wraps an Arduino fs::File
+class SDStorageFile : public StorageFile {
+public:
+  explicit SDStorageFile(File file) : file(file) {}
+  ~SDStorageFile() override { close(); }
+  
+  size_t read(uint8_t* buffer, size_t length) override {
+    return file.read(buffer, length);
+  }
+  
+  size_t write(const uint8_t* data, size_t length) override {
+    return file.write(data, length);
+  }
+  
+  bool seek(size_t position) override {
+    return file.seek(position);
+  }
+  
+  size_t position() override {
+    return file.position();
+  }
+  
+  size_t size() override {
+    return file.size();
+  }
+  
+  void close() override {
+    if (file) {
+      file.close();
+    }
+  }
+
+private:
+  File file;
+};
+
+SDStorageBackend::SDStorageBackend(int csPin) : csPin(csPin), mounted(false) {}
+
+bool SDStorageBackend::begin() {
+  if (mounted) {
+    return true;
+  }
+  
+  SPI.begin(SD_SCK_PIN, SD_MISO_PIN, SD_MOSI_PIN);
+  mounted = SD.begin(csPin);
+  return mounted;
+}
+
+void SDStorageBackend::end() {
+  if (mounted) {
+    SD.end();
+    mounted = false;
+  }
+}
+
+StorageFilePtr SDStorageBackend::open(const char* path, StorageOpenMode mode) {
+  if (!mounted) {
+    return StorageFilePtr();
+  }
+  
+  const char* fsMode = FILE_READ;
+  if (mode == STORAGE_WRITE) {
+    fsMode = FILE_WRITE;
+  } else if (mode == STORAGE_APPEND) {
+    fsMode = FILE_APPEND;
+  }
+  
+  File file = SD.open(path, fsMode);
+  if (!file || file.isDirectory()) {
+    return StorageFilePtr();
+  }
+  
+  return StorageFilePtr(new SDStorageFile(file));
+}
+
+bool SDStorageBackend::exists(const char* path) {
+  return mounted && SD.exists(path);
+}
+
+bool SDStorageBackend::remove(const char* path) {
+  return mounted && SD.remove(path);
+}
+
+bool SDStorageBackend::rename(const char* from, const char* to) {
+  return mounted && SD.rename(from, to);
+}
+
+bool SDStorageBackend::mkdir(const char* path) {
+  if (!mounted) {
+    return false;
+  }
+  return SD.exists(path) || SD.mkdir(path);
+}
+
+bool SDStorageBackend::stat(const char* path, size_t* size) {
+  if (!mounted) {
+    return false;
+  }
+  
+  File file = SD.open(path, FILE_READ);
+  if (!file || file.isDirectory()) {
+    return false;
+  }
+  
+  if (size) {
+    *size = file.size();
+  }
+  file.close();
+  return true;
+}
+
+int SDStorageBackend::list(const char* dir, StorageListCallback callback) {
+  if (!mounted) {
+    return 0;
+  }
+  
+  File root = SD.open(dir);
+  if (!root) {
+    return 0;
+  }
+  
+  if (!root.isDirectory()) {
+    root.close();
+    return 0;
+  }
+  
+  // Build "<dir>/<name>" paths, the SD library only reports the base name
+  String prefix = dir;
+  if (!prefix.endsWith("/")) {
+    prefix += "/";
+  }
+  
+  int count = 0;
+  File file = root.openNextFile();
+  while (file) {
+    if (!file.isDirectory()) {
+      String path = prefix + file.name();
+      size_t size = file.size();
+      file.close();
+      count++;
+      
+      if (callback && !callback(path.c_str(), size)) {
+        break;
+      }
+    } else {
+      file.close();
+    }
+    file = root.openNextFile();
+  }
+  
+  root.close();
+  return count;
+}
+
+bool SDStorageBackend::usage(uint64_t* totalBytes, uint64_t* usedBytes) {
+  if (!mounted) {
+    return false;
+  }
+  
+  if (totalBytes) {
+    *totalBytes = SD.totalBytes();
+  }
+  if (usedBytes) {
+    *usedBytes = SD.usedBytes();
+  }
+  return true;
+}
+
+#endif // ARDUINO
@@ -0,0 +1,138 @@
+#include "tar_source.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#define TAR_BLOCK_SIZE 512
+
+static size_t paddedSize(size_t size) {
+  return (size + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE * TAR_BLOCK_SIZE;
+}
+
+TarUploadSource::TarUploadSource(StorageBackend* storage)
+  : storage(storage), totalSize(2 * TAR_BLOCK_SIZE), offset(0), openIndex(SIZE_MAX) {}
+
+bool TarUploadSource::addFile(const std::string& path, const std::string& name, size_t size,
+                              uint64_t mtime) {
+  if (name.empty() || name.size() > 99) {
+    return false;
+  }
+  
+  Entry entry;
+  entry.path = path;
+  entry.name = name;
+  entry.size = size;
+  entry.mtime = mtime;
+  entry.start = totalSize - 2 * TAR_BLOCK_SIZE;
+  entries.push_back(entry);
+  
+  totalSize += TAR_BLOCK_SIZE + paddedSize(size);
+  return true;
+}
+
+size_t TarUploadSource::size() {
+  return totalSize;
+}
+
+bool TarUploadSource::seek(size_t newOffset) {
+  if (newOffset > totalSize) {
+    return false;
+  }
+  offset = newOffset;
+  return true;
+}
+
+// ustar header; numbers are octal text
+void TarUploadSource::makeHeader(const Entry& entry, uint8_t* header) {
+  memset(header, 0, TAR_BLOCK_SIZE);
+  char* h = (char*)header;
+  
+  memcpy(h, entry.name.c_str(), entry.name.size());
+  memcpy(h + 100, "0000644", 7);                                           // mode
+  memcpy(h + 108, "0000000", 7);                                           // uid
+  memcpy(h + 116, "0000000", 7);                                           // gid
+  snprintf(h + 124, 12, "%011llo", (unsigned long long)entry.size);
+  snprintf(h + 136, 12, "%011llo", (unsigned long long)entry.mtime);
+  h[156] = '0';                                                            // regular file
+  memcpy(h + 257, "ustar", 6);
+  memcpy(h + 263, "00", 2);
+  
+  // The checksum is taken with its own field as spaces
+  memset(h + 148, ' ', 8);
+  unsigned int sum = 0;
+  for (int i = 0; i < TAR_BLOCK_SIZE; i++) {
+    sum += header[i];
+  }
+  snprintf(h + 148, 8, "%06o", sum);
+  h[155] = ' ';
+}
+
+bool TarUploadSource::openEntry(size_t index) {
+  if (openIndex == index && file) {
+    return true;
+  }
+  
+  if (file) {
+    file->close();
+  }
+  file = storage->open(entries[index].path.c_str(), STORAGE_READ);
+  openIndex = file ? index : SIZE_MAX;
+  return (bool)file;
+}
+
+size_t TarUploadSource::read(uint8_t* buffer, size_t len) {
+  size_t done = 0;
+  
+  while (done < len && offset < totalSize) {
+    // Entry the offset falls in; the tail after the last one is zeros
+    size_t index = entries.size();
+    size_t lo = 0;
+    size_t hi = entries.size();
+    while (lo < hi) {
+      size_t mid = (lo + hi) / 2;
+      if (entries[mid].start <= offset) {
+        index = mid;
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    
+    size_t n;
+    if (index == entries.size() ||
+        offset >= entries[index].start + TAR_BLOCK_SIZE + paddedSize(entries[index].size)) {
+      // End-of-archive blocks
+      n = std::min(len - done, totalSize - offset);
+      memset(buffer + done, 0, n);
+    } else {
+      const Entry& entry = entries[index];
+      size_t within = offset - entry.start;
+      
+      if (within < TAR_BLOCK_SIZE) {
+        uint8_t header[TAR_BLOCK_SIZE];
+        makeHeader(entry, header);
+        n = std::min(len - done, TAR_BLOCK_SIZE - within);
+        memcpy(buffer + done, header + within, n);
+      } else if (within - TAR_BLOCK_SIZE < entry.size) {
+        size_t dataOffset = within - TAR_BLOCK_SIZE;
+        if (!openEntry(index) || (file->position() != dataOffset && !file->seek(dataOffset))) {
+          return done;
+        }
+        n = file->read(buffer + done, std::min(len - done, entry.size - dataOffset));
+        if (n == 0) {
+          return done;
+        }
+      } else {
+        // Padding to the next block
+        size_t end = entry.start + TAR_BLOCK_SIZE + paddedSize(entry.size);
+        n = std::min(len - done, end - offset);
+        memset(buffer + done, 0, n);
+      }
+    }
+    
+    done += n;
+    offset += n;
+  }
+  
+  return done;
+}
@@ -0,0 +1,48 @@
+#ifndef TAR_SOURCE_H
+#define TAR_SOURCE_H
+
+// Streams several captures as one uncompressed (ustar) tar archive, read
+// straight from storage without a temporary copy. Seekable, so a resumable
+// upload can restart it at any offset. Free of Arduino includes so it can
+// be built on a host machine.
+
+#include <string>
+#include <vector>
+#include "storage_backend.h"
+#include "upload_source.h"
+
+class TarUploadSource : public UploadSource {
+public:
+  explicit TarUploadSource(StorageBackend* storage);
+  
+  // Add a file; name is the entry name in the archive (max 99 characters),
+  // mtime its timestamp (seconds since the epoch)
+  bool addFile(const std::string& path, const std::string& name, size_t size, uint64_t mtime);
+  
+  size_t count() const { return entries.size(); }
+  
+  size_t size() override;
+  bool seek(size_t offset) override;
+  size_t read(uint8_t* buffer, size_t len) override;
+
+private:
+  struct Entry {
+    std::string path;
+    std::string name;
+    size_t size;
+    uint64_t mtime;
+    size_t start;       // Offset of the header block in the archive
+  };
+  
+  void makeHeader(const Entry& entry, uint8_t* header);
+  bool openEntry(size_t index);
+  
+  StorageBackend* storage;
+  std::vector<Entry> entries;
+  size_t totalSize;     // Entries plus the two zero blocks at the end
+  size_t offset;
+  size_t openIndex;     // Entry whose file is open, or SIZE_MAX
+  StorageFilePtr file;
+};
+
+#endif // TAR_SOURCE_H
@@ -1,5 +1,6 @@
 #include "time_sync.h"
 #include "cellular.h"
+#include "at_parser.h"
 #include "config.h"
 
 // Sync time with NTP server
@@ -20,36 +21,32 @@ bool syncTimeWithNTP() {
   }
   
   // Request time sync
-  response = sendATCommand("AT+CNTP", 10000);
+  response = sendATCommandUntil("AT+CNTP", "+CNTP:", 10000);
   if (response.indexOf("+CNTP: 1") == -1) {
     Serial.println("NTP request failed");
     return false;
   }
   
-  // Get network time
+  // Get network time, +CCLK: "yy/MM/dd,hh:mm:ss±zz"
   response = sendATCommand("AT+CCLK?");
-  if (response.indexOf("+CCLK:") == -1) {
+  AtSlice line;
+  AtClock clock;
+  if (!findAtLine(response.c_str(), response.length(), "+CCLK:", line)) {
     Serial.println("Failed to get network time");
     return false;
   }
   
-  // Parse time response (format: +CCLK: "yy/MM/dd,hh:mm:ss±zz")
-  int timeIndex = response.indexOf("\"");
-  if (timeIndex == -1) {
+  if (!parseClock(line, clock)) {
     Serial.println("Invalid time format");
     return false;
   }
   
-  String timeStr = response.substring(timeIndex + 1, response.lastIndexOf("\""));
-  Serial.println("Network time: " + timeStr);
-  
-  // Parse date/time components
-  int year = 2000 + timeStr.substring(0, 2).toInt();
-  int month = timeStr.substring(3, 5).toInt();
-  int day = timeStr.substring(6, 8).toInt();
-  int hour = timeStr.substring(9, 11).toInt();
-  int minute = timeStr.substring(12, 14).toInt();
-  int second = timeStr.substring(15, 17).toInt();
+  int year = clock.year;
+  int month = clock.month;
+  int day = clock.day;
+  int hour = clock.hour;
+  int minute = clock.minute;
+  int second = clock.second;
   
   // Set ESP32 system time
   struct tm timeinfo;
@@ -70,19 +67,43 @@ bool syncTimeWithNTP() {
   return true;
 }
 
+// Check if the system clock has been set (does not wait)
+bool isTimeSet() {
+  // Before the first sync the clock starts at the epoch
+  return time(NULL) > MIN_VALID_EPOCH;
+}
+
 // Get current time as a formatted string
 bool getTimestampString(char* buffer, size_t bufferSize) {
-  struct tm timeinfo;
-  if (!getLocalTime(&timeinfo)) {
+  // getLocalTime() waits up to 5 s for a clock that was never set,
+  // so check first and never stall the capture path
+  if (!isTimeSet()) {
     // If unable to get time, use a placeholder
     strncpy(buffer, "yyyyMMdd_HHMMSS", bufferSize);
     return false;
   }
   
-  strftime(buffer, bufferSize, TIME_FORMAT, &timeinfo);
+  formatTimestamp(time(NULL), buffer, bufferSize);
   return true;
 }
 
+// Format a given time as a filename timestamp
+void formatTimestamp(time_t t, char* buffer, size_t bufferSize) {
+  struct tm timeinfo;
+  localtime_r(&t, &timeinfo);
+  strftime(buffer, bufferSize, TIME_FORMAT, &timeinfo);
+}
+
+time_t parseTimestamp(const char* text) {
+  struct tm timeinfo = {};
+  const char* end = strptime(text, TIME_FORMAT, &timeinfo);
+  if (!end || *end != '\0') {
+    return 0;
+  }
+  timeinfo.tm_isdst = -1;
+  return mktime(&timeinfo);
+}
+
 // Check if a daily event should occur
 bool checkDailyEvent(int hour, int minute) {
   struct tm timeinfo;
@@ -7,9 +7,18 @@
 // Sync time with NTP server
 bool syncTimeWithNTP();
 
+// Check if the system clock has been set (does not wait)
+bool isTimeSet();
+
 // Get current time as a formatted string
 bool getTimestampString(char* buffer, size_t bufferSize);
 
+// Format a given time as a filename timestamp
+void formatTimestamp(time_t t, char* buffer, size_t bufferSize);
+
+// Read a filename timestamp back, 0 if it isn't one
+time_t parseTimestamp(const char* text);
+
 // Check if a daily event should occur
 bool checkDailyEvent(int hour, int minute);
 
@@ -0,0 +1,321 @@
+#include "tls_client.h"
+#include "mbedtls/net_sockets.h"
+
+// Wait between polls of the transport while the handshake waits for data
+#define TLS_POLL_DELAY_MS 10
+
+TlsClient::TlsClient(Client* transport)
+  : transport(transport), rootCerts(NULL), handshakeTimeoutMs(TLS_HANDSHAKE_TIMEOUT_S * 1000),
+    configured(false), open(false), resumed(false), peeked(-1), nextSession(0) {
+  mbedtls_entropy_init(&entropy);
+  mbedtls_ctr_drbg_init(&drbg);
+  mbedtls_x509_crt_init(&caChain);
+  mbedtls_ssl_config_init(&config);
+  mbedtls_ssl_init(&ssl);
+  for (int i = 0; i < TLS_SESSION_CACHE_SIZE; i++) {
+    sessions[i].host[0] = '\0';
+    sessions[i].valid = false;
+    mbedtls_ssl_session_init(&sessions[i].session);
+  }
+}
+
+TlsClient::~TlsClient() {
+  stop();
+  clearSessions();
+  mbedtls_ssl_free(&ssl);
+  mbedtls_ssl_config_free(&config);
+  mbedtls_x509_crt_free(&caChain);
+  mbedtls_ctr_drbg_free(&drbg);
+  mbedtls_entropy_free(&entropy);
+}
+
+void TlsClient::setCACert(const char* certs) {
+  rootCerts = certs;
+  configured = false;
+}
+
+// Random generator, root certificates and client settings, once
+bool TlsClient::configure() {
+  if (configured) {
+    return true;
+  }
+  if (!rootCerts) {
+    Serial.println("TLS: no root certificates");
+    return false;
+  }
+  
+  static const char personalization[] = "cabinmonitor-tls";
+  int ret = mbedtls_ctr_drbg_seed(&drbg, mbedtls_entropy_func, &entropy,
+                                  (const unsigned char*)personalization, sizeof(personalization) - 1);
+  if (ret != 0) {
+    Serial.printf("TLS: RNG seed failed (-0x%04x)\n", -ret);
+    return false;
+  }
+  
+  // A certificate that doesn't parse is skipped as long as some do
+  mbedtls_x509_crt_free(&caChain);
+  mbedtls_x509_crt_init(&caChain);
+  ret = mbedtls_x509_crt_parse(&caChain, (const unsigned char*)rootCerts, strlen(rootCerts) + 1);
+  if (ret < 0) {
+    Serial.printf("TLS: root certificates not parsed (-0x%04x)\n", -ret);
+    return false;
+  }
+  
+  ret = mbedtls_ssl_config_defaults(&config, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                    MBEDTLS_SSL_PRESET_DEFAULT);
+  if (ret != 0) {
+    Serial.printf("TLS: config failed (-0x%04x)\n", -ret);
+    return false;
+  }
+  mbedtls_ssl_conf_authmode(&config, MBEDTLS_SSL_VERIFY_REQUIRED);
+  mbedtls_ssl_conf_ca_chain(&config, &caChain, NULL);
+  mbedtls_ssl_conf_rng(&config, mbedtls_ctr_drbg_random, &drbg);
+  mbedtls_ssl_conf_session_tickets(&config, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+  
+  configured = true;
+  return true;
+}
+
+// mbedTLS reads and writes through the transport; nothing there yet means
+// try again, a closed transport ends the connection
+int TlsClient::sendCallback(void* context, const unsigned char* buf, size_t len) {
+  Client* transport = ((TlsClient*)context)->transport;
+  if (!transport->connected()) {
+    return MBEDTLS_ERR_NET_CONN_RESET;
+  }
+  
+  size_t written = transport->write(buf, len);
+  return written > 0 ? (int)written : MBEDTLS_ERR_NET_SEND_FAILED;
+}
+
+int TlsClient::receiveCallback(void* context, unsigned char* buf, size_t len) {
+  Client* transport = ((TlsClient*)context)->transport;
+  if (transport->available() > 0) {
+    int n = transport->read(buf, len);
+    if (n > 0) {
+      return n;
+    }
+  }
+  return transport->connected() ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_CONN_RESET;
+}
+
+TlsCachedSession* TlsClient::findSession(const char* host, uint16_t port) {
+  for (int i = 0; i < TLS_SESSION_CACHE_SIZE; i++) {
+    if (sessions[i].valid && sessions[i].port == port && strcmp(sessions[i].host, host) == 0) {
+      return &sessions[i];
+    }
+  }
+  return NULL;
+}
+
+// Keep what the server agreed to, replacing this host's old session or the
+// oldest entry
+void TlsClient::saveSession(const char* host, uint16_t port) {
+  TlsCachedSession* entry = findSession(host, port);
+  if (!entry) {
+    entry = &sessions[nextSession];
+    nextSession = (nextSession + 1) % TLS_SESSION_CACHE_SIZE;
+  }
+  
+  mbedtls_ssl_session_free(&entry->session);
+  mbedtls_ssl_session_init(&entry->session);
+  entry->valid = mbedtls_ssl_get_session(&ssl, &entry->session) == 0;
+  strlcpy(entry->host, host, sizeof(entry->host));
+  entry->port = port;
+}
+
+void TlsClient::clearSessions() {
+  for (int i = 0; i < TLS_SESSION_CACHE_SIZE; i++) {
+    mbedtls_ssl_session_free(&sessions[i].session);
+    mbedtls_ssl_session_init(&sessions[i].session);
+    sessions[i].valid = false;
+  }
+}
+
+// Step through the handshake so the timeout holds while the modem is slow.
+// A resumed handshake goes from the ServerHello straight to the server's
+// ChangeCipherSpec, without the certificate.
+bool TlsClient::handshake(const char* host) {
+  unsigned long start = millis();
+  bool sawCertificate = false;
+  while (ssl.state != MBEDTLS_SSL_HANDSHAKE_OVER) {
+    if (ssl.state == MBEDTLS_SSL_SERVER_CERTIFICATE) {
+      sawCertificate = true;
+    }
+    
+    int ret = mbedtls_ssl_handshake_step(&ssl);
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+      if (millis() - start > handshakeTimeoutMs) {
+        Serial.printf("TLS handshake with %s timed out\n", host);
+        return false;
+      }
+      delay(TLS_POLL_DELAY_MS);
+    } else if (ret != 0) {
+      Serial.printf("TLS handshake with %s failed (-0x%04x)\n", host, -ret);
+      return false;
+    }
+  }
+  
+  resumed = !sawCertificate;
+  return true;
+}
+
+int TlsClient::connect(IPAddress ip, uint16_t port) {
+  return connect(ip.toString().c_str(), port);
+}
+
+int TlsClient::connect(const char* host, uint16_t port) {
+  stop();
+  if (!configure() || !transport->connect(host, port)) {
+    return 0;
+  }
+  
+  // A fresh context per connection, offered the host's last session
+  mbedtls_ssl_free(&ssl);
+  mbedtls_ssl_init(&ssl);
+  int ret = mbedtls_ssl_setup(&ssl, &config);
+  if (ret == 0) {
+    ret = mbedtls_ssl_set_hostname(&ssl, host);
+  }
+  if (ret != 0) {
+    Serial.printf("TLS setup failed (-0x%04x)\n", -ret);
+    transport->stop();
+    return 0;
+  }
+  mbedtls_ssl_set_bio(&ssl, this, sendCallback, receiveCallback, NULL);
+  
+  TlsCachedSession* cached = findSession(host, port);
+  if (cached && mbedtls_ssl_set_session(&ssl, &cached->session) != 0) {
+    cached->valid = false;
+  }
+  
+  resumed = false;
+  if (!handshake(host)) {
+    // The session may be what the server refused, start over next time
+    if (cached) {
+      cached->valid = false;
+    }
+    transport->stop();
+    return 0;
+  }
+  
+  // Kept for the next connect, also after a resumption, which may have
+  // brought a renewed ticket
+  saveSession(host, port);
+  open = true;
+  peeked = -1;
+  return 1;
+}
+
+size_t TlsClient::write(uint8_t b) {
+  return write(&b, 1);
+}
+
+size_t TlsClient::write(const uint8_t* buf, size_t size) {
+  if (!open) {
+    return 0;
+  }
+  
+  size_t written = 0;
+  while (written < size) {
+    int ret = mbedtls_ssl_write(&ssl, buf + written, size - written);
+    if (ret > 0) {
+      written += ret;
+    } else if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+      Serial.printf("TLS write failed (-0x%04x)\n", -ret);
+      stop();
+      return 0;
+    }
+  }
+  return written;
+}
+
+// Decrypt the next record if nothing is buffered, keeping its first byte
+bool TlsClient::fillPeek() {
+  if (peeked >= 0 || mbedtls_ssl_get_bytes_avail(&ssl) > 0) {
+    return true;
+  }
+  
+  unsigned char c;
+  int ret = mbedtls_ssl_read(&ssl, &c, 1);
+  if (ret == 1) {
+    peeked = c;
+    return true;
+  }
+  
+  // Close notify, reset or a bad record: the connection is done
+  if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+    open = false;
+  }
+  return false;
+}
+
+int TlsClient::available() {
+  if (!open && peeked < 0) {
+    return 0;
+  }
+  
+  if (open) {
+    fillPeek();
+  }
+  return (peeked >= 0 ? 1 : 0) + (int)mbedtls_ssl_get_bytes_avail(&ssl);
+}
+
+int TlsClient::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int TlsClient::read(uint8_t* buf, size_t size) {
+  if (size == 0 || available() == 0) {
+    return -1;
+  }
+  
+  size_t n = 0;
+  if (peeked >= 0) {
+    buf[n++] = peeked;
+    peeked = -1;
+  }
+  
+  // Only what is already decrypted, so a read never waits on the network
+  size_t buffered = mbedtls_ssl_get_bytes_avail(&ssl);
+  if (n < size && buffered > 0) {
+    int ret = mbedtls_ssl_read(&ssl, buf + n, min(size - n, buffered));
+    if (ret > 0) {
+      n += ret;
+    }
+  }
+  return n;
+}
+
+int TlsClient::peek() {
+  if (peeked < 0 && available() > 0) {
+    // Already decrypted bytes: hold the next one back
+    unsigned char c;
+    if (peeked < 0 && mbedtls_ssl_read(&ssl, &c, 1) == 1) {
+      peeked = c;
+    }
+  }
+  return peeked;
+}
+
+void TlsClient::flush() {
+  transport->flush();
+}
+
+void TlsClient::stop() {
+  if (open) {
+    mbedtls_ssl_close_notify(&ssl);
+    transport->flush();
+  }
+  open = false;
+  peeked = -1;
+  transport->stop();
+}
+
+uint8_t TlsClient::connected() {
+  if (peeked >= 0 || (open && mbedtls_ssl_get_bytes_avail(&ssl) > 0)) {
+    return 1;
+  }
+  return open && transport->connected();
+}
@@ -0,0 +1,78 @@
+#ifndef TLS_CLIENT_H
+#define TLS_CLIENT_H
+
+#include <Arduino.h>
+#include <Client.h>
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/x509_crt.h"
+#include "config.h"
+
+// TLS 1.2 with mbedTLS over any Arduino Client (the modem's TCP socket).
+// The session of each host is kept after a full handshake and offered on
+// the next connect, so a reconnect is resumed (session ticket or ID) with
+// one round trip less and no certificate chain on the wire.
+
+struct TlsCachedSession {
+  char host[64];
+  uint16_t port;
+  bool valid;
+  mbedtls_ssl_session session;
+};
+
+class TlsClient : public Client {
+public:
+  TlsClient(Client* transport);
+  ~TlsClient();
+  
+  // PEM root certificates; the string must outlive the client
+  void setCACert(const char* rootCerts);
+  void setHandshakeTimeout(unsigned long seconds) { handshakeTimeoutMs = seconds * 1000; }
+  
+  int connect(IPAddress ip, uint16_t port) override;
+  int connect(const char* host, uint16_t port) override;
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t* buf, size_t size) override;
+  int available() override;
+  int read() override;
+  int read(uint8_t* buf, size_t size) override;
+  int peek() override;
+  void flush() override;
+  void stop() override;
+  uint8_t connected() override;
+  operator bool() override { return connected(); }
+  
+  // Whether the last handshake resumed a cached session
+  bool wasResumed() const { return resumed; }
+  
+  // Forget the cached sessions (credentials or server changed)
+  void clearSessions();
+
+private:
+  static int sendCallback(void* context, const unsigned char* buf, size_t len);
+  static int receiveCallback(void* context, unsigned char* buf, size_t len);
+  bool configure();
+  bool handshake(const char* host);
+  TlsCachedSession* findSession(const char* host, uint16_t port);
+  void saveSession(const char* host, uint16_t port);
+  bool fillPeek();
+  
+  Client* transport;
+  const char* rootCerts;
+  unsigned long handshakeTimeoutMs;
+  bool configured;
+  bool open;
+  bool resumed;
+  int peeked;  // A byte read ahead by available(), -1 if none
+  
+  mbedtls_entropy_context entropy;
+  mbedtls_ctr_drbg_context drbg;
+  mbedtls_x509_crt caChain;
+  mbedtls_ssl_config config;
+  mbedtls_ssl_context ssl;
+  TlsCachedSession sessions[TLS_SESSION_CACHE_SIZE];
+  uint8_t nextSession;  // Replaced next when every entry is taken
+};
+
+#endif // TLS_CLIENT_H
@@ -0,0 +1,134 @@
+#include "token_cache.h"
+#include "time_sync.h"
+#include "config.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#define TOKEN_CACHE_MAGIC 0x544F4B31  // "TOK1"
+
+// Survives resets other than power loss; the expiry is wall-clock time so it
+// stays meaningful after a restart once the clock is set again
+struct RtcToken {
+  uint32_t magic;
+  time_t expiresAt;
+  char token[OAUTH_TOKEN_MAX_LENGTH];
+};
+
+RTC_DATA_ATTR RtcToken rtcToken;
+
+String cachedToken;
+unsigned long tokenExpiresMs = 0;  // millis() deadline, used before NTP sync
+bool tokenValid = false;
+
+TokenRefreshFunction tokenRefresher = NULL;
+SemaphoreHandle_t tokenMutex = NULL;
+TokenCacheStats tokenStats;
+
+void initTokenCache(TokenRefreshFunction refresh) {
+  tokenRefresher = refresh;
+  if (!tokenMutex) {
+    tokenMutex = xSemaphoreCreateMutex();
+  }
+  
+  // Take over a token from before the restart if it is still good
+  if (!tokenValid && rtcToken.magic == TOKEN_CACHE_MAGIC && isTimeSet()) {
+    time_t remaining = rtcToken.expiresAt - time(NULL);
+    if (remaining > OAUTH_REFRESH_MARGIN_SEC) {
+      cachedToken = String(rtcToken.token);
+      tokenExpiresMs = millis() + (unsigned long)remaining * 1000UL;
+      tokenValid = true;
+      Serial.printf("Reusing access token, %ld s left\n", (long)remaining);
+    }
+  }
+}
+
+// Still usable for at least the refresh margin
+static bool tokenFresh() {
+  if (!tokenValid) {
+    return false;
+  }
+  return (long)(tokenExpiresMs - millis()) > (long)OAUTH_REFRESH_MARGIN_SEC * 1000L;
+}
+
+static void storeToken(const String& token, uint32_t expiresIn) {
+  cachedToken = token;
+  tokenExpiresMs = millis() + expiresIn * 1000UL;
+  tokenValid = true;
+  
+  // Tokens too long for RTC memory are only kept in RAM
+  if (isTimeSet() && token.length() < sizeof(rtcToken.token)) {
+    strlcpy(rtcToken.token, token.c_str(), sizeof(rtcToken.token));
+    rtcToken.expiresAt = time(NULL) + expiresIn;
+    rtcToken.magic = TOKEN_CACHE_MAGIC;
+  } else {
+    rtcToken.magic = 0;
+  }
+}
+
+// Refresh under the mutex; callers queued behind a refresh reuse its result
+static bool refreshLocked(const String* rejected, String& token) {
+  if (!tokenRefresher || !tokenMutex) {
+    return false;
+  }
+  
+  xSemaphoreTake(tokenMutex, portMAX_DELAY);
+  
+  bool replaced = rejected ? (tokenValid && cachedToken != *rejected) : tokenFresh();
+  if (replaced) {
+    tokenStats.coalesced++;
+    token = cachedToken;
+    xSemaphoreGive(tokenMutex);
+    return true;
+  }
+  
+  String newToken;
+  uint32_t expiresIn = 0;
+  bool ok = tokenRefresher(newToken, expiresIn);
+  if (ok) {
+    tokenStats.refreshes++;
+    storeToken(newToken, expiresIn);
+    token = cachedToken;
+  } else {
+    tokenStats.failures++;
+  }
+  
+  xSemaphoreGive(tokenMutex);
+  return ok;
+}
+
+bool getAccessToken(String& token) {
+  if (tokenFresh()) {
+    tokenStats.hits++;
+    token = cachedToken;
+    return true;
+  }
+  
+  return refreshLocked(NULL, token);
+}
+
+bool renewAccessToken(const String& rejected, String& token) {
+  return refreshLocked(&rejected, token);
+}
+
+void clearAccessToken() {
+  if (tokenMutex) {
+    xSemaphoreTake(tokenMutex, portMAX_DELAY);
+  }
+  cachedToken = "";
+  tokenValid = false;
+  rtcToken.magic = 0;
+  if (tokenMutex) {
+    xSemaphoreGive(tokenMutex);
+  }
+}
+
+const TokenCacheStats& getTokenCacheStats() {
+  return tokenStats;
+}
+
+void printTokenCacheStats() {
+  Serial.printf("Access token: %lu refreshes, %lu failures, %lu round trips saved (%lu cached, %lu coalesced)\n",
+                (unsigned long)tokenStats.refreshes, (unsigned long)tokenStats.failures,
+                (unsigned long)(tokenStats.hits + tokenStats.coalesced),
+                (unsigned long)tokenStats.hits, (unsigned long)tokenStats.coalesced);
+}
@@ -0,0 +1,34 @@
+#ifndef TOKEN_CACHE_H
+#define TOKEN_CACHE_H
+
+#include <Arduino.h>
+
+// OAuth access token cached in RAM and RTC memory, refreshed near expiry
+
+// Fetches a new token and its lifetime in seconds from the OAuth server
+typedef bool (*TokenRefreshFunction)(String& token, uint32_t& expiresIn);
+
+// Counters since boot; hits and coalesced waits are saved round trips
+struct TokenCacheStats {
+  uint32_t refreshes;
+  uint32_t failures;
+  uint32_t hits;
+  uint32_t coalesced;
+};
+
+// Set the refresh function and pick up a token kept across a restart
+void initTokenCache(TokenRefreshFunction refresh);
+
+// Get a valid token, refreshing only when it is missing or about to expire
+bool getAccessToken(String& token);
+
+// Called after a 401; refreshes unless another caller already replaced the token
+bool renewAccessToken(const String& rejected, String& token);
+
+// Forget the token (credentials changed)
+void clearAccessToken();
+
+const TokenCacheStats& getTokenCacheStats();
+void printTokenCacheStats();
+
+#endif // TOKEN_CACHE_H
@@ -0,0 +1,52 @@
+#ifndef UPLOAD_BACKEND_H
+#define UPLOAD_BACKEND_H
+
+#include <Arduino.h>
+#include "http_client.h"
+#include "upload_source.h"
+
+// Content type for an upload, from its name
+inline const char* getUploadMimeType(const String& name) {
+  return name.endsWith(".tar") ? "application/x-tar" : "image/jpeg";
+}
+
+// A place captures are uploaded to (Google Drive, a WebDAV/HTTP PUT server)
+class UploadBackend {
+public:
+  virtual ~UploadBackend() {}
+  
+  virtual const char* name() = 0;
+  
+  // Check if the backend has the settings it needs (no network access)
+  virtual bool isConfigured() = 0;
+  
+  // Get ready to upload, proving the server is reachable where that is cheap
+  virtual bool begin() = 0;
+  
+  // Cheapest check that the server is reachable and takes our credentials,
+  // called after begin()
+  virtual bool probe() = 0;
+  
+  // Send one capture. localPath is the file on storage the source reads from,
+  // or NULL for frames held in memory; backends may keep resume state beside it.
+  virtual bool upload(const String& name, UploadSource& source, const char* localPath) = 0;
+  
+  // Check that the server holds the named capture at the expected size, and
+  // with this SHA-256 where given and the backend can tell
+  virtual bool verify(const String& name, size_t size, const uint8_t* sha256 = NULL) = 0;
+  
+  // Check whether the server already holds exactly this capture (SHA-256 of
+  // the content); false when it doesn't or the backend can't tell
+  virtual bool hasRemoteCopy(const String& name, const uint8_t* sha256, size_t size) { return false; }
+  
+  // End of a batch, let the connection go
+  virtual void close() = 0;
+  
+  // Connection whose counters describe the batch (NULL if not HTTP based)
+  virtual HttpConnection* getConnection() { return NULL; }
+  
+  // Backend-specific figures logged after a batch
+  virtual void printStats() {}
+};
+
+#endif // UPLOAD_BACKEND_H
@@ -0,0 +1,188 @@
+#include "upload_ledger.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef ESP_PLATFORM
+#include <esp_heap_caps.h>
+#endif
+
+#define LEDGER_READ_KEYS 64
+
+// Large and only used by the upload task, so it goes to PSRAM when there is
+// some (ps_malloc without the Arduino include)
+static uint64_t* allocateSlots(size_t count) {
+#ifdef ESP_PLATFORM
+  void* slots = heap_caps_calloc(count, sizeof(uint64_t), MALLOC_CAP_SPIRAM);
+  if (slots) {
+    return (uint64_t*)slots;
+  }
+#endif
+  return (uint64_t*)calloc(count, sizeof(uint64_t));
+}
+
+UploadLedger::UploadLedger(StorageBackend* storage, const char* path, uint32_t maxEntries)
+  : storage(storage), path(path), maxEntries(maxEntries), slots(NULL), tableSize(0), entries(0),
+    loaded(false) {
+  // At most 3/4 full, a power of two so probing can wrap with a mask
+  tableSize = 16;
+  while (tableSize < (size_t)maxEntries * 4 / 3 + 1) {
+    tableSize <<= 1;
+  }
+}
+
+UploadLedger::~UploadLedger() {
+  free(slots);
+}
+
+uint64_t UploadLedger::keyOf(const uint8_t* hash) {
+  uint64_t key;
+  memcpy(&key, hash, sizeof(key));
+  return key != 0 ? key : 1;
+}
+
+// Digests are uniformly random, so the low bits index the table directly
+bool UploadLedger::find(uint64_t key) const {
+  size_t mask = tableSize - 1;
+  for (size_t i = key & mask; slots[i] != 0; i = (i + 1) & mask) {
+    if (slots[i] == key) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void UploadLedger::insert(uint64_t key) {
+  size_t mask = tableSize - 1;
+  size_t i = key & mask;
+  while (slots[i] != 0) {
+    if (slots[i] == key) {
+      return;
+    }
+    i = (i + 1) & mask;
+  }
+  slots[i] = key;
+  entries++;
+}
+
+// Rebuild the table from the log, which holds at most maxEntries whole keys
+bool UploadLedger::fill() {
+  memset(slots, 0, tableBytes());
+  entries = 0;
+  
+  StorageFilePtr file = storage->open(path.c_str(), STORAGE_READ);
+  if (!file) {
+    return true;  // No log yet
+  }
+  
+  uint64_t buffer[LEDGER_READ_KEYS];
+  size_t len;
+  while ((len = file->read((uint8_t*)buffer, sizeof(buffer))) >= sizeof(uint64_t)) {
+    for (size_t i = 0; i < len / sizeof(uint64_t); i++) {
+      insert(buffer[i]);
+    }
+    if (len % sizeof(uint64_t) != 0) {
+      break;
+    }
+  }
+  file->close();
+  return true;
+}
+
+bool UploadLedger::load() {
+  if (loaded) {
+    return true;
+  }
+  
+  if (!slots) {
+    slots = allocateSlots(tableSize);
+    if (!slots) {
+      return false;
+    }
+  }
+  
+  // An append cut short by a power loss would misalign every later one,
+  // and a lowered limit leaves too many; either way the log is rewritten
+  size_t size = 0;
+  if (storage->stat(path.c_str(), &size) &&
+      (size % sizeof(uint64_t) != 0 || size / sizeof(uint64_t) > maxEntries)) {
+    compact(maxEntries);
+  }
+  
+  loaded = fill();
+  return loaded;
+}
+
+// Keep the newest keep whole keys of the log, copied a buffer at a time
+bool UploadLedger::compact(uint32_t keep) {
+  StorageFilePtr source = storage->open(path.c_str(), STORAGE_READ);
+  if (!source) {
+    return false;
+  }
+  
+  size_t total = source->size() / sizeof(uint64_t);
+  size_t skip = total > keep ? total - keep : 0;
+  size_t remaining = total - skip;
+  
+  std::string temp = path + ".tmp";
+  StorageFilePtr target = storage->open(temp.c_str(), STORAGE_WRITE);
+  if (!target || !source->seek(skip * sizeof(uint64_t))) {
+    source->close();
+    return false;
+  }
+  
+  uint64_t buffer[LEDGER_READ_KEYS];
+  bool written = true;
+  while (written && remaining > 0) {
+    size_t bytes = (remaining < LEDGER_READ_KEYS ? remaining : LEDGER_READ_KEYS) * sizeof(uint64_t);
+    written = source->read((uint8_t*)buffer, bytes) == bytes &&
+              target->write((const uint8_t*)buffer, bytes) == bytes;
+    remaining -= bytes / sizeof(uint64_t);
+  }
+  source->close();
+  target->close();
+  
+  if (!written) {
+    storage->remove(temp.c_str());
+    return false;
+  }
+  storage->remove(path.c_str());
+  return storage->rename(temp.c_str(), path.c_str());
+}
+
+bool UploadLedger::contains(const uint8_t* hash) {
+  return load() && find(keyOf(hash));
+}
+
+bool UploadLedger::add(const uint8_t* hash) {
+  if (!load()) {
+    return false;
+  }
+  
+  uint64_t key = keyOf(hash);
+  if (find(key)) {
+    return true;
+  }
+  
+  // Full: drop the older half, those captures are long gone from the card
+  if (entries >= maxEntries) {
+    if (!compact(maxEntries / 2) || !fill()) {
+      return false;
+    }
+  }
+  
+  StorageFilePtr file = storage->open(path.c_str(), STORAGE_APPEND);
+  if (!file) {
+    return false;
+  }
+  bool written = file->write((const uint8_t*)&key, sizeof(key)) == sizeof(key);
+  file->close();
+  
+  if (written) {
+    insert(key);
+  }
+  return written;
+}
+
+uint32_t UploadLedger::count() {
+  load();
+  return entries;
+}
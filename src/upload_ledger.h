@@ -0,0 +1,49 @@
+#ifndef UPLOAD_LEDGER_H
+#define UPLOAD_LEDGER_H
+
+// Content hashes of captures the server has confirmed, so a capture that was
+// sent but not deleted before a power loss isn't sent again. An append-only
+// log on storage is the record; an open-addressing hash set, loaded from the
+// log on first use, keeps lookups O(1). The set is allocated once (PSRAM on
+// the ESP32), the log is only ever streamed. Free of Arduino includes so it
+// can be built on a host machine.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include "storage_backend.h"
+
+class UploadLedger {
+public:
+  // The newest maxEntries hashes are kept; the log is halved when it fills
+  UploadLedger(StorageBackend* storage, const char* path, uint32_t maxEntries);
+  ~UploadLedger();
+  
+  // hash is a SHA-256 digest, the first 8 bytes are the key. Both are false
+  // if the table couldn't be allocated, the capture is then just sent.
+  bool contains(const uint8_t* hash);
+  bool add(const uint8_t* hash);
+  
+  uint32_t count();
+  
+  // RAM taken by the table, whatever the number of entries
+  size_t tableBytes() const { return tableSize * sizeof(uint64_t); }
+
+private:
+  static uint64_t keyOf(const uint8_t* hash);
+  bool load();
+  bool fill();
+  void insert(uint64_t key);
+  bool find(uint64_t key) const;
+  bool compact(uint32_t keep);
+  
+  StorageBackend* storage;
+  std::string path;
+  uint32_t maxEntries;
+  uint64_t* slots;   // 0 marks an empty slot
+  size_t tableSize;
+  uint32_t entries;
+  bool loaded;
+};
+
+#endif // UPLOAD_LEDGER_H
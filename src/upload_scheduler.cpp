@@ -0,0 +1,127 @@
+#include "upload_scheduler.h"
+#include <algorithm>
+
+UploadScheduler::UploadScheduler(const UploadPriorityWeights& weights, const UploadBudget& budget)
+  : weights(weights), budget(budget), queueBuilt(false), sessionFiles(0), budgetSkips(0) {
+  usage.day = -1;
+  usage.month = -1;
+  usage.dayBytes = 0;
+  usage.monthBytes = 0;
+}
+
+void UploadScheduler::setUsage(const UploadBudgetUsage& newUsage) {
+  usage = newUsage;
+}
+
+void UploadScheduler::add(const UploadCandidate& candidate) {
+  candidates.push_back(candidate);
+  queueBuilt = false;
+}
+
+// Scores are relative to the other captures waiting, so they are computed
+// once all of them are known
+void UploadScheduler::buildQueue() {
+  for (const Entry& entry : queue) {
+    candidates.push_back(entry.candidate);
+  }
+  queue.clear();
+  
+  if (candidates.empty()) {
+    queueBuilt = true;
+    return;
+  }
+  
+  uint64_t oldest = candidates[0].order;
+  uint64_t newest = candidates[0].order;
+  size_t largest = 1;
+  for (const UploadCandidate& c : candidates) {
+    oldest = std::min(oldest, c.order);
+    newest = std::max(newest, c.order);
+    largest = std::max(largest, c.size);
+  }
+  
+  for (const UploadCandidate& c : candidates) {
+    float recency = newest > oldest ? (float)(c.order - oldest) / (float)(newest - oldest) : 1.0f;
+    float small = 1.0f - (float)c.size / (float)largest;
+    
+    Entry entry;
+    entry.candidate = c;
+    entry.score = weights.recency * recency +
+                  weights.eventEdge * (c.eventEdge ? 1.0f : 0.0f) +
+                  weights.confidence * (c.confidence / 100.0f) +
+                  weights.size * small;
+    queue.push_back(entry);
+  }
+  
+  candidates.clear();
+  std::make_heap(queue.begin(), queue.end());
+  queueBuilt = true;
+}
+
+void UploadScheduler::rollPeriods(time_t now) {
+  if (now <= 0) {
+    return;
+  }
+  
+  struct tm t;
+  gmtime_r(&now, &t);
+  int32_t day = (int32_t)(now / 86400);
+  int32_t month = (t.tm_year + 1900) * 12 + t.tm_mon;
+  
+  if (day != usage.day) {
+    usage.day = day;
+    usage.dayBytes = 0;
+  }
+  if (month != usage.month) {
+    usage.month = month;
+    usage.monthBytes = 0;
+  }
+}
+
+uint64_t UploadScheduler::remainingBytes(time_t now) {
+  rollPeriods(now);
+  
+  uint64_t remaining = UINT64_MAX;
+  if (budget.dailyBytes > 0) {
+    remaining = budget.dailyBytes > usage.dayBytes ? budget.dailyBytes - usage.dayBytes : 0;
+  }
+  if (budget.monthlyBytes > 0) {
+    uint64_t month = budget.monthlyBytes > usage.monthBytes ? budget.monthlyBytes - usage.monthBytes : 0;
+    remaining = std::min(remaining, month);
+  }
+  return remaining;
+}
+
+bool UploadScheduler::next(UploadCandidate& candidate, time_t now) {
+  if (budget.maxFilesPerSession > 0 && sessionFiles >= budget.maxFilesPerSession) {
+    return false;
+  }
+  
+  if (!queueBuilt) {
+    buildQueue();
+  }
+  
+  uint64_t remaining = remainingBytes(now);
+  
+  // Captures that don't fit wait for the next period, a smaller one may still go
+  while (!queue.empty()) {
+    std::pop_heap(queue.begin(), queue.end());
+    Entry entry = queue.back();
+    queue.pop_back();
+    
+    if (entry.candidate.size <= remaining) {
+      candidate = entry.candidate;
+      sessionFiles++;
+      return true;
+    }
+    budgetSkips++;
+  }
+  
+  return false;
+}
+
+void UploadScheduler::recordSent(uint64_t bytes, time_t now) {
+  rollPeriods(now);
+  usage.dayBytes += bytes;
+  usage.monthBytes += bytes;
+}
@@ -0,0 +1,90 @@
+#ifndef UPLOAD_SCHEDULER_H
+#define UPLOAD_SCHEDULER_H
+
+// Chooses which captures to upload next and keeps uploads inside the data
+// plan. This header must stay free of Arduino includes so the scheduler can
+// be exercised on a host machine.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+// A capture waiting to be uploaded
+struct UploadCandidate {
+  std::string path;
+  size_t size;
+  uint64_t order;        // Capture order, higher is newer
+  bool eventEdge;        // First or last frame of an activity event
+  uint8_t confidence;    // Detection confidence 0-100, 0 if unknown
+};
+
+// How much each input counts towards a capture's priority
+struct UploadPriorityWeights {
+  float recency;
+  float eventEdge;
+  float confidence;
+  float size;            // Favours small files
+};
+
+// Data plan limits, 0 means unlimited
+struct UploadBudget {
+  uint64_t dailyBytes;
+  uint64_t monthlyBytes;
+  uint32_t maxFilesPerSession;
+};
+
+// Bytes used in the current day and month, persisted between sessions
+struct UploadBudgetUsage {
+  int32_t day;           // Days since the epoch, -1 before the first upload
+  int32_t month;         // Months since year 0 (year * 12 + month)
+  uint64_t dayBytes;
+  uint64_t monthBytes;
+};
+
+class UploadScheduler {
+public:
+  UploadScheduler(const UploadPriorityWeights& weights, const UploadBudget& budget);
+  
+  // Budget usage from the last session
+  void setUsage(const UploadBudgetUsage& usage);
+  const UploadBudgetUsage& getUsage() const { return usage; }
+  
+  void add(const UploadCandidate& candidate);
+  size_t pending() const { return queue.size() + candidates.size(); }
+  
+  // Highest priority capture that fits the remaining budget. now is the wall
+  // clock (0 if unknown, then the budget periods don't roll over).
+  bool next(UploadCandidate& candidate, time_t now);
+  
+  // Count bytes sent (payload plus protocol overhead)
+  void recordSent(uint64_t bytes, time_t now);
+  
+  // Bytes left today and this month, whichever is smaller
+  uint64_t remainingBytes(time_t now);
+  
+  uint32_t sentThisSession() const { return sessionFiles; }
+  uint32_t skippedForBudget() const { return budgetSkips; }
+
+private:
+  struct Entry {
+    float score;
+    UploadCandidate candidate;
+    bool operator<(const Entry& other) const { return score < other.score; }
+  };
+  
+  void rollPeriods(time_t now);
+  void buildQueue();
+  
+  UploadPriorityWeights weights;
+  UploadBudget budget;
+  UploadBudgetUsage usage;
+  std::vector<UploadCandidate> candidates;
+  std::vector<Entry> queue;   // Max-heap on score
+  bool queueBuilt;
+  uint32_t sessionFiles;
+  uint32_t budgetSkips;
+};
+
+#endif // UPLOAD_SCHEDULER_H
@@ -0,0 +1,62 @@
+#ifndef UPLOAD_SOURCE_H
+#define UPLOAD_SOURCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "storage_backend.h"
+
+// Seekable byte source for uploads, so a transfer can resume at an offset
+class UploadSource {
+public:
+  virtual ~UploadSource() {}
+  virtual size_t size() = 0;
+  virtual bool seek(size_t offset) = 0;
+  virtual size_t read(uint8_t* buffer, size_t len) = 0;
+};
+
+// A file on a storage backend
+class FileUploadSource : public UploadSource {
+public:
+  explicit FileUploadSource(StorageFile* file) : file(file) {}
+  
+  size_t size() override { return file->size(); }
+  bool seek(size_t offset) override { return file->seek(offset); }
+  size_t read(uint8_t* buffer, size_t len) override { return file->read(buffer, len); }
+
+private:
+  StorageFile* file;
+};
+
+// A capture held in memory (PSRAM spool, camera frame buffer)
+class BufferUploadSource : public UploadSource {
+public:
+  BufferUploadSource(const uint8_t* data, size_t len) : data(data), len(len), offset(0) {}
+  
+  size_t size() override { return len; }
+  
+  bool seek(size_t newOffset) override {
+    if (newOffset > len) {
+      return false;
+    }
+    offset = newOffset;
+    return true;
+  }
+  
+  size_t read(uint8_t* buffer, size_t maxLen) override {
+    size_t n = len - offset;
+    if (n > maxLen) {
+      n = maxLen;
+    }
+    memcpy(buffer, data + offset, n);
+    offset += n;
+    return n;
+  }
+
+private:
+  const uint8_t* data;
+  size_t len;
+  size_t offset;
+};
+
+#endif // UPLOAD_SOURCE_H
@@ -0,0 +1,156 @@
+#include "upload_task.h"
+#include "uploader.h"
+#include "config.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+TaskHandle_t uploadTaskHandle = NULL;
+volatile bool uploadPauseRequested = false;
+volatile bool batchRequested = false;
+volatile UploadTaskState uploadTaskState = UPLOAD_TASK_IDLE;
+volatile bool uploadTaskBusy = false;  // Awake and possibly holding files open
+
+// Event alert handed over by the main loop, owned by the task until sent
+camera_fb_t* volatile alertFrame = NULL;
+volatile bool alertInProgress = false;
+char alertFilename[64];
+unsigned long alertTriggerMs = 0;
+unsigned long alertQueuedMs = 0;
+
+// Capture asked for in full, waiting for the task
+volatile bool captureRequested = false;
+char requestedCapture[64];
+
+// Upload the alert frame from PSRAM and log where the time went
+static void sendAlertFrame() {
+  alertInProgress = true;
+  unsigned long startMs = millis();
+  bool sent = uploadAlertFrame(alertFilename, alertFrame->buf, alertFrame->len);
+  unsigned long doneMs = millis();
+  alertInProgress = false;
+  
+  returnPhotoBuffer(alertFrame);
+  alertFrame = NULL;
+  
+  Serial.printf("Alert %s %s: trigger to capture %lu ms, to upload start %lu ms, to remote %lu ms\n",
+                alertFilename, sent ? "sent" : "failed", alertQueuedMs - alertTriggerMs,
+                startMs - alertTriggerMs, doneMs - alertTriggerMs);
+}
+
+static void uploadTask(void* param) {
+  while (true) {
+    // Sleep until there is something to send
+    uploadTaskBusy = false;
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    uploadTaskBusy = true;
+    
+    // An event alert goes first, even while the queue is paused
+    if (alertFrame) {
+      sendAlertFrame();
+    }
+    
+    if (captureRequested) {
+      bool sent = uploadCapture(requestedCapture);
+      Serial.printf("Requested capture %s %s\n", requestedCapture, sent ? "sent" : "failed");
+      captureRequested = false;
+    }
+    
+    if (!batchRequested) {
+      continue;
+    }
+    batchRequested = false;
+    if (uploadPauseRequested) {
+      uploadTaskState = UPLOAD_TASK_PAUSED;
+      continue;
+    }
+    
+    uploadTaskState = UPLOAD_TASK_RUNNING;
+    bool success = uploadPendingCaptures();
+    
+    if (uploadPauseRequested) {
+      uploadTaskState = UPLOAD_TASK_PAUSED;
+    } else {
+      uploadTaskState = success ? UPLOAD_TASK_DONE : UPLOAD_TASK_FAILED;
+    }
+  }
+}
+
+bool startUploadTask() {
+  if (uploadTaskHandle) {
+    return true;
+  }
+  
+  // Core 0, away from loop() on core 1
+  BaseType_t result = xTaskCreatePinnedToCore(uploadTask, "upload", UPLOAD_TASK_STACK_SIZE, NULL,
+                                              UPLOAD_TASK_PRIORITY, &uploadTaskHandle, 0);
+  if (result != pdPASS) {
+    Serial.println("Failed to start upload task");
+    uploadTaskHandle = NULL;
+    return false;
+  }
+  
+  return true;
+}
+
+void requestUpload() {
+  uploadPauseRequested = false;
+  
+  // Without the task, upload in the caller as before
+  if (!uploadTaskHandle) {
+    uploadTaskState = uploadPendingCaptures() ? UPLOAD_TASK_DONE : UPLOAD_TASK_FAILED;
+    return;
+  }
+  
+  if (uploadTaskState != UPLOAD_TASK_RUNNING) {
+    // Marked running here so the caller doesn't request the same batch twice
+    uploadTaskState = UPLOAD_TASK_RUNNING;
+    batchRequested = true;
+    xTaskNotifyGive(uploadTaskHandle);
+  }
+}
+
+void pauseUpload() {
+  uploadPauseRequested = true;
+}
+
+bool isUploadPauseRequested() {
+  return uploadPauseRequested && !alertInProgress;
+}
+
+UploadTaskState getUploadTaskState() {
+  return uploadTaskState;
+}
+
+bool isUploadTaskBusy() {
+  return uploadTaskBusy || uploadTaskState == UPLOAD_TASK_RUNNING;
+}
+
+void acknowledgeUploadResult() {
+  if (uploadTaskState == UPLOAD_TASK_DONE || uploadTaskState == UPLOAD_TASK_FAILED) {
+    uploadTaskState = UPLOAD_TASK_IDLE;
+  }
+}
+
+bool queueAlertFrame(camera_fb_t* fb, const char* filename, unsigned long triggerMs) {
+  if (!uploadTaskHandle || alertFrame) {
+    return false;
+  }
+  
+  strlcpy(alertFilename, filename, sizeof(alertFilename));
+  alertTriggerMs = triggerMs;
+  alertQueuedMs = millis();
+  alertFrame = fb;
+  xTaskNotifyGive(uploadTaskHandle);
+  return true;
+}
+
+bool queueCaptureUpload(const char* filename) {
+  if (!uploadTaskHandle || captureRequested) {
+    return false;
+  }
+  
+  strlcpy(requestedCapture, filename, sizeof(requestedCapture));
+  captureRequested = true;
+  xTaskNotifyGive(uploadTaskHandle);
+  return true;
+}
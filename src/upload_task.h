@@ -0,0 +1,49 @@
+#ifndef UPLOAD_TASK_H
+#define UPLOAD_TASK_H
+
+#include <Arduino.h>
+#include "camera.h"
+
+// Background task that uploads pending captures while the main loop keeps
+// polling sensors, the button and the LED
+
+enum UploadTaskState {
+  UPLOAD_TASK_IDLE,     // Nothing requested
+  UPLOAD_TASK_RUNNING,  // Batch in progress
+  UPLOAD_TASK_PAUSED,   // Stopped at a chunk boundary, resumes on request
+  UPLOAD_TASK_DONE,     // Last batch sent everything
+  UPLOAD_TASK_FAILED    // Last batch left files behind
+};
+
+// Create the task (once, from setup)
+bool startUploadTask();
+
+// Start or resume draining the upload queue
+void requestUpload();
+
+// Stop at the next chunk or file boundary (new activity)
+void pauseUpload();
+
+// Checked by uploaders between chunks and files
+bool isUploadPauseRequested();
+
+UploadTaskState getUploadTaskState();
+
+// True while the task sends anything (a batch, an alert, a requested
+// capture) and may have captures, sidecars or the ledger open
+bool isUploadTaskBusy();
+
+// Clear a finished batch's result back to idle
+void acknowledgeUploadResult();
+
+// Send the first frame of an event straight from the camera buffer, ahead of
+// the queue and while capture goes on. Takes the frame buffer and returns it
+// to the camera once sent; false (caller keeps fb) if an alert is already in
+// flight or there is no task. triggerMs is millis() when the sensor fired.
+bool queueAlertFrame(camera_fb_t* fb, const char* filename, unsigned long triggerMs);
+
+// Send one stored capture in full ahead of the queue (a request for the
+// original of a preview); false if one is already waiting or there is no task
+bool queueCaptureUpload(const char* filename);
+
+#endif // UPLOAD_TASK_H
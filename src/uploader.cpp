@@ -0,0 +1,793 @@
+#include "uploader.h"
+#include "google_drive.h"
+#include "webdav_upload.h"
+#include "storage.h"
+#include "integrity.h"
+#include "capture_spool.h"
+#include "cellular.h"
+#include "modem_client.h"
+#include "upload_task.h"
+#include "upload_scheduler.h"
+#include "tar_source.h"
+#include "preview.h"
+#include "read_ahead.h"
+#include "upload_ledger.h"
+#include "backoff.h"
+#include "config.h"
+#include <Preferences.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+
+UploadBackend* uploadBackend = NULL;
+UploadLedger* uploadLedger = NULL;
+
+// Last reachability probe
+Backoff uploadBackoff("Upload target", UPLOAD_BACKOFF_BASE_MS, UPLOAD_BACKOFF_MAX_MS);
+volatile bool probeOk = false;
+unsigned long probeTime = 0;
+
+// Hints noted by the main loop, read by the upload task
+struct CaptureHint {
+  bool eventEdge;
+  uint8_t confidence;
+};
+
+std::map<String, CaptureHint> captureHints;
+SemaphoreHandle_t hintMutex = NULL;
+
+static UploadBackend* backendForId(const String& id) {
+  if (id == "webdav") {
+    return getWebDavBackend();
+  }
+  if (id == "drive") {
+    return getGoogleDriveBackend();
+  }
+  return NULL;
+}
+
+void setUploadBackend(UploadBackend* backend) {
+  if (uploadBackend && uploadBackend != backend) {
+    uploadBackend->close();
+  }
+  uploadBackend = backend;
+}
+
+UploadBackend* getUploadBackend() {
+  if (!uploadBackend) {
+    String id = "drive";
+    Preferences preferences;
+    if (preferences.begin("upload", true)) {
+      id = preferences.getString("backend", id);
+      preferences.end();
+    }
+    
+    uploadBackend = backendForId(id);
+    if (!uploadBackend) {
+      uploadBackend = getGoogleDriveBackend();
+    }
+  }
+  return uploadBackend;
+}
+
+bool selectUploadBackend(const String& id) {
+  UploadBackend* backend = backendForId(id);
+  if (!backend) {
+    Serial.printf("Unknown upload backend: %s\n", id.c_str());
+    return false;
+  }
+  
+  Preferences preferences;
+  if (!preferences.begin("upload", false)) {
+    return false;
+  }
+  preferences.putString("backend", id);
+  preferences.end();
+  
+  setUploadBackend(backend);
+  Serial.printf("Uploading to %s\n", backend->name());
+  return true;
+}
+
+bool isUploadConfigured() {
+  return getUploadBackend()->isConfigured();
+}
+
+// Backends reach their server through the HTTP(S) transports, so those are
+// registered before any of them starts, however uploads are reached
+static bool beginBackend(UploadBackend* backend) {
+  beginModemTransport();
+  return backend->begin();
+}
+
+bool initUploader() {
+  return beginBackend(getUploadBackend());
+}
+
+static void setProbeResult(bool ok) {
+  probeOk = ok;
+  probeTime = millis();
+  if (ok) {
+    uploadBackoff.success();
+  } else {
+    uploadBackoff.failure();
+  }
+}
+
+bool probeUploadTarget(bool refresh) {
+  if (!refresh && probeOk && millis() - probeTime < UPLOAD_PROBE_TTL_MS) {
+    return true;
+  }
+  
+  if (!uploadBackoff.ready()) {
+    Serial.printf("Upload probe backing off, %lu s left\n", uploadBackoff.remainingMs() / 1000);
+    return false;
+  }
+  
+  UploadBackend* backend = getUploadBackend();
+  unsigned long start = millis();
+  bool ok = beginBackend(backend) && (isCellularConnected() || connectCellular()) && backend->probe();
+  setProbeResult(ok);
+  
+  Serial.printf("Upload probe (%s): %s in %lu ms\n", backend->name(), ok ? "reachable" : "unreachable",
+                millis() - start);
+  return ok;
+}
+
+void noteCaptureHint(const char* filename, bool eventEdge, uint8_t confidence) {
+  if (!hintMutex) {
+    hintMutex = xSemaphoreCreateMutex();
+  }
+  
+  xSemaphoreTake(hintMutex, portMAX_DELAY);
+  auto it = captureHints.find(filename);
+  if (it != captureHints.end()) {
+    it->second.eventEdge = it->second.eventEdge || eventEdge;
+    it->second.confidence = max(it->second.confidence, confidence);
+  } else if (captureHints.size() < MAX_CAPTURE_HINTS) {
+    CaptureHint hint = { eventEdge, confidence };
+    captureHints[filename] = hint;
+  }
+  xSemaphoreGive(hintMutex);
+}
+
+static void applyCaptureHint(const char* path, UploadCandidate& candidate) {
+  if (!hintMutex) {
+    return;
+  }
+  
+  xSemaphoreTake(hintMutex, portMAX_DELAY);
+  auto it = captureHints.find(path);
+  if (it != captureHints.end()) {
+    candidate.eventEdge = it->second.eventEdge;
+    candidate.confidence = it->second.confidence;
+  }
+  xSemaphoreGive(hintMutex);
+}
+
+// Deferred captures keep their hints, uploaded ones drop them
+static void forgetCaptureHint(const String& path) {
+  if (!hintMutex) {
+    return;
+  }
+  
+  xSemaphoreTake(hintMutex, portMAX_DELAY);
+  captureHints.erase(path);
+  xSemaphoreGive(hintMutex);
+}
+
+// Data used so far this day and month, kept in NVS across sessions and reboots
+static UploadBudgetUsage loadBudgetUsage() {
+  UploadBudgetUsage usage = { -1, -1, 0, 0 };
+  Preferences preferences;
+  if (preferences.begin("upload", true)) {
+    usage.day = preferences.getInt("bud_day", -1);
+    usage.month = preferences.getInt("bud_month", -1);
+    usage.dayBytes = preferences.getULong64("bud_day_b", 0);
+    usage.monthBytes = preferences.getULong64("bud_month_b", 0);
+    preferences.end();
+  }
+  return usage;
+}
+
+static void saveBudgetUsage(const UploadBudgetUsage& usage) {
+  Preferences preferences;
+  if (preferences.begin("upload", false)) {
+    preferences.putInt("bud_day", usage.day);
+    preferences.putInt("bud_month", usage.month);
+    preferences.putULong64("bud_day_b", usage.dayBytes);
+    preferences.putULong64("bud_month_b", usage.monthBytes);
+    preferences.end();
+  }
+}
+
+// Name on the server, the path without its leading slash; with
+// UPLOAD_FOLDER_PER_DAY it goes in a folder for the capture's day
+// ("20261018/capture_...jpg"), captures from before a time sync don't
+static String remoteName(const String& filename) {
+  String name = filename.startsWith("/") ? filename.substring(1) : filename;
+  if (!UPLOAD_FOLDER_PER_DAY) {
+    return name;
+  }
+  
+  time_t captured = getCaptureTime(filename.c_str());
+  if (captured == 0) {
+    return name;
+  }
+  
+  struct tm timeinfo;
+  char day[16];
+  localtime_r(&captured, &timeinfo);
+  strftime(day, sizeof(day), "%Y%m%d", &timeinfo);
+  return String(day) + "/" + name;
+}
+
+static UploadLedger* getUploadLedger() {
+  if (!uploadLedger) {
+    uploadLedger = new UploadLedger(getStorageBackend(), UPLOAD_LEDGER_FILE, UPLOAD_LEDGER_MAX_ENTRIES);
+  }
+  return uploadLedger;
+}
+
+// A capture whose content the server already confirmed, e.g. sent just
+// before a power loss kept it from being deleted. Captures without a digest
+// sidecar can't be told apart and are always sent.
+static bool isAlreadyUploaded(UploadBackend* backend, const String& filename) {
+  CaptureDigest digest;
+  if (!readDigestSidecar(getStorageBackend(), filename.c_str(), digest)) {
+    return false;
+  }
+  
+  if (getUploadLedger()->contains(digest.hash)) {
+    return true;
+  }
+  
+  // Costs a request per capture, so only when asked for
+  if (UPLOAD_DEDUP_REMOTE && backend->hasRemoteCopy(remoteName(filename), digest.hash, digest.size)) {
+    getUploadLedger()->add(digest.hash);
+    return true;
+  }
+  return false;
+}
+
+// Remember a confirmed upload before its file is deleted
+static void recordUploaded(const String& filename) {
+  CaptureDigest digest;
+  if (readDigestSidecar(getStorageBackend(), filename.c_str(), digest)) {
+    getUploadLedger()->add(digest.hash);
+  }
+}
+
+// Per-file upload without the init and cellular checks, done once per batch
+static bool sendCapture(UploadBackend* backend, const String& filename, size_t* sentBytes) {
+  StorageBackend* storage = getStorageBackend();
+  StorageFilePtr file = storage->open(filename.c_str(), STORAGE_READ);
+  if (!file) {
+    Serial.printf("Failed to open file: %s\n", filename.c_str());
+    return false;
+  }
+  
+  size_t fileSize = file->size();
+  if (fileSize == 0) {
+    Serial.println("File is empty");
+    file->close();
+    return false;
+  }
+  
+  // Storage is read ahead into PSRAM while the modem sends, when there is PSRAM
+  FileUploadSource fileSource(file.get());
+  ReadAheadUploadSource readAhead(fileSource);
+  UploadSource& source = readAhead.begin() ? (UploadSource&)readAhead : (UploadSource&)fileSource;
+  
+  // The file goes out in one hold of the modem, SMS waits for it
+  bool result;
+  {
+    ModemLock lock;
+    result = lock.isLocked() && backend->upload(remoteName(filename), source, filename.c_str());
+  }
+  readAhead.end();
+  file->close();
+  
+  // The digest written at capture time, when there is one, is checked too
+  if (result && UPLOAD_VERIFY_REMOTE) {
+    CaptureDigest digest;
+    bool hasDigest = readDigestSidecar(storage, filename.c_str(), digest);
+    if (!backend->verify(remoteName(filename), fileSize, hasDigest ? digest.hash : NULL)) {
+      Serial.printf("Server copy of %s does not match\n", filename.c_str());
+      result = false;
+    }
+  }
+  
+  if (result) {
+    *sentBytes = fileSize;
+  }
+  return result;
+}
+
+// Send captures as one tar archive, named after the first of them; each
+// entry keeps its file name and capture time
+static bool sendBundle(UploadBackend* backend, const std::vector<UploadCandidate>& bundle,
+                       size_t* sentBytes) {
+  TarUploadSource tar(getStorageBackend());
+  size_t payload = 0;
+  for (const UploadCandidate& entry : bundle) {
+    String name = remoteName(entry.path.c_str());
+    if (!tar.addFile(entry.path, name.c_str(), entry.size, getCaptureTime(entry.path.c_str()))) {
+      Serial.printf("Cannot bundle %s\n", entry.path.c_str());
+      return false;
+    }
+    payload += entry.size;
+  }
+  
+  String first = remoteName(bundle.front().path.c_str());
+  String name = first.substring(0, first.lastIndexOf('.')) + "_" + String((int)bundle.size()) + ".tar";
+  Serial.printf("Uploading %d files as %s (%lu KB)\n", (int)bundle.size(), name.c_str(),
+                (unsigned long)(tar.size() / 1024));
+  
+  ReadAheadUploadSource readAhead(tar);
+  UploadSource& source = readAhead.begin() ? (UploadSource&)readAhead : (UploadSource&)tar;
+  
+  // Not resumable across reboots: the next batch may bundle different files
+  bool result;
+  {
+    ModemLock lock;
+    result = lock.isLocked() && backend->upload(name, source, NULL);
+  }
+  readAhead.end();
+  
+  if (result && UPLOAD_VERIFY_REMOTE && !backend->verify(name, tar.size())) {
+    Serial.printf("Server copy of %s does not match\n", name.c_str());
+    result = false;
+  }
+  
+  if (result) {
+    *sentBytes = payload;
+  }
+  return result;
+}
+
+// Handshakes, bytes on the wire and throughput for one batch
+static void printUploadBatchStats(UploadBackend* backend, int files, uint64_t payloadBytes,
+                                  unsigned long elapsedMs) {
+  if (files == 0) {
+    return;
+  }
+  
+  float minutes = elapsedMs / 60000.0f;
+  Serial.printf("Upload batch (%s%s): %d files, %lu KB payload in %lu s (%.1f files/min, %.1f KB/s)\n",
+                backend->name(), UPLOAD_BUNDLE_MODE ? ", bundled" : "", files,
+                (unsigned long)(payloadBytes / 1024), elapsedMs / 1000,
+                minutes > 0 ? files / minutes : 0.0f,
+                elapsedMs > 0 ? payloadBytes / 1.024f / elapsedMs : 0.0f);
+  
+  HttpConnection* http = backend->getConnection();
+  if (http) {
+    const HttpStats& stats = http->getStats();
+    Serial.printf("  %lu handshakes (%lu reconnects), %lu requests, %lu KB sent, %lu KB received\n",
+                  (unsigned long)stats.connects, (unsigned long)stats.reconnects,
+                  (unsigned long)stats.requests, (unsigned long)(stats.bytesSent / 1024),
+                  (unsigned long)(stats.bytesReceived / 1024));
+    
+    // Bytes beyond the payload are what each file costs in protocol overhead
+    uint64_t overhead = stats.bytesSent + stats.bytesReceived > payloadBytes ?
+                        stats.bytesSent + stats.bytesReceived - payloadBytes : 0;
+    Serial.printf("  Per file: %.1f requests, %lu bytes of overhead\n",
+                  (float)stats.requests / files, (unsigned long)(overhead / files));
+  }
+  printReadAheadStats();
+  
+  backend->printStats();
+}
+
+// Bytes on the wire so far, so the budget includes protocol overhead
+static uint64_t wireBytes(UploadBackend* backend) {
+  HttpConnection* http = backend->getConnection();
+  if (!http) {
+    return 0;
+  }
+  return http->getStats().bytesSent + http->getStats().bytesReceived;
+}
+
+static void chargeBudget(UploadScheduler& scheduler, UploadBackend* backend,
+                         uint64_t wireBefore, size_t payload) {
+  uint64_t used = backend->getConnection() ? wireBytes(backend) - wireBefore : payload;
+  scheduler.recordSent(used, time(NULL));
+  saveBudgetUsage(scheduler.getUsage());
+}
+
+// Previews of the waiting captures, newest first, ahead of any full
+// resolution file; decoding reads the card without holding the modem
+static bool sendPreviews(UploadBackend* backend, UploadScheduler& scheduler,
+                         std::vector<UploadCandidate>& captures, uint64_t& batchBytes) {
+  std::sort(captures.begin(), captures.end(), [](const UploadCandidate& a, const UploadCandidate& b) {
+    return a.order > b.order;
+  });
+  
+  int previews = 0;
+  bool result = true;
+  for (const UploadCandidate& capture : captures) {
+    if (isUploadPauseRequested()) {
+      result = false;
+      break;
+    }
+    
+    uint8_t* jpeg;
+    size_t len;
+    if (!makePreview(getStorageBackend(), capture.path.c_str(), &jpeg, &len)) {
+      // Without a preview the original has to go, or nothing would be sent
+      markPreviewFailed(getStorageBackend(), capture.path.c_str());
+      if (!PREVIEW_FULL_UPLOAD) {
+        scheduler.add(capture);
+      }
+      continue;
+    }
+    
+    if (len > scheduler.remainingBytes(time(NULL))) {
+      Serial.println("Data budget used up, previews wait");
+      free(jpeg);
+      result = false;
+      break;
+    }
+    
+    String name = getPreviewName(remoteName(capture.path.c_str()));
+    BufferUploadSource source(jpeg, len);
+    uint64_t wireBefore = wireBytes(backend);
+    bool sent;
+    {
+      ModemLock lock;
+      sent = lock.isLocked() && backend->upload(name, source, NULL);
+    }
+    free(jpeg);
+    chargeBudget(scheduler, backend, wireBefore, sent ? len : 0);
+    if (!sent) {
+      Serial.printf("Failed to upload preview: %s\n", name.c_str());
+      result = false;
+      break;
+    }
+    
+    markPreviewSent(getStorageBackend(), capture.path.c_str());
+    batchBytes += len;
+    previews++;
+  }
+  
+  if (previews > 0) {
+    Serial.printf("Uploaded %d previews\n", previews);
+  }
+  return result;
+}
+
+// Upload the bundle collected so far and empty it
+static bool flushBundle(UploadBackend* backend, UploadScheduler& scheduler,
+                        std::vector<UploadCandidate>& bundle, int& uploaded, uint64_t& batchBytes) {
+  if (bundle.empty()) {
+    return true;
+  }
+  
+  size_t sent = 0;
+  uint64_t wireBefore = wireBytes(backend);
+  bool ok = sendBundle(backend, bundle, &sent);
+  chargeBudget(scheduler, backend, wireBefore, sent);
+  
+  if (!ok) {
+    Serial.printf("Failed to upload bundle of %d files\n", (int)bundle.size());
+  } else {
+    Serial.printf("Successfully uploaded bundle of %d files\n", (int)bundle.size());
+    for (const UploadCandidate& entry : bundle) {
+      String filename = entry.path.c_str();
+      recordUploaded(filename);
+      deleteFile(filename);
+      forgetCaptureHint(filename);
+    }
+    batchBytes += sent;
+    uploaded += bundle.size();
+  }
+  
+  bundle.clear();
+  return ok;
+}
+
+static UploadScheduler makeScheduler() {
+  UploadPriorityWeights weights = { UPLOAD_WEIGHT_RECENCY, UPLOAD_WEIGHT_EVENT_EDGE,
+                                    UPLOAD_WEIGHT_CONFIDENCE, UPLOAD_WEIGHT_SIZE };
+  UploadBudget budget = { UPLOAD_DAILY_BUDGET_BYTES, UPLOAD_MONTHLY_BUDGET_BYTES, MAX_FILES_PER_SESSION };
+  UploadScheduler scheduler(weights, budget);
+  scheduler.setUsage(loadBudgetUsage());
+  return scheduler;
+}
+
+bool uploadPendingCaptures() {
+  // A batch that can't start means the target is down, probes back off
+  UploadBackend* backend = getUploadBackend();
+  if (!beginBackend(backend)) {
+    Serial.printf("%s not initialized\n", backend->name());
+    setProbeResult(false);
+    return false;
+  }
+  
+  if (!isCellularConnected() && !connectCellular()) {
+    Serial.println("Failed to connect cellular for upload");
+    setProbeResult(false);
+    return false;
+  }
+  
+  UploadScheduler scheduler = makeScheduler();
+  
+  // One kept-alive connection serves the whole batch
+  HttpConnection* http = backend->getConnection();
+  if (http) {
+    http->resetStats();
+  }
+  resetReadAheadStats();
+  unsigned long batchStart = millis();
+  uint64_t batchBytes = 0;
+  int uploaded = 0;
+  
+  // Frames spooled in PSRAM while the SD card was unavailable go first
+  String spooledName;
+  const uint8_t* spooledData;
+  size_t spooledLen;
+  while (!isUploadPauseRequested() && peekSpooledCapture(spooledName, &spooledData, &spooledLen)) {
+    if (spooledLen > scheduler.remainingBytes(time(NULL))) {
+      Serial.println("Data budget used up, spooled frames wait");
+      releaseSpooledCapture();
+      break;
+    }
+    
+    BufferUploadSource source(spooledData, spooledLen);
+    uint64_t wireBefore = wireBytes(backend);
+    bool sent;
+    {
+      ModemLock lock;
+      sent = lock.isLocked() && backend->upload(remoteName(spooledName), source, NULL);
+    }
+    chargeBudget(scheduler, backend, wireBefore, sent ? spooledLen : 0);
+    if (!sent) {
+      Serial.printf("Failed to upload spooled frame: %s\n", spooledName.c_str());
+      releaseSpooledCapture();
+      backend->close();
+      return false;
+    }
+    Serial.printf("Successfully uploaded spooled frame: %s\n", spooledName.c_str());
+    batchBytes += spooledLen;
+    uploaded++;
+    dropSpooledCapture();
+  }
+  
+  // Queue every capture on storage with its hints; captures whose preview
+  // hasn't gone out yet get one first, those without one go in full
+  std::vector<UploadCandidate> previews;
+  getStorageBackend()->list("/", [&scheduler, &previews](const char* path, size_t size) {
+    if (isCaptureFile(path)) {
+      UploadCandidate candidate;
+      candidate.path = path;
+      candidate.size = size;
+      candidate.order = getCaptureOrder(path);
+      candidate.eventEdge = false;
+      candidate.confidence = 0;
+      applyCaptureHint(path, candidate);
+      if (PREVIEW_UPLOAD && !isPreviewSent(getStorageBackend(), path)) {
+        previews.push_back(candidate);
+      }
+      if (!PREVIEW_UPLOAD || PREVIEW_FULL_UPLOAD || isPreviewFailed(getStorageBackend(), path)) {
+        scheduler.add(candidate);
+      }
+    }
+    return true;
+  });
+  
+  bool previewsSent = sendPreviews(backend, scheduler, previews, batchBytes);
+  
+  int fileCount = scheduler.pending();
+  if (fileCount == 0) {
+    Serial.println("No files to upload");
+    backend->close();
+    printPreviewStats();
+    printUploadBatchStats(backend, uploaded, batchBytes, millis() - batchStart);
+    return previewsSent;
+  }
+  
+  Serial.printf("Found %d files to upload, %lu KB of data budget left\n", fileCount,
+                (unsigned long)(min(scheduler.remainingBytes(time(NULL)), (uint64_t)UINT32_MAX) / 1024));
+  
+  // Upload in priority order until the queue, the budget or the session runs out
+  bool allSuccess = previewsSent;
+  int quarantined = 0;
+  int duplicates = 0;
+  UploadCandidate candidate;
+  int bundleDeferred = 0;
+  std::vector<UploadCandidate> bundle;
+  size_t bundleBytes = 0;
+  
+  while (scheduler.next(candidate, time(NULL))) {
+    String filename = candidate.path.c_str();
+    
+    // New activity: leave the rest for the next batch
+    if (isUploadPauseRequested()) {
+      Serial.println("Upload paused");
+      allSuccess = false;
+      break;
+    }
+    
+    // Don't pay to send a file that was truncated or corrupted on the card
+    IntegrityResult integrity = verifyCaptureFile(getStorageBackend(), filename.c_str());
+    if (integrity != INTEGRITY_OK && integrity != INTEGRITY_UNVERIFIED) {
+      Serial.printf("Skipping %s: %s\n", filename.c_str(), getIntegrityResultName(integrity));
+      if (integrity != INTEGRITY_READ_ERROR && quarantineFile(getStorageBackend(), filename.c_str())) {
+        quarantined++;
+        forgetCaptureHint(filename);
+      } else {
+        allSuccess = false;
+      }
+      continue;
+    }
+    
+    // Sent before but never deleted: drop it without paying for it again
+    if (isAlreadyUploaded(backend, filename)) {
+      Serial.printf("Already uploaded, deleting: %s\n", filename.c_str());
+      deleteFile(filename);
+      forgetCaptureHint(filename);
+      duplicates++;
+      continue;
+    }
+    
+    // Bundled captures aren't charged until the archive is sent, so the
+    // bundle as a whole must still fit the budget
+    if (UPLOAD_BUNDLE_MODE) {
+      if (!bundle.empty() && (bundle.size() >= UPLOAD_BUNDLE_MAX_FILES ||
+                              bundleBytes + candidate.size > UPLOAD_BUNDLE_MAX_BYTES ||
+                              bundleBytes + candidate.size > scheduler.remainingBytes(time(NULL)))) {
+        allSuccess = flushBundle(backend, scheduler, bundle, uploaded, batchBytes) && allSuccess;
+        bundleBytes = 0;
+      }
+      if (candidate.size > scheduler.remainingBytes(time(NULL))) {
+        bundleDeferred++;
+        continue;
+      }
+      bundle.push_back(candidate);
+      bundleBytes += candidate.size;
+      continue;
+    }
+    
+    Serial.printf("Uploading file %lu (%d waiting): %s\n", (unsigned long)scheduler.sentThisSession(),
+                  (int)scheduler.pending(), filename.c_str());
+    
+    // Sent files are deleted one by one, captures taken meanwhile stay queued
+    size_t sent = 0;
+    uint64_t wireBefore = wireBytes(backend);
+    bool ok = sendCapture(backend, filename, &sent);
+    chargeBudget(scheduler, backend, wireBefore, sent);
+    if (!ok) {
+      Serial.printf("Failed to upload file: %s\n", filename.c_str());
+      allSuccess = false;
+    } else {
+      Serial.printf("Successfully uploaded: %s\n", filename.c_str());
+      recordUploaded(filename);
+      deleteFile(filename);
+      forgetCaptureHint(filename);
+      batchBytes += sent;
+      uploaded++;
+    }
+  }
+  
+  // A pause leaves the files collected so far for the next batch
+  if (!isUploadPauseRequested()) {
+    allSuccess = flushBundle(backend, scheduler, bundle, uploaded, batchBytes) && allSuccess;
+  }
+  
+  // Files left behind by the budget or MAX_FILES_PER_SESSION go next time
+  int deferred = scheduler.pending() + scheduler.skippedForBudget() + bundleDeferred;
+  if (deferred > 0) {
+    Serial.printf("%d files deferred (session limit or data budget)\n", deferred);
+    allSuccess = false;
+  }
+  
+  // Let the modem go idle between batches
+  backend->close();
+  
+  if (duplicates > 0) {
+    Serial.printf("%d files were already on the server\n", duplicates);
+  }
+  if (quarantined > 0) {
+    Serial.printf("%d corrupt files moved to %s\n", quarantined, QUARANTINE_DIR);
+  }
+  printIntegrityStats();
+  printPreviewStats();
+  printUploadBatchStats(backend, uploaded, batchBytes, millis() - batchStart);
+  
+  return allSuccess;
+}
+
+bool uploadAlertFrame(const char* filename, const uint8_t* data, size_t len) {
+  UploadBackend* backend = getUploadBackend();
+  if (!beginBackend(backend)) {
+    return false;
+  }
+  
+  if (!isCellularConnected() && !connectCellular()) {
+    return false;
+  }
+  
+  UploadScheduler scheduler = makeScheduler();
+  if (len > scheduler.remainingBytes(time(NULL))) {
+    Serial.println("Data budget used up, alert frame waits for the batch");
+    return false;
+  }
+  
+  // The camera buffer is read in place, nothing is copied or read back
+  BufferUploadSource source(data, len);
+  uint64_t wireBefore = wireBytes(backend);
+  bool sent;
+  {
+    ModemLock lock;
+    sent = lock.isLocked() && backend->upload(remoteName(filename), source, NULL);
+  }
+  chargeBudget(scheduler, backend, wireBefore, sent ? len : 0);
+  
+  if (sent) {
+    recordUploaded(filename);
+    deleteFile(filename);
+    forgetCaptureHint(filename);
+  }
+  return sent;
+}
+
+bool uploadCapture(const String& filename) {
+  UploadBackend* backend = getUploadBackend();
+  if (!beginBackend(backend)) {
+    return false;
+  }
+  
+  if (!isCellularConnected() && !connectCellular()) {
+    return false;
+  }
+  
+  StorageBackend* storage = getStorageBackend();
+  size_t size;
+  if (!storage->stat(filename.c_str(), &size)) {
+    Serial.printf("File not found: %s\n", filename.c_str());
+    return false;
+  }
+  
+  // The same checks as in the batch: a damaged file isn't paid for, one
+  // the server already has is only deleted
+  IntegrityResult integrity = verifyCaptureFile(storage, filename.c_str());
+  if (integrity != INTEGRITY_OK && integrity != INTEGRITY_UNVERIFIED) {
+    Serial.printf("Skipping %s: %s\n", filename.c_str(), getIntegrityResultName(integrity));
+    if (integrity != INTEGRITY_READ_ERROR && quarantineFile(storage, filename.c_str())) {
+      forgetCaptureHint(filename);
+    }
+    return false;
+  }
+  
+  if (isAlreadyUploaded(backend, filename)) {
+    Serial.printf("Already uploaded, deleting: %s\n", filename.c_str());
+    deleteFile(filename);
+    forgetCaptureHint(filename);
+    return true;
+  }
+  
+  UploadScheduler scheduler = makeScheduler();
+  if (size > scheduler.remainingBytes(time(NULL))) {
+    Serial.printf("Data budget used up, %s waits for the batch\n", filename.c_str());
+    return false;
+  }
+  
+  size_t sent = 0;
+  uint64_t wireBefore = wireBytes(backend);
+  bool ok = sendCapture(backend, filename, &sent);
+  chargeBudget(scheduler, backend, wireBefore, sent);
+  backend->close();
+  
+  if (!ok) {
+    Serial.printf("Failed to upload file: %s\n", filename.c_str());
+    return false;
+  }
+  
+  Serial.printf("Successfully uploaded: %s\n", filename.c_str());
+  recordUploaded(filename);
+  deleteFile(filename);
+  forgetCaptureHint(filename);
+  return true;
+}
@@ -0,0 +1,44 @@
+#ifndef UPLOADER_H
+#define UPLOADER_H
+
+#include <Arduino.h>
+#include "upload_backend.h"
+
+// Uploads captures through the selected backend
+
+// Backend in use; chosen from the saved setting on first use (Drive by default)
+void setUploadBackend(UploadBackend* backend);
+UploadBackend* getUploadBackend();
+
+// Select a backend by id ("drive" or "webdav") and remember the choice
+bool selectUploadBackend(const String& id);
+
+// Check if the backend has its settings (no network access)
+bool isUploadConfigured();
+
+// Prepare the backend, true when it is ready to upload
+bool initUploader();
+
+// Cheap reachability check (DNS plus one small authenticated request). A
+// success is reused for UPLOAD_PROBE_TTL_MS unless refresh is set; after a
+// failure the next probe waits out a backoff instead of waking the modem.
+bool probeUploadTarget(bool refresh = false);
+
+// Scheduling hints for a capture (first or last frame of an event, how sure
+// the trigger was), kept in RAM until the capture is uploaded
+void noteCaptureHint(const char* filename, bool eventEdge, uint8_t confidence);
+
+// Upload spooled frames, then stored captures in priority order within the
+// data budget and MAX_FILES_PER_SESSION, over one connection
+bool uploadPendingCaptures();
+
+// Upload a frame held in memory ahead of the queue (event alert), then
+// delete its stored copy so the batch doesn't send it again
+bool uploadAlertFrame(const char* filename, const uint8_t* data, size_t len);
+
+// Upload a single capture from storage, e.g. the original of a preview
+// when PREVIEW_FULL_UPLOAD is off (asked for by SMS, see queueCaptureUpload()).
+// Checked, charged to the budget, recorded and deleted as in the batch.
+bool uploadCapture(const String& filename);
+
+#endif // UPLOADER_H
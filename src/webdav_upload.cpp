@@ -0,0 +1,201 @@
+#include "webdav_upload.h"
+#include "cellular.h"
+#include "config.h"
+#include <Preferences.h>
+#include <base64.h>
+
+class WebDavUploadBackend : public UploadBackend {
+public:
+  WebDavUploadBackend() : loaded(false), tls(false), port(0) {}
+  
+  const char* name() override { return "WebDAV"; }
+  
+  bool isConfigured() override {
+    load();
+    return host.length() > 0;
+  }
+  
+  bool begin() override {
+    if (!isConfigured()) {
+      return false;
+    }
+    
+    Client* client = tls ? getHttpsClient() : getHttpClient();
+    if (!client) {
+      Serial.printf("No %s transport for the WebDAV server\n", tls ? "HTTPS" : "HTTP");
+      return false;
+    }
+    
+    http.setClient(client);
+    return true;
+  }
+  
+  // DNS, then a HEAD on the folder; a folder that won't answer HEAD (405)
+  // still proves the server is there and accepted the credentials
+  bool probe() override {
+    if (!resolveHost(host)) {
+      return false;
+    }
+    
+    HttpResponse response;
+    if (!http.request("HEAD", host.c_str(), port, basePath.c_str(), authHeader, String(), response, 0)) {
+      return false;
+    }
+    
+    return (response.status >= 200 && response.status < 400) || response.status == 405;
+  }
+  
+  bool upload(const String& name, UploadSource& source, const char* localPath) override {
+    if (!ensureFolder(name)) {
+      return false;
+    }
+    
+    // A PUT is all or nothing, there is no partial state to keep
+    String target = remotePath(name);
+    String headers = authHeader + "Content-Type: " + getUploadMimeType(name) + "\r\n";
+    
+    HttpResponse response;
+    if (!http.request("PUT", host.c_str(), port, target.c_str(), headers, source, response, 256)) {
+      Serial.println("WebDAV upload interrupted");
+      return false;
+    }
+    
+    // 201 Created, or 200/204 when an earlier attempt already landed
+    if (response.status != 200 && response.status != 201 && response.status != 204) {
+      Serial.printf("WebDAV upload rejected (HTTP %d)\n", response.status);
+      return false;
+    }
+    
+    return true;
+  }
+  
+  // A HEAD has no content digest, the size is all there is to compare
+  bool verify(const String& name, size_t size, const uint8_t* sha256) override {
+    String target = remotePath(name);
+    
+    HttpResponse response;
+    if (!http.request("HEAD", host.c_str(), port, target.c_str(), authHeader, String(), response, 0)) {
+      return false;
+    }
+    
+    return response.status == 200 && response.contentLength == (long)size;
+  }
+  
+  void close() override { http.stop(); }
+  
+  HttpConnection* getConnection() override { return &http; }
+  
+  // Settings changed, read them again on next use
+  void reload() {
+    loaded = false;
+    lastFolder = "";
+  }
+
+private:
+  // Each path segment is encoded on its own, "20261018/capture.jpg" stays a path
+  String remotePath(const String& name) {
+    int slash = name.indexOf('/');
+    if (slash == -1) {
+      return basePath + urlEncode(name);
+    }
+    return basePath + urlEncode(name.substring(0, slash)) + "/" + urlEncode(name.substring(slash + 1));
+  }
+  
+  // Create the day folder of "20261018/capture.jpg" once; MKCOL answers 405
+  // when it already exists
+  bool ensureFolder(const String& name) {
+    int slash = name.indexOf('/');
+    if (slash == -1) {
+      return true;
+    }
+    
+    String folder = name.substring(0, slash);
+    if (folder == lastFolder) {
+      return true;
+    }
+    
+    String target = basePath + urlEncode(folder) + "/";
+    HttpResponse response;
+    if (!http.request("MKCOL", host.c_str(), port, target.c_str(), authHeader, String(), response, 256)) {
+      return false;
+    }
+    
+    if (response.status != 201 && response.status != 405) {
+      Serial.printf("WebDAV folder %s not created (HTTP %d)\n", folder.c_str(), response.status);
+      return false;
+    }
+    
+    lastFolder = folder;
+    return true;
+  }
+  
+  // Settings are read from NVS once and kept, headers are built once
+  void load() {
+    if (loaded) {
+      return;
+    }
+    loaded = true;
+    host = "";
+    authHeader = "";
+    
+    Preferences preferences;
+    if (!preferences.begin("upload", true)) {
+      return;
+    }
+    String url = preferences.getString("url", "");
+    String user = preferences.getString("user", "");
+    String password = preferences.getString("password", "");
+    preferences.end();
+    
+    if (url.length() == 0 || !splitUrl(url, host, basePath, port)) {
+      host = "";
+      return;
+    }
+    
+    tls = url.startsWith("https");
+    if (!basePath.endsWith("/")) {
+      basePath += "/";
+    }
+    
+    if (user.length() > 0) {
+      authHeader = "Authorization: Basic " + base64::encode(user + ":" + password) + "\r\n";
+    }
+  }
+  
+  bool loaded;
+  bool tls;
+  String host;
+  String basePath;
+  uint16_t port;
+  String authHeader;
+  String lastFolder;  // Day folder known to exist
+  HttpConnection http;
+};
+
+WebDavUploadBackend webDavBackend;
+
+bool saveWebDavSettings(const String& url, const String& user, const String& password) {
+  String host, path;
+  uint16_t port;
+  if (!splitUrl(url, host, path, port)) {
+    Serial.println("Invalid WebDAV URL");
+    return false;
+  }
+  
+  Preferences preferences;
+  if (!preferences.begin("upload", false)) {
+    return false;
+  }
+  preferences.putString("url", url);
+  preferences.putString("user", user);
+  preferences.putString("password", password);
+  preferences.end();
+  
+  webDavBackend.reload();
+  Serial.println("WebDAV settings saved successfully");
+  return true;
+}
+
+UploadBackend* getWebDavBackend() {
+  return &webDavBackend;
+}
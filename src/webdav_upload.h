@@ -0,0 +1,15 @@
+#ifndef WEBDAV_UPLOAD_H
+#define WEBDAV_UPLOAD_H
+
+#include <Arduino.h>
+#include "upload_backend.h"
+
+// Plain HTTP PUT / WebDAV server (e.g. nginx dav, Apache mod_dav, Nextcloud)
+
+// Save the collection URL ("https://host/photos/") and optional Basic auth
+bool saveWebDavSettings(const String& url, const String& user, const String& password);
+
+// The WebDAV server as an upload backend
+UploadBackend* getWebDavBackend();
+
+#endif // WEBDAV_UPLOAD_H
@@ -0,0 +1,91 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+// Host stand-in for the parts of the Arduino core the firmware modules in
+// the native build use: String, Serial, IPAddress and a clock that runs on
+// the test clock (delay() lets simulated time pass instead of waiting)
+
+#include <ctype.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+
+using std::max;
+using std::min;
+
+class String : public std::string {
+public:
+  String() {}
+  String(const char* text) : std::string(text ? text : "") {}
+  String(const std::string& text) : std::string(text) {}
+  String(char c) : std::string(1, c) {}
+  String(int value) : std::string(std::to_string(value)) {}
+  String(unsigned int value) : std::string(std::to_string(value)) {}
+  String(long value) : std::string(std::to_string(value)) {}
+  String(unsigned long value) : std::string(std::to_string(value)) {}
+  
+  int indexOf(char c, unsigned int from = 0) const { return position(find(c, from)); }
+  int indexOf(const char* text, unsigned int from = 0) const { return position(find(text, from)); }
+  int lastIndexOf(char c) const { return position(rfind(c)); }
+  
+  String substring(unsigned int from) const { return from < length() ? substr(from) : std::string(); }
+  String substring(unsigned int from, unsigned int to) const {
+    return from < to && from < length() ? substr(from, to - from) : std::string();
+  }
+  
+  bool startsWith(const String& prefix) const { return compare(0, prefix.length(), prefix) == 0; }
+  bool endsWith(const String& suffix) const {
+    return length() >= suffix.length() && compare(length() - suffix.length(), suffix.length(), suffix) == 0;
+  }
+  bool equalsIgnoreCase(const String& other) const { return strcasecmp(c_str(), other.c_str()) == 0; }
+  
+  long toInt() const { return strtol(c_str(), NULL, 10); }
+  void replace(const String& from, const String& to);
+  void toLowerCase();
+  void trim();
+
+private:
+  static int position(size_t pos) { return pos == npos ? -1 : (int)pos; }
+};
+
+class IPAddress {
+public:
+  IPAddress(uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, uint8_t d = 0) : octets{a, b, c, d} {}
+  String toString() const;
+
+private:
+  uint8_t octets[4];
+};
+
+// Console output goes to stdout, unless muted (benchmarks)
+class HardwareSerial {
+public:
+  HardwareSerial() : muted(false) {}
+  
+  void print(const char* text) { if (!muted) fputs(text, stdout); }
+  void println(const char* text = "") { if (!muted) puts(text); }
+  void println(const String& text) { println(text.c_str()); }
+  int printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+  
+  void mute(bool on) { muted = on; }
+
+private:
+  bool muted;
+};
+
+extern HardwareSerial Serial;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+
+// glibc has it from 2.38
+#if !defined(__GLIBC__) || __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38)
+size_t strlcpy(char* dest, const char* src, size_t size);
+#endif
+
+#endif // ARDUINO_H
@@ -0,0 +1,40 @@
+#ifndef LITTLEFS_H
+#define LITTLEFS_H
+
+// Host stand-in for LittleFS: whole files kept in RAM
+
+#include "Arduino.h"
+
+class File {
+public:
+  File() : data(NULL), position(0) {}
+  explicit File(std::string* data) : data(data), position(0) {}
+  
+  operator bool() const { return data != NULL; }
+  size_t size() const { return data ? data->length() : 0; }
+  size_t write(const uint8_t* buf, size_t size);
+  size_t print(const char* text) { return write((const uint8_t*)text, strlen(text)); }
+  String readString();
+  void close() { data = NULL; }
+
+private:
+  std::string* data;
+  size_t position;
+};
+
+class LittleFSFS {
+public:
+  bool begin(bool formatOnFail = false) { return true; }
+  
+  // "r" fails for a missing file, "w" creates or truncates, "a" appends
+  File open(const char* path, const char* mode = "r");
+  bool exists(const char* path);
+  bool remove(const char* path);
+  
+  // Drop every file (between tests)
+  void format();
+};
+
+extern LittleFSFS LittleFS;
+
+#endif // LITTLEFS_H
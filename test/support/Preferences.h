@@ -0,0 +1,33 @@
+#ifndef PREFERENCES_H
+#define PREFERENCES_H
+
+// Host stand-in for the ESP32 NVS Preferences, strings and unsigned ints
+// only, kept in RAM for the life of the test binary
+
+#include "Arduino.h"
+
+class Preferences {
+public:
+  Preferences() : open(false), readOnly(true) {}
+  
+  // Like NVS, a namespace that was never written can't be opened read-only
+  bool begin(const char* name, bool readOnly = false);
+  void end() { open = false; }
+  
+  String getString(const char* key, const String& defaultValue = String());
+  size_t putString(const char* key, const String& value);
+  uint32_t getUInt(const char* key, uint32_t defaultValue = 0);
+  size_t putUInt(const char* key, uint32_t value);
+  bool remove(const char* key);
+  bool clear();
+
+private:
+  std::string space;
+  bool open;
+  bool readOnly;
+};
+
+// Forget every namespace (between tests)
+void resetPreferences();
+
+#endif // PREFERENCES_H
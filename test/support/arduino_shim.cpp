@@ -0,0 +1,200 @@
+#include "Arduino.h"
+#include <stdarg.h>
+#include <map>
+#include "LittleFS.h"
+#include "Preferences.h"
+#include "base64.h"
+#include "test_clock.h"
+
+HardwareSerial Serial;
+LittleFSFS LittleFS;
+
+void String::replace(const String& from, const String& to) {
+  if (from.empty()) {
+    return;
+  }
+  for (size_t pos = find(from); pos != npos; pos = find(from, pos + to.length())) {
+    std::string::replace(pos, from.length(), to);
+  }
+}
+
+void String::toLowerCase() {
+  for (size_t i = 0; i < length(); i++) {
+    (*this)[i] = tolower((unsigned char)(*this)[i]);
+  }
+}
+
+void String::trim() {
+  size_t start = find_first_not_of(" \t\r\n");
+  if (start == npos) {
+    clear();
+    return;
+  }
+  erase(find_last_not_of(" \t\r\n") + 1);
+  erase(0, start);
+}
+
+String IPAddress::toString() const {
+  char text[16];
+  snprintf(text, sizeof(text), "%u.%u.%u.%u", octets[0], octets[1], octets[2], octets[3]);
+  return text;
+}
+
+int HardwareSerial::printf(const char* format, ...) {
+  if (muted) {
+    return 0;
+  }
+  va_list args;
+  va_start(args, format);
+  int n = vprintf(format, args);
+  va_end(args);
+  return n;
+}
+
+unsigned long millis() {
+  return testMillis();
+}
+
+unsigned long micros() {
+  return testMillis() * 1000UL;
+}
+
+void delay(unsigned long ms) {
+  advanceTestMillis(ms);
+}
+
+#if !defined(__GLIBC__) || __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38)
+size_t strlcpy(char* dest, const char* src, size_t size) {
+  size_t length = strlen(src);
+  if (size > 0) {
+    size_t n = length < size - 1 ? length : size - 1;
+    memcpy(dest, src, n);
+    dest[n] = '\0';
+  }
+  return length;
+}
+#endif
+
+// Preferences: namespace -> key -> value
+static std::map<std::string, std::map<std::string, String> > preferenceStore;
+
+bool Preferences::begin(const char* name, bool openReadOnly) {
+  if (openReadOnly && preferenceStore.find(name) == preferenceStore.end()) {
+    return false;
+  }
+  space = name;
+  readOnly = openReadOnly;
+  open = true;
+  preferenceStore[space];
+  return true;
+}
+
+String Preferences::getString(const char* key, const String& defaultValue) {
+  if (!open) {
+    return defaultValue;
+  }
+  std::map<std::string, String>& values = preferenceStore[space];
+  std::map<std::string, String>::iterator it = values.find(key);
+  return it == values.end() ? defaultValue : it->second;
+}
+
+size_t Preferences::putString(const char* key, const String& value) {
+  if (!open || readOnly) {
+    return 0;
+  }
+  preferenceStore[space][key] = value;
+  return value.length();
+}
+
+uint32_t Preferences::getUInt(const char* key, uint32_t defaultValue) {
+  String value = getString(key);
+  return value.empty() ? defaultValue : (uint32_t)strtoul(value.c_str(), NULL, 10);
+}
+
+size_t Preferences::putUInt(const char* key, uint32_t value) {
+  return putString(key, String((unsigned long)value)) > 0 ? sizeof(value) : 0;
+}
+
+bool Preferences::remove(const char* key) {
+  return open && !readOnly && preferenceStore[space].erase(key) > 0;
+}
+
+bool Preferences::clear() {
+  if (!open || readOnly) {
+    return false;
+  }
+  preferenceStore[space].clear();
+  return true;
+}
+
+void resetPreferences() {
+  preferenceStore.clear();
+}
+
+String base64::encode(const uint8_t* data, size_t length) {
+  static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  String encoded;
+  for (size_t i = 0; i < length; i += 3) {
+    uint32_t block = data[i] << 16;
+    if (i + 1 < length) {
+      block |= data[i + 1] << 8;
+    }
+    if (i + 2 < length) {
+      block |= data[i + 2];
+    }
+    encoded += alphabet[(block >> 18) & 0x3F];
+    encoded += alphabet[(block >> 12) & 0x3F];
+    encoded += i + 1 < length ? alphabet[(block >> 6) & 0x3F] : '=';
+    encoded += i + 2 < length ? alphabet[block & 0x3F] : '=';
+  }
+  return encoded;
+}
+
+String base64::encode(const String& text) {
+  return encode((const uint8_t*)text.c_str(), text.length());
+}
+
+// LittleFS: path -> content
+static std::map<std::string, std::string> littleFsFiles;
+
+size_t File::write(const uint8_t* buf, size_t size) {
+  if (!data) {
+    return 0;
+  }
+  data->append((const char*)buf, size);
+  return size;
+}
+
+String File::readString() {
+  if (!data || position >= data->length()) {
+    return String();
+  }
+  String rest = data->substr(position);
+  position = data->length();
+  return rest;
+}
+
+File LittleFSFS::open(const char* path, const char* mode) {
+  if (mode[0] == 'r') {
+    std::map<std::string, std::string>::iterator it = littleFsFiles.find(path);
+    return it == littleFsFiles.end() ? File() : File(&it->second);
+  }
+  
+  std::string& content = littleFsFiles[path];
+  if (mode[0] == 'w') {
+    content.clear();
+  }
+  return File(&content);
+}
+
+bool LittleFSFS::exists(const char* path) {
+  return littleFsFiles.find(path) != littleFsFiles.end();
+}
+
+bool LittleFSFS::remove(const char* path) {
+  return littleFsFiles.erase(path) > 0;
+}
+
+void LittleFSFS::format() {
+  littleFsFiles.clear();
+}
@@ -0,0 +1,14 @@
+#ifndef BASE64_H
+#define BASE64_H
+
+// Host stand-in for the Arduino-ESP32 base64 helper
+
+#include "Arduino.h"
+
+class base64 {
+public:
+  static String encode(const uint8_t* data, size_t length);
+  static String encode(const String& text);
+};
+
+#endif // BASE64_H
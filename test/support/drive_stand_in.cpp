@@ -0,0 +1,133 @@
+#include "drive_stand_in.h"
+
+#define DRIVE_SESSION_PATH "/upload/drive/v3/files?uploadType=resumable"
+
+DriveStandIn::DriveStandIn(const char* accessToken)
+  : accessToken(accessToken), nextId(1), commitUnit(256 * 1024), commitLimit(SIZE_MAX),
+    limitedChunks(0), failStatus(0), chunkCount(0), queryCount(0) {
+}
+
+const DriveStandInSession* DriveStandIn::findByName(const std::string& name) const {
+  for (std::map<std::string, DriveStandInSession>::const_iterator it = sessions.begin();
+       it != sessions.end(); ++it) {
+    if (it->second.name == name) {
+      return &it->second;
+    }
+  }
+  return NULL;
+}
+
+DriveStandInSession* DriveStandIn::findSession(const std::string& path) {
+  size_t id = path.find("upload_id=");
+  if (id == std::string::npos) {
+    return NULL;
+  }
+  std::map<std::string, DriveStandInSession>::iterator it = sessions.find(path.substr(id + 10));
+  return it == sessions.end() ? NULL : &it->second;
+}
+
+std::string DriveStandIn::createSession(const StandInRequest& request) {
+  if (request.header("authorization") != "Bearer " + accessToken) {
+    return response(401, "Unauthorized");
+  }
+  
+  // {"name":"<name>","parents":[...]}
+  size_t nameStart = request.body.find("\"name\":\"");
+  size_t total = strtoul(request.header("x-upload-content-length").c_str(), NULL, 10);
+  if (nameStart == std::string::npos || total == 0) {
+    return response(400, "Bad Request");
+  }
+  nameStart += 8;
+  
+  DriveStandInSession session;
+  session.name = request.body.substr(nameStart, request.body.find('"', nameStart) - nameStart);
+  session.total = total;
+  session.complete = false;
+  
+  std::string id = "session" + std::to_string(nextId++);
+  sessions[id] = session;
+  return response(200, "OK", "Location: https://" DRIVE_STAND_IN_HOST DRIVE_SESSION_PATH "&upload_id=" + id + "\r\n");
+}
+
+std::string DriveStandIn::progress(const DriveStandInSession& session) {
+  if (session.complete) {
+    return response(201, "Created", "Content-Type: application/json\r\n", "{\"id\":\"file\"}");
+  }
+  if (session.data.empty()) {
+    return response(308, "Resume Incomplete");
+  }
+  return response(308, "Resume Incomplete", "Range: bytes=0-" + std::to_string(session.data.length() - 1) + "\r\n");
+}
+
+void DriveStandIn::commit(DriveStandInSession& session, size_t first, const std::string& body, size_t limit) {
+  // A resent range overlaps what is already there
+  size_t committed = session.data.length();
+  if (first > committed || first + body.length() <= committed) {
+    return;
+  }
+  size_t n = std::min(first + body.length() - committed, limit);
+  session.data.append(body, committed - first, n);
+  session.complete = session.data.length() == session.total;
+}
+
+std::string DriveStandIn::handle(const StandInRequest& request) {
+  if (request.method == "POST" && request.path == DRIVE_SESSION_PATH) {
+    return createSession(request);
+  }
+  
+  DriveStandInSession* session = findSession(request.path);
+  if (request.method != "PUT") {
+    return response(405, "Method Not Allowed");
+  }
+  
+  // An expired session is gone for queries and chunks alike
+  std::string range = request.header("content-range");
+  bool query = range.compare(0, 8, "bytes */") == 0;
+  if (query) {
+    queryCount++;
+  }
+  if (!session) {
+    return response(404, "Not Found");
+  }
+  if (query) {
+    return progress(*session);
+  }
+  
+  // bytes <first>-<last>/<total>
+  chunkCount++;
+  size_t first = strtoul(range.c_str() + 6, NULL, 10);
+  size_t last = strtoul(range.c_str() + range.find('-') + 1, NULL, 10);
+  if (range.compare(0, 6, "bytes ") != 0 || last + 1 - first != request.body.length() ||
+      last >= session->total) {
+    return response(400, "Bad Request");
+  }
+  
+  // Every chunk but the last is a whole number of 256 KB units
+  if (last + 1 < session->total && request.body.length() % (256 * 1024) != 0) {
+    return response(400, "Bad Request");
+  }
+  
+  if (failStatus) {
+    int status = failStatus;
+    failStatus = 0;
+    return response(status, "Injected");
+  }
+  
+  commit(*session, first, request.body, limitedChunks > 0 ? commitLimit : SIZE_MAX);
+  if (limitedChunks > 0) {
+    limitedChunks--;
+  }
+  return progress(*session);
+}
+
+void DriveStandIn::partialRequest(const StandInRequest& request) {
+  DriveStandInSession* session = findSession(request.path);
+  std::string range = request.header("content-range");
+  if (!session || request.method != "PUT" || range.compare(0, 6, "bytes ") != 0 || range[6] == '*') {
+    return;
+  }
+  
+  size_t first = strtoul(range.c_str() + 6, NULL, 10);
+  size_t kept = request.body.length() / commitUnit * commitUnit;
+  commit(*session, first, request.body.substr(0, kept), SIZE_MAX);
+}
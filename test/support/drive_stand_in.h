@@ -0,0 +1,70 @@
+#ifndef DRIVE_STAND_IN_H
+#define DRIVE_STAND_IN_H
+
+// The Google Drive resumable upload protocol as the server side sees it:
+// a POST creates a session and answers with its URI in Location; each PUT
+// carries "Content-Range: bytes <first>-<last>/<total>" and is answered
+// 308 with "Range: bytes=0-<committed - 1>" until the upload is complete
+// (201); "bytes */<total>" asks how much is committed. Data received before
+// a dropped connection is kept in whole commit units, like Drive's 256 KB.
+
+#include <map>
+#include <string>
+#include "http_stand_in.h"
+
+#define DRIVE_STAND_IN_HOST "www.googleapis.com"
+
+struct DriveStandInSession {
+  std::string name;        // From the metadata
+  size_t total;
+  std::string data;        // Committed bytes
+  bool complete;
+};
+
+class DriveStandIn : public HttpStandIn {
+public:
+  explicit DriveStandIn(const char* accessToken);
+  
+  // Partial data kept after a disconnect, rounded down to this (default 256 KB)
+  void setCommitUnit(size_t bytes) { commitUnit = bytes; }
+  
+  // Commit at most this much of each of the next chunks
+  void limitCommits(size_t bytes, int chunks = 1) { commitLimit = bytes; limitedChunks = chunks; }
+  
+  // Answer the next chunk with this status instead (once)
+  void failNextChunk(int status) { failStatus = status; }
+  
+  // Sessions last about a week; this one is gone now
+  void expireSessions() { sessions.clear(); }
+  
+  void setAccessToken(const char* token) { accessToken = token; }
+  
+  const DriveStandInSession* findByName(const std::string& name) const;
+  size_t sessionCount() const { return sessions.size(); }
+  uint32_t chunks() const { return chunkCount; }
+  uint32_t statusQueries() const { return queryCount; }
+
+protected:
+  std::string handle(const StandInRequest& request) override;
+  void partialRequest(const StandInRequest& request) override;
+
+private:
+  std::string createSession(const StandInRequest& request);
+  std::string progress(const DriveStandInSession& session);
+  DriveStandInSession* findSession(const std::string& path);
+  
+  // Bytes of a chunk from its Content-Range onto the committed data
+  void commit(DriveStandInSession& session, size_t first, const std::string& body, size_t limit);
+  
+  std::string accessToken;
+  std::map<std::string, DriveStandInSession> sessions;  // By upload_id
+  uint32_t nextId;
+  size_t commitUnit;
+  size_t commitLimit;
+  int limitedChunks;
+  int failStatus;
+  uint32_t chunkCount;
+  uint32_t queryCount;
+};
+
+#endif // DRIVE_STAND_IN_H
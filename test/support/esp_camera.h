@@ -0,0 +1,18 @@
+#ifndef ESP_CAMERA_H
+#define ESP_CAMERA_H
+
+// Host stand-in for the camera driver's frame buffer type, which the
+// upload headers mention
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+  uint8_t* buf;
+  size_t len;
+  size_t width;
+  size_t height;
+  int format;
+} camera_fb_t;
+
+#endif // ESP_CAMERA_H
@@ -0,0 +1,149 @@
+#include "firmware_fakes.h"
+#include "cellular.h"
+#include "config.h"
+#include "preview.h"
+#include "storage.h"
+#include "time_sync.h"
+#include "upload_task.h"
+
+static Client* tcpPeer = NULL;
+static size_t tcpPacketSize = TCP_MAX_PACKET_SIZE;
+static FakeTcpLog tcpLog;
+static bool dnsResolves = true;
+static bool uploadPaused = false;
+static bool timeSet = true;
+
+void setFakeTcpPeer(Client* peer) {
+  tcpPeer = peer;
+}
+
+void setFakeTcpPacketSize(size_t size) {
+  tcpPacketSize = size;
+}
+
+const FakeTcpLog& getFakeTcpLog() {
+  return tcpLog;
+}
+
+void setFakeDnsResult(bool resolves) {
+  dnsResolves = resolves;
+}
+
+void setFakeUploadPause(bool paused) {
+  uploadPaused = paused;
+}
+
+void setFakeTimeSet(bool set) {
+  timeSet = set;
+}
+
+void resetFirmwareFakes() {
+  setStorageBackend(NULL);
+  tcpPeer = NULL;
+  tcpPacketSize = TCP_MAX_PACKET_SIZE;
+  tcpLog = FakeTcpLog();
+  dnsResolves = true;
+  uploadPaused = false;
+  timeSet = true;
+}
+
+// upload_task.h
+
+bool isUploadPauseRequested() {
+  return uploadPaused;
+}
+
+// time_sync.h: formatting as the firmware does, whether the clock was set
+// is up to the test
+
+bool isTimeSet() {
+  return timeSet;
+}
+
+bool getTimestampString(char* buffer, size_t bufferSize) {
+  if (!timeSet) {
+    strncpy(buffer, "yyyyMMdd_HHMMSS", bufferSize);
+    return false;
+  }
+  formatTimestamp(time(NULL), buffer, bufferSize);
+  return true;
+}
+
+void formatTimestamp(time_t t, char* buffer, size_t bufferSize) {
+  struct tm timeinfo;
+  localtime_r(&t, &timeinfo);
+  strftime(buffer, bufferSize, TIME_FORMAT, &timeinfo);
+}
+
+time_t parseTimestamp(const char* text) {
+  struct tm timeinfo = {};
+  const char* end = strptime(text, TIME_FORMAT, &timeinfo);
+  if (!end || *end != '\0') {
+    return 0;
+  }
+  timeinfo.tm_isdst = -1;
+  return mktime(&timeinfo);
+}
+
+// preview.h: the marker name only, making previews needs the JPEG codec
+
+String getPreviewMarkerPath(const char* capturePath) {
+  return String(capturePath) + PREVIEW_MARKER_EXT;
+}
+
+// cellular.h: one socket, the modem lock is always free
+
+bool lockModem(unsigned long timeout) {
+  return true;
+}
+
+void unlockModem() {
+}
+
+bool resolveHost(const String& host) {
+  return dnsResolves;
+}
+
+bool connectTCP(const String& host, int port) {
+  if (!tcpPeer || !tcpPeer->connect(host.c_str(), port)) {
+    return false;
+  }
+  tcpLog.connects++;
+  return true;
+}
+
+bool disconnectTCP() {
+  if (tcpPeer) {
+    tcpPeer->stop();
+  }
+  return true;
+}
+
+bool isTCPConnected() {
+  return tcpPeer && tcpPeer->connected();
+}
+
+// Split into packets of the current size, as the firmware does
+bool writeTCPData(const uint8_t* data, size_t length) {
+  if (!isTCPConnected()) {
+    return false;
+  }
+  tcpLog.writes.push_back(length);
+  tcpLog.packets += (length + tcpPacketSize - 1) / tcpPacketSize;
+  return tcpPeer->write(data, length) == length;
+}
+
+size_t getTCPPacketSize() {
+  return tcpPacketSize;
+}
+
+bool hasTCPData() {
+  return tcpPeer && tcpPeer->available() > 0;
+}
+
+int readTCPData(uint8_t* buffer, size_t length) {
+  if (!tcpPeer || tcpPeer->available() <= 0) {
+    return 0;
+  }
+  return tcpPeer->read(buffer, length);
+}
@@ -0,0 +1,41 @@
+#ifndef FIRMWARE_FAKES_H
+#define FIRMWARE_FAKES_H
+
+// Stand-ins for the firmware functions the natively built modules call but
+// whose own modules need the ESP32: the upload task's pause flag, the clock
+// state (time_sync.h), the preview marker name, and the modem's DNS and TCP
+// socket (cellular.h), which here connect straight to a Client acting as
+// the server
+
+#include <vector>
+#include <Client.h>
+
+// What the modem's socket was given
+struct FakeTcpLog {
+  uint32_t connects;
+  std::vector<size_t> writes;  // Bytes handed to writeTCPData(), one entry per call
+  uint32_t packets;            // AT+CIPSENDs those took
+};
+
+// Server side of the modem's socket (NULL: every connect fails)
+void setFakeTcpPeer(Client* peer);
+
+// What getTCPPacketSize() reports, as the modem's AT+CIPSEND? would
+void setFakeTcpPacketSize(size_t size);
+
+const FakeTcpLog& getFakeTcpLog();
+
+// resolveHost() answer
+void setFakeDnsResult(bool resolves);
+
+// isUploadPauseRequested() answer
+void setFakeUploadPause(bool paused);
+
+// isTimeSet() answer, timestamps come from the host clock
+void setFakeTimeSet(bool set);
+
+// Everything back to its default (no peer, 1460 byte packets, DNS works,
+// no pause, time set, no storage backend)
+void resetFirmwareFakes();
+
+#endif // FIRMWARE_FAKES_H
@@ -0,0 +1,165 @@
+#include "http_stand_in.h"
+#include "test_clock.h"
+
+std::string StandInRequest::header(const char* name) const {
+  std::map<std::string, std::string>::const_iterator it = headers.find(name);
+  return it == headers.end() ? std::string() : it->second;
+}
+
+HttpStandIn::HttpStandIn()
+  : open(false), refusing(false), dropCountdown(0), roundTripMs(0), bytesPerSecond(0), linkBytes(0),
+    inBody(false), bodyRemaining(0) {
+  resetStats();
+}
+
+void HttpStandIn::setLink(uint32_t roundTrip, uint32_t rate) {
+  roundTripMs = roundTrip;
+  bytesPerSecond = rate;
+}
+
+void HttpStandIn::resetStats() {
+  memset(&stats, 0, sizeof(stats));
+}
+
+std::string HttpStandIn::response(int status, const char* reason, const std::string& headers,
+                                  const std::string& body) {
+  return "HTTP/1.1 " + std::to_string(status) + " " + reason + "\r\n" + headers +
+         "Content-Length: " + std::to_string(body.length()) + "\r\n\r\n" + body;
+}
+
+int HttpStandIn::connect(IPAddress ip, uint16_t port) {
+  return connect(ip.toString().c_str(), port);
+}
+
+int HttpStandIn::connect(const char* host, uint16_t port) {
+  disconnect();
+  if (refusing) {
+    return 0;
+  }
+  
+  // The TCP handshake is a round trip
+  advanceTestMillis(roundTripMs);
+  open = true;
+  stats.connects++;
+  return 1;
+}
+
+size_t HttpStandIn::write(uint8_t b) {
+  return write(&b, 1);
+}
+
+size_t HttpStandIn::write(const uint8_t* buf, size_t size) {
+  if (!open) {
+    return 0;
+  }
+  
+  size_t taken = 0;
+  while (taken < size && open) {
+    receive(buf[taken++]);
+    if (dropCountdown > 0 && --dropCountdown == 0) {
+      stats.drops++;
+      if (inBody) {
+        partialRequest(request);
+      }
+      disconnect();
+    }
+  }
+  
+  if (bytesPerSecond > 0) {
+    linkBytes += taken;
+    uint64_t ms = linkBytes * 1000 / bytesPerSecond;
+    advanceTestMillis(ms);
+    linkBytes -= ms * bytesPerSecond / 1000;
+  }
+  return taken;
+}
+
+void HttpStandIn::receive(uint8_t c) {
+  stats.bytesIn++;
+  if (inBody) {
+    request.body += (char)c;
+    stats.bodyBytesIn++;
+    if (--bodyRemaining > 0) {
+      return;
+    }
+  } else {
+    head += (char)c;
+    size_t end = head.find("\r\n\r\n");
+    if (end == std::string::npos) {
+      return;
+    }
+    
+    // Request line and headers
+    request = StandInRequest();
+    size_t lineEnd = head.find("\r\n");
+    size_t space = head.find(' ');
+    request.method = head.substr(0, space);
+    request.path = head.substr(space + 1, head.find(' ', space + 1) - space - 1);
+    size_t pos = lineEnd + 2;
+    while (pos < end) {
+      size_t next = head.find("\r\n", pos);
+      size_t colon = head.find(':', pos);
+      if (colon != std::string::npos && colon < next) {
+        std::string name = head.substr(pos, colon - pos);
+        for (size_t i = 0; i < name.length(); i++) {
+          name[i] = tolower((unsigned char)name[i]);
+        }
+        size_t valueStart = head.find_first_not_of(' ', colon + 1);
+        request.headers[name] = valueStart < next ? head.substr(valueStart, next - valueStart) : "";
+      }
+      pos = next + 2;
+    }
+    head.clear();
+    
+    bodyRemaining = strtoul(request.header("content-length").c_str(), NULL, 10);
+    if (bodyRemaining > 0) {
+      inBody = true;
+      return;
+    }
+  }
+  
+  inBody = false;
+  stats.requests++;
+  advanceTestMillis(roundTripMs);
+  output += handle(request);
+}
+
+void HttpStandIn::disconnect() {
+  open = false;
+  head.clear();
+  inBody = false;
+  bodyRemaining = 0;
+  output.clear();
+}
+
+int HttpStandIn::available() {
+  return output.length();
+}
+
+int HttpStandIn::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int HttpStandIn::read(uint8_t* buf, size_t size) {
+  size_t n = std::min(size, output.length());
+  if (n == 0) {
+    return -1;
+  }
+  memcpy(buf, output.data(), n);
+  output.erase(0, n);
+  stats.bytesOut += n;
+  return n;
+}
+
+int HttpStandIn::peek() {
+  return output.empty() ? -1 : (uint8_t)output[0];
+}
+
+void HttpStandIn::stop() {
+  disconnect();
+}
+
+uint8_t HttpStandIn::connected() {
+  return open || !output.empty();
+}
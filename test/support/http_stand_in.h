@@ -0,0 +1,90 @@
+#ifndef HTTP_STAND_IN_H
+#define HTTP_STAND_IN_H
+
+// An HTTP/1.1 server at the other end of a Client: requests written to it
+// are parsed and answered by handle(), the answer is read back through the
+// same Client. Every connect is a new connection. The link can drop after
+// a number of bytes, and takes time on the test clock (a round trip per
+// request, the uplink rate per byte sent).
+
+#include <map>
+#include <string>
+#include <Client.h>
+
+struct StandInRequest {
+  std::string method;
+  std::string path;
+  std::map<std::string, std::string> headers;  // Lower case names
+  std::string body;
+  
+  std::string header(const char* name) const;
+};
+
+struct StandInStats {
+  uint32_t connects;
+  uint32_t requests;
+  uint32_t drops;          // Injected disconnects
+  uint64_t bytesIn;        // Everything the client wrote, headers included
+  uint64_t bytesOut;
+  uint64_t bodyBytesIn;
+};
+
+class HttpStandIn : public Client {
+public:
+  HttpStandIn();
+  
+  // The connection closes once this many more bytes came in (0: never)
+  void dropAfter(size_t bytes) { dropCountdown = bytes; }
+  
+  // Refuse the next connects
+  void refuseConnects(bool refuse) { refusing = refuse; }
+  
+  // Round trip added to each answer; bytesPerSecond 0 for no limit
+  void setLink(uint32_t roundTripMs, uint32_t bytesPerSecond);
+  
+  const StandInStats& getStats() const { return stats; }
+  void resetStats();
+  
+  // A complete response with Content-Length and keep-alive
+  static std::string response(int status, const char* reason, const std::string& headers = "",
+                              const std::string& body = "");
+  
+  int connect(IPAddress ip, uint16_t port) override;
+  int connect(const char* host, uint16_t port) override;
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t* buf, size_t size) override;
+  int available() override;
+  int read() override;
+  int read(uint8_t* buf, size_t size) override;
+  int peek() override;
+  void flush() override {}
+  void stop() override;
+  uint8_t connected() override;
+  operator bool() override { return connected(); }
+
+protected:
+  virtual std::string handle(const StandInRequest& request) = 0;
+  
+  // The connection dropped with this much of a request in
+  virtual void partialRequest(const StandInRequest& request) {}
+
+private:
+  void receive(uint8_t c);
+  void disconnect();
+  
+  bool open;
+  bool refusing;
+  size_t dropCountdown;
+  uint32_t roundTripMs;
+  uint32_t bytesPerSecond;
+  uint64_t linkBytes;       // Sent since the last time charge, below a millisecond's worth
+  
+  std::string head;         // Request being received
+  bool inBody;
+  size_t bodyRemaining;
+  StandInRequest request;
+  std::string output;       // Answers not read yet
+  StandInStats stats;
+};
+
+#endif // HTTP_STAND_IN_H
@@ -0,0 +1,238 @@
+#include "sim_host.h"
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include "test_clock.h"
+
+static bool startsWith(const std::string& text, const char* prefix) {
+  return text.compare(0, strlen(prefix), prefix) == 0;
+}
+
+SimHost::SimHost(ModemSimulator& modem)
+  : modem(modem), quickSend(false), dataAnnounced(false), packetSize(SIM_HOST_PACKET_SIZE), unacked(0) {
+  memset(&stats, 0, sizeof(stats));
+}
+
+// Next line (or "> " prompt, as ">"), letting simulated time pass while
+// the modem has nothing to say
+bool SimHost::readLine(std::string& line, uint32_t deadline, bool promptExpected) {
+  while ((int32_t)(deadline - testMillis()) > 0) {
+    if (!modem.available()) {
+      advanceTestMillis(1);
+      continue;
+    }
+    
+    AtLineReader::Result result = reader.feed((char)modem.read(), promptExpected);
+    if (result == AtLineReader::AT_LINE_PROMPT) {
+      line = ">";
+      return true;
+    }
+    if (result == AtLineReader::AT_LINE_READY) {
+      AtSlice slice = reader.line();
+      line.assign(slice.data, slice.length);
+      
+      // The data URC can turn up in any answer, as on the device
+      if (line == "+CIPRXGET: 1") {
+        dataAnnounced = true;
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+bool SimHost::readRaw(std::string& data, size_t length, uint32_t deadline) {
+  while (length > 0 && (int32_t)(deadline - testMillis()) > 0) {
+    if (!modem.available()) {
+      advanceTestMillis(1);
+      continue;
+    }
+    data += (char)modem.read();
+    length--;
+  }
+  return length == 0;
+}
+
+bool SimHost::command(const std::string& command, const char* finalLine, uint32_t timeoutMs,
+                      const char* failLine) {
+  std::string text = command + "\r\n";
+  modem.write((const uint8_t*)text.data(), text.length());
+  stats.commands++;
+  
+  received.clear();
+  uint32_t deadline = testMillis() + timeoutMs;
+  bool prompt = strcmp(finalLine, ">") == 0;
+  std::string line;
+  while (readLine(line, deadline, prompt)) {
+    // The modem echoes commands until ATE0
+    if (line == command) {
+      continue;
+    }
+    if (startsWith(line, finalLine)) {
+      received.push_back(line);
+      return true;
+    }
+    if (line == "ERROR" || startsWith(line, "+CME ERROR") || (failLine && startsWith(line, failLine))) {
+      return false;
+    }
+    received.push_back(line);
+  }
+  return false;
+}
+
+bool SimHost::waitFor(const char* prefix, uint32_t timeoutMs) {
+  uint32_t deadline = testMillis() + timeoutMs;
+  std::string line;
+  while (readLine(line, deadline, false)) {
+    if (startsWith(line, prefix)) {
+      received.push_back(line);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool SimHost::findLine(const char* prefix, std::string& line) const {
+  for (const std::string& candidate : received) {
+    if (startsWith(candidate, prefix)) {
+      line = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool SimHost::attach() {
+  std::string line;
+  AtRegistration registration;
+  return command("AT") && command("ATE0") &&
+         command("AT+CPIN?") && findLine("+CPIN: READY", line) &&
+         command("AT+CEREG?") && findLine("+CEREG:", line) &&
+         parseRegistration(AtSlice(line.data(), line.length()), registration) &&
+         registration.isRegistered() &&
+         command("AT+SAPBR=3,1,\"APN\",\"iot\"") &&
+         command("AT+SAPBR=1,1", "OK", 85000);
+}
+
+bool SimHost::connectTcp(const char* host, int port, bool quick) {
+  command("AT+CIPSHUT", "SHUT OK");
+  command("AT+CIPMUX=0");
+  quickSend = command(quick ? "AT+CIPQSEND=1" : "AT+CIPQSEND=0") && quick;
+  command("AT+CIPRXGET=1");
+  
+  std::string start = "AT+CIPSTART=\"TCP\",\"" + std::string(host) + "\"," + std::to_string(port);
+  if (!command(start, "CONNECT OK", 20000, "CONNECT FAIL")) {
+    return false;
+  }
+  
+  packetSize = SIM_HOST_PACKET_SIZE;
+  unacked = 0;
+  dataAnnounced = false;
+  std::string line;
+  AtFields fields;
+  if (command("AT+CIPSEND?") && findLine("+CIPSEND:", line) &&
+      fields.parse(AtSlice(line.data(), line.length()), "+CIPSEND:") && fields.size() > 0) {
+    long size = fields.getInt(fields.size() - 1);
+    if (size > 0 && size < SIM_HOST_PACKET_SIZE) {
+      packetSize = size;
+    }
+  }
+  return true;
+}
+
+void SimHost::disconnectTcp() {
+  command("AT+CIPCLOSE", "CLOSE OK", 5000);
+  command("AT+CIPSHUT", "SHUT OK", 5000);
+}
+
+bool SimHost::waitWindow(uint32_t maxUnacked) {
+  while (unacked > maxUnacked) {
+    std::string line;
+    AtTcpAck ack;
+    if (!command("AT+CIPACK") || !findLine("+CIPACK:", line) ||
+        !parseTcpAck(AtSlice(line.data(), line.length()), ack)) {
+      return false;
+    }
+    stats.ackPolls++;
+    unacked = ack.sent - ack.acked;
+    if (unacked > maxUnacked) {
+      advanceTestMillis(SIM_HOST_ACK_POLL_MS);
+    }
+  }
+  return true;
+}
+
+bool SimHost::sendPacket(const uint8_t* data, size_t length) {
+  if (!command("AT+CIPSEND=" + std::to_string(length), ">", 5000)) {
+    return false;
+  }
+  
+  modem.write(data, length);
+  
+  // No command echo here, the final line is all that comes
+  uint32_t deadline = testMillis() + 20000;
+  const char* finalLine = quickSend ? "DATA ACCEPT" : "SEND OK";
+  std::string line;
+  while (readLine(line, deadline, false)) {
+    if (startsWith(line, finalLine)) {
+      unacked += length;
+      stats.packets++;
+      stats.bytesSent += length;
+      return true;
+    }
+    if (line == "SEND FAIL" || line == "ERROR") {
+      return false;
+    }
+  }
+  return false;
+}
+
+bool SimHost::sendTcp(const uint8_t* data, size_t length, bool drain) {
+  size_t sent = 0;
+  while (sent < length) {
+    size_t n = std::min(packetSize, length - sent);
+    if (quickSend && unacked + n > SIM_HOST_SEND_WINDOW && !waitWindow(SIM_HOST_SEND_WINDOW - n)) {
+      return false;
+    }
+    if (!sendPacket(data + sent, n)) {
+      return false;
+    }
+    sent += n;
+  }
+  return !drain || !quickSend || waitWindow(0);
+}
+
+bool SimHost::receiveTcp(std::string& data, size_t expected, uint32_t timeoutMs) {
+  uint32_t deadline = testMillis() + timeoutMs;
+  while (data.length() < expected) {
+    if (!dataAnnounced && !waitFor("+CIPRXGET: 1", deadline - testMillis())) {
+      return false;
+    }
+    dataAnnounced = false;
+    
+    // Fetch until the modem has nothing left
+    while (data.length() < expected) {
+      std::string request = "AT+CIPRXGET=2," + std::to_string(SIM_HOST_PACKET_SIZE);
+      modem.write((const uint8_t*)(request + "\r\n").data(), request.length() + 2);
+      stats.commands++;
+      
+      std::string line;
+      while (readLine(line, deadline, false) && !startsWith(line, "+CIPRXGET: 2,")) {
+      }
+      AtFields fields;
+      if (!fields.parse(AtSlice(line.data(), line.length()), "+CIPRXGET:") || fields.size() < 3) {
+        return false;
+      }
+      size_t n = fields.getInt(1, 0);
+      size_t before = data.length();
+      if (!readRaw(data, n, deadline) || !readLine(line, deadline, false) || line != "OK") {
+        return false;
+      }
+      stats.bytesReceived += data.length() - before;
+      if (fields.getInt(2, 0) == 0) {
+        break;
+      }
+    }
+  }
+  return true;
+}
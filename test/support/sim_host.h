@@ -0,0 +1,78 @@
+#ifndef SIM_HOST_H
+#define SIM_HOST_H
+
+// Drives a ModemSimulator on the test clock the way cellular.cpp drives the
+// SIM7000G: commands and their final lines, the "> " prompt, TCP packets
+// with quick send and the ACK window, and AT+CIPRXGET reads. The firmware's
+// own driver needs FreeRTOS, this is the same sequence without it.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "at_parser.h"
+#include "modem_simulator.h"
+
+// Matches config.h
+#define SIM_HOST_PACKET_SIZE    1460
+#define SIM_HOST_SEND_WINDOW    5840
+#define SIM_HOST_ACK_POLL_MS    50
+
+struct SimHostStats {
+  uint32_t commands;
+  uint32_t packets;
+  uint32_t ackPolls;
+  uint64_t bytesSent;
+  uint64_t bytesReceived;
+};
+
+class SimHost {
+public:
+  explicit SimHost(ModemSimulator& modem);
+  
+  // Send a command and wait for a line starting with finalLine; false on
+  // ERROR, failLine or timeout. Lines before the final one are in lines().
+  bool command(const std::string& command, const char* finalLine = "OK",
+               uint32_t timeoutMs = 10000, const char* failLine = NULL);
+  
+  // Wait for a line starting with prefix (a URC or a late answer)
+  bool waitFor(const char* prefix, uint32_t timeoutMs);
+  
+  const std::vector<std::string>& lines() const { return received; }
+  
+  // Find a line starting with prefix among lines()
+  bool findLine(const char* prefix, std::string& line) const;
+  
+  // Echo off, SIM and registration checked, bearer up
+  bool attach();
+  
+  // AT+CIPSTART with quick send on or off, packet size from AT+CIPSEND?
+  bool connectTcp(const char* host, int port, bool quickSend);
+  void disconnectTcp();
+  
+  // Packets of at most the packet size; with quick send the modem may hold
+  // SIM_HOST_SEND_WINDOW unacknowledged bytes, drain waits for all of them
+  bool sendTcp(const uint8_t* data, size_t length, bool drain);
+  
+  // Wait for the server's data and fetch until expected bytes are in
+  bool receiveTcp(std::string& data, size_t expected, uint32_t timeoutMs);
+  
+  const SimHostStats& getStats() const { return stats; }
+
+private:
+  bool readLine(std::string& line, uint32_t deadline, bool promptExpected);
+  bool readRaw(std::string& data, size_t length, uint32_t deadline);
+  bool sendPacket(const uint8_t* data, size_t length);
+  bool waitWindow(uint32_t maxUnacked);
+  
+  ModemSimulator& modem;
+  AtLineReader reader;
+  std::vector<std::string> received;
+  bool quickSend;
+  bool dataAnnounced;  // +CIPRXGET: 1 seen since the last fetch
+  size_t packetSize;
+  uint32_t unacked;
+  SimHostStats stats;
+};
+
+#endif // SIM_HOST_H
@@ -0,0 +1,40 @@
+#include "temp_dir.h"
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+std::string makeTempDir() {
+  const char* base = getenv("TMPDIR");
+  std::string pattern = std::string(base && *base ? base : "/tmp") + "/storage_XXXXXX";
+  if (!mkdtemp(&pattern[0])) {
+    return "";
+  }
+  return pattern;
+}
+
+void removeTempDir(const std::string& dir) {
+  DIR* d = opendir(dir.c_str());
+  if (!d) {
+    return;
+  }
+  
+  struct dirent* entry;
+  while ((entry = readdir(d)) != NULL) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+      continue;
+    }
+    
+    std::string path = dir + "/" + entry->d_name;
+    struct stat st;
+    if (lstat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+      removeTempDir(path);
+    } else {
+      unlink(path.c_str());
+    }
+  }
+  
+  closedir(d);
+  rmdir(dir.c_str());
+}
@@ -0,0 +1,14 @@
+#ifndef TEMP_DIR_H
+#define TEMP_DIR_H
+
+// Scratch directories on the host filesystem for the POSIX storage backend
+
+#include <string>
+
+// A new empty directory under $TMPDIR (or /tmp), "" on failure
+std::string makeTempDir();
+
+// Remove a directory and everything below it
+void removeTempDir(const std::string& dir);
+
+#endif // TEMP_DIR_H
@@ -0,0 +1,15 @@
+#include "test_clock.h"
+
+static uint32_t now = 0;
+
+uint32_t testMillis() {
+  return now;
+}
+
+void advanceTestMillis(uint32_t ms) {
+  now += ms;
+}
+
+void resetTestMillis() {
+  now = 0;
+}
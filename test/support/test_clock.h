@@ -0,0 +1,13 @@
+#ifndef TEST_CLOCK_H
+#define TEST_CLOCK_H
+
+// Simulated milliseconds shared by the host fakes and the modem simulator,
+// so timeouts, latency and transfer times pass without waiting
+
+#include <stdint.h>
+
+uint32_t testMillis();
+void advanceTestMillis(uint32_t ms);
+void resetTestMillis();
+
+#endif // TEST_CLOCK_H
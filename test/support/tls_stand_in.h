@@ -0,0 +1,85 @@
+#ifndef TLS_STAND_IN_H
+#define TLS_STAND_IN_H
+
+// A TLS 1.2 server (mbedTLS) at the other end of the modem's socket, for
+// TLS_STAND_IN_HOST with a self-signed certificate. Sessions are kept in a
+// cache, so a client can resume. Whatever comes in after the handshake is
+// sent back. Each flight the server answers takes a round trip on the test
+// clock.
+
+#include <string>
+#include <Client.h>
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/pk.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/ssl_cache.h"
+#include "mbedtls/x509_crt.h"
+
+#define TLS_STAND_IN_HOST "tls.example.net"
+
+// The server's certificate, which is also the root to trust
+extern const char TLS_STAND_IN_CERT[];
+
+// A root that didn't sign it
+extern const char TLS_STAND_IN_OTHER_ROOT[];
+
+struct TlsStandInStats {
+  uint32_t connects;
+  uint32_t handshakes;
+  uint32_t failedHandshakes;
+  uint32_t flights;         // Answers, a round trip each
+  uint64_t bytesIn;
+  uint64_t bytesOut;
+};
+
+class TlsStandIn : public Client {
+public:
+  TlsStandIn();
+  ~TlsStandIn();
+  
+  void setRoundTrip(uint32_t ms) { roundTripMs = ms; }
+  
+  // A server restart: no session can be resumed
+  void forgetSessions();
+  
+  const TlsStandInStats& getStats() const { return stats; }
+  void resetStats();
+  
+  int connect(IPAddress ip, uint16_t port) override;
+  int connect(const char* host, uint16_t port) override;
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t* buf, size_t size) override;
+  int available() override;
+  int read() override;
+  int read(uint8_t* buf, size_t size) override;
+  int peek() override;
+  void flush() override {}
+  void stop() override;
+  uint8_t connected() override;
+  operator bool() override { return connected(); }
+
+private:
+  static int sendCallback(void* context, const unsigned char* buf, size_t len);
+  static int receiveCallback(void* context, unsigned char* buf, size_t len);
+  
+  // Run the server on what came in: the handshake, then the echo
+  void serve();
+  
+  bool open;
+  bool established;
+  uint32_t roundTripMs;
+  std::string input;        // Received, not consumed by mbedTLS yet
+  std::string output;       // Sent, not read by the client yet
+  TlsStandInStats stats;
+  
+  mbedtls_entropy_context entropy;
+  mbedtls_ctr_drbg_context drbg;
+  mbedtls_x509_crt certificate;
+  mbedtls_pk_context key;
+  mbedtls_ssl_cache_context cache;
+  mbedtls_ssl_config config;
+  mbedtls_ssl_context ssl;
+};
+
+#endif // TLS_STAND_IN_H
@@ -0,0 +1,82 @@
+#include "webdav_stand_in.h"
+#include <base64.h>
+
+static int hexValue(char c) {
+  return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+}
+
+static std::string urlDecode(const std::string& path) {
+  std::string decoded;
+  for (size_t i = 0; i < path.length(); i++) {
+    if (path[i] == '%' && i + 2 < path.length()) {
+      decoded += (char)(hexValue(path[i + 1]) * 16 + hexValue(path[i + 2]));
+      i += 2;
+    } else {
+      decoded += path[i];
+    }
+  }
+  return decoded;
+}
+
+WebDavStandIn::WebDavStandIn(const char* collection, const char* user, const char* password)
+  : headOnCollections(true), mkcolCount(0), putCount(0), unauthorizedCount(0) {
+  if (user[0]) {
+    expectedAuth = "Basic " + base64::encode(String(user) + ":" + password);
+  }
+  collections.insert(collection);
+}
+
+const std::string* WebDavStandIn::file(const std::string& path) const {
+  std::map<std::string, std::string>::const_iterator it = files.find(path);
+  return it == files.end() ? NULL : &it->second;
+}
+
+std::string WebDavStandIn::parent(const std::string& path) {
+  size_t end = path.length() > 1 && path[path.length() - 1] == '/' ? path.length() - 2 : path.length() - 1;
+  return path.substr(0, path.rfind('/', end) + 1);
+}
+
+std::string WebDavStandIn::handle(const StandInRequest& request) {
+  if (!expectedAuth.empty() && request.header("authorization") != expectedAuth) {
+    unauthorizedCount++;
+    return response(401, "Unauthorized", "WWW-Authenticate: Basic realm=\"dav\"\r\n");
+  }
+  
+  std::string path = urlDecode(request.path);
+  if (request.method == "HEAD") {
+    if (collections.count(path)) {
+      return headOnCollections ? response(200, "OK") : response(405, "Method Not Allowed");
+    }
+    
+    // The size of the file, without the file
+    const std::string* content = file(path);
+    if (!content) {
+      return response(404, "Not Found");
+    }
+    return "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(content->length()) + "\r\n\r\n";
+  }
+  
+  if (request.method == "MKCOL") {
+    mkcolCount++;
+    if (collections.count(path) || files.count(path.substr(0, path.length() - 1))) {
+      return response(405, "Method Not Allowed");
+    }
+    if (!collections.count(parent(path))) {
+      return response(409, "Conflict");
+    }
+    collections.insert(path);
+    return response(201, "Created");
+  }
+  
+  if (request.method == "PUT") {
+    putCount++;
+    if (!collections.count(parent(path))) {
+      return response(409, "Conflict");
+    }
+    bool existed = files.count(path) > 0;
+    files[path] = request.body;
+    return existed ? response(204, "No Content") : response(201, "Created");
+  }
+  
+  return response(405, "Method Not Allowed");
+}
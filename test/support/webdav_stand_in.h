@@ -0,0 +1,46 @@
+#ifndef WEBDAV_STAND_IN_H
+#define WEBDAV_STAND_IN_H
+
+// A WebDAV server (nginx dav or Apache mod_dav) as far as the upload
+// backend uses it: HEAD, MKCOL and PUT under one collection, with Basic
+// auth when a user is set
+
+#include <map>
+#include <set>
+#include <string>
+#include "http_stand_in.h"
+
+class WebDavStandIn : public HttpStandIn {
+public:
+  // The collection uploads go under ("/photos/"), which exists
+  WebDavStandIn(const char* collection, const char* user, const char* password);
+  
+  // Servers that only allow HEAD on files answer 405 on collections
+  void refuseHeadOnCollections(bool refuse) { headOnCollections = !refuse; }
+  
+  void addCollection(const std::string& path) { collections.insert(path); }
+  
+  // Stored content, NULL when there is no such file
+  const std::string* file(const std::string& path) const;
+  
+  uint32_t mkcols() const { return mkcolCount; }
+  uint32_t puts() const { return putCount; }
+  uint32_t unauthorized() const { return unauthorizedCount; }
+
+protected:
+  std::string handle(const StandInRequest& request) override;
+
+private:
+  // Collection a path is in, "/photos/20260418/a.jpg" -> "/photos/20260418/"
+  static std::string parent(const std::string& path);
+  
+  std::string expectedAuth;
+  bool headOnCollections;
+  std::set<std::string> collections;         // With a trailing slash
+  std::map<std::string, std::string> files;  // Decoded paths
+  uint32_t mkcolCount;
+  uint32_t putCount;
+  uint32_t unauthorizedCount;
+};
+
+#endif // WEBDAV_STAND_IN_H
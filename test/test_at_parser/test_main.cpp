@@ -0,0 +1,348 @@
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <new>
+#include <string>
+#include "at_parser.h"
+
+// Heap allocations so far, the host's allocator is too fast for the time
+// alone to show what the per-line copies cost on the ESP32
+static uint32_t allocations = 0;
+
+void* operator new(size_t size) {
+  allocations++;
+  void* p = malloc(size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
+static AtLineReader reader;
+
+// Feed text, collecting each line (or prompt as ">") into lines, one per "|"
+static std::string feedAll(const char* text, bool promptExpected = false) {
+  std::string lines;
+  for (const char* p = text; *p; p++) {
+    AtLineReader::Result result = reader.feed(*p, promptExpected);
+    if (result == AtLineReader::AT_LINE_READY) {
+      AtSlice line = reader.line();
+      lines.append(line.data, line.length);
+      lines += '|';
+    } else if (result == AtLineReader::AT_LINE_PROMPT) {
+      lines += ">|";
+    }
+  }
+  return lines;
+}
+
+static AtSlice slice(const char* text) {
+  return AtSlice(text, strlen(text));
+}
+
+void setUp(void) {
+  reader = AtLineReader();
+}
+
+void tearDown(void) {
+}
+
+void test_reader_cr_lf(void) {
+  // CR LF, a bare LF, blank lines and padding spaces
+  std::string lines = feedAll("\r\nOK\r\n\r\n+CSQ: 18,99\n  ERROR  \r\n\r\n");
+  TEST_ASSERT_EQUAL_STRING("OK|+CSQ: 18,99|ERROR|", lines.c_str());
+}
+
+void test_reader_line_split_across_feeds(void) {
+  TEST_ASSERT_EQUAL_STRING("", feedAll("+CREG: 0,").c_str());
+  TEST_ASSERT_EQUAL_STRING("+CREG: 0,1|", feedAll("1\r\n").c_str());
+}
+
+void test_reader_splits_long_lines(void) {
+  std::string text(AT_LINE_BUFFER_SIZE + 100, 'x');
+  text += "\r\nOK\r\n";
+  
+  std::string lines = feedAll(text.c_str());
+  std::string expected = std::string(AT_LINE_BUFFER_SIZE, 'x') + "|" + std::string(100, 'x') + "|OK|";
+  TEST_ASSERT_EQUAL_STRING(expected.c_str(), lines.c_str());
+  TEST_ASSERT_EQUAL_UINT32(1, reader.getSplitLines());
+  
+  // Exactly one buffer full: no empty piece after it
+  setUp();
+  text = std::string(AT_LINE_BUFFER_SIZE, 'y') + "\r\nOK\r\n";
+  expected = std::string(AT_LINE_BUFFER_SIZE, 'y') + "|OK|";
+  TEST_ASSERT_EQUAL_STRING(expected.c_str(), feedAll(text.c_str()).c_str());
+}
+
+void test_reader_prompt_only_when_expected(void) {
+  // Without a send in progress ">" is just the start of a line
+  TEST_ASSERT_EQUAL_STRING("> text|", feedAll("\r\n> text\r\n").c_str());
+  
+  // The prompt has no line end
+  TEST_ASSERT_EQUAL_STRING(">|", feedAll("\r\n> ", true).c_str());
+  
+  // Only at the start of a line
+  setUp();
+  TEST_ASSERT_EQUAL_STRING("a>b|", feedAll("a>b\r\n", true).c_str());
+}
+
+void test_fields_quoted_commas(void) {
+  AtFields fields;
+  TEST_ASSERT_TRUE(fields.parse(slice("+CMGL: 1,\"REC UNREAD\",\"+15551234567\",\"\",\"26/10/18,09:15:00-16\""),
+                                "+CMGL:"));
+  TEST_ASSERT_EQUAL(5, fields.size());
+  TEST_ASSERT_EQUAL_INT(1, fields.getInt(0));
+  TEST_ASSERT_TRUE(fields.get(1).equals("REC UNREAD"));
+  TEST_ASSERT_TRUE(fields.get(2).equals("+15551234567"));
+  TEST_ASSERT_TRUE(fields.get(3).empty());
+  TEST_ASSERT_TRUE(fields.get(4).equals("26/10/18,09:15:00-16"));
+  
+  // Missing fields read as the fallback
+  TEST_ASSERT_EQUAL_INT(-1, fields.getInt(7));
+  TEST_ASSERT_FALSE(fields.parse(slice("+CSQ: 18,99"), "+CMGL:"));
+}
+
+void test_fields_limit(void) {
+  AtFields fields;
+  TEST_ASSERT_TRUE(fields.parse(slice("+X: 1,2,3,4,5,6,7,8,9,10"), "+X:"));
+  TEST_ASSERT_EQUAL(AT_MAX_FIELDS, fields.size());
+  TEST_ASSERT_EQUAL_INT(8, fields.getInt(AT_MAX_FIELDS - 1));
+}
+
+void test_registration_answer_and_urc(void) {
+  AtRegistration reg;
+  
+  // Answer to AT+CEREG?: <n>,<stat>
+  TEST_ASSERT_TRUE(parseRegistration(slice("+CEREG: 0,5"), reg));
+  TEST_ASSERT_EQUAL(AT_REG_EPS, reg.domain);
+  TEST_ASSERT_EQUAL_INT(5, reg.stat);
+  TEST_ASSERT_TRUE(reg.isRegistered());
+  
+  // Unsolicited: <stat> alone
+  TEST_ASSERT_TRUE(parseRegistration(slice("+CGREG: 2"), reg));
+  TEST_ASSERT_EQUAL(AT_REG_GPRS, reg.domain);
+  TEST_ASSERT_EQUAL_INT(2, reg.stat);
+  TEST_ASSERT_FALSE(reg.isRegistered());
+  
+  // With location: <n>,<stat>,<lac>,<ci>
+  TEST_ASSERT_TRUE(parseRegistration(slice("+CREG: 2,1,\"00C3\",\"01A2B3C4\""), reg));
+  TEST_ASSERT_EQUAL(AT_REG_CS, reg.domain);
+  TEST_ASSERT_EQUAL_INT(1, reg.stat);
+  
+  TEST_ASSERT_FALSE(parseRegistration(slice("+CREG:"), reg));
+  TEST_ASSERT_FALSE(parseRegistration(slice("+CSQ: 18,99"), reg));
+}
+
+void test_signal_quality(void) {
+  AtSignalQuality csq;
+  TEST_ASSERT_TRUE(parseSignalQuality(slice("+CSQ: 18,99"), csq));
+  TEST_ASSERT_TRUE(csq.isKnown());
+  TEST_ASSERT_EQUAL_INT(-77, csq.dbm());
+  TEST_ASSERT_TRUE(parseSignalQuality(slice("+CSQ: 99,99"), csq));
+  TEST_ASSERT_FALSE(csq.isKnown());
+}
+
+void test_http_action(void) {
+  AtHttpAction action;
+  TEST_ASSERT_TRUE(parseHttpAction(slice("+HTTPACTION: 1,200,34"), action));
+  TEST_ASSERT_EQUAL_INT(1, action.method);
+  TEST_ASSERT_EQUAL_INT(200, action.status);
+  TEST_ASSERT_EQUAL_INT(34, action.length);
+}
+
+void test_clock_negative_zone(void) {
+  AtClock clock;
+  TEST_ASSERT_TRUE(parseClock(slice("+CCLK: \"26/10/18,09:15:42-28\""), clock));
+  TEST_ASSERT_EQUAL_INT(2026, clock.year);
+  TEST_ASSERT_EQUAL_INT(10, clock.month);
+  TEST_ASSERT_EQUAL_INT(18, clock.day);
+  TEST_ASSERT_EQUAL_INT(9, clock.hour);
+  TEST_ASSERT_EQUAL_INT(15, clock.minute);
+  TEST_ASSERT_EQUAL_INT(42, clock.second);
+  TEST_ASSERT_EQUAL_INT(-28, clock.zoneQuarters);
+  
+  TEST_ASSERT_TRUE(parseClock(slice("+CCLK: \"26/01/01,00:00:00+08\""), clock));
+  TEST_ASSERT_EQUAL_INT(8, clock.zoneQuarters);
+  
+  // Not set yet (month 0), or cut short
+  TEST_ASSERT_FALSE(parseClock(slice("+CCLK: \"80/00/06,00:00:12+00\""), clock));
+  TEST_ASSERT_FALSE(parseClock(slice("+CCLK: \"26/10/18,09:15\""), clock));
+}
+
+void test_tcp_ack(void) {
+  AtTcpAck ack;
+  TEST_ASSERT_TRUE(parseTcpAck(slice("+CIPACK: 5840,2920,2920"), ack));
+  TEST_ASSERT_EQUAL_UINT32(5840, ack.sent);
+  TEST_ASSERT_EQUAL_UINT32(2920, ack.acked);
+  TEST_ASSERT_EQUAL_UINT32(2920, ack.unacked);
+  
+  TEST_ASSERT_FALSE(parseTcpAck(slice("+CIPACK: 5840,2920"), ack));
+  TEST_ASSERT_FALSE(parseTcpAck(slice("+CIPACK: ,,"), ack));
+}
+
+void test_find_line(void) {
+  const char* response = "AT+CCLK?\r\n+CCLK: \"26/10/18,09:15:42+00\"\r\n\r\nOK\r\n";
+  AtSlice line;
+  TEST_ASSERT_TRUE(findAtLine(response, strlen(response), "+CCLK:", line));
+  TEST_ASSERT_TRUE(line.equals("+CCLK: \"26/10/18,09:15:42+00\""));
+  TEST_ASSERT_FALSE(findAtLine(response, strlen(response), "+CSQ:", line));
+}
+
+// A slice of a real session: registration, signal, clock, a quick send
+// with its acknowledgements and a few URCs
+static const char* const TRANSCRIPT =
+  "AT+CSQ\r\n\r\n+CSQ: 18,99\r\n\r\nOK\r\n"
+  "AT+CEREG?\r\n\r\n+CEREG: 0,1\r\n\r\nOK\r\n"
+  "\r\n+CEREG: 5\r\n"
+  "AT+CCLK?\r\n\r\n+CCLK: \"26/10/18,09:15:42-28\"\r\n\r\nOK\r\n"
+  "AT+CIPSTART=\"TCP\",\"www.googleapis.com\",443\r\n\r\nOK\r\n\r\nCONNECT OK\r\n"
+  "AT+CIPSEND=1460\r\n\r\n> "
+  "\r\nDATA ACCEPT:1460\r\n"
+  "AT+CIPACK\r\n\r\n+CIPACK: 1460,1460,0\r\n\r\nOK\r\n"
+  "\r\n+CIPRXGET: 1\r\n"
+  "AT+HTTPACTION=1\r\n\r\nOK\r\n\r\n+HTTPACTION: 1,200,34\r\n";
+
+#define BENCH_ROUNDS 20000
+
+// Typed results found per pass, so both parsers can be checked against each other
+struct TranscriptCounts {
+  uint32_t lines;
+  uint32_t prompts;
+  long sum;
+};
+
+static void parseInPlace(TranscriptCounts& counts) {
+  for (const char* p = TRANSCRIPT; *p; p++) {
+    bool promptExpected = p > TRANSCRIPT && p[-1] == '\n' && p[1] == ' ';
+    AtLineReader::Result result = reader.feed(*p, promptExpected);
+    if (result == AtLineReader::AT_LINE_PROMPT) {
+      counts.prompts++;
+      continue;
+    }
+    if (result != AtLineReader::AT_LINE_READY) {
+      continue;
+    }
+    counts.lines++;
+    
+    // Dispatched on the prefix first, as the URC handlers are
+    AtSlice line = reader.line();
+    AtSignalQuality csq;
+    AtRegistration reg;
+    AtClock clock;
+    AtTcpAck ack;
+    AtHttpAction action;
+    if (line.startsWith("+CSQ:") && parseSignalQuality(line, csq)) {
+      counts.sum += csq.rssi;
+    } else if (line.startsWith("+CEREG:") && parseRegistration(line, reg)) {
+      counts.sum += reg.stat;
+    } else if (line.startsWith("+CCLK:") && parseClock(line, clock)) {
+      counts.sum += clock.zoneQuarters;
+    } else if (line.startsWith("+CIPACK:") && parseTcpAck(line, ack)) {
+      counts.sum += ack.acked;
+    } else if (line.startsWith("+HTTPACTION:") && parseHttpAction(line, action)) {
+      counts.sum += action.status;
+    }
+  }
+}
+
+// The same with a std::string per line and substring copies, the way the
+// firmware parsed before the in-place reader
+static void parseWithStrings(TranscriptCounts& counts) {
+  std::string line;
+  for (const char* p = TRANSCRIPT; *p; p++) {
+    if (line.empty() && *p == '>' && p[1] == ' ') {
+      counts.prompts++;
+      p++;
+      continue;
+    }
+    if (*p == '\r') {
+      continue;
+    }
+    if (*p != '\n') {
+      line += *p;
+      continue;
+    }
+    if (line.empty()) {
+      continue;
+    }
+    counts.lines++;
+    
+    std::string value = line.substr(line.find(':') + 1);
+    if (line.compare(0, 5, "+CSQ:") == 0) {
+      counts.sum += atol(value.substr(0, value.find(',')).c_str());
+    } else if (line.compare(0, 7, "+CEREG:") == 0) {
+      size_t comma = value.find(',');
+      counts.sum += atol(comma == std::string::npos ? value.c_str() : value.substr(comma + 1).c_str());
+    } else if (line.compare(0, 6, "+CCLK:") == 0) {
+      std::string time = value.substr(value.find('"') + 1);
+      counts.sum += atol(time.substr(17).c_str());
+    } else if (line.compare(0, 8, "+CIPACK:") == 0) {
+      std::string rest = value.substr(value.find(',') + 1);
+      counts.sum += atol(rest.substr(0, rest.find(',')).c_str());
+    } else if (line.compare(0, 12, "+HTTPACTION:") == 0) {
+      std::string rest = value.substr(value.find(',') + 1);
+      counts.sum += atol(rest.substr(0, rest.find(',')).c_str());
+    }
+    line = "";
+  }
+}
+
+void test_transcript_benchmark(void) {
+  TranscriptCounts inPlace = {0, 0, 0};
+  TranscriptCounts strings = {0, 0, 0};
+  
+  uint32_t before = allocations;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int i = 0; i < BENCH_ROUNDS; i++) {
+    parseInPlace(inPlace);
+  }
+  std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+  uint32_t inPlaceAllocations = allocations - before;
+  for (int i = 0; i < BENCH_ROUNDS; i++) {
+    parseWithStrings(strings);
+  }
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+  uint32_t stringAllocations = allocations - before - inPlaceAllocations;
+  
+  TEST_ASSERT_EQUAL_UINT32(strings.lines, inPlace.lines);
+  TEST_ASSERT_EQUAL_UINT32(BENCH_ROUNDS, inPlace.prompts);
+  TEST_ASSERT_EQUAL_INT(strings.sum, inPlace.sum);
+  TEST_ASSERT_EQUAL_UINT32(0, inPlaceAllocations);
+  
+  double bytes = (double)strlen(TRANSCRIPT) * BENCH_ROUNDS;
+  double inPlaceNs = std::chrono::duration<double, std::nano>(middle - start).count();
+  double stringsNs = std::chrono::duration<double, std::nano>(end - middle).count();
+  char summary[200];
+  snprintf(summary, sizeof(summary),
+           "Transcript (%.0f bytes): in place %.1f ns/byte, 0 allocations; "
+           "strings %.1f ns/byte, %.1f allocations per line",
+           bytes, inPlaceNs / bytes, stringsNs / bytes, (double)stringAllocations / strings.lines);
+  TEST_MESSAGE(summary);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_reader_cr_lf);
+  RUN_TEST(test_reader_line_split_across_feeds);
+  RUN_TEST(test_reader_splits_long_lines);
+  RUN_TEST(test_reader_prompt_only_when_expected);
+  RUN_TEST(test_fields_quoted_commas);
+  RUN_TEST(test_fields_limit);
+  RUN_TEST(test_registration_answer_and_urc);
+  RUN_TEST(test_signal_quality);
+  RUN_TEST(test_http_action);
+  RUN_TEST(test_clock_negative_zone);
+  RUN_TEST(test_tcp_ack);
+  RUN_TEST(test_find_line);
+  RUN_TEST(test_transcript_benchmark);
+  return UNITY_END();
+}
@@ -0,0 +1,238 @@
+#include <unity.h>
+#include <string>
+#include "config.h"
+#include "drive_resumable.h"
+#include "drive_stand_in.h"
+#include "firmware_fakes.h"
+#include "storage.h"
+#include "test_clock.h"
+
+#define CAPTURE_NAME "20260418_101500.jpg"
+#define SESSION_PATH "/captures/20260418/" CAPTURE_NAME UPLOAD_SESSION_EXT
+#define ACCESS_TOKEN "ya29.test-token"
+#define CAPTURE_SIZE (700 * 1024)  // Two whole chunks and a short one
+
+static RamStorageBackend* storage;
+static DriveStandIn* drive;
+static HttpConnection* http;
+static std::string capture;
+
+static DriveUploadResult upload(const char* token = ACCESS_TOKEN) {
+  BufferUploadSource source((const uint8_t*)capture.data(), capture.length());
+  return driveResumableUpload(*http, token, CAPTURE_NAME, "folder", "image/jpeg", source, SESSION_PATH);
+}
+
+static bool sessionSaved() {
+  size_t size;
+  return storage->stat(SESSION_PATH, &size);
+}
+
+// Committed offset kept in the session file
+static size_t savedOffset() {
+  StorageFilePtr file = storage->open(SESSION_PATH, STORAGE_READ);
+  if (!file) {
+    return SIZE_MAX;
+  }
+  char line[512];
+  size_t len = file->read((uint8_t*)line, sizeof(line) - 1);
+  line[len] = '\0';
+  return strtoul(line, NULL, 10);
+}
+
+static void assertUploaded() {
+  const DriveStandInSession* session = drive->findByName(CAPTURE_NAME);
+  TEST_ASSERT_NOT_NULL(session);
+  TEST_ASSERT_TRUE(session->complete);
+  TEST_ASSERT_EQUAL(CAPTURE_SIZE, session->data.length());
+  TEST_ASSERT_TRUE(session->data == capture);
+  TEST_ASSERT_FALSE(sessionSaved());
+}
+
+void setUp(void) {
+  resetTestMillis();
+  resetFirmwareFakes();
+  storage = new RamStorageBackend(1 << 20);
+  storage->begin();
+  storage->mkdir("/captures");
+  storage->mkdir("/captures/20260418");
+  setStorageBackend(storage);
+  
+  drive = new DriveStandIn(ACCESS_TOKEN);
+  http = new HttpConnection();
+  http->setClient(drive);
+  
+  capture.resize(CAPTURE_SIZE);
+  uint32_t x = 12345;
+  for (size_t i = 0; i < capture.length(); i++) {
+    x = x * 1103515245 + 12345;
+    capture[i] = (char)(x >> 16);
+  }
+}
+
+void tearDown(void) {
+  delete http;
+  delete drive;
+  delete storage;
+}
+
+void test_clean_upload(void) {
+  TEST_ASSERT_EQUAL(DRIVE_UPLOAD_OK, upload());
+  assertUploaded();
+  TEST_ASSERT_EQUAL_UINT32(3, drive->chunks());
+  TEST_ASSERT_EQUAL_UINT32(0, drive->statusQueries());
+  
+  // One connection for the session and all chunks
+  TEST_ASSERT_EQUAL_UINT32(1, drive->getStats().connects);
+  TEST_ASSERT_EQUAL_UINT32(0, http->getStats().reconnects);
+}
+
+// The link drops in the second chunk; what the server kept of it is asked
+// for and the upload goes on from there
+void test_drop_mid_chunk_resumes(void) {
+  drive->setCommitUnit(64 * 1024);
+  drive->dropAfter(400 * 1024);
+  TEST_ASSERT_EQUAL(DRIVE_UPLOAD_INTERRUPTED, upload());
+  TEST_ASSERT_TRUE(sessionSaved());
+  TEST_ASSERT_EQUAL(256 * 1024, savedOffset());
+  TEST_ASSERT_EQUAL_UINT32(1, drive->getStats().drops);
+  
+  const DriveStandInSession* session = drive->findByName(CAPTURE_NAME);
+  TEST_ASSERT_NOT_NULL(session);
+  TEST_ASSERT_EQUAL(384 * 1024, session->data.length());
+  
+  TEST_ASSERT_EQUAL(DRIVE_UPLOAD_OK, upload());
+  assertUploaded();
+  TEST_ASSERT_EQUAL_UINT32(1, drive->sessionCount());
+  TEST_ASSERT_EQUAL_UINT32(1, drive->statusQueries());
+  
+  // The dropped chunk never got an answer; then 384-640 KB and the rest
+  TEST_ASSERT_EQUAL_UINT32(1 + 2, drive->chunks());
+}
+
+// Dropped before anything of the chunk was committed: resent whole
+void test_drop_before_commit_resends_chunk(void) {
+  drive->dropAfter(300 * 1024);
+  TEST_ASSERT_EQUAL(DRIVE_UPLOAD_INTERRUPTED, upload());
+  TEST_ASSERT_EQUAL(256 * 1024, savedOffset());
+  
+  TEST_ASSERT_EQUAL(DRIVE_UPLOAD_OK, upload());
+  assertUploaded();
+}
+
+// The server took less than was sent and says so in Range
+void test_short_commit_resends_rest(void) {
+  drive->limitCommits(100 * 1024);
+  TEST_ASSERT_EQUAL(DRIVE_UPLOAD_OK, upload());
+  assertUploaded();
+  
+  // 0-256 KB (100 KB taken), 100-356, 356-612, 612-700
+  TEST_ASSERT_EQUAL_UINT32(4, drive->chunks());
+}
+
+void test_server_error_keeps_session(void) {
+  drive->failNextChunk(503);
+  TEST_ASSERT_EQUAL(DRIVE_UPLOAD_INTERRUPTED, upload());
+  TEST_ASSERT_TRUE(sessionSaved());
+  TEST_ASSERT_EQUAL(0, savedOffset());
+  
+  TEST_ASSERT_EQUAL(DRIVE_UPLOAD_OK, upload());
+  assertUploaded();
+  TEST_ASSERT_EQUAL_UINT32(1, drive->sessionCount());
+}
+
+void test_expired_session_starts_over(void) {
+  drive->dropAfter(400 * 1024);
+  TEST_ASSERT_EQUAL(DRIVE_UPLOAD_INTERRUPTED, upload());
+  TEST_ASSERT_TRUE(sessionSaved());
+  
+  drive->expireSessions();
+  TEST_ASSERT_EQUAL(DRIVE_UPLOAD_OK, upload());
+  assertUploaded();
+  TEST_ASSERT_EQUAL_UINT32(1, drive->statusQueries());
+  TEST_ASSERT_EQUAL_UINT32(1 + 3, drive->chunks());
+}
+
+// A session file left by an earlier boot is picked up, also when the
+// server has everything already
+void test_complete_session_not_resent(void) {
+  TEST_ASSERT_EQUAL(DRIVE_UPLOAD_OK, upload());
+  StorageFilePtr file = storage->open(SESSION_PATH, STORAGE_WRITE);
+  std::string line = std::to_string(512 * 1024) + " https://" DRIVE_STAND_IN_HOST
+                     "/upload/drive/v3/files?uploadType=resumable&upload_id=session1\n";
+  file->write((const uint8_t*)line.data(), line.length());
+  file->close();
+  
+  TEST_ASSERT_EQUAL(DRIVE_UPLOAD_OK, upload());
+  assertUploaded();
+  TEST_ASSERT_EQUAL_UINT32(3, drive->chunks());
+  TEST_ASSERT_EQUAL_UINT32(1, drive->statusQueries());
+}
+
+// Stops before the first chunk with the session kept
+void test_pause_between_chunks(void) {
+  setFakeUploadPause(true);
+  TEST_ASSERT_EQUAL(DRIVE_UPLOAD_PAUSED, upload());
+  TEST_ASSERT_TRUE(sessionSaved());
+  TEST_ASSERT_EQUAL_UINT32(0, drive->chunks());
+  
+  setFakeUploadPause(false);
+  TEST_ASSERT_EQUAL(DRIVE_UPLOAD_OK, upload());
+  assertUploaded();
+  TEST_ASSERT_EQUAL_UINT32(1, drive->sessionCount());
+}
+
+void test_rejected_token(void) {
+  TEST_ASSERT_EQUAL(DRIVE_UPLOAD_UNAUTHORIZED, upload("ya29.expired"));
+  TEST_ASSERT_FALSE(sessionSaved());
+  TEST_ASSERT_EQUAL_UINT32(0, drive->sessionCount());
+}
+
+// No progress three times in a row: given up for now, session kept
+void test_stalled_upload_interrupted(void) {
+  drive->limitCommits(0, DRIVE_UPLOAD_MAX_STALLS);
+  TEST_ASSERT_EQUAL(DRIVE_UPLOAD_INTERRUPTED, upload());
+  TEST_ASSERT_EQUAL_UINT32(DRIVE_UPLOAD_MAX_STALLS, drive->chunks());
+  TEST_ASSERT_EQUAL(0, savedOffset());
+  
+  TEST_ASSERT_EQUAL(DRIVE_UPLOAD_OK, upload());
+  assertUploaded();
+}
+
+// Disconnects every 200 KB on a 2G-like link until the upload gets through
+void test_repeated_drops(void) {
+  drive->setCommitUnit(64 * 1024);
+  drive->setLink(600, 8000);
+  
+  int attempts = 0;
+  DriveUploadResult result;
+  do {
+    drive->dropAfter(200 * 1024);
+    result = upload();
+    attempts++;
+  } while (result == DRIVE_UPLOAD_INTERRUPTED && attempts < 10);
+  
+  TEST_ASSERT_EQUAL(DRIVE_UPLOAD_OK, result);
+  assertUploaded();
+  TEST_ASSERT_EQUAL_UINT32(1, drive->sessionCount());
+  
+  char summary[120];
+  snprintf(summary, sizeof(summary), "700 KB in %d attempts, %llu bytes sent, %.1f s", attempts,
+           (unsigned long long)drive->getStats().bytesIn, testMillis() / 1000.0);
+  TEST_MESSAGE(summary);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_clean_upload);
+  RUN_TEST(test_drop_mid_chunk_resumes);
+  RUN_TEST(test_drop_before_commit_resends_chunk);
+  RUN_TEST(test_short_commit_resends_rest);
+  RUN_TEST(test_server_error_keeps_session);
+  RUN_TEST(test_expired_session_starts_over);
+  RUN_TEST(test_complete_session_not_resent);
+  RUN_TEST(test_pause_between_chunks);
+  RUN_TEST(test_rejected_token);
+  RUN_TEST(test_stalled_upload_interrupted);
+  RUN_TEST(test_repeated_drops);
+  return UNITY_END();
+}
@@ -0,0 +1,125 @@
+#include <unity.h>
+#include <map>
+#include <string>
+#include "config.h"
+#include "http_client.h"
+#include "http_stand_in.h"
+#include "test_clock.h"
+
+#define HOST "api.example.net"
+
+// Answers everything with 200, unless told to leave requests unanswered
+// or to answer only part of the status line
+class ScriptedServer : public HttpStandIn {
+public:
+  ScriptedServer() : silent(0), partial(0) {}
+  
+  int silent;      // Next requests to take in and never answer
+  int partial;     // Next requests to answer with half a status line
+  std::map<std::string, int> handled;  // Complete requests, by method
+
+protected:
+  std::string handle(const StandInRequest& request) override {
+    handled[request.method]++;
+    if (silent > 0) {
+      silent--;
+      return "";
+    }
+    if (partial > 0) {
+      partial--;
+      return "HTTP/1.1 2";
+    }
+    return response(200, "OK", "", "done");
+  }
+};
+
+static ScriptedServer* server;
+static HttpConnection* connection;
+
+static bool send(const char* method) {
+  HttpResponse response;
+  return connection->request(method, HOST, 80, "/files", "", method[0] == 'G' ? "" : "body", response) &&
+         response.status == 200;
+}
+
+void setUp(void) {
+  resetTestMillis();
+  server = new ScriptedServer();
+  connection = new HttpConnection();
+  connection->setClient(server);
+  
+  // Every test starts on a kept-alive connection
+  TEST_ASSERT_TRUE(send("GET"));
+  server->handled.clear();
+  connection->resetStats();
+}
+
+void tearDown(void) {
+  delete connection;
+  delete server;
+}
+
+// A kept-alive connection the server closed in the meantime: a GET or PUT
+// goes again on a new one
+void test_stale_connection_retried(void) {
+  server->dropAfter(10);
+  TEST_ASSERT_TRUE(send("GET"));
+  server->dropAfter(10);
+  TEST_ASSERT_TRUE(send("PUT"));
+  TEST_ASSERT_EQUAL(1, server->handled["GET"]);
+  TEST_ASSERT_EQUAL(1, server->handled["PUT"]);
+  TEST_ASSERT_EQUAL_UINT32(2, connection->getStats().reconnects);
+}
+
+// A POST may have been acted on before the connection went, never sent twice
+void test_stale_post_not_retried(void) {
+  server->dropAfter(10);
+  TEST_ASSERT_FALSE(send("POST"));
+  TEST_ASSERT_EQUAL_UINT32(0, connection->getStats().reconnects);
+  TEST_ASSERT_EQUAL(1, server->getStats().connects);
+}
+
+// The whole POST went out but no answer came: it isn't repeated
+void test_post_timeout_not_retried(void) {
+  server->silent = 1;
+  unsigned long start = millis();
+  TEST_ASSERT_FALSE(send("POST"));
+  TEST_ASSERT_EQUAL(1, server->handled["POST"]);
+  TEST_ASSERT_EQUAL_UINT32(0, connection->getStats().reconnects);
+  TEST_ASSERT_TRUE(millis() - start < 2 * HTTP_TIMEOUT_MS);
+}
+
+// A PUT that got no answer can go again, doing it twice does no harm
+void test_put_timeout_retried(void) {
+  server->silent = 1;
+  TEST_ASSERT_TRUE(send("PUT"));
+  TEST_ASSERT_EQUAL(2, server->handled["PUT"]);
+  TEST_ASSERT_EQUAL_UINT32(1, connection->getStats().reconnects);
+}
+
+// Once the server started answering it had the request, nothing is retried
+void test_partial_response_not_retried(void) {
+  server->partial = 1;
+  TEST_ASSERT_FALSE(send("GET"));
+  TEST_ASSERT_EQUAL(1, server->handled["GET"]);
+  TEST_ASSERT_EQUAL_UINT32(0, connection->getStats().reconnects);
+}
+
+// A new connection that fails isn't stale, not even a GET goes again
+void test_new_connection_not_retried(void) {
+  connection->stop();
+  server->dropAfter(10);
+  TEST_ASSERT_FALSE(send("GET"));
+  TEST_ASSERT_EQUAL_UINT32(0, connection->getStats().reconnects);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_stale_connection_retried);
+  RUN_TEST(test_stale_post_not_retried);
+  RUN_TEST(test_post_timeout_not_retried);
+  RUN_TEST(test_put_timeout_retried);
+  RUN_TEST(test_partial_response_not_retried);
+  RUN_TEST(test_new_connection_not_retried);
+  return UNITY_END();
+}
@@ -0,0 +1,309 @@
+#include <unity.h>
+#include <string>
+#include <LittleFS.h>
+#include "config.h"
+#include "firmware_fakes.h"
+#include "http_client.h"
+#include "modem_client.h"
+#include "test_clock.h"
+#include "tls_client.h"
+#include "tls_stand_in.h"
+
+#define TLS_RTT_MS 700  // LTE-M, a round trip through the modem
+
+// The far end of a plain socket: keeps what came in, sends it back on request
+class EchoPeer : public Client {
+public:
+  EchoPeer() : open(false) {}
+  
+  void answer(const std::string& data) { output += data; }
+  
+  int connect(IPAddress ip, uint16_t port) override { return connect("", port); }
+  int connect(const char* host, uint16_t port) override {
+    open = true;
+    return 1;
+  }
+  size_t write(uint8_t b) override { return write(&b, 1); }
+  size_t write(const uint8_t* buf, size_t size) override {
+    received.append((const char*)buf, size);
+    return size;
+  }
+  int available() override { return output.length(); }
+  int read() override { return -1; }
+  int read(uint8_t* buf, size_t size) override {
+    size_t n = std::min(size, output.length());
+    memcpy(buf, output.data(), n);
+    output.erase(0, n);
+    return n ? (int)n : -1;
+  }
+  int peek() override { return -1; }
+  void flush() override {}
+  void stop() override { open = false; }
+  uint8_t connected() override { return open; }
+  operator bool() override { return open; }
+  
+  std::string received;
+  std::string output;
+
+private:
+  bool open;
+};
+
+static EchoPeer* peer;
+static TlsStandIn* server;
+
+static void writeCaFile(const char* pem) {
+  File file = LittleFS.open(TLS_CA_FILE, "w");
+  file.print(pem);
+  file.close();
+}
+
+// HTTPS over the modem as the uploader sets it up
+static TlsClient* beginTls(const char* rootCerts) {
+  setFakeTcpPeer(server);
+  writeCaFile(rootCerts);
+  if (!beginModemTransport()) {
+    return NULL;
+  }
+  return (TlsClient*)getHttpsClient();
+}
+
+// Send and read back through the TLS connection
+static std::string echo(Client* client, const std::string& message) {
+  TEST_ASSERT_EQUAL(message.length(), client->write((const uint8_t*)message.data(), message.length()));
+  std::string reply;
+  unsigned long start = millis();
+  while (reply.length() < message.length() && millis() - start < 10000) {
+    uint8_t buffer[512];
+    int n = client->available() ? client->read(buffer, sizeof(buffer)) : 0;
+    if (n > 0) {
+      reply.append((const char*)buffer, n);
+    } else {
+      delay(10);
+    }
+  }
+  return reply;
+}
+
+void setUp(void) {
+  resetTestMillis();
+  resetFirmwareFakes();
+  LittleFS.format();
+  peer = new EchoPeer();
+  server = new TlsStandIn();
+  server->setRoundTrip(TLS_RTT_MS);
+  
+  // The transport is set up again for each test, without the sessions
+  // an earlier one left
+  if (getHttpsClient()) {
+    ((TlsClient*)getHttpsClient())->clearSessions();
+  }
+  setHttpClient(NULL);
+  setHttpsClient(NULL);
+}
+
+void tearDown(void) {
+  setFakeTcpPeer(NULL);
+  delete server;
+  delete peer;
+}
+
+// Small writes are collected into whole packets
+void test_writes_coalesced(void) {
+  setFakeTcpPeer(peer);
+  ModemClient client;
+  TEST_ASSERT_EQUAL(1, client.connect("dav.example.net", 80));
+  
+  std::string data(3000, 'x');
+  for (int i = 0; i < 30; i++) {
+    TEST_ASSERT_EQUAL(100, client.write((const uint8_t*)data.data() + i * 100, 100));
+  }
+  TEST_ASSERT_EQUAL(2, getFakeTcpLog().writes.size());
+  TEST_ASSERT_EQUAL(TCP_MAX_PACKET_SIZE, getFakeTcpLog().writes[0]);
+  
+  // The rest goes before anything is read
+  client.flush();
+  TEST_ASSERT_EQUAL(3, getFakeTcpLog().writes.size());
+  TEST_ASSERT_EQUAL(3000 - 2 * TCP_MAX_PACKET_SIZE, getFakeTcpLog().writes[2]);
+  TEST_ASSERT_EQUAL_UINT32(3, getFakeTcpLog().packets);
+  TEST_ASSERT_TRUE(peer->received == data);
+  client.stop();
+}
+
+// The modem reported a smaller packet size after a reconnect: what was
+// collected at the old size goes out first, then packets of the new size
+void test_packet_size_shrinks(void) {
+  setFakeTcpPeer(peer);
+  ModemClient client;
+  TEST_ASSERT_EQUAL(1, client.connect("dav.example.net", 80));
+  
+  std::string data(2210, 'y');
+  client.write((const uint8_t*)data.data(), 1000);
+  setFakeTcpPacketSize(500);
+  client.write((const uint8_t*)data.data() + 1000, 1210);
+  client.flush();
+  
+  const std::vector<size_t>& writes = getFakeTcpLog().writes;
+  TEST_ASSERT_EQUAL(4, writes.size());
+  TEST_ASSERT_EQUAL(1000, writes[0]);
+  TEST_ASSERT_EQUAL(500, writes[1]);
+  TEST_ASSERT_EQUAL(500, writes[2]);
+  TEST_ASSERT_EQUAL(210, writes[3]);
+  TEST_ASSERT_EQUAL(2210, peer->received.length());
+  client.stop();
+}
+
+// Received data is fetched a packet at a time and handed out in any pieces
+void test_reads(void) {
+  setFakeTcpPeer(peer);
+  ModemClient client;
+  TEST_ASSERT_EQUAL(1, client.connect("dav.example.net", 80));
+  TEST_ASSERT_EQUAL(0, client.available());
+  
+  std::string answer(4000, '\0');
+  for (size_t i = 0; i < answer.length(); i++) {
+    answer[i] = (char)i;
+  }
+  peer->answer(answer);
+  
+  std::string got;
+  TEST_ASSERT_EQUAL((char)answer[0], (char)client.peek());
+  while (got.length() < answer.length() && client.available()) {
+    uint8_t buffer[700];
+    int n = client.read(buffer, sizeof(buffer));
+    TEST_ASSERT_GREATER_THAN(0, n);
+    got.append((const char*)buffer, n);
+  }
+  TEST_ASSERT_TRUE(got == answer);
+  TEST_ASSERT_EQUAL(-1, client.read());
+  
+  // Nothing buffered survives a stop
+  client.write((const uint8_t*)"abc", 3);
+  client.stop();
+  TEST_ASSERT_EQUAL(0, peer->received.length());
+  TEST_ASSERT_FALSE(client.connected());
+}
+
+// Without root certificates there is plain HTTP only
+void test_no_root_certificates(void) {
+  setFakeTcpPeer(server);
+  TEST_ASSERT_FALSE(beginModemTransport());
+  TEST_ASSERT_NOT_NULL(getHttpClient());
+  TEST_ASSERT_NULL(getHttpsClient());
+  
+  // Provisioned later, picked up on the next call
+  writeCaFile(TLS_STAND_IN_CERT);
+  TEST_ASSERT_TRUE(beginModemTransport());
+  TEST_ASSERT_NOT_NULL(getHttpsClient());
+}
+
+// The first connect is a full handshake, the next resumes its session:
+// no certificate on the wire and a round trip less
+void test_handshake_then_resumption(void) {
+  TlsClient* tls = beginTls(TLS_STAND_IN_CERT);
+  TEST_ASSERT_NOT_NULL(tls);
+  
+  uint32_t start = testMillis();
+  TEST_ASSERT_EQUAL(1, tls->connect(TLS_STAND_IN_HOST, 443));
+  uint32_t fullMillis = testMillis() - start;
+  TEST_ASSERT_FALSE(tls->wasResumed());
+  TEST_ASSERT_TRUE(echo(tls, "GET / HTTP/1.1\r\n\r\n") == "GET / HTTP/1.1\r\n\r\n");
+  tls->stop();
+  TlsStandInStats full = server->getStats();
+  
+  server->resetStats();
+  start = testMillis();
+  TEST_ASSERT_EQUAL(1, tls->connect(TLS_STAND_IN_HOST, 443));
+  uint32_t resumedMillis = testMillis() - start;
+  TEST_ASSERT_TRUE(tls->wasResumed());
+  TEST_ASSERT_TRUE(echo(tls, "again") == "again");
+  tls->stop();
+  TlsStandInStats resumed = server->getStats();
+  
+  TEST_ASSERT_EQUAL_UINT32(1, full.handshakes);
+  TEST_ASSERT_EQUAL_UINT32(1, resumed.handshakes);
+  TEST_ASSERT_LESS_THAN_UINT64(full.bytesOut, resumed.bytesOut);
+  TEST_ASSERT_LESS_THAN_UINT32(fullMillis, resumedMillis);
+  
+  const ModemClientStats& stats = getModemClientStats();
+  TEST_ASSERT_EQUAL_UINT32(2, stats.handshakes);
+  TEST_ASSERT_EQUAL_UINT32(1, stats.resumedHandshakes);
+  
+  char summary[200];
+  snprintf(summary, sizeof(summary),
+           "TLS at %d ms round trip, TCP connect included: full handshake %lu ms, %llu bytes "
+           "from the server; resumed %lu ms, %llu bytes",
+           TLS_RTT_MS, (unsigned long)fullMillis, (unsigned long long)full.bytesOut,
+           (unsigned long)resumedMillis, (unsigned long long)resumed.bytesOut);
+  TEST_MESSAGE(summary);
+}
+
+// Records larger than a packet in both directions
+void test_large_echo(void) {
+  TlsClient* tls = beginTls(TLS_STAND_IN_CERT);
+  TEST_ASSERT_EQUAL(1, tls->connect(TLS_STAND_IN_HOST, 443));
+  
+  std::string message(6000, '\0');
+  for (size_t i = 0; i < message.length(); i++) {
+    message[i] = (char)(i * 7);
+  }
+  TEST_ASSERT_TRUE(echo(tls, message) == message);
+  tls->stop();
+}
+
+// After a server restart the offered session is refused and a full
+// handshake follows on the same connect
+void test_server_forgot_session(void) {
+  TlsClient* tls = beginTls(TLS_STAND_IN_CERT);
+  TEST_ASSERT_EQUAL(1, tls->connect(TLS_STAND_IN_HOST, 443));
+  tls->stop();
+  
+  server->forgetSessions();
+  TEST_ASSERT_EQUAL(1, tls->connect(TLS_STAND_IN_HOST, 443));
+  TEST_ASSERT_FALSE(tls->wasResumed());
+  tls->stop();
+  
+  TEST_ASSERT_EQUAL(1, tls->connect(TLS_STAND_IN_HOST, 443));
+  TEST_ASSERT_TRUE(tls->wasResumed());
+  tls->stop();
+}
+
+// A certificate that doesn't chain to the configured root, or is for
+// another name, ends the handshake
+void test_certificate_rejected(void) {
+  TlsClient* tls = beginTls(TLS_STAND_IN_OTHER_ROOT);
+  TEST_ASSERT_NOT_NULL(tls);
+  TEST_ASSERT_EQUAL(0, tls->connect(TLS_STAND_IN_HOST, 443));
+  TEST_ASSERT_FALSE(tls->connected());
+  TEST_ASSERT_EQUAL_UINT32(0, server->getStats().handshakes);
+  
+  tls->setCACert(TLS_STAND_IN_CERT);
+  TEST_ASSERT_EQUAL(0, tls->connect("other.example.net", 443));
+  TEST_ASSERT_EQUAL(1, tls->connect(TLS_STAND_IN_HOST, 443));
+  tls->stop();
+}
+
+// The server never answers: the handshake gives up at its timeout
+void test_handshake_timeout(void) {
+  TlsClient* tls = beginTls(TLS_STAND_IN_CERT);
+  setFakeTcpPeer(peer);
+  
+  uint32_t start = testMillis();
+  TEST_ASSERT_EQUAL(0, tls->connect(TLS_STAND_IN_HOST, 443));
+  TEST_ASSERT_UINT32_WITHIN(1000, TLS_HANDSHAKE_TIMEOUT_S * 1000, testMillis() - start);
+  TEST_ASSERT_FALSE(peer->received.empty());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_writes_coalesced);
+  RUN_TEST(test_packet_size_shrinks);
+  RUN_TEST(test_reads);
+  RUN_TEST(test_no_root_certificates);
+  RUN_TEST(test_handshake_then_resumption);
+  RUN_TEST(test_large_echo);
+  RUN_TEST(test_server_forgot_session);
+  RUN_TEST(test_certificate_rejected);
+  RUN_TEST(test_handshake_timeout);
+  return UNITY_END();
+}
@@ -0,0 +1,261 @@
+#include <unity.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "modem_simulator.h"
+#include "sim_host.h"
+#include "test_clock.h"
+
+#define SIM_EPOCH 1767225600  // 2026-01-01 00:00:00 UTC
+
+static ModemSimulatorConfig makeConfig() {
+  ModemSimulatorConfig config;
+  config.latencyMs = 50;
+  config.bytesPerSecond = 12500;
+  config.failurePercent = 0;
+  config.silentPercent = 0;
+  config.rssi = 18;
+  config.registration = 1;
+  config.epoch = SIM_EPOCH;
+  config.seed = 7;
+  return config;
+}
+
+// Files the stand-in server took: path and body length
+struct ReceivedFiles {
+  std::vector<std::pair<std::string, size_t> > files;
+};
+
+static std::string recordPut(const std::string& head, size_t bodyLength, void* context) {
+  ReceivedFiles* received = (ReceivedFiles*)context;
+  size_t pathStart = head.find(' ') + 1;
+  received->files.push_back(std::make_pair(head.substr(pathStart, head.find(' ', pathStart) - pathStart),
+                                           bodyLength));
+  return "HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n";
+}
+
+void setUp(void) {
+  resetTestMillis();
+}
+
+void tearDown(void) {
+}
+
+void test_basic_answers(void) {
+  ModemSimulator modem(testMillis, makeConfig());
+  SimHost host(modem);
+  std::string line;
+  
+  TEST_ASSERT_TRUE(host.command("AT"));
+  TEST_ASSERT_TRUE(host.command("AT+CSQ"));
+  TEST_ASSERT_TRUE(host.findLine("+CSQ: 18,99", line));
+  TEST_ASSERT_TRUE(host.command("AT+CEREG?"));
+  TEST_ASSERT_TRUE(host.findLine("+CEREG: 1,1", line));
+  TEST_ASSERT_FALSE(host.command("AT+NOSUCHCOMMAND"));
+  
+  // The network clock runs from the configured epoch
+  advanceTestMillis(3600 * 1000);
+  TEST_ASSERT_TRUE(host.command("AT+CCLK?"));
+  TEST_ASSERT_TRUE(host.findLine("+CCLK:", line));
+  AtClock clock;
+  TEST_ASSERT_TRUE(parseClock(AtSlice(line.data(), line.length()), clock));
+  TEST_ASSERT_EQUAL_INT(2026, clock.year);
+  TEST_ASSERT_EQUAL_INT(1, clock.hour);
+  
+  // Each answer waits for the latency
+  uint32_t start = testMillis();
+  TEST_ASSERT_TRUE(host.command("AT"));
+  TEST_ASSERT_GREATER_OR_EQUAL(50, testMillis() - start);
+}
+
+void test_baud_change(void) {
+  ModemSimulator modem(testMillis, makeConfig());
+  SimHost host(modem);
+  TEST_ASSERT_EQUAL_UINT32(115200, modem.getBaud());
+  TEST_ASSERT_TRUE(host.command("AT+IPR=921600"));
+  TEST_ASSERT_EQUAL_UINT32(921600, modem.getBaud());
+}
+
+void test_rules_come_first(void) {
+  ModemSimulator modem(testMillis, makeConfig());
+  SimHost host(modem);
+  modem.addRule("AT+CSQ", "+CSQ: 5,99\nOK");
+  modem.addRule("AT+CPIN?", "+CME ERROR: 10");
+  std::string line;
+  
+  TEST_ASSERT_TRUE(host.command("AT+CSQ"));
+  TEST_ASSERT_TRUE(host.findLine("+CSQ: 5,99", line));
+  TEST_ASSERT_FALSE(host.command("AT+CPIN?"));
+  TEST_ASSERT_EQUAL_UINT32(2, modem.getStats().scripted);
+}
+
+void test_transcript_replay(void) {
+  ModemSimulator modem(testMillis, makeConfig());
+  SimHost host(modem);
+  modem.loadTranscript(
+    "AT> AT+CEREG?\n"
+    "AT< AT+CEREG?\n"
+    "AT< +CEREG: 0,2\n"
+    "AT< OK\n"
+    "URC: +CEREG: 1\n"
+    "AT> AT+CEREG?\n"
+    "AT< +CEREG: 0,5\n"
+    "AT< OK\n");
+  std::string line;
+  
+  // Recorded answers in order, then the built-in ones
+  TEST_ASSERT_TRUE(host.command("AT+CEREG?"));
+  TEST_ASSERT_TRUE(host.findLine("+CEREG: 0,2", line));
+  TEST_ASSERT_TRUE(host.command("AT+CEREG?"));
+  TEST_ASSERT_TRUE(host.findLine("+CEREG: 0,5", line));
+  TEST_ASSERT_TRUE(host.command("AT+CEREG?"));
+  TEST_ASSERT_TRUE(host.findLine("+CEREG: 1,1", line));
+}
+
+void test_inject_urc(void) {
+  ModemSimulator modem(testMillis, makeConfig());
+  SimHost host(modem);
+  modem.injectUrc("+APP PDP: 0,DEACTIVE");
+  TEST_ASSERT_TRUE(host.waitFor("+APP PDP:", 1000));
+}
+
+void test_sms(void) {
+  ModemSimulator modem(testMillis, makeConfig());
+  SimHost host(modem);
+  std::string line;
+  
+  TEST_ASSERT_TRUE(host.command("AT+CMGF=1"));
+  TEST_ASSERT_TRUE(host.command("AT+CMGS=\"+15551234567\"", ">"));
+  TEST_ASSERT_TRUE(host.command("Activity detected\x1A", "OK"));
+  TEST_ASSERT_TRUE(host.findLine("+CMGS: 1", line));
+}
+
+// The same seed fails the same commands; 100% always fails
+void test_failure_injection(void) {
+  ModemSimulatorConfig config = makeConfig();
+  config.failurePercent = 30;
+  std::string outcomes[2];
+  for (int run = 0; run < 2; run++) {
+    ModemSimulator modem(testMillis, config);
+    SimHost host(modem);
+    TEST_ASSERT_TRUE(host.command("ATE0"));
+    for (int i = 0; i < 20; i++) {
+      outcomes[run] += host.command("AT+SAPBR=1,1") ? '1' : '0';
+    }
+  }
+  TEST_ASSERT_EQUAL_STRING(outcomes[0].c_str(), outcomes[1].c_str());
+  TEST_ASSERT_TRUE(outcomes[0].find('0') != std::string::npos);
+  TEST_ASSERT_TRUE(outcomes[0].find('1') != std::string::npos);
+  
+  config.failurePercent = 100;
+  ModemSimulator modem(testMillis, config);
+  SimHost host(modem);
+  TEST_ASSERT_FALSE(host.attach());
+}
+
+void test_silent_commands_time_out(void) {
+  ModemSimulatorConfig config = makeConfig();
+  config.silentPercent = 100;
+  ModemSimulator modem(testMillis, config);
+  SimHost host(modem);
+  
+  uint32_t start = testMillis();
+  TEST_ASSERT_FALSE(host.command("AT", "OK", 2000));
+  TEST_ASSERT_GREATER_OR_EQUAL(2000, testMillis() - start);
+  TEST_ASSERT_EQUAL_UINT32(1, modem.getStats().silent);
+}
+
+void test_no_connect_without_bearer(void) {
+  ModemSimulator modem(testMillis, makeConfig());
+  SimHost host(modem);
+  TEST_ASSERT_FALSE(host.connectTcp("dav.example.com", 80, true));
+  
+  ModemSimulatorConfig searching = makeConfig();
+  searching.registration = 2;
+  ModemSimulator unregistered(testMillis, searching);
+  SimHost unregisteredHost(unregistered);
+  TEST_ASSERT_FALSE(unregisteredHost.attach());
+}
+
+#define SESSION_FILES       10
+#define SESSION_FILE_SIZE   (60 * 1024)
+
+// Simulated time of a whole upload session: bearer, TCP connect, then one
+// HTTP PUT per capture on the kept-alive connection, each answer read back
+static uint32_t runUploadSession(bool quickSend, ReceivedFiles& received, SimHostStats& stats) {
+  ModemSimulator modem(testMillis, makeConfig());
+  modem.setHttpResponder(recordPut, &received);
+  SimHost host(modem);
+  
+  uint32_t start = testMillis();
+  TEST_ASSERT_TRUE(host.attach());
+  TEST_ASSERT_TRUE(host.connectTcp("dav.example.com", 80, quickSend));
+  
+  std::vector<uint8_t> body(SESSION_FILE_SIZE, 0xA5);
+  for (int i = 0; i < SESSION_FILES; i++) {
+    char head[160];
+    snprintf(head, sizeof(head),
+             "PUT /photos/capture_%03d.jpg HTTP/1.1\r\nHost: dav.example.com\r\n"
+             "Content-Length: %u\r\n\r\n", i, (unsigned)body.size());
+    std::vector<uint8_t> request(head, head + strlen(head));
+    request.insert(request.end(), body.begin(), body.end());
+    TEST_ASSERT_TRUE(host.sendTcp(request.data(), request.size(), false));
+    
+    std::string response;
+    while (response.find("\r\n\r\n") == std::string::npos) {
+      TEST_ASSERT_TRUE(host.receiveTcp(response, response.length() + 1, 30000));
+    }
+    TEST_ASSERT_EQUAL_INT(0, response.find("HTTP/1.1 201"));
+  }
+  host.disconnectTcp();
+  
+  stats = host.getStats();
+  return testMillis() - start;
+}
+
+void test_upload_session_benchmark(void) {
+  ReceivedFiles plainFiles;
+  ReceivedFiles quickFiles;
+  SimHostStats plainStats;
+  SimHostStats quickStats;
+  uint32_t plainMs = runUploadSession(false, plainFiles, plainStats);
+  resetTestMillis();
+  uint32_t quickMs = runUploadSession(true, quickFiles, quickStats);
+  
+  TEST_ASSERT_EQUAL(SESSION_FILES, quickFiles.files.size());
+  TEST_ASSERT_EQUAL(SESSION_FILES, plainFiles.files.size());
+  for (int i = 0; i < SESSION_FILES; i++) {
+    char path[48];
+    snprintf(path, sizeof(path), "/photos/capture_%03d.jpg", i);
+    TEST_ASSERT_EQUAL_STRING(path, quickFiles.files[i].first.c_str());
+    TEST_ASSERT_EQUAL(SESSION_FILE_SIZE, quickFiles.files[i].second);
+  }
+  
+  // Never faster than the uplink, and quick send keeps it busy
+  uint32_t lineMs = (uint64_t)SESSION_FILES * SESSION_FILE_SIZE * 1000 / 12500;
+  TEST_ASSERT_GREATER_THAN_UINT32(lineMs, quickMs);
+  TEST_ASSERT_LESS_THAN_UINT32(plainMs, quickMs);
+  
+  char summary[200];
+  snprintf(summary, sizeof(summary),
+           "Session of %d x %u bytes at 12500 B/s: plain send %.1f s (%u packets), "
+           "quick send %.1f s (%u packets, %u ACK polls), line time %.1f s",
+           SESSION_FILES, (unsigned)SESSION_FILE_SIZE, plainMs / 1000.0, (unsigned)plainStats.packets,
+           quickMs / 1000.0, (unsigned)quickStats.packets, (unsigned)quickStats.ackPolls, lineMs / 1000.0);
+  TEST_MESSAGE(summary);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_basic_answers);
+  RUN_TEST(test_baud_change);
+  RUN_TEST(test_rules_come_first);
+  RUN_TEST(test_transcript_replay);
+  RUN_TEST(test_inject_urc);
+  RUN_TEST(test_sms);
+  RUN_TEST(test_failure_injection);
+  RUN_TEST(test_silent_commands_time_out);
+  RUN_TEST(test_no_connect_without_bearer);
+  RUN_TEST(test_upload_session_benchmark);
+  return UNITY_END();
+}
@@ -0,0 +1,207 @@
+#include <unity.h>
+#include <chrono>
+#include <set>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "firmware_fakes.h"
+#include "integrity.h"
+#include "storage.h"
+#include "temp_dir.h"
+#include "test_clock.h"
+#include "Preferences.h"
+
+static std::string root;
+static PosixStorageBackend* storage;
+
+// A small but complete JPEG: SOI, filler, EOI
+static std::vector<uint8_t> makeCapture(size_t size, uint8_t fill) {
+  std::vector<uint8_t> data(size, fill);
+  data[0] = 0xFF;
+  data[1] = 0xD8;
+  data[size - 2] = 0xFF;
+  data[size - 1] = 0xD9;
+  return data;
+}
+
+static void touch(const String& path) {
+  StorageFilePtr file = storage->open(path.c_str(), STORAGE_WRITE);
+  TEST_ASSERT_TRUE(file != nullptr);
+}
+
+static double elapsedMs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void setUp(void) {
+  resetTestMillis();
+  resetFirmwareFakes();
+  resetPreferences();
+  root = makeTempDir();
+  storage = new PosixStorageBackend(root);
+  TEST_ASSERT_TRUE(storage->begin());
+  setStorageBackend(storage);
+}
+
+void tearDown(void) {
+  Serial.mute(false);
+  setStorageBackend(NULL);
+  delete storage;
+  removeTempDir(root);
+}
+
+// The capture and its digest sidecar land on the backend and verify
+void test_save_photo(void) {
+  std::vector<uint8_t> data = makeCapture(3 * SD_WRITE_CHUNK_SIZE + 100, 0x55);
+  TEST_ASSERT_TRUE(savePhotoToSD("/a.jpg", data.data(), data.size()));
+  
+  size_t size = 0;
+  TEST_ASSERT_TRUE(storage->stat("/a.jpg", &size));
+  TEST_ASSERT_EQUAL(data.size(), size);
+  TEST_ASSERT_TRUE(fileExists("/a.jpg.sum"));
+  TEST_ASSERT_EQUAL(INTEGRITY_OK, verifyCaptureFile(storage, "/a.jpg"));
+  
+  // Saving again under the same name replaces the file and its sidecars
+  touch("/a.jpg.pv");
+  std::vector<uint8_t> other = makeCapture(200, 0x66);
+  TEST_ASSERT_TRUE(savePhotoToSD("/a.jpg", other.data(), other.size()));
+  TEST_ASSERT_FALSE(fileExists("/a.jpg.pv"));
+  TEST_ASSERT_EQUAL(INTEGRITY_OK, verifyCaptureFile(storage, "/a.jpg"));
+}
+
+// Listing counts captures only, deleting one takes its sidecars along
+void test_listing_and_cleanup(void) {
+  std::vector<uint8_t> data = makeCapture(100, 0x11);
+  const char* names[] = { "/a.jpg", "/b.jpg", "/c.jpg" };
+  for (const char* name : names) {
+    TEST_ASSERT_TRUE(savePhotoToSD(name, data.data(), data.size()));
+  }
+  touch("/b.jpg.pv");
+  touch("/b.jpg.ses");
+  
+  TEST_ASSERT_EQUAL(3, getFileCount());
+  std::set<String> listed;
+  for (int i = 0; i < 3; i++) {
+    listed.insert(getFileName(i));
+  }
+  TEST_ASSERT_EQUAL(3, listed.size());
+  TEST_ASSERT_TRUE(listed.count("/b.jpg") == 1);
+  TEST_ASSERT_EQUAL_STRING("", getFileName(3).c_str());
+  
+  TEST_ASSERT_TRUE(deleteFile("/b.jpg"));
+  TEST_ASSERT_FALSE(fileExists("/b.jpg.sum"));
+  TEST_ASSERT_FALSE(fileExists("/b.jpg.pv"));
+  TEST_ASSERT_FALSE(fileExists("/b.jpg.ses"));
+  TEST_ASSERT_FALSE(deleteFile("/b.jpg"));
+  TEST_ASSERT_EQUAL(2, getFileCount());
+  
+  TEST_ASSERT_TRUE(deleteAllFiles());
+  TEST_ASSERT_EQUAL(0, storage->list("/", NULL));
+}
+
+// Captures named before the clock was set get their time once it is
+void test_backfill_timestamps(void) {
+  setFakeTimeSet(false);
+  char name[64];
+  makeCaptureFilename(name, sizeof(name));
+  TEST_ASSERT_NOT_NULL(strstr(name, UNSYNCED_TIMESTAMP));
+  TEST_ASSERT_EQUAL(0, getCaptureTime(name));
+  
+  std::vector<uint8_t> data = makeCapture(100, 0x22);
+  TEST_ASSERT_TRUE(savePhotoToSD(name, data.data(), data.size()));
+  TEST_ASSERT_EQUAL(0, backfillCaptureTimestamps());
+  
+  setFakeTimeSet(true);
+  TEST_ASSERT_EQUAL(1, backfillCaptureTimestamps());
+  TEST_ASSERT_FALSE(fileExists(name));
+  TEST_ASSERT_EQUAL(1, getFileCount());
+  
+  String renamed = getFileName(0);
+  TEST_ASSERT_TRUE(getCaptureTime(renamed.c_str()) > 0);
+  TEST_ASSERT_EQUAL(getCaptureOrder(name), getCaptureOrder(renamed.c_str()));
+  TEST_ASSERT_EQUAL(INTEGRITY_OK, verifyCaptureFile(storage, renamed.c_str()));
+}
+
+// A capture left unsynced by an earlier boot, which never had the time, gets
+// the time this boot started
+void test_backfill_earlier_boot(void) {
+  TEST_ASSERT_TRUE(initStorage());
+  TEST_ASSERT_TRUE(initStorage());  // Boot 2
+  std::vector<uint8_t> data = makeCapture(100, 0x44);
+  const char* name = "/capture_000001_000003_unsynced.jpg";
+  TEST_ASSERT_TRUE(savePhotoToSD(name, data.data(), data.size()));
+  touch("/capture_000001_000003_unsynced.jpg.pv");
+  
+  advanceTestMillis(600000);
+  time_t bootStart = time(NULL) - 600;
+  TEST_ASSERT_EQUAL(1, backfillCaptureTimestamps());
+  TEST_ASSERT_FALSE(fileExists(name));
+  
+  String renamed = getFileName(0);
+  TEST_ASSERT_INT_WITHIN(1, bootStart, getCaptureTime(renamed.c_str()));
+  TEST_ASSERT_EQUAL(getCaptureOrder(name), getCaptureOrder(renamed.c_str()));
+  TEST_ASSERT_TRUE(fileExists((renamed + ".pv").c_str()));
+  TEST_ASSERT_EQUAL(INTEGRITY_OK, verifyCaptureFile(storage, renamed.c_str()));
+  
+  // Nothing left to rename
+  TEST_ASSERT_EQUAL(0, backfillCaptureTimestamps());
+}
+
+// Saving, listing and cleanup with a card's worth of captures in one
+// directory, each with a digest sidecar
+#define BENCH_CAPTURES 2000
+#define BENCH_CAPTURE_SIZE 16384
+
+void test_benchmark_listing_and_cleanup(void) {
+  std::vector<uint8_t> data = makeCapture(BENCH_CAPTURE_SIZE, 0x33);
+  std::vector<String> names;
+  Serial.mute(true);
+  
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int i = 0; i < BENCH_CAPTURES; i++) {
+    char name[64];
+    makeCaptureFilename(name, sizeof(name));
+    TEST_ASSERT_TRUE(savePhotoToSD(name, data.data(), data.size()));
+    names.push_back(name);
+  }
+  double saveMs = elapsedMs(start);
+  
+  start = std::chrono::steady_clock::now();
+  TEST_ASSERT_EQUAL(BENCH_CAPTURES, getFileCount());
+  double countMs = elapsedMs(start);
+  
+  // The last index walks the whole directory
+  start = std::chrono::steady_clock::now();
+  TEST_ASSERT_TRUE(getFileName(BENCH_CAPTURES - 1).length() > 0);
+  double nameMs = elapsedMs(start);
+  
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < BENCH_CAPTURES / 2; i++) {
+    TEST_ASSERT_TRUE(deleteFile(names[i]));
+  }
+  double deleteMs = elapsedMs(start);
+  
+  start = std::chrono::steady_clock::now();
+  TEST_ASSERT_TRUE(deleteAllFiles());
+  double deleteAllMs = elapsedMs(start);
+  TEST_ASSERT_EQUAL(0, storage->list("/", NULL));
+  
+  Serial.mute(false);
+  char summary[256];
+  snprintf(summary, sizeof(summary),
+           "%d captures of %d bytes: save %.3f ms each, count %.2f ms, "
+           "last name %.2f ms, delete %.3f ms each, delete all %d files %.2f ms",
+           BENCH_CAPTURES, BENCH_CAPTURE_SIZE, saveMs / BENCH_CAPTURES, countMs,
+           nameMs, deleteMs / (BENCH_CAPTURES / 2), BENCH_CAPTURES, deleteAllMs);
+  TEST_MESSAGE(summary);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_save_photo);
+  RUN_TEST(test_listing_and_cleanup);
+  RUN_TEST(test_backfill_timestamps);
+  RUN_TEST(test_backfill_earlier_boot);
+  RUN_TEST(test_benchmark_listing_and_cleanup);
+  return UNITY_END();
+}
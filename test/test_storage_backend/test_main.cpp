@@ -0,0 +1,150 @@
+#include <unity.h>
+#include <string>
+#include "storage_backend.h"
+#include "temp_dir.h"
+
+static RamStorageBackend* ram;
+static std::string posixRoot;
+static PosixStorageBackend* posix;
+
+static void writeFile(StorageBackend* storage, const char* path, const std::string& content) {
+  StorageFilePtr file = storage->open(path, STORAGE_WRITE);
+  TEST_ASSERT_TRUE(file != nullptr);
+  TEST_ASSERT_EQUAL(content.length(), file->write((const uint8_t*)content.data(), content.length()));
+}
+
+static std::string readFile(StorageBackend* storage, const char* path) {
+  StorageFilePtr file = storage->open(path, STORAGE_READ);
+  if (!file) {
+    return "<missing>";
+  }
+  std::string content(file->size(), '\0');
+  file->read((uint8_t*)&content[0], content.length());
+  return content;
+}
+
+void setUp(void) {
+  ram = new RamStorageBackend(4096);
+  ram->begin();
+  posixRoot = makeTempDir();
+  posix = new PosixStorageBackend(posixRoot);
+}
+
+void tearDown(void) {
+  delete ram;
+  delete posix;
+  removeTempDir(posixRoot);
+}
+
+// A reader keeps its data after the file is removed, like an unlinked
+// file on a POSIX filesystem
+void test_ram_remove_while_open(void) {
+  writeFile(ram, "/a.jpg", "0123456789");
+  StorageFilePtr reader = ram->open("/a.jpg", STORAGE_READ);
+  uint8_t buffer[16];
+  TEST_ASSERT_EQUAL(4, reader->read(buffer, 4));
+  
+  TEST_ASSERT_TRUE(ram->remove("/a.jpg"));
+  TEST_ASSERT_FALSE(ram->exists("/a.jpg"));
+  TEST_ASSERT_EQUAL(6, reader->read(buffer, sizeof(buffer)));
+  TEST_ASSERT_EQUAL_MEMORY("456789", buffer, 6);
+  TEST_ASSERT_EQUAL(0, ram->bytesUsed());
+  
+  // A new file under the old name is a different file
+  writeFile(ram, "/a.jpg", "new");
+  TEST_ASSERT_EQUAL(10, reader->size());
+}
+
+// A writer follows its file to the new name
+void test_ram_rename_while_open(void) {
+  TEST_ASSERT_TRUE(ram->mkdir("/sent"));
+  StorageFilePtr writer = ram->open("/a.jpg", STORAGE_WRITE);
+  writer->write((const uint8_t*)"abc", 3);
+  
+  TEST_ASSERT_TRUE(ram->rename("/a.jpg", "/sent/a.jpg"));
+  writer->write((const uint8_t*)"def", 3);
+  writer->close();
+  TEST_ASSERT_EQUAL_STRING("abcdef", readFile(ram, "/sent/a.jpg").c_str());
+  TEST_ASSERT_EQUAL_STRING("<missing>", readFile(ram, "/a.jpg").c_str());
+}
+
+// Writes stop at the capacity
+void test_ram_capacity(void) {
+  writeFile(ram, "/a.jpg", std::string(4000, 'a'));
+  StorageFilePtr file = ram->open("/b.jpg", STORAGE_WRITE);
+  TEST_ASSERT_EQUAL(96, file->write((const uint8_t*)std::string(200, 'b').data(), 200));
+  
+  uint64_t total, used;
+  TEST_ASSERT_TRUE(ram->usage(&total, &used));
+  TEST_ASSERT_EQUAL(4096, total);
+  TEST_ASSERT_EQUAL(4096, used);
+}
+
+// Paths are relative to the root directory, only regular files are listed
+void test_posix_files(void) {
+  TEST_ASSERT_TRUE(posix->begin());
+  TEST_ASSERT_TRUE(posix->mkdir("/quarantine"));
+  writeFile(posix, "/a.jpg", "0123456789");
+  writeFile(posix, "/a.jpg.sum", "digest");
+  
+  size_t size = 0;
+  TEST_ASSERT_TRUE(posix->stat("/a.jpg", &size));
+  TEST_ASSERT_EQUAL(10, size);
+  TEST_ASSERT_FALSE(posix->stat("/quarantine", &size));
+  
+  size_t listedBytes = 0;
+  TEST_ASSERT_EQUAL(2, posix->list("/", [&listedBytes](const char* path, size_t size) {
+    TEST_ASSERT_EQUAL('/', path[0]);
+    listedBytes += size;
+    return true;
+  }));
+  TEST_ASSERT_EQUAL(16, listedBytes);
+  
+  TEST_ASSERT_TRUE(posix->rename("/a.jpg", "/quarantine/a.jpg"));
+  TEST_ASSERT_EQUAL_STRING("0123456789", readFile(posix, "/quarantine/a.jpg").c_str());
+  TEST_ASSERT_EQUAL(1, posix->list("/quarantine", NULL));
+  TEST_ASSERT_TRUE(posix->remove("/a.jpg.sum"));
+  TEST_ASSERT_EQUAL(0, posix->list("/", NULL));
+  
+  uint64_t total = 0, used = 0;
+  TEST_ASSERT_TRUE(posix->usage(&total, &used));
+  TEST_ASSERT_TRUE(total > 0 && used <= total);
+}
+
+// Appends go to the end, reads and seeks work on the same file
+void test_posix_append_and_seek(void) {
+  TEST_ASSERT_TRUE(posix->begin());
+  writeFile(posix, "/log", "abc");
+  StorageFilePtr file = posix->open("/log", STORAGE_APPEND);
+  TEST_ASSERT_EQUAL(3, file->write((const uint8_t*)"def", 3));
+  TEST_ASSERT_EQUAL(6, file->size());
+  file->close();
+  
+  file = posix->open("/log", STORAGE_READ);
+  uint8_t buffer[4];
+  TEST_ASSERT_TRUE(file->seek(4));
+  TEST_ASSERT_EQUAL(2, file->read(buffer, sizeof(buffer)));
+  TEST_ASSERT_EQUAL_MEMORY("ef", buffer, 2);
+  TEST_ASSERT_EQUAL(6, file->position());
+}
+
+// Nothing works before begin(), or on a root that isn't there
+void test_posix_unmounted(void) {
+  TEST_ASSERT_TRUE(posix->open("/a.jpg", STORAGE_WRITE) == nullptr);
+  TEST_ASSERT_FALSE(posix->usage(NULL, NULL));
+  
+  PosixStorageBackend missing(posixRoot + "/missing");
+  TEST_ASSERT_FALSE(missing.begin());
+  TEST_ASSERT_FALSE(missing.isMounted());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_ram_remove_while_open);
+  RUN_TEST(test_ram_rename_while_open);
+  RUN_TEST(test_ram_capacity);
+  RUN_TEST(test_posix_files);
+  RUN_TEST(test_posix_append_and_seek);
+  RUN_TEST(test_posix_unmounted);
+  return UNITY_END();
+}
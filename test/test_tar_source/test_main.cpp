@@ -0,0 +1,239 @@
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "modem_simulator.h"
+#include "sim_host.h"
+#include "storage_backend.h"
+#include "tar_source.h"
+#include "test_clock.h"
+
+#define BLOCK 512
+
+static RamStorageBackend* storage;
+
+static std::vector<uint8_t> makeFile(const char* path, size_t size, uint8_t seed) {
+  std::vector<uint8_t> data(size);
+  for (size_t i = 0; i < size; i++) {
+    data[i] = (uint8_t)(seed + i * 7);
+  }
+  StorageFilePtr file = storage->open(path, STORAGE_WRITE);
+  file->write(data.data(), data.size());
+  file->close();
+  return data;
+}
+
+static std::vector<uint8_t> readAll(UploadSource& source) {
+  std::vector<uint8_t> data(source.size());
+  TEST_ASSERT_TRUE(source.seek(0));
+  size_t done = 0;
+  while (done < data.size()) {
+    size_t n = source.read(data.data() + done, std::min((size_t)1000, data.size() - done));
+    TEST_ASSERT_GREATER_THAN(0, n);
+    done += n;
+  }
+  return data;
+}
+
+void setUp(void) {
+  storage = new RamStorageBackend(16 << 20);
+  storage->begin();
+  resetTestMillis();
+}
+
+void tearDown(void) {
+  delete storage;
+}
+
+// Headers as tar itself reads them: name, octal size and mtime, checksum
+// over the block with its own field as spaces, data padded to the block
+void test_archive_layout(void) {
+  static const size_t sizes[] = { 1, BLOCK, 1000, 0 };
+  std::vector<std::vector<uint8_t> > contents;
+  TarUploadSource tar(storage);
+  for (int i = 0; i < 4; i++) {
+    char path[32], name[32];
+    snprintf(path, sizeof(path), "/capture_%d.jpg", i);
+    snprintf(name, sizeof(name), "20261018/capture_%d.jpg", i);
+    contents.push_back(makeFile(path, sizes[i], i));
+    TEST_ASSERT_TRUE(tar.addFile(path, name, sizes[i], 1792300000 + i));
+  }
+  TEST_ASSERT_EQUAL(4, tar.count());
+  
+  // Headers, data in whole blocks, two zero blocks
+  size_t expected = 4 * BLOCK + BLOCK + BLOCK + 2 * BLOCK + 0 + 2 * BLOCK;
+  TEST_ASSERT_EQUAL(expected, tar.size());
+  
+  std::vector<uint8_t> archive = readAll(tar);
+  size_t pos = 0;
+  for (int i = 0; i < 4; i++) {
+    const char* header = (const char*)archive.data() + pos;
+    char name[32];
+    snprintf(name, sizeof(name), "20261018/capture_%d.jpg", i);
+    TEST_ASSERT_EQUAL_STRING(name, header);
+    TEST_ASSERT_EQUAL(sizes[i], strtoul(header + 124, NULL, 8));
+    TEST_ASSERT_EQUAL(1792300000 + i, strtoul(header + 136, NULL, 8));
+    TEST_ASSERT_EQUAL_INT('0', header[156]);
+    TEST_ASSERT_EQUAL_STRING("ustar", header + 257);
+    
+    unsigned int sum = 0;
+    for (int j = 0; j < BLOCK; j++) {
+      sum += j >= 148 && j < 156 ? ' ' : (uint8_t)header[j];
+    }
+    TEST_ASSERT_EQUAL(sum, strtoul(header + 148, NULL, 8));
+    
+    pos += BLOCK;
+    if (sizes[i] > 0) {
+      TEST_ASSERT_EQUAL_MEMORY(contents[i].data(), archive.data() + pos, sizes[i]);
+    }
+    for (size_t j = sizes[i]; j % BLOCK != 0; j++) {
+      TEST_ASSERT_EQUAL_HEX8(0, archive[pos + j]);
+    }
+    pos += (sizes[i] + BLOCK - 1) / BLOCK * BLOCK;
+  }
+  for (; pos < archive.size(); pos++) {
+    TEST_ASSERT_EQUAL_HEX8(0, archive[pos]);
+  }
+}
+
+// A resumed upload restarts the archive anywhere
+void test_seek_anywhere(void) {
+  TarUploadSource tar(storage);
+  for (int i = 0; i < 3; i++) {
+    char path[32];
+    snprintf(path, sizeof(path), "/c%d.jpg", i);
+    makeFile(path, 700 + i * 900, i);
+    TEST_ASSERT_TRUE(tar.addFile(path, path + 1, 700 + i * 900, 0));
+  }
+  std::vector<uint8_t> archive = readAll(tar);
+  
+  uint32_t random = 99;
+  for (int i = 0; i < 200; i++) {
+    random = random * 1103515245 + 12345;
+    size_t offset = (random >> 8) % archive.size();
+    size_t len = std::min((size_t)(random % 1500 + 1), archive.size() - offset);
+    std::vector<uint8_t> piece(len);
+    TEST_ASSERT_TRUE(tar.seek(offset));
+    TEST_ASSERT_EQUAL(len, tar.read(piece.data(), len));
+    TEST_ASSERT_EQUAL_MEMORY(archive.data() + offset, piece.data(), len);
+  }
+  
+  TEST_ASSERT_TRUE(tar.seek(archive.size()));
+  uint8_t c;
+  TEST_ASSERT_EQUAL(0, tar.read(&c, 1));
+  TEST_ASSERT_FALSE(tar.seek(archive.size() + 1));
+}
+
+void test_rejected_names(void) {
+  TarUploadSource tar(storage);
+  TEST_ASSERT_FALSE(tar.addFile("/a.jpg", "", 10, 0));
+  TEST_ASSERT_FALSE(tar.addFile("/a.jpg", std::string(100, 'n'), 10, 0));
+  TEST_ASSERT_TRUE(tar.addFile("/a.jpg", std::string(99, 'n'), 10, 0));
+}
+
+// A capture that went missing ends the read short instead of sending junk
+void test_missing_file(void) {
+  TarUploadSource tar(storage);
+  TEST_ASSERT_TRUE(tar.addFile("/gone.jpg", "gone.jpg", 2000, 0));
+  std::vector<uint8_t> buffer(tar.size());
+  TEST_ASSERT_EQUAL(BLOCK, tar.read(buffer.data(), buffer.size()));
+}
+
+#define BENCH_FILES      20
+#define BENCH_MIN_SIZE   20000
+#define BENCH_MAX_SIZE   80000
+
+struct SessionResult {
+  uint32_t millis;
+  uint64_t wireBytes;
+  uint32_t requests;
+};
+
+static std::string created(const std::string& head, size_t bodyLength, void* context) {
+  return "HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n";
+}
+
+// PUT each body on one kept-alive connection, each answer read before the next
+static SessionResult runSession(const std::vector<std::pair<std::string, std::vector<uint8_t> > >& puts) {
+  resetTestMillis();
+  ModemSimulatorConfig config = { 50, 12500, 0, 0, 18, 1, 0, 1 };
+  ModemSimulator modem(testMillis, config);
+  modem.setHttpResponder(created, NULL);
+  SimHost host(modem);
+  TEST_ASSERT_TRUE(host.attach());
+  TEST_ASSERT_TRUE(host.connectTcp("dav.example.com", 80, true));
+  
+  uint32_t start = testMillis();
+  uint64_t received = 0;
+  for (size_t i = 0; i < puts.size(); i++) {
+    std::string head = "PUT /photos/" + puts[i].first + " HTTP/1.1\r\nHost: dav.example.com\r\n"
+                       "Connection: keep-alive\r\nContent-Length: " +
+                       std::to_string(puts[i].second.size()) + "\r\n"
+                       "Content-Type: application/octet-stream\r\n\r\n";
+    std::vector<uint8_t> request(head.begin(), head.end());
+    request.insert(request.end(), puts[i].second.begin(), puts[i].second.end());
+    TEST_ASSERT_TRUE(host.sendTcp(request.data(), request.size(), false));
+    
+    std::string response;
+    while (response.find("\r\n\r\n") == std::string::npos) {
+      TEST_ASSERT_TRUE(host.receiveTcp(response, response.length() + 1, 30000));
+    }
+    received += response.length();
+  }
+  
+  SessionResult result;
+  result.millis = testMillis() - start;
+  result.wireBytes = modem.getStats().payloadBytes + received;
+  result.requests = modem.getStats().httpRequests;
+  return result;
+}
+
+// The same captures as one archive and one PUT each: bytes on the TCP
+// connection (both ways) and simulated time over the modem
+void test_bundle_vs_per_file(void) {
+  std::vector<std::pair<std::string, std::vector<uint8_t> > > perFile;
+  TarUploadSource tar(storage);
+  uint64_t payload = 0;
+  uint32_t random = 5;
+  for (int i = 0; i < BENCH_FILES; i++) {
+    random = random * 1103515245 + 12345;
+    size_t size = BENCH_MIN_SIZE + (random >> 8) % (BENCH_MAX_SIZE - BENCH_MIN_SIZE);
+    char path[32];
+    snprintf(path, sizeof(path), "/capture_%03d.jpg", i);
+    perFile.push_back(std::make_pair(std::string(path + 1), makeFile(path, size, i)));
+    TEST_ASSERT_TRUE(tar.addFile(path, path + 1, size, 0));
+    payload += size;
+  }
+  
+  std::vector<std::pair<std::string, std::vector<uint8_t> > > bundle;
+  bundle.push_back(std::make_pair(std::string("capture_000_20.tar"), readAll(tar)));
+  
+  SessionResult files = runSession(perFile);
+  SessionResult archive = runSession(bundle);
+  TEST_ASSERT_EQUAL_UINT32(BENCH_FILES, files.requests);
+  TEST_ASSERT_EQUAL_UINT32(1, archive.requests);
+  
+  // The archive costs a header block and padding per file, at most a
+  // kilobyte each, and saves a round trip per file
+  TEST_ASSERT_LESS_OR_EQUAL_UINT64(payload + BENCH_FILES * 1024 + 2048, archive.wireBytes);
+  TEST_ASSERT_LESS_THAN_UINT32(files.millis, archive.millis);
+  
+  char summary[220];
+  snprintf(summary, sizeof(summary),
+           "%d captures, %llu bytes: per file %llu bytes on the wire in %.1f s, "
+           "one archive %llu bytes in %.1f s",
+           BENCH_FILES, (unsigned long long)payload, (unsigned long long)files.wireBytes,
+           files.millis / 1000.0, (unsigned long long)archive.wireBytes, archive.millis / 1000.0);
+  TEST_MESSAGE(summary);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_archive_layout);
+  RUN_TEST(test_seek_anywhere);
+  RUN_TEST(test_rejected_names);
+  RUN_TEST(test_missing_file);
+  RUN_TEST(test_bundle_vs_per_file);
+  return UNITY_END();
+}
@@ -0,0 +1,122 @@
+#include <unity.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "modem_simulator.h"
+#include "sim_host.h"
+#include "test_clock.h"
+
+#define SEND_BYTES          (100 * 1024)
+#define UPLINK_RATE         12500
+
+static ModemSimulatorConfig makeConfig(uint32_t latencyMs) {
+  ModemSimulatorConfig config;
+  config.latencyMs = latencyMs;
+  config.bytesPerSecond = UPLINK_RATE;
+  config.failurePercent = 0;
+  config.silentPercent = 0;
+  config.rssi = 18;
+  config.registration = 1;
+  config.epoch = 0;
+  config.seed = 3;
+  return config;
+}
+
+// Simulated time until the server has every byte; 0 if the send failed
+static uint32_t timeSend(uint32_t latencyMs, bool quickSend, SimHostStats* stats = NULL) {
+  resetTestMillis();
+  ModemSimulator modem(testMillis, makeConfig(latencyMs));
+  SimHost host(modem);
+  TEST_ASSERT_TRUE(host.attach());
+  TEST_ASSERT_TRUE(host.connectTcp("upload.example.com", 80, quickSend));
+  
+  std::vector<uint8_t> data(SEND_BYTES, 0x5A);
+  uint32_t start = testMillis();
+  if (!host.sendTcp(data.data(), data.size(), true)) {
+    return 0;
+  }
+  uint32_t elapsed = testMillis() - start;
+  
+  TEST_ASSERT_EQUAL_UINT64(SEND_BYTES, modem.getStats().payloadBytes);
+  if (stats) {
+    *stats = host.getStats();
+  }
+  return elapsed;
+}
+
+void setUp(void) {
+  resetTestMillis();
+}
+
+void tearDown(void) {
+}
+
+// A drained quick send has nothing left unacknowledged
+void test_quick_send_drains(void) {
+  ModemSimulator modem(testMillis, makeConfig(100));
+  SimHost host(modem);
+  TEST_ASSERT_TRUE(host.attach());
+  TEST_ASSERT_TRUE(host.connectTcp("upload.example.com", 80, true));
+  
+  std::vector<uint8_t> data(20000, 0x11);
+  TEST_ASSERT_TRUE(host.sendTcp(data.data(), data.size(), true));
+  TEST_ASSERT_EQUAL_UINT32(14, host.getStats().packets);
+  
+  std::string line;
+  AtTcpAck ack;
+  TEST_ASSERT_TRUE(host.command("AT+CIPACK"));
+  TEST_ASSERT_TRUE(host.findLine("+CIPACK:", line));
+  TEST_ASSERT_TRUE(parseTcpAck(AtSlice(line.data(), line.length()), ack));
+  TEST_ASSERT_EQUAL_UINT32(20000, ack.sent);
+  TEST_ASSERT_EQUAL_UINT32(0, ack.unacked);
+}
+
+void test_send_failure_reported(void) {
+  ModemSimulatorConfig config = makeConfig(50);
+  ModemSimulator modem(testMillis, config);
+  SimHost host(modem);
+  TEST_ASSERT_TRUE(host.attach());
+  TEST_ASSERT_TRUE(host.connectTcp("upload.example.com", 80, false));
+  
+  config.failurePercent = 100;
+  modem.setConfig(config);
+  uint8_t data[100] = {0};
+  TEST_ASSERT_FALSE(host.sendTcp(data, sizeof(data), true));
+}
+
+// Plain AT+CIPSEND waits for each packet's SEND OK; quick send only for the
+// modem to take it, and for ACKs once SIM_HOST_SEND_WINDOW is in flight
+void test_send_benchmark(void) {
+  static const uint32_t latencies[] = { 20, 50, 150, 300 };
+  double lineSeconds = (double)SEND_BYTES / UPLINK_RATE;
+  
+  for (size_t i = 0; i < sizeof(latencies) / sizeof(latencies[0]); i++) {
+    SimHostStats quickStats;
+    uint32_t plainMs = timeSend(latencies[i], false);
+    uint32_t quickMs = timeSend(latencies[i], true, &quickStats);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, plainMs);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, quickMs);
+    TEST_ASSERT_LESS_THAN_UINT32(plainMs, quickMs);
+    
+    char summary[200];
+    snprintf(summary, sizeof(summary),
+             "%u bytes, %3u ms latency: AT+CIPSEND %.0f B/s, quick send %.0f B/s "
+             "(%u ACK polls), uplink %u B/s (%.1f s)",
+             (unsigned)SEND_BYTES, (unsigned)latencies[i], SEND_BYTES * 1000.0 / plainMs,
+             SEND_BYTES * 1000.0 / quickMs, (unsigned)quickStats.ackPolls, (unsigned)UPLINK_RATE,
+             lineSeconds);
+    TEST_MESSAGE(summary);
+  }
+  
+  // With a fast modem link quick send gets close to the uplink rate
+  uint32_t quickMs = timeSend(latencies[0], true);
+  TEST_ASSERT_GREATER_THAN(UPLINK_RATE * 8 / 10, (uint64_t)SEND_BYTES * 1000 / quickMs);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_quick_send_drains);
+  RUN_TEST(test_send_failure_reported);
+  RUN_TEST(test_send_benchmark);
+  return UNITY_END();
+}
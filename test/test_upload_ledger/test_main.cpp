@@ -0,0 +1,218 @@
+#include <unity.h>
+#include <stdio.h>
+#include <chrono>
+#include "config.h"
+#include "storage_backend.h"
+#include "upload_ledger.h"
+
+#define LEDGER_PATH "/uploaded.log"
+
+static RamStorageBackend* storage;
+
+// Stand-in for a SHA-256 digest, uniformly spread like the real ones
+static void makeHash(uint64_t n, uint8_t hash[32]) {
+  for (int i = 0; i < 4; i++) {
+    uint64_t z = n * 4 + i + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    memcpy(hash + i * 8, &z, 8);
+  }
+}
+
+static size_t logSize() {
+  size_t size = 0;
+  storage->stat(LEDGER_PATH, &size);
+  return size;
+}
+
+void setUp(void) {
+  storage = new RamStorageBackend(1 << 20);
+  storage->begin();
+}
+
+void tearDown(void) {
+  delete storage;
+}
+
+void test_add_and_contains(void) {
+  UploadLedger ledger(storage, LEDGER_PATH, 100);
+  uint8_t a[32], b[32];
+  makeHash(1, a);
+  makeHash(2, b);
+  
+  TEST_ASSERT_FALSE(ledger.contains(a));
+  TEST_ASSERT_TRUE(ledger.add(a));
+  TEST_ASSERT_TRUE(ledger.contains(a));
+  TEST_ASSERT_FALSE(ledger.contains(b));
+  
+  // A repeat isn't logged again
+  TEST_ASSERT_TRUE(ledger.add(a));
+  TEST_ASSERT_EQUAL_UINT32(1, ledger.count());
+  TEST_ASSERT_EQUAL(8, logSize());
+}
+
+// The key is the first 8 bytes; all zero must not look like an empty slot
+void test_zero_key(void) {
+  UploadLedger ledger(storage, LEDGER_PATH, 100);
+  uint8_t zero[32] = {0};
+  TEST_ASSERT_FALSE(ledger.contains(zero));
+  TEST_ASSERT_TRUE(ledger.add(zero));
+  TEST_ASSERT_TRUE(ledger.contains(zero));
+}
+
+void test_reload_from_log(void) {
+  uint8_t hash[32];
+  {
+    UploadLedger ledger(storage, LEDGER_PATH, 1000);
+    for (int i = 0; i < 500; i++) {
+      makeHash(i, hash);
+      TEST_ASSERT_TRUE(ledger.add(hash));
+    }
+  }
+  
+  UploadLedger reloaded(storage, LEDGER_PATH, 1000);
+  TEST_ASSERT_EQUAL_UINT32(500, reloaded.count());
+  for (int i = 0; i < 500; i++) {
+    makeHash(i, hash);
+    TEST_ASSERT_TRUE(reloaded.contains(hash));
+  }
+  makeHash(500, hash);
+  TEST_ASSERT_FALSE(reloaded.contains(hash));
+}
+
+// A power loss in the middle of an append leaves a partial key
+void test_torn_append_repaired(void) {
+  uint8_t hash[32];
+  {
+    UploadLedger ledger(storage, LEDGER_PATH, 100);
+    for (int i = 0; i < 10; i++) {
+      makeHash(i, hash);
+      ledger.add(hash);
+    }
+  }
+  StorageFilePtr file = storage->open(LEDGER_PATH, STORAGE_APPEND);
+  file->write((const uint8_t*)"abc", 3);
+  file->close();
+  
+  UploadLedger ledger(storage, LEDGER_PATH, 100);
+  TEST_ASSERT_EQUAL_UINT32(10, ledger.count());
+  TEST_ASSERT_EQUAL(80, logSize());
+  
+  makeHash(10, hash);
+  TEST_ASSERT_TRUE(ledger.add(hash));
+  UploadLedger reloaded(storage, LEDGER_PATH, 100);
+  TEST_ASSERT_TRUE(reloaded.contains(hash));
+  TEST_ASSERT_EQUAL_UINT32(11, reloaded.count());
+}
+
+// A full ledger keeps the newer half
+void test_full_ledger_halves(void) {
+  UploadLedger ledger(storage, LEDGER_PATH, 100);
+  uint8_t hash[32];
+  for (int i = 0; i <= 100; i++) {
+    makeHash(i, hash);
+    TEST_ASSERT_TRUE(ledger.add(hash));
+  }
+  
+  TEST_ASSERT_EQUAL_UINT32(51, ledger.count());
+  TEST_ASSERT_EQUAL(51 * 8, logSize());
+  makeHash(0, hash);
+  TEST_ASSERT_FALSE(ledger.contains(hash));
+  makeHash(49, hash);
+  TEST_ASSERT_FALSE(ledger.contains(hash));
+  makeHash(50, hash);
+  TEST_ASSERT_TRUE(ledger.contains(hash));
+  makeHash(100, hash);
+  TEST_ASSERT_TRUE(ledger.contains(hash));
+  TEST_ASSERT_FALSE(storage->exists(LEDGER_PATH ".tmp"));
+}
+
+// A log from a build with a higher limit is cut to the newest entries
+void test_lowered_limit(void) {
+  uint8_t hash[32];
+  {
+    UploadLedger ledger(storage, LEDGER_PATH, 1000);
+    for (int i = 0; i < 300; i++) {
+      makeHash(i, hash);
+      ledger.add(hash);
+    }
+  }
+  
+  UploadLedger ledger(storage, LEDGER_PATH, 200);
+  TEST_ASSERT_EQUAL_UINT32(200, ledger.count());
+  TEST_ASSERT_EQUAL(200 * 8, logSize());
+  makeHash(99, hash);
+  TEST_ASSERT_FALSE(ledger.contains(hash));
+  makeHash(100, hash);
+  TEST_ASSERT_TRUE(ledger.contains(hash));
+}
+
+// Nothing is remembered that didn't make it to storage
+void test_storage_full(void) {
+  delete storage;
+  storage = new RamStorageBackend(16);
+  storage->begin();
+  
+  UploadLedger ledger(storage, LEDGER_PATH, 100);
+  uint8_t hash[32];
+  makeHash(1, hash);
+  TEST_ASSERT_TRUE(ledger.add(hash));
+  makeHash(2, hash);
+  TEST_ASSERT_TRUE(ledger.add(hash));
+  makeHash(3, hash);
+  TEST_ASSERT_FALSE(ledger.add(hash));
+  TEST_ASSERT_FALSE(ledger.contains(hash));
+  TEST_ASSERT_EQUAL_UINT32(2, ledger.count());
+}
+
+// The firmware's size: 50000 entries in a 1 MB table, a 400 KB log
+#define BENCH_ENTRIES UPLOAD_LEDGER_MAX_ENTRIES
+#define BENCH_LOOKUPS 1000000
+
+void test_full_size_benchmark(void) {
+  uint8_t hash[32];
+  {
+    UploadLedger ledger(storage, LEDGER_PATH, BENCH_ENTRIES);
+    TEST_ASSERT_EQUAL(1024 * 1024, ledger.tableBytes());
+    for (int i = 0; i < BENCH_ENTRIES; i++) {
+      makeHash(i, hash);
+      ledger.add(hash);
+    }
+  }
+  TEST_ASSERT_EQUAL(BENCH_ENTRIES * 8, logSize());
+  
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  UploadLedger ledger(storage, LEDGER_PATH, BENCH_ENTRIES);
+  TEST_ASSERT_EQUAL_UINT32(BENCH_ENTRIES, ledger.count());
+  std::chrono::steady_clock::time_point loaded = std::chrono::steady_clock::now();
+  
+  // Half hits, half misses
+  uint32_t hits = 0;
+  for (int i = 0; i < BENCH_LOOKUPS; i++) {
+    makeHash(i % (BENCH_ENTRIES * 2), hash);
+    hits += ledger.contains(hash) ? 1 : 0;
+  }
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+  TEST_ASSERT_GREATER_THAN_UINT32(BENCH_LOOKUPS / 2 - BENCH_ENTRIES, hits);
+  TEST_ASSERT_LESS_THAN_UINT32(BENCH_LOOKUPS / 2 + BENCH_ENTRIES, hits);
+  
+  char summary[160];
+  snprintf(summary, sizeof(summary), "Ledger of %d: loaded in %.2f ms, %.1f ns per lookup",
+           BENCH_ENTRIES, std::chrono::duration<double, std::milli>(loaded - start).count(),
+           std::chrono::duration<double, std::nano>(end - loaded).count() / BENCH_LOOKUPS);
+  TEST_MESSAGE(summary);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_add_and_contains);
+  RUN_TEST(test_zero_key);
+  RUN_TEST(test_reload_from_log);
+  RUN_TEST(test_torn_append_repaired);
+  RUN_TEST(test_full_ledger_halves);
+  RUN_TEST(test_lowered_limit);
+  RUN_TEST(test_storage_full);
+  RUN_TEST(test_full_size_benchmark);
+  return UNITY_END();
+}
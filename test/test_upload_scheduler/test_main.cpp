@@ -0,0 +1,281 @@
+#include <unity.h>
+#include <stdio.h>
+#include "upload_scheduler.h"
+
+// UTC times around the period boundaries
+#define JAN_15_NOON         1768478400      // 2026-01-15 12:00:00
+#define JAN_15_LAST_SECOND  1768521599      // 2026-01-15 23:59:59
+#define JAN_16_MIDNIGHT     1768521600      // 2026-01-16 00:00:00
+#define JAN_31_LATE         1769900400      // 2026-01-31 23:00:00
+#define FEB_1_MIDNIGHT      1769904000      // 2026-02-01 00:00:00
+#define DEC_31_LATE         1798759800      // 2026-12-31 23:30:00
+#define NEW_YEAR_2027       1798761600      // 2027-01-01 00:00:00
+#define APR_1_MORNING       1775023200      // 2026-04-01 06:00:00, first upload of the simulated month
+#define MAY_1_MORNING       1777615200      // 2026-05-01 06:00:00
+
+#define DAY_SECONDS         86400
+
+static const UploadPriorityWeights RECENT_AND_EDGES = { 1.0f, 2.0f, 1.0f, 0.0f };
+static const UploadBudget UNLIMITED = { 0, 0, 0 };
+
+static UploadCandidate candidate(const char* path, size_t size, uint64_t order,
+                                 bool eventEdge = false, uint8_t confidence = 0) {
+  UploadCandidate c;
+  c.path = path;
+  c.size = size;
+  c.order = order;
+  c.eventEdge = eventEdge;
+  c.confidence = confidence;
+  return c;
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_priority_order(void) {
+  UploadScheduler scheduler(RECENT_AND_EDGES, UNLIMITED);
+  scheduler.add(candidate("/newest.jpg", 1000, 3));
+  scheduler.add(candidate("/edge.jpg", 1000, 1, true));
+  scheduler.add(candidate("/confident.jpg", 1000, 2, false, 90));
+  
+  // Scores: edge 0 + 2, confident 0.5 + 0.9, newest 1
+  UploadCandidate next;
+  TEST_ASSERT_TRUE(scheduler.next(next, JAN_15_NOON));
+  TEST_ASSERT_EQUAL_STRING("/edge.jpg", next.path.c_str());
+  TEST_ASSERT_TRUE(scheduler.next(next, JAN_15_NOON));
+  TEST_ASSERT_EQUAL_STRING("/confident.jpg", next.path.c_str());
+  TEST_ASSERT_TRUE(scheduler.next(next, JAN_15_NOON));
+  TEST_ASSERT_EQUAL_STRING("/newest.jpg", next.path.c_str());
+  TEST_ASSERT_FALSE(scheduler.next(next, JAN_15_NOON));
+  TEST_ASSERT_EQUAL_UINT32(3, scheduler.sentThisSession());
+}
+
+void test_size_weight_favours_small_files(void) {
+  UploadPriorityWeights weights = { 0.0f, 0.0f, 0.0f, 1.0f };
+  UploadScheduler scheduler(weights, UNLIMITED);
+  scheduler.add(candidate("/large.jpg", 1000, 1));
+  scheduler.add(candidate("/small.jpg", 100, 2));
+  scheduler.add(candidate("/medium.jpg", 500, 3));
+  
+  UploadCandidate next;
+  TEST_ASSERT_TRUE(scheduler.next(next, 0));
+  TEST_ASSERT_EQUAL_STRING("/small.jpg", next.path.c_str());
+  TEST_ASSERT_TRUE(scheduler.next(next, 0));
+  TEST_ASSERT_EQUAL_STRING("/medium.jpg", next.path.c_str());
+  TEST_ASSERT_TRUE(scheduler.next(next, 0));
+  TEST_ASSERT_EQUAL_STRING("/large.jpg", next.path.c_str());
+}
+
+// Captures added while a session runs are scored with the ones still queued
+void test_added_during_session(void) {
+  UploadScheduler scheduler(RECENT_AND_EDGES, UNLIMITED);
+  scheduler.add(candidate("/first.jpg", 1000, 1));
+  scheduler.add(candidate("/second.jpg", 1000, 2));
+  
+  UploadCandidate next;
+  TEST_ASSERT_TRUE(scheduler.next(next, 0));
+  TEST_ASSERT_EQUAL_STRING("/second.jpg", next.path.c_str());
+  
+  scheduler.add(candidate("/edge.jpg", 1000, 3, true));
+  TEST_ASSERT_EQUAL(2, scheduler.pending());
+  TEST_ASSERT_TRUE(scheduler.next(next, 0));
+  TEST_ASSERT_EQUAL_STRING("/edge.jpg", next.path.c_str());
+  TEST_ASSERT_TRUE(scheduler.next(next, 0));
+  TEST_ASSERT_EQUAL_STRING("/first.jpg", next.path.c_str());
+}
+
+void test_day_rolls_over_at_utc_midnight(void) {
+  UploadBudget budget = { 1000, 0, 0 };
+  UploadScheduler scheduler(RECENT_AND_EDGES, budget);
+  
+  scheduler.recordSent(800, JAN_15_NOON);
+  TEST_ASSERT_EQUAL_UINT64(200, scheduler.remainingBytes(JAN_15_LAST_SECOND));
+  TEST_ASSERT_EQUAL_UINT64(1000, scheduler.remainingBytes(JAN_16_MIDNIGHT));
+  TEST_ASSERT_EQUAL_UINT64(0, scheduler.getUsage().dayBytes);
+}
+
+void test_month_rolls_over(void) {
+  UploadBudget budget = { 0, 5000, 0 };
+  UploadScheduler scheduler(RECENT_AND_EDGES, budget);
+  
+  scheduler.recordSent(3000, JAN_15_NOON);
+  scheduler.recordSent(1000, JAN_31_LATE);
+  TEST_ASSERT_EQUAL_UINT64(1000, scheduler.remainingBytes(JAN_31_LATE));
+  TEST_ASSERT_EQUAL_UINT64(5000, scheduler.remainingBytes(FEB_1_MIDNIGHT));
+  
+  // The month index runs on across the new year
+  scheduler.recordSent(4500, DEC_31_LATE);
+  TEST_ASSERT_EQUAL_UINT64(500, scheduler.remainingBytes(DEC_31_LATE));
+  TEST_ASSERT_EQUAL_UINT64(5000, scheduler.remainingBytes(NEW_YEAR_2027));
+  TEST_ASSERT_EQUAL_INT32(2027 * 12, scheduler.getUsage().month);
+}
+
+// Usage is kept between sessions; the tighter of the two budgets counts
+void test_usage_carried_between_sessions(void) {
+  UploadBudget budget = { 1000, 1500, 0 };
+  UploadScheduler first(RECENT_AND_EDGES, budget);
+  first.recordSent(900, JAN_15_NOON);
+  
+  UploadScheduler second(RECENT_AND_EDGES, budget);
+  second.setUsage(first.getUsage());
+  TEST_ASSERT_EQUAL_UINT64(100, second.remainingBytes(JAN_15_LAST_SECOND));
+  
+  // Next day the daily budget is back, the month only has 600 left
+  TEST_ASSERT_EQUAL_UINT64(600, second.remainingBytes(JAN_16_MIDNIGHT));
+}
+
+// Without a clock the periods don't roll over, usage keeps counting
+void test_unknown_time_keeps_usage(void) {
+  UploadBudget budget = { 1000, 0, 0 };
+  UploadScheduler scheduler(RECENT_AND_EDGES, budget);
+  scheduler.recordSent(600, JAN_15_NOON);
+  scheduler.recordSent(300, 0);
+  TEST_ASSERT_EQUAL_UINT64(100, scheduler.remainingBytes(0));
+}
+
+void test_skips_candidates_over_remaining_budget(void) {
+  UploadBudget budget = { 1000, 0, 0 };
+  UploadScheduler scheduler(RECENT_AND_EDGES, budget);
+  scheduler.recordSent(200, JAN_15_NOON);
+  
+  // The edge frame comes first but doesn't fit the 800 bytes left
+  scheduler.add(candidate("/edge.jpg", 900, 2, true));
+  scheduler.add(candidate("/fits.jpg", 700, 1));
+  scheduler.add(candidate("/also_too_big.jpg", 850, 3));
+  
+  UploadCandidate next;
+  TEST_ASSERT_TRUE(scheduler.next(next, JAN_15_NOON));
+  TEST_ASSERT_EQUAL_STRING("/fits.jpg", next.path.c_str());
+  TEST_ASSERT_EQUAL_UINT32(2, scheduler.skippedForBudget());
+  
+  // The skipped ones wait for the next session
+  TEST_ASSERT_EQUAL(0, scheduler.pending());
+  TEST_ASSERT_FALSE(scheduler.next(next, JAN_15_NOON));
+}
+
+void test_max_files_per_session(void) {
+  UploadBudget budget = { 0, 0, 2 };
+  UploadScheduler scheduler(RECENT_AND_EDGES, budget);
+  scheduler.add(candidate("/a.jpg", 100, 1));
+  scheduler.add(candidate("/b.jpg", 100, 2));
+  scheduler.add(candidate("/c.jpg", 100, 3));
+  
+  UploadCandidate next;
+  TEST_ASSERT_TRUE(scheduler.next(next, 0));
+  TEST_ASSERT_TRUE(scheduler.next(next, 0));
+  TEST_ASSERT_FALSE(scheduler.next(next, 0));
+  TEST_ASSERT_EQUAL(1, scheduler.pending());
+}
+
+// A month of captures, one upload session a day, a scheduler per session
+// with the usage carried over as the firmware does. Captures that don't go
+// stay on the card for the next day.
+#define SIM_DAYS                30
+#define SIM_CAPTURES_PER_DAY    40
+#define SIM_DAILY_BUDGET        (3UL << 20)
+#define SIM_MONTHLY_BUDGET      (60UL << 20)
+#define SIM_REQUEST_OVERHEAD    2048        // Headers and TLS records per upload
+
+void test_month_of_captures_against_budget(void) {
+  UploadBudget budget = { SIM_DAILY_BUDGET, SIM_MONTHLY_BUDGET, 0 };
+  UploadBudgetUsage usage = { -1, -1, 0, 0 };
+  std::vector<UploadCandidate> onCard;
+  uint32_t random = 12345;
+  uint64_t order = 0;
+  uint64_t monthBytes = 0;
+  uint32_t edgesCaptured = 0;
+  uint32_t edgesSent = 0;
+  uint32_t othersCaptured = 0;
+  uint32_t othersSent = 0;
+  
+  for (int day = 0; day < SIM_DAYS; day++) {
+    for (int i = 0; i < SIM_CAPTURES_PER_DAY; i++) {
+      random = random * 1103515245 + 12345;
+      char path[32];
+      snprintf(path, sizeof(path), "/capture_%04u.jpg", (unsigned)order);
+      bool edge = i % 8 == 0 || i % 8 == 7;
+      onCard.push_back(candidate(path, 60000 + (random >> 8) % 140000, order++, edge,
+                                 (random >> 4) % 100));
+      if (edge) {
+        edgesCaptured++;
+      } else {
+        othersCaptured++;
+      }
+    }
+    
+    time_t now = APR_1_MORNING + day * DAY_SECONDS;
+    UploadScheduler scheduler(RECENT_AND_EDGES, budget);
+    scheduler.setUsage(usage);
+    for (const UploadCandidate& c : onCard) {
+      scheduler.add(c);
+    }
+    
+    uint64_t dayBytes = 0;
+    UploadCandidate next;
+    while (scheduler.next(next, now)) {
+      scheduler.recordSent(next.size + SIM_REQUEST_OVERHEAD, now);
+      dayBytes += next.size + SIM_REQUEST_OVERHEAD;
+      if (next.eventEdge) {
+        edgesSent++;
+      } else {
+        othersSent++;
+      }
+      for (size_t i = 0; i < onCard.size(); i++) {
+        if (onCard[i].path == next.path) {
+          onCard.erase(onCard.begin() + i);
+          break;
+        }
+      }
+    }
+    usage = scheduler.getUsage();
+    monthBytes += dayBytes;
+    
+    // Overhead is charged after the check, so a day may go over by that much
+    TEST_ASSERT_LESS_OR_EQUAL_UINT64(SIM_DAILY_BUDGET + SIM_REQUEST_OVERHEAD, dayBytes);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT64(SIM_MONTHLY_BUDGET + SIM_REQUEST_OVERHEAD, monthBytes);
+    TEST_ASSERT_EQUAL_UINT64(monthBytes, usage.monthBytes);
+    
+    // Whatever is left of the month gets used, a day is never wasted
+    if (monthBytes + 200000 + SIM_REQUEST_OVERHEAD < SIM_MONTHLY_BUDGET) {
+      TEST_ASSERT_GREATER_THAN_UINT64(SIM_DAILY_BUDGET - 200000 - SIM_REQUEST_OVERHEAD, dayBytes);
+    }
+  }
+  
+  // The monthly budget ran out before the captures did
+  TEST_ASSERT_GREATER_THAN_UINT64(SIM_MONTHLY_BUDGET - 200000 - SIM_REQUEST_OVERHEAD, monthBytes);
+  TEST_ASSERT_GREATER_THAN(0, onCard.size());
+  
+  // Event edges are favoured when not everything fits
+  TEST_ASSERT_GREATER_THAN(othersSent * edgesCaptured / othersCaptured, edgesSent);
+  
+  // and May starts with a fresh budget
+  UploadScheduler may(RECENT_AND_EDGES, budget);
+  may.setUsage(usage);
+  TEST_ASSERT_EQUAL_UINT64(SIM_DAILY_BUDGET, may.remainingBytes(MAY_1_MORNING));
+  
+  char summary[160];
+  snprintf(summary, sizeof(summary),
+           "April: %u of %u captures sent (%u of %u event edges), %llu bytes, %u left on the card",
+           (unsigned)(edgesSent + othersSent), (unsigned)(edgesCaptured + othersCaptured),
+           (unsigned)edgesSent, (unsigned)edgesCaptured, (unsigned long long)monthBytes,
+           (unsigned)onCard.size());
+  TEST_MESSAGE(summary);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_priority_order);
+  RUN_TEST(test_size_weight_favours_small_files);
+  RUN_TEST(test_added_during_session);
+  RUN_TEST(test_day_rolls_over_at_utc_midnight);
+  RUN_TEST(test_month_rolls_over);
+  RUN_TEST(test_usage_carried_between_sessions);
+  RUN_TEST(test_unknown_time_keeps_usage);
+  RUN_TEST(test_skips_candidates_over_remaining_budget);
+  RUN_TEST(test_max_files_per_session);
+  RUN_TEST(test_month_of_captures_against_budget);
+  return UNITY_END();
+}
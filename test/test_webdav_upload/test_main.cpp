@@ -0,0 +1,235 @@
+#include <unity.h>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "drive_resumable.h"
+#include "drive_stand_in.h"
+#include "firmware_fakes.h"
+#include "http_client.h"
+#include <Preferences.h>
+#include "test_clock.h"
+#include "webdav_stand_in.h"
+#include "webdav_upload.h"
+
+#define DAV_URL "http://dav.example.net/photos"
+#define DAV_USER "cabin"
+#define DAV_PASSWORD "s3cret:with colon"
+
+// Benchmark: a day's worth of captures over a 2G-like link
+#define BENCH_FILES 20
+#define BENCH_MIN_SIZE 30000
+#define BENCH_MAX_SIZE 90000
+#define BENCH_RTT_MS 600
+#define BENCH_RATE 10000  // Bytes per second, uplink
+
+static WebDavStandIn* dav;
+static UploadBackend* backend;
+
+static std::string makeCapture(size_t size, uint32_t seed) {
+  std::string data(size, '\0');
+  for (size_t i = 0; i < size; i++) {
+    seed = seed * 1103515245 + 12345;
+    data[i] = (char)(seed >> 16);
+  }
+  return data;
+}
+
+static bool uploadCapture(const String& name, const std::string& data) {
+  BufferUploadSource source((const uint8_t*)data.data(), data.length());
+  return backend->upload(name, source, NULL);
+}
+
+void setUp(void) {
+  resetTestMillis();
+  resetFirmwareFakes();
+  resetPreferences();
+  
+  dav = new WebDavStandIn("/photos/", DAV_USER, DAV_PASSWORD);
+  setHttpClient(dav);
+  TEST_ASSERT_TRUE(saveWebDavSettings(DAV_URL, DAV_USER, DAV_PASSWORD));
+  backend = getWebDavBackend();
+  TEST_ASSERT_TRUE(backend->isConfigured());
+  TEST_ASSERT_TRUE(backend->begin());
+  backend->getConnection()->resetStats();
+}
+
+void tearDown(void) {
+  // The backend outlives the stand-in
+  backend->getConnection()->setClient(NULL);
+  setHttpClient(NULL);
+  delete dav;
+}
+
+void test_probe(void) {
+  TEST_ASSERT_TRUE(backend->probe());
+  TEST_ASSERT_EQUAL_UINT32(1, dav->getStats().requests);
+  
+  // A server that won't HEAD a collection is still there
+  dav->refuseHeadOnCollections(true);
+  TEST_ASSERT_TRUE(backend->probe());
+  
+  // Nothing goes out without DNS
+  setFakeDnsResult(false);
+  TEST_ASSERT_FALSE(backend->probe());
+  TEST_ASSERT_EQUAL_UINT32(2, dav->getStats().requests);
+}
+
+void test_wrong_credentials(void) {
+  TEST_ASSERT_TRUE(saveWebDavSettings(DAV_URL, DAV_USER, "wrong"));
+  TEST_ASSERT_TRUE(backend->begin());
+  TEST_ASSERT_FALSE(backend->probe());
+  TEST_ASSERT_FALSE(uploadCapture("20260418/a.jpg", "jpeg"));
+  TEST_ASSERT_EQUAL_UINT32(2, dav->unauthorized());
+  TEST_ASSERT_NULL(dav->file("/photos/20260418/a.jpg"));
+}
+
+// The day folder is created before its first capture, once
+void test_upload_creates_day_folder_once(void) {
+  std::string a = makeCapture(5000, 1), b = makeCapture(7000, 2), c = makeCapture(100, 3);
+  TEST_ASSERT_TRUE(uploadCapture("20260418/20260418_101500.jpg", a));
+  TEST_ASSERT_TRUE(uploadCapture("20260418/20260418_101530.jpg", b));
+  TEST_ASSERT_TRUE(uploadCapture("20260419/20260419_000100.jpg", c));
+  
+  TEST_ASSERT_EQUAL_UINT32(2, dav->mkcols());
+  TEST_ASSERT_EQUAL_UINT32(3, dav->puts());
+  TEST_ASSERT_TRUE(*dav->file("/photos/20260418/20260418_101500.jpg") == a);
+  TEST_ASSERT_TRUE(*dav->file("/photos/20260418/20260418_101530.jpg") == b);
+  TEST_ASSERT_TRUE(*dav->file("/photos/20260419/20260419_000100.jpg") == c);
+  
+  // All on one kept-alive connection
+  TEST_ASSERT_EQUAL_UINT32(1, dav->getStats().connects);
+}
+
+// After a reboot (or new settings) the folder is asked for again and the
+// server's 405 for an existing one is fine
+void test_existing_folder(void) {
+  dav->addCollection("/photos/20260418/");
+  TEST_ASSERT_TRUE(uploadCapture("20260418/a.jpg", "jpeg"));
+  TEST_ASSERT_EQUAL_UINT32(1, dav->mkcols());
+  TEST_ASSERT_NOT_NULL(dav->file("/photos/20260418/a.jpg"));
+}
+
+// Names are encoded per path segment
+void test_encoded_name(void) {
+  TEST_ASSERT_TRUE(uploadCapture("2026 04 18/capture #1.jpg", "jpeg"));
+  TEST_ASSERT_NOT_NULL(dav->file("/photos/2026 04 18/capture #1.jpg"));
+}
+
+void test_verify(void) {
+  std::string a = makeCapture(4321, 4);
+  TEST_ASSERT_TRUE(uploadCapture("20260418/a.jpg", a));
+  TEST_ASSERT_TRUE(backend->verify("20260418/a.jpg", a.length(), NULL));
+  TEST_ASSERT_FALSE(backend->verify("20260418/a.jpg", a.length() + 1, NULL));
+  TEST_ASSERT_FALSE(backend->verify("20260418/missing.jpg", a.length(), NULL));
+}
+
+// A PUT cut off halfway leaves nothing; sending it again is the retry
+void test_dropped_put(void) {
+  std::string a = makeCapture(20000, 5);
+  TEST_ASSERT_TRUE(uploadCapture("20260418/first.jpg", "jpeg"));
+  backend->close();
+  
+  // On a new connection, so not taken for a stale one
+  dav->dropAfter(10000);
+  TEST_ASSERT_FALSE(uploadCapture("20260418/a.jpg", a));
+  TEST_ASSERT_NULL(dav->file("/photos/20260418/a.jpg"));
+  
+  TEST_ASSERT_TRUE(uploadCapture("20260418/a.jpg", a));
+  TEST_ASSERT_TRUE(*dav->file("/photos/20260418/a.jpg") == a);
+  TEST_ASSERT_EQUAL_UINT32(3, dav->getStats().connects);
+}
+
+// A kept-alive connection that dies under the next PUT may just have been
+// closed by the server, that PUT goes again on a new one
+void test_stale_connection_retried(void) {
+  std::string a = makeCapture(20000, 6);
+  TEST_ASSERT_TRUE(uploadCapture("20260418/first.jpg", "jpeg"));
+  dav->dropAfter(10000);
+  TEST_ASSERT_TRUE(uploadCapture("20260418/a.jpg", a));
+  TEST_ASSERT_TRUE(*dav->file("/photos/20260418/a.jpg") == a);
+  TEST_ASSERT_EQUAL_UINT32(2, dav->getStats().connects);
+  TEST_ASSERT_EQUAL_UINT32(1, backend->getConnection()->getStats().reconnects);
+}
+
+struct OverheadResult {
+  uint64_t wireBytes;   // Both ways, past the capture bytes
+  uint32_t requests;
+  uint32_t millis;      // Past the time the capture bytes take on the link
+};
+
+static OverheadResult overhead(HttpStandIn& server, uint64_t payload, uint32_t start) {
+  const StandInStats& stats = server.getStats();
+  OverheadResult result;
+  result.wireBytes = stats.bytesIn + stats.bytesOut - payload;
+  result.requests = stats.requests;
+  result.millis = testMillis() - start - payload * 1000 / BENCH_RATE;
+  return result;
+}
+
+// Per capture cost of each protocol past the capture itself, on the same
+// link: WebDAV is one PUT (and a MKCOL a day), Drive a session POST and a
+// PUT. Drive's folder lookups and token refreshes, once a day or an hour,
+// aren't counted.
+void test_overhead_against_drive(void) {
+  std::vector<std::string> captures;
+  uint64_t payload = 0;
+  uint32_t random = 7;
+  for (int i = 0; i < BENCH_FILES; i++) {
+    random = random * 1103515245 + 12345;
+    captures.push_back(makeCapture(BENCH_MIN_SIZE + (random >> 8) % (BENCH_MAX_SIZE - BENCH_MIN_SIZE), i));
+    payload += captures.back().length();
+  }
+  
+  char name[48];
+  dav->setLink(BENCH_RTT_MS, BENCH_RATE);
+  uint32_t start = testMillis();
+  for (int i = 0; i < BENCH_FILES; i++) {
+    snprintf(name, sizeof(name), "20260418/20260418_%06d.jpg", i);
+    TEST_ASSERT_TRUE(uploadCapture(name, captures[i]));
+  }
+  OverheadResult webdav = overhead(*dav, payload, start);
+  
+  DriveStandIn drive("ya29.test-token");
+  drive.setLink(BENCH_RTT_MS, BENCH_RATE);
+  HttpConnection http;
+  http.setClient(&drive);
+  start = testMillis();
+  for (int i = 0; i < BENCH_FILES; i++) {
+    snprintf(name, sizeof(name), "20260418_%06d.jpg", i);
+    BufferUploadSource source((const uint8_t*)captures[i].data(), captures[i].length());
+    TEST_ASSERT_EQUAL(DRIVE_UPLOAD_OK, driveResumableUpload(http, "ya29.test-token", name, "folder",
+                                                            "image/jpeg", source, NULL));
+  }
+  OverheadResult resumable = overhead(drive, payload, start);
+  http.stop();
+  
+  TEST_ASSERT_EQUAL_UINT32(BENCH_FILES + 1, webdav.requests);
+  TEST_ASSERT_EQUAL_UINT32(BENCH_FILES * 2, resumable.requests);
+  TEST_ASSERT_LESS_THAN_UINT64(resumable.wireBytes, webdav.wireBytes);
+  TEST_ASSERT_LESS_THAN_UINT32(resumable.millis, webdav.millis);
+  
+  char summary[240];
+  snprintf(summary, sizeof(summary),
+           "%d captures, %llu bytes; per capture past the content: WebDAV %llu bytes, %.2f requests, "
+           "%lu ms; Drive resumable %llu bytes, %.2f requests, %lu ms",
+           BENCH_FILES, (unsigned long long)payload,
+           (unsigned long long)(webdav.wireBytes / BENCH_FILES), webdav.requests / (double)BENCH_FILES,
+           (unsigned long)(webdav.millis / BENCH_FILES),
+           (unsigned long long)(resumable.wireBytes / BENCH_FILES), resumable.requests / (double)BENCH_FILES,
+           (unsigned long)(resumable.millis / BENCH_FILES));
+  TEST_MESSAGE(summary);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_probe);
+  RUN_TEST(test_wrong_credentials);
+  RUN_TEST(test_upload_creates_day_folder_once);
+  RUN_TEST(test_existing_folder);
+  RUN_TEST(test_encoded_name);
+  RUN_TEST(test_verify);
+  RUN_TEST(test_dropped_put);
+  RUN_TEST(test_stale_connection_retried);
+  RUN_TEST(test_overhead_against_drive);
+  return UNITY_END();
+}